@@ -113,6 +113,17 @@ SOURCES +=./src/main.cpp\
     ./src/player/soundManager.c \
     ./src/player/mixer.c \
     ./src/player/songPlayer.cpp \
+    ./src/player/allocationtracker.cpp \
+    ./src/player/audiopulldevice.cpp \
+    ./src/player/batchrenderer.cpp \
+    ./src/player/drumsetcache.cpp \
+    ./src/player/drumsetloader.cpp \
+    ./src/player/engineContext.cpp \
+    ./src/player/mixerKernels.c \
+    ./src/player/offlinerenderer.cpp \
+    ./src/player/pedaleventqueue.cpp \
+    ./src/player/playercheck.cpp \
+    ./src/player/songprefetcher.cpp \
     ./src/model/tree/project/paramsfoldertreemodel.cpp \
     ./src/workspace/settings.cpp \
     ./src/model/tree/project/songsfoldertreeitem.cpp \
@@ -142,6 +153,7 @@ SOURCES +=./src/main.cpp\
     ./src/model/filegraph/autopilotdatamodel.cpp \
     ./src/model/filegraph/autopilotdatafillmodel.cpp \
     ./src/model/filegraph/autopilot.cpp \
+    ./src/asynclogger.cpp \
     ./src/debug.cpp \
     ./src/versioninfo.cpp
 
@@ -201,6 +213,18 @@ HEADERS  += \
     ./src/player/songPlayer.h \
     ./src/player/button.h \
     ./src/player/soundManager.h \
+    ./src/player/allocationtracker.h \
+    ./src/player/audiopulldevice.h \
+    ./src/player/batchrenderer.h \
+    ./src/player/drumsetcache.h \
+    ./src/player/drumsetloader.h \
+    ./src/player/engineContext.h \
+    ./src/player/mixerKernels.h \
+    ./src/player/offlinerenderer.h \
+    ./src/player/pedaleventqueue.h \
+    ./src/player/playercheck.h \
+    ./src/player/seqlock.h \
+    ./src/player/songprefetcher.h \
     ./src/model/tree/project/paramsfoldertreemodel.h \
     ./src/workspace/settings.h \
     ./src/model/tree/project/songsfoldertreeitem.h \
@@ -239,6 +263,7 @@ HEADERS  += \
     ./src/model/filegraph/autopilotdatafillmodel.h \
     ./src/model/filegraph/autopilot.h \
     ./src/model/filegraph/midiParser.h \
+    ./src/asynclogger.h \
     ./src/debug.h \
     ./src/versioninfo.h
 
@@ -247,3 +272,15 @@ RESOURCES += \
 
 DEFINES+= MININI_ANSI
 DEFINES+= QT_MESSAGELOGCONTEXT
+
+# Count the heap allocations of the audio rendering when configured with CONFIG+=alloctracker,
+# for --render --check-allocations and --check, see AllocationTracker. It replaces malloc and free.
+alloctracker {
+    unix:!macx: DEFINES+= BBM_ALLOCATION_TRACKER
+}
+
+# Drop the debug messages at compile time in release builds, see AsyncLogger.
+# Only once CONFIG above is set for release, it is set for debug by default.
+CONFIG(release, debug|release) {
+    DEFINES+= BBM_LOG_LEVEL=LOG_LEVEL_INFO QT_NO_DEBUG_OUTPUT
+}
@@ -0,0 +1,337 @@
+/*
+    This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+    BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "asynclogger.h"
+#include "debug.h"
+
+#include <QDateTime>
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+// State of a ring, FREE rings are claimed by the first message of a thread
+#define LOG_RING_FREE       0
+#define LOG_RING_OWNED      1
+#define LOG_RING_RELEASED   2   // Its thread exited, freed once written
+
+struct LogRecord
+{
+    quint64 sequence;   // Order of the messages across threads
+    qint64 time_ms;
+    int type;           // QtMsgType
+    int line;
+    const char *file;
+    const char *function;
+    const char *category;
+    int length;         // Of the message, can be longer than text
+    ushort text[LOG_MESSAGE_LENGTH];
+};
+
+// Single producer, single consumer: head is only written by the owner thread, tail by the writer
+struct LogRing
+{
+    std::atomic<int> state;
+    std::atomic<unsigned int> head;
+    std::atomic<unsigned int> tail;
+    LogRecord records[LOG_RING_LENGTH];
+};
+
+static LogRing Rings[LOG_MAX_THREADS];
+
+static std::atomic<quint64> Sequence(0);
+static std::atomic<quint64> Dropped(0);
+static std::atomic<int> Level(LOG_LEVEL_DEBUG);
+
+/**
+ * @brief Ring of the calling thread, handed back when the thread exits
+ */
+class LogRingOwner
+{
+public:
+    LogRingOwner() : ring(nullptr) {}
+    ~LogRingOwner()
+    {
+        if (ring) {
+            ring->state.store(LOG_RING_RELEASED, std::memory_order_release);
+        }
+    }
+
+    LogRing *ring;
+};
+
+static thread_local LogRingOwner RingOwner;
+
+/**
+ * @brief claimRing gets a free ring for the calling thread
+ * @return nullptr if all the rings are used
+ */
+static LogRing *claimRing(void)
+{
+    for (int i = 0; i < LOG_MAX_THREADS; i++) {
+        int state = LOG_RING_FREE;
+        if (Rings[i].state.compare_exchange_strong(state, LOG_RING_OWNED, std::memory_order_acquire)) {
+            RingOwner.ring = &Rings[i];
+            return RingOwner.ring;
+        }
+    }
+    return nullptr;
+}
+
+AsyncLogger::AsyncLogger(QObject *parent)
+    : QThread(parent)
+    , m_reportedDropped(0)
+    , m_quit(false)
+{
+    m_batch.reserve(LOG_MAX_THREADS * LOG_RING_LENGTH);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+}
+
+/**
+ * @brief AsyncLogger::instance
+ * @return the logger of the application, started by setupDebugging
+ */
+AsyncLogger *AsyncLogger::instance()
+{
+    // NOTE: never deleted, threads may still log while static objects are destroyed
+    static AsyncLogger *logger = new AsyncLogger();
+    return logger;
+}
+
+/**
+ * @brief AsyncLogger::log queues a message for the writer thread
+ *        NOTE: can be called from any thread, never waits nor allocates
+ */
+void AsyncLogger::log(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    int level = levelOf(type);
+    if (level < BBM_LOG_LEVEL || level < Level.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    LogRing *ring = RingOwner.ring;
+    if (!ring) {
+        ring = claimRing();
+        if (!ring) {
+            Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    unsigned int head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_LENGTH) {
+        Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    LogRecord &record = ring->records[head % LOG_RING_LENGTH];
+    record.sequence = Sequence.fetch_add(1, std::memory_order_relaxed);
+    record.time_ms = QDateTime::currentMSecsSinceEpoch();
+    record.type = type;
+    record.line = context.line;
+    record.file = context.file;
+    record.function = context.function;
+    record.category = context.category;
+    record.length = msg.size();
+    memcpy(record.text, msg.constData(), qMin(record.length, LOG_MESSAGE_LENGTH) * sizeof(ushort));
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * @brief AsyncLogger::levelOf
+ * @return the LogLevel of type
+ */
+int AsyncLogger::levelOf(QtMsgType type)
+{
+    switch (type) {
+    case QtDebugMsg:
+        return LOG_LEVEL_DEBUG;
+    case QtInfoMsg:
+        return LOG_LEVEL_INFO;
+    case QtWarningMsg:
+        return LOG_LEVEL_WARNING;
+    case QtCriticalMsg:
+        return LOG_LEVEL_CRITICAL;
+    case QtFatalMsg:
+        return LOG_LEVEL_FATAL;
+    }
+    return LOG_LEVEL_FATAL;
+}
+
+/**
+ * @brief AsyncLogger::setLevel
+ * @param level LogLevel of the least severe messages written, fatal messages are always written
+ */
+void AsyncLogger::setLevel(int level)
+{
+    Level.store(qBound((int)LOG_LEVEL_DEBUG, level, (int)LOG_LEVEL_FATAL));
+}
+
+int AsyncLogger::level()
+{
+    return Level.load();
+}
+
+/**
+ * @brief AsyncLogger::droppedMessages
+ * @return messages dropped since start since their thread ring was full or there was no ring left
+ */
+quint64 AsyncLogger::droppedMessages()
+{
+    return Dropped.load();
+}
+
+/**
+ * @brief AsyncLogger::setLogFile
+ * @param path file the messages are appended to besides stdout, empty to only write to stdout
+ */
+void AsyncLogger::setLogFile(const QString &path)
+{
+    QMutexLocker locker(&m_writeMutex);
+    m_logFile.close();
+    m_logFilePath = path;
+    if (m_logFilePath.isEmpty()) {
+        return;
+    }
+    m_logFile.setFileName(m_logFilePath);
+    if (!m_logFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        fprintf(stderr, "AsyncLogger - unable to open log file %s\n", m_logFilePath.toLocal8Bit().constData());
+    }
+}
+
+/**
+ * @brief AsyncLogger::flush writes the queued messages before returning, used for fatal messages
+ */
+void AsyncLogger::flush()
+{
+    // The writer thread is already writing, it would lock itself
+    if (QThread::currentThread() == this) {
+        return;
+    }
+    writePending();
+}
+
+/**
+ * @brief AsyncLogger::stop writes the queued messages and ends the writer thread
+ */
+void AsyncLogger::stop()
+{
+    m_quit.store(true);
+    wait();
+    writePending();
+    m_quit.store(false);
+}
+
+void AsyncLogger::run()
+{
+    while (!m_quit.load()) {
+        if (!writePending()) {
+            msleep(LOG_WRITER_PERIOD_MS);
+        }
+    }
+    writePending();
+}
+
+/**
+ * @brief AsyncLogger::writePending formats and writes the messages queued in all the rings
+ * @return false if there was nothing to write
+ */
+bool AsyncLogger::writePending()
+{
+    QMutexLocker locker(&m_writeMutex);
+    unsigned int heads[LOG_MAX_THREADS];
+    bool released[LOG_MAX_THREADS];
+
+    m_batch.clear();
+    for (int i = 0; i < LOG_MAX_THREADS; i++) {
+        // State is read first, a released ring got its last message before
+        released[i] = Rings[i].state.load(std::memory_order_acquire) == LOG_RING_RELEASED;
+        heads[i] = Rings[i].head.load(std::memory_order_acquire);
+        for (unsigned int tail = Rings[i].tail.load(std::memory_order_relaxed); tail != heads[i]; tail++) {
+            m_batch.append(&Rings[i].records[tail % LOG_RING_LENGTH]);
+        }
+    }
+    std::sort(m_batch.begin(), m_batch.end(), [](const LogRecord *a, const LogRecord *b) {
+        return a->sequence < b->sequence;
+    });
+
+    QByteArray text;
+    for (int i = 0; i < m_batch.size(); i++) {
+        const LogRecord *record = m_batch[i];
+        QMessageLogContext context(record->file, record->line, record->function, record->category);
+        QString msg = QString::fromUtf16(record->text, qMin(record->length, LOG_MESSAGE_LENGTH));
+        if (record->length > LOG_MESSAGE_LENGTH) {
+            msg += QString("... (%1 characters)").arg(record->length);
+        }
+        text += debugMessageFormatter(QDateTime::fromMSecsSinceEpoch(record->time_ms), (QtMsgType)record->type, context, msg).toUtf8();
+        text += '\n';
+    }
+
+    // The records are copied, the rings can be reused
+    for (int i = 0; i < LOG_MAX_THREADS; i++) {
+        Rings[i].tail.store(heads[i], std::memory_order_release);
+        if (released[i]) {
+            Rings[i].state.store(LOG_RING_FREE, std::memory_order_release);
+        }
+    }
+
+    quint64 dropped = Dropped.load(std::memory_order_relaxed);
+    if (dropped != m_reportedDropped) {
+        QMessageLogContext context(__FILE__, __LINE__, Q_FUNC_INFO, "default");
+        QString msg = QString("%1 log messages dropped, %2 since start").arg(dropped - m_reportedDropped).arg(dropped);
+        text += debugMessageFormatter(QDateTime::currentDateTime(), QtWarningMsg, context, msg).toUtf8();
+        text += '\n';
+        m_reportedDropped = dropped;
+    }
+
+    if (text.isEmpty()) {
+        return false;
+    }
+    fwrite(text.constData(), 1, text.size(), stdout);
+    fflush(stdout);
+    writeLogFile(text);
+    return true;
+}
+
+void AsyncLogger::writeLogFile(const QByteArray &data)
+{
+    if (!m_logFile.isOpen()) {
+        return;
+    }
+    m_logFile.write(data);
+    m_logFile.flush();
+    if (m_logFile.size() > LOG_FILE_MAX_SIZE) {
+        rotateLogFile();
+    }
+}
+
+/**
+ * @brief AsyncLogger::rotateLogFile renames the log file to path.1, path.1 to path.2... and starts a new one
+ */
+void AsyncLogger::rotateLogFile()
+{
+    m_logFile.close();
+    QFile::remove(QString("%1.%2").arg(m_logFilePath).arg(LOG_FILE_COUNT - 1));
+    for (int i = LOG_FILE_COUNT - 2; i > 0; i--) {
+        QFile::rename(QString("%1.%2").arg(m_logFilePath).arg(i), QString("%1.%2").arg(m_logFilePath).arg(i + 1));
+    }
+    QFile::rename(m_logFilePath, m_logFilePath + ".1");
+    if (!m_logFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        fprintf(stderr, "AsyncLogger - unable to open log file %s\n", m_logFilePath.toLocal8Bit().constData());
+    }
+}
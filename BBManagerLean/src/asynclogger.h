@@ -0,0 +1,88 @@
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+// Use our wrapper for Qt includes
+#include "QtIncludes.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+
+#include <atomic>
+
+// Severity of the messages, QtMsgType values are not ordered by severity
+enum LogLevel {
+   LOG_LEVEL_DEBUG,
+   LOG_LEVEL_INFO,
+   LOG_LEVEL_WARNING,
+   LOG_LEVEL_CRITICAL,
+   LOG_LEVEL_FATAL
+};
+
+// Messages below BBM_LOG_LEVEL are discarded at compile time (see BBManagerLean.pro),
+// the ones below AsyncLogger::level() at runtime
+#ifndef BBM_LOG_LEVEL
+#define BBM_LOG_LEVEL               LOG_LEVEL_DEBUG
+#endif
+
+// Threads logging at a time, a thread beyond it has its messages dropped
+#define LOG_MAX_THREADS             (16)
+// Units: messages, queued per thread
+#define LOG_RING_LENGTH             (256)
+// Units: UTF-16 characters, longer messages are truncated
+#define LOG_MESSAGE_LENGTH          (200)
+// Units: ms, period of the writer when there is nothing to write
+#define LOG_WRITER_PERIOD_MS        (10)
+// Units: bytes, the log file is rotated beyond it
+#define LOG_FILE_MAX_SIZE           (2 * 1024 * 1024)
+// Log files kept, the current one included
+#define LOG_FILE_COUNT              (3)
+
+struct LogRecord;
+
+/**
+ * @brief Writes the log messages from a background thread so logging never blocks nor does I/O.
+ *
+ * Each thread logging gets one of LOG_MAX_THREADS rings, preallocated and single producer,
+ * on its first message and hands it back when it exits. log() only copies the message in the
+ * ring; when it is full the message is counted as dropped instead of waiting. The writer
+ * thread formats the messages in the order they were logged and writes them to stdout and
+ * to the log file, rotated beyond LOG_FILE_MAX_SIZE.
+ *
+ * The file, function and category of the message context are kept as pointers, they are
+ * string literals with QT_MESSAGELOGCONTEXT.
+ */
+class AsyncLogger : public QThread
+{
+   Q_OBJECT
+public:
+   static AsyncLogger *instance();
+
+   static void log(QtMsgType type, const QMessageLogContext &context, const QString &msg);
+   static int levelOf(QtMsgType type);
+   static void setLevel(int level);
+   static int level();
+   static quint64 droppedMessages();
+
+   void setLogFile(const QString &path);
+   void flush();
+   void stop();
+
+private:
+   explicit AsyncLogger(QObject *parent = nullptr);
+   ~AsyncLogger();
+
+   void run(void);
+   bool writePending(void);
+   void writeLogFile(const QByteArray &data);
+   void rotateLogFile(void);
+
+   QMutex m_writeMutex;    // Held while reading the rings and writing, flush() may write from another thread
+   QVector<const LogRecord *> m_batch;
+   quint64 m_reportedDropped;
+   QString m_logFilePath;
+   QFile m_logFile;
+   std::atomic<bool> m_quit;
+};
+
+#endif // ASYNCLOGGER_H
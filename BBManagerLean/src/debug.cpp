@@ -13,7 +13,10 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "debug.h"
+#include "asynclogger.h"
+#include "workspace/settings.h"
 
+#include <QCoreApplication>
 #include <QDateTime>
 #include <QDebug>
 #include <QDir>
@@ -36,30 +39,38 @@ QString msgTypeLoggableRepr(QtMsgType type){
 }
 
 QString debugMessageFormatter(QtMsgType type, const QMessageLogContext &context, const QString &msg){
-    QString currentTime = QDateTime::currentDateTime().toString("yyyy-MM-ddThh:mm:ss:zzz");
+    return debugMessageFormatter(QDateTime::currentDateTime(), type, context, msg);
+}
+
+QString debugMessageFormatter(const QDateTime &time, QtMsgType type, const QMessageLogContext &context, const QString &msg){
+    QString currentTime = time.toString("yyyy-MM-ddThh:mm:ss:zzz");
     QString messageType = msgTypeLoggableRepr(type);
 
     return QString("[%1|%2::%3:%4::%5] %6").arg(currentTime, messageType, context.file, QString::number(context.line), context.function, msg);
 }
 
+// Only queues the message, AsyncLogger formats and writes it from its thread
 void consolidatedLogHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg){
-    QString txt = debugMessageFormatter(type,context,msg);
-
-    QFile outFile(LOGGING_PATH);
-    QTextStream ts(stdout);
-    ts << txt << endl;
+    AsyncLogger::log(type, context, msg);
 
+    // Qt aborts once a fatal message is handled
+    if(type == QtFatalMsg){
+        AsyncLogger::instance()->flush();
+    }
 }
 
 void setupDebugging(){
     QDir outDir(LOGGING_DIR);
-    QFile outFile(LOGGING_PATH);
-    if(!outFile.exists()){
-        if(!outDir.exists()){
-            outDir.mkpath(outDir.absolutePath());
-        }
+    if(!outDir.exists()){
+        outDir.mkpath(outDir.absolutePath());
     }
+
+    AsyncLogger *logger = AsyncLogger::instance();
+    AsyncLogger::setLevel(Settings::getLogLevel());
+    logger->setLogFile(Settings::getLogToFile() ? QString(LOGGING_PATH) : QString());
+    logger->start(QThread::LowPriority);
     qInstallMessageHandler(*consolidatedLogHandler);
+    qAddPostRoutine(shutdownDebugging);
 
     qDebug() << "Current path:" << QDir::currentPath();
     qDebug() << "Home path:" << QDir::homePath();
@@ -67,3 +78,9 @@ void setupDebugging(){
     qDebug() << "Root path:" << QDir::rootPath();
     qDebug() << "Log File:" << LOGGING_PATH;
 }
+
+// Called when the application is destroyed, the messages queued are written
+void shutdownDebugging(){
+    qInstallMessageHandler(nullptr);
+    AsyncLogger::instance()->stop();
+}
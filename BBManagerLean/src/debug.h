@@ -1,6 +1,7 @@
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#include <QDateTime>
 #include <QString>
 #include <QtDebug>
 
@@ -10,8 +11,10 @@
 
 QString msgTypeLoggableRepr(QtMsgType type);
 QString debugMessageFormatter(QtMsgType type, const QMessageLogContext &context, const QString &msg);
+QString debugMessageFormatter(const QDateTime &time, QtMsgType type, const QMessageLogContext &context, const QString &msg);
 void consolidatedLogHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
 void setupDebugging();
+void shutdownDebugging();
 
 
 #endif // DEBUG_H
@@ -27,10 +27,16 @@
 #include <stdexcept>
 #include <signal.h>
 #include "src/player/player.h"  // Include the Player class header
+#include "src/asynclogger.h"
+#include "src/debug.h"
+#include "src/player/allocationtracker.h"
+#include "src/player/batchrenderer.h"
+#include "src/player/offlinerenderer.h"
+#include "src/player/playercheck.h"
+#include "src/player/engineContext.h"
 
 // Default paths for the demo content
 const QString DEFAULT_DRUMSET_PATH = "/home/rory/Documents/BBWorkspace/user_lib/drum_sets/Indie Drumset v2.0.DRM"; // Using a smaller drumset as default
-const QString DEFAULT_SONG_PATH = "/home/rory/Documents/BBWorkspace/user_lib/projects/BeatBuddy Default Content 2.0 - Project/SONGS/203A18C4/716D6763.BBS";
 
 // List of available drum sets for testing (smaller to larger size)
 const QStringList AVAILABLE_DRUMSETS = {
@@ -41,7 +47,7 @@ const QStringList AVAILABLE_DRUMSETS = {
     "/home/rory/Documents/BBWorkspace/user_lib/drum_sets/Rock Drumset v2.0.DRM"      // Option 5 - Largest
 };
 
-// List of available songs for testing
+// List of available songs for testing, played as a setlist
 const QStringList AVAILABLE_SONGS = {
     "/home/rory/Documents/BBWorkspace/user_lib/projects/BeatBuddy Default Content 2.0 - Project/SONGS/203A18C4/716D6763.BBS", // Option 6
     "/home/rory/Documents/BBWorkspace/user_lib/projects/BeatBuddy Default Content 2.0 - Project/SONGS/203A18C4/781A9FDF.BBS", // Option 7
@@ -70,7 +76,7 @@ void processKeyboardInput(Player* player) {
             while (std::cin.get(input)) {
                 if (input == ' ') {
                     // Toggle playback on spacebar
-                    if (player->started()) {
+                    if (player->status().started) {
                         std::cout << "Stopping playback..." << std::endl;
                         player->stop();
                     } else {
@@ -83,6 +89,23 @@ void processKeyboardInput(Player* player) {
                     player->stop();
                     QCoreApplication::quit();
                     break;
+                } else if (input == 'm' || input == 'M') {
+                    // Toggle drumset loading between mmap and heap copy (applied on next drumset load)
+                    player->setDrumsetMmap(!player->drumsetMmap());
+                    std::cout << "Drumset loading: " << (player->drumsetMmap() ? "mmap" : "heap copy") << std::endl;
+                } else if (input == 'p' || input == 'P') {
+                    // Toggle audio output between pull mode and push loop (applied on next play)
+                    player->setPullMode(!player->pullMode());
+                    std::cout << "Audio output: " << (player->pullMode() ? "pull" : "push") << std::endl;
+                } else if (input == 'a' || input == 'A') {
+                    // Toggle adaptive buffering (buffer time grows on underruns, then slowly shrinks)
+                    player->setAdaptiveBuffering(!player->adaptiveBuffering());
+                    std::cout << "Adaptive buffering: " << (player->adaptiveBuffering() ? "on" : "off")
+                              << ", " << player->underrunCount() << " underrun(s) so far, buffer " << player->bufferTime_ms() << " ms" << std::endl;
+                } else if (input == 'n' || input == 'N') {
+                    // Select next song of the setlist, while playing it starts at the next bar
+                    player->nextSong();
+                    std::cout << "Song " << (player->setlistIndex() + 1) << " of " << player->setlist().size() << " selected" << std::endl;
                 } else if (input >= '1' && input <= '5') {
                     // Select drum set
                     int index = input - '1';
@@ -95,7 +118,7 @@ void processKeyboardInput(Player* player) {
                     int index = (input == '0') ? 4 : (input - '6');
                     if (index >= 0 && index < AVAILABLE_SONGS.size()) {
                         std::cout << "Loading song " << (index + 6) << "..." << std::endl;
-                        player->setSong(AVAILABLE_SONGS[index]);
+                        player->setSetlistIndex(index);
                     }
                 }
             }
@@ -109,11 +132,182 @@ void processKeyboardInput(Player* player) {
     inputThread.start();
 }
 
+// Value following option in args, or defaultValue if absent
+QString optionValue(const QStringList &args, const QString &option, const QString &defaultValue = QString()) {
+    int index = args.indexOf(option);
+    return (index >= 0 && index + 1 < args.size()) ? args[index + 1] : defaultValue;
+}
+
+// Render a song to a WAV file without audio device:
+//   --render out.wav [--drumset file] [--song file] [--effects folder] [--timeline file] [--duration s] [--tempo bpm] [--polyphony n] [--seed n]
+//                    [--check-allocations]
+// --check-allocations fails if the audio rendering allocated or freed any memory, it needs a build tracking allocations (CONFIG+=alloctracker)
+int renderOffline(const QStringList &args) {
+    QString wavPath = optionValue(args, "--render");
+    if (wavPath.isEmpty()) {
+        std::cerr << "Usage: --render out.wav [--drumset file] [--song file] [--effects folder] [--timeline file] [--duration s] [--tempo bpm] [--polyphony n] [--seed n] [--check-allocations]" << std::endl;
+        return 1;
+    }
+
+    OfflineRenderer renderer;
+    renderer.setDrumset(optionValue(args, "--drumset", DEFAULT_DRUMSET_PATH));
+    renderer.setSong(optionValue(args, "--song", AVAILABLE_SONGS[0]));
+    renderer.setEffectsPath(optionValue(args, "--effects"));
+    renderer.setDuration(optionValue(args, "--duration", "0").toDouble());
+    renderer.setTempo(optionValue(args, "--tempo", "0").toInt());
+    renderer.setPolyphony(optionValue(args, "--polyphony", "64").toInt());
+    renderer.setSeed(optionValue(args, "--seed", QString::number(ENGINE_DEFAULT_SEED)).toUInt());
+
+    QString timeline = optionValue(args, "--timeline");
+    if (!timeline.isEmpty() && !renderer.loadTimeline(timeline)) {
+        std::cerr << "Invalid timeline " << timeline.toStdString() << std::endl;
+        return 1;
+    }
+
+    if (!renderer.render(wavPath)) {
+        std::cerr << "Failed to render " << wavPath.toStdString() << std::endl;
+        return 1;
+    }
+    std::cout << "Rendered " << renderer.renderedSamples() / 44100.0 << " s in " << renderer.renderTime_ms()
+              << " ms (" << renderer.realtimeRatio() << "x realtime), " << renderer.stealCount() << " sound(s) stolen" << std::endl;
+
+    if (args.contains("--check-allocations")) {
+        if (!AllocationTracker::isEnabled()) {
+            std::cerr << "Allocations are not tracked in this build, configure it with CONFIG+=alloctracker" << std::endl;
+            return 1;
+        }
+        std::cout << renderer.allocationCount() << " heap allocation(s) and " << renderer.freeCount() << " free(s) while rendering" << std::endl;
+        if (renderer.allocationCount() != 0 || renderer.freeCount() != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Check the real-time path of the player without audio device, through song changes and a drumset swap:
+//   --check [--drumset file] [--next-drumset file] [--song file] [--next-song file] [--effects folder] [--block samples] [--seed n]
+// The song, the next song then the song again are chained at the next bar, then the next drumset is swapped in.
+// It fails if the audio rendering allocated or freed any memory, it needs a build tracking allocations (CONFIG+=alloctracker).
+// The song is then played with pedal taps with blocks of 256, 1024 and 4096 samples, it fails if one is not applied
+// within a refresh (5 ticks) before when it happened: events are applied at the start of the refresh they fall in.
+int checkPlayer(const QStringList &args) {
+    if (!AllocationTracker::isEnabled()) {
+        std::cerr << "Allocations are not tracked in this build, configure it with CONFIG+=alloctracker" << std::endl;
+        return 1;
+    }
+
+    QString song = optionValue(args, "--song", AVAILABLE_SONGS[0]);
+    QStringList songs;
+    songs << song << optionValue(args, "--next-song", AVAILABLE_SONGS[1]) << song;
+
+    PlayerCheck check;
+    check.setDrumset(optionValue(args, "--drumset", DEFAULT_DRUMSET_PATH));
+    check.setNextDrumset(optionValue(args, "--next-drumset", AVAILABLE_DRUMSETS[1]));
+    check.setSongs(songs);
+    check.setEffectsPath(optionValue(args, "--effects"));
+    check.setBlockSamples(optionValue(args, "--block", "1024").toInt());
+    check.setSeed(optionValue(args, "--seed", QString::number(ENGINE_DEFAULT_SEED)).toUInt());
+
+    bool ok = check.checkAllocations();
+    std::cout << "Rendered " << check.renderedSamples() / 44100.0 << " s, " << check.songChanges() << " song change(s), "
+              << check.drumsetSwaps() << " drumset swap(s), " << check.allocationCount() << " heap allocation(s) and "
+              << check.freeCount() << " free(s) while rendering" << std::endl;
+    ok = ok && check.allocationCount() == 0 && check.freeCount() == 0;
+
+    bool timing = check.checkEventTiming();
+    std::cout << check.eventCount() << " pedal event(s) applied " << check.eventMin_ns() / 1000000.0 << " to "
+              << check.eventMax_ns() / 1000000.0 << " ms from when they happened" << std::endl;
+    for (int i = 0; i < PLAYER_CHECK_EVENT_BLOCKS; i++) {
+        std::cout << "  blocks of " << PlayerCheck::eventBlockSamples(i) << " samples: " << check.eventMin_ns(i) / 1000000.0
+                  << " to " << check.eventMax_ns(i) / 1000000.0 << " ms" << std::endl;
+    }
+    if (!ok || !timing) {
+        std::cerr << "Player check failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Render every song of a project, or the given .BBS files, to WAV files on all cores:
+//   --batch outdir [--drumset file] [--project folder] [song.BBS ...] [--csv file] [--loops n] [--timeline file]
+//                  [--threads n] [--effects folder] [--tempo bpm] [--polyphony n] [--seed n]
+int renderBatch(const QStringList &args) {
+    QString outputDir = optionValue(args, "--batch");
+    if (outputDir.isEmpty()) {
+        std::cerr << "Usage: --batch outdir [--drumset file] [--project folder] [song.BBS ...] [--csv file] [--loops n] [--timeline file] [--threads n] [--effects folder] [--tempo bpm] [--polyphony n] [--seed n]" << std::endl;
+        return 1;
+    }
+
+    BatchRenderer batch;
+    batch.setOutputDir(outputDir);
+    batch.setDrumset(optionValue(args, "--drumset", DEFAULT_DRUMSET_PATH));
+    batch.setEffectsPath(optionValue(args, "--effects"));
+    batch.setTimeline(optionValue(args, "--timeline"));
+    batch.setWalkLoops(optionValue(args, "--loops", "2").toInt());
+    batch.setTempo(optionValue(args, "--tempo", "0").toInt());
+    batch.setPolyphony(optionValue(args, "--polyphony", "64").toInt());
+    batch.setSeed(optionValue(args, "--seed", QString::number(ENGINE_DEFAULT_SEED)).toUInt());
+    batch.setThreadCount(optionValue(args, "--threads", "0").toInt());
+
+    QString project = optionValue(args, "--project");
+    if (!project.isEmpty() && batch.addProject(project) == 0) {
+        std::cerr << "No song found in " << project.toStdString() << std::endl;
+        return 1;
+    }
+    for (int i = 1; i < args.size(); i++) {
+        if (args[i].endsWith(".BBS", Qt::CaseInsensitive) && !args[i - 1].startsWith("--")) {
+            batch.addSong(args[i]);
+        }
+    }
+    if (batch.songCount() == 0) {
+        std::cerr << "No song to render, use --project or list .BBS files" << std::endl;
+        return 1;
+    }
+
+    bool ok = batch.run();
+    QString csv = optionValue(args, "--csv", QDir(outputDir).filePath("render.csv"));
+    if (!batch.writeCsv(csv)) {
+        std::cerr << "Failed to write " << csv.toStdString() << std::endl;
+        return 1;
+    }
+
+    double audio_s = 0.0;
+    int failed = 0;
+    for (int i = 0; i < batch.results().size(); i++) {
+        audio_s += batch.results()[i].duration_s;
+        failed += batch.results()[i].ok ? 0 : 1;
+    }
+    std::cout << "Rendered " << batch.results().size() << " song(s), " << audio_s << " s of audio in " << batch.renderTime_ms() << " ms";
+    if (batch.renderTime_ms() > 0) {
+        std::cout << " (" << audio_s * 1000.0 / batch.renderTime_ms() << "x realtime)";
+    }
+    std::cout << ", " << failed << " failed. Results in " << csv.toStdString() << std::endl;
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
     try {
         QCoreApplication a(argc, argv);
+
+        // Offline render, no audio device nor keyboard needed
+        if (a.arguments().contains("--render")) {
+            return renderOffline(a.arguments());
+        }
+        if (a.arguments().contains("--batch")) {
+            return renderBatch(a.arguments());
+        }
+        if (a.arguments().contains("--check")) {
+            return checkPlayer(a.arguments());
+        }
         
+        // Log from a background thread so the player thread never waits for stdout,
+        // --log-level n only writes the messages from LogLevel n up
+        setupDebugging();
+        if (a.arguments().contains("--log-level")) {
+            AsyncLogger::setLevel(optionValue(a.arguments(), "--log-level").toInt());
+        }
+
         // Set signal handlers for graceful shutdown
         signal(SIGINT, signalHandler);
         signal(SIGTERM, signalHandler);
@@ -124,13 +318,17 @@ int main(int argc, char *argv[])
         
         // Set initial files
         player.setDrumset(DEFAULT_DRUMSET_PATH);  // Start with a smaller drumset by default
-        player.setSong(DEFAULT_SONG_PATH);
+        player.setSetlist(AVAILABLE_SONGS);
         
         // Display instructions
         std::cout << "Press spacebar to control playback. Press 'q' to quit." << std::endl;
-        std::cout << "When not playing:" << std::endl;
-        std::cout << "  1-5: Select drum set" << std::endl;
+        std::cout << "Keys:" << std::endl;
+        std::cout << "  1-5: Select drum set (while playing: swapped at the next bar)" << std::endl;
         std::cout << "  6-0: Select song" << std::endl;
+        std::cout << "  n: Select next song of the setlist (while playing: change song at the next bar)" << std::endl;
+        std::cout << "  m: Toggle drumset loading (mmap / heap copy)" << std::endl;
+        std::cout << "  p: Toggle audio output (pull / push)" << std::endl;
+        std::cout << "  a: Toggle adaptive buffering" << std::endl;
         
         // Start keyboard input processing in another thread
         processKeyboardInput(&player);
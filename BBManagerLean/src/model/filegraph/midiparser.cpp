@@ -377,8 +377,9 @@ void MIDIPARSER_MidiTrack::write_file(const std::string& name) const
 /*****************************************************************************
  **                    INTERNAL GLOBAL VARIABLE
  *****************************************************************************/
-static volatile uint8_t* DataPtr;
-static volatile uint32_t Index;
+// Per thread, songs are parsed by the engines of several threads at a time (see EngineContext)
+static thread_local volatile uint8_t* DataPtr;
+static thread_local volatile uint32_t Index;
 
 /**
  * @brief
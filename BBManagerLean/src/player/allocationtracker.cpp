@@ -0,0 +1,286 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "allocationtracker.h"
+#include "engineContext.h"
+
+#include <atomic>
+#include <errno.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ALLOCATION_ABORT_MESSAGE    "AllocationTracker - heap allocation while rendering audio, aborting\n"
+#define FREE_ABORT_MESSAGE          "AllocationTracker - heap free while rendering audio, aborting\n"
+
+// Real-time scopes the thread is in, and allocations and frees it made in them
+static ENGINE_THREAD_LOCAL int RealtimeDepth = 0;
+static ENGINE_THREAD_LOCAL quint64 ThreadAllocations = 0;
+static ENGINE_THREAD_LOCAL quint64 ThreadFrees = 0;
+
+static std::atomic<quint64> Allocations(0);
+static std::atomic<quint64> Frees(0);
+static std::atomic<bool> AbortOnAllocation(false);
+
+#ifdef BBM_ALLOCATION_TRACKER
+
+/**
+ * @brief abortIfRequested aborts the process if setAbortOnAllocation asked for it
+ *        NOTE: called from within the allocator, must not allocate
+ * @param message
+ */
+static inline void abortIfRequested(const char *message)
+{
+    if (AbortOnAllocation.load(std::memory_order_relaxed)) {
+        // Stderr is unbuffered, the message is written without allocating
+        RealtimeDepth = 0;
+        fputs(message, stderr);
+        abort();
+    }
+}
+
+/**
+ * @brief trackAllocation counts an allocation of the calling thread if it is rendering audio
+ *        NOTE: called from within the allocator, must not allocate
+ */
+static inline void trackAllocation(void)
+{
+    if (RealtimeDepth <= 0) {
+        return;
+    }
+    ThreadAllocations++;
+    Allocations.fetch_add(1, std::memory_order_relaxed);
+    abortIfRequested(ALLOCATION_ABORT_MESSAGE);
+}
+
+/**
+ * @brief trackFree counts a free of the calling thread if it is rendering audio, free may lock as malloc does
+ *        NOTE: called from within the allocator, must not allocate
+ * @param ptr freeing a null pointer does nothing and is not counted
+ */
+static inline void trackFree(void *ptr)
+{
+    if (!ptr || RealtimeDepth <= 0) {
+        return;
+    }
+    ThreadFrees++;
+    Frees.fetch_add(1, std::memory_order_relaxed);
+    abortIfRequested(FREE_ABORT_MESSAGE);
+}
+
+#if defined(__GLIBC__)
+
+// glibc entry points, the interposed functions forward to them
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void *__libc_pvalloc(size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    trackAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    trackAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    trackAllocation();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    trackAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    trackAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+    void *result;
+
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    trackAllocation();
+    result = __libc_memalign(alignment, size);
+    if (!result && size != 0) {
+        return ENOMEM;
+    }
+    *ptr = result;
+    return 0;
+}
+
+void *valloc(size_t size)
+{
+    trackAllocation();
+    return __libc_valloc(size);
+}
+
+void *pvalloc(size_t size)
+{
+    trackAllocation();
+    return __libc_pvalloc(size);
+}
+
+void free(void *ptr)
+{
+    trackFree(ptr);
+    __libc_free(ptr);
+}
+}
+
+#else
+
+// No portable way to interpose malloc, only allocations through operator new and frees through operator delete are tracked
+void *operator new(size_t size)
+{
+    void *ptr;
+
+    trackAllocation();
+    ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    trackAllocation();
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    trackFree(ptr);
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    trackFree(ptr);
+    free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    trackFree(ptr);
+    free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    trackFree(ptr);
+    free(ptr);
+}
+
+#endif // __GLIBC__
+#endif // BBM_ALLOCATION_TRACKER
+
+/**
+ * @brief AllocationTracker::isEnabled
+ * @return false if allocations are not tracked in this build
+ */
+bool AllocationTracker::isEnabled()
+{
+#ifdef BBM_ALLOCATION_TRACKER
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief AllocationTracker::enterRealtime marks the calling thread as rendering audio
+ */
+void AllocationTracker::enterRealtime()
+{
+    RealtimeDepth++;
+}
+
+void AllocationTracker::leaveRealtime()
+{
+    RealtimeDepth--;
+}
+
+/**
+ * @brief AllocationTracker::setAbortOnAllocation
+ * @param abort true to abort the process on the first allocation or free made while rendering audio
+ */
+void AllocationTracker::setAbortOnAllocation(bool abort)
+{
+    AbortOnAllocation.store(abort);
+}
+
+/**
+ * @brief AllocationTracker::allocations
+ * @return allocations made while rendering audio by all threads since start
+ */
+quint64 AllocationTracker::allocations()
+{
+    return Allocations.load();
+}
+
+/**
+ * @brief AllocationTracker::threadAllocations
+ * @return allocations made while rendering audio by the calling thread since it started
+ */
+quint64 AllocationTracker::threadAllocations()
+{
+    return ThreadAllocations;
+}
+
+/**
+ * @brief AllocationTracker::frees
+ * @return frees made while rendering audio by all threads since start
+ */
+quint64 AllocationTracker::frees()
+{
+    return Frees.load();
+}
+
+/**
+ * @brief AllocationTracker::threadFrees
+ * @return frees made while rendering audio by the calling thread since it started
+ */
+quint64 AllocationTracker::threadFrees()
+{
+    return ThreadFrees;
+}
@@ -0,0 +1,42 @@
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+/**
+ * @brief Counts the heap allocations and frees made by threads while they render audio.
+ *
+ * The real-time path (pedal events, song processing and mixing) must never allocate nor free since malloc
+ * and free may lock or stall. Threads mark it with RealtimeScope, allocations and frees made inside are
+ * counted and can abort the process to get a backtrace of the culprit.
+ *
+ * They are only tracked when built with BBM_ALLOCATION_TRACKER (configured with CONFIG+=alloctracker, see BBManagerLean.pro):
+ * on glibc malloc, free and their variants are interposed, which covers operator new, delete and Qt
+ * containers, elsewhere only operator new and delete are replaced. Otherwise nothing is counted.
+ */
+class AllocationTracker
+{
+public:
+   // Marks the calling thread as rendering audio while in scope, scopes can be nested
+   class RealtimeScope
+   {
+   public:
+      inline RealtimeScope() {AllocationTracker::enterRealtime();}
+      inline ~RealtimeScope() {AllocationTracker::leaveRealtime();}
+
+   private:
+      Q_DISABLE_COPY(RealtimeScope)
+   };
+
+   static bool isEnabled();
+   static void enterRealtime();
+   static void leaveRealtime();
+   static void setAbortOnAllocation(bool abort);
+   static quint64 allocations();
+   static quint64 threadAllocations();
+   static quint64 frees();
+   static quint64 threadFrees();
+};
+
+#endif // ALLOCATIONTRACKER_H
@@ -0,0 +1,166 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <limits.h>
+
+#include "audiopulldevice.h"
+#include "mixer.h"
+#include "player.h"
+
+#define AUDIO_TIMING_LOG_INTERVAL_MS    (10000)
+#define NS_TO_MS(ns)                    ((double)(ns) / 1000000.0)
+
+AudioCallbackTiming::AudioCallbackTiming()
+    : m_mode("")
+{
+    m_timer.start();
+    clear();
+}
+
+/**
+ * @brief AudioCallbackTiming::reset starts a new measurement
+ * @param mode name of the output mode, used in logs
+ */
+void AudioCallbackTiming::reset(const char *mode)
+{
+    m_mode = mode;
+    m_timer.restart();
+    clear();
+}
+
+void AudioCallbackTiming::begin()
+{
+    m_beginTime = m_timer.nsecsElapsed();
+    if (m_lastBeginTime >= 0) {
+        qint64 interval = m_beginTime - m_lastBeginTime;
+        m_intervalMin = qMin(m_intervalMin, interval);
+        m_intervalMax = qMax(m_intervalMax, interval);
+        m_intervalTotal += interval;
+        m_intervalCount++;
+    }
+    m_lastBeginTime = m_beginTime;
+}
+
+void AudioCallbackTiming::end()
+{
+    qint64 endTime = m_timer.nsecsElapsed();
+    qint64 render = endTime - m_beginTime;
+    m_renderMax = qMax(m_renderMax, render);
+    m_renderTotal += render;
+    m_count++;
+
+    if (endTime - m_logTime > AUDIO_TIMING_LOG_INTERVAL_MS * 1000000LL) {
+        m_logDue = true;
+    }
+}
+
+/**
+ * @brief AudioCallbackTiming::event records where a pedal event was applied
+ * @param offset position in the audio minus the position matching when it happened (ns), negative when early
+ */
+void AudioCallbackTiming::event(qint64 offset)
+{
+    m_eventMin = qMin(m_eventMin, offset);
+    m_eventMax = qMax(m_eventMax, offset);
+    m_eventTotal += offset;
+    m_eventCount++;
+}
+
+/**
+ * @brief AudioCallbackTiming::log logs the statistics since the last log and starts a new window
+ */
+void AudioCallbackTiming::log()
+{
+    if (m_count > 0) {
+        qDebug() << "Audio" << m_mode << "callbacks:" << m_count
+                 << "interval min/avg/max (ms):" << NS_TO_MS(m_intervalCount > 0 ? m_intervalMin : 0)
+                 << "/" << NS_TO_MS(m_intervalCount > 0 ? m_intervalTotal / m_intervalCount : 0)
+                 << "/" << NS_TO_MS(m_intervalMax)
+                 << "render avg/max (ms):" << NS_TO_MS(m_renderTotal / m_count)
+                 << "/" << NS_TO_MS(m_renderMax);
+    }
+    if (m_eventCount > 0) {
+        qDebug() << "Audio" << m_mode << "pedal events:" << m_eventCount
+                 << "offset min/avg/max (ms):" << NS_TO_MS(m_eventMin)
+                 << "/" << NS_TO_MS(m_eventTotal / m_eventCount)
+                 << "/" << NS_TO_MS(m_eventMax);
+    }
+
+    qint64 lastBeginTime = m_lastBeginTime;
+    clear();
+    m_lastBeginTime = lastBeginTime;
+    m_logTime = m_timer.nsecsElapsed();
+}
+
+/**
+ * @brief AudioCallbackTiming::logIfDue logs once AUDIO_TIMING_LOG_INTERVAL_MS elapsed
+ *        NOTE: not to be called from the audio callbacks, logging allocates
+ */
+void AudioCallbackTiming::logIfDue()
+{
+    if (m_logDue) {
+        log();
+    }
+}
+
+void AudioCallbackTiming::clear()
+{
+    m_logTime = 0;
+    m_logDue = false;
+    m_beginTime = 0;
+    m_lastBeginTime = -1;
+    m_count = 0;
+    m_intervalCount = 0;
+    m_intervalMin = LLONG_MAX;
+    m_intervalMax = 0;
+    m_intervalTotal = 0;
+    m_renderMax = 0;
+    m_renderTotal = 0;
+    m_eventCount = 0;
+    m_eventMin = LLONG_MAX;
+    m_eventMax = LLONG_MIN;
+    m_eventTotal = 0;
+}
+
+AudioPullDevice::AudioPullDevice(Player *player, QObject *parent)
+    : QIODevice(parent)
+    , m_player(player)
+{
+}
+
+bool AudioPullDevice::isSequential() const
+{
+    return true;
+}
+
+/**
+ * @brief AudioPullDevice::bytesAvailable
+ * @return data is rendered on demand, so there is always a whole buffer available
+ */
+qint64 AudioPullDevice::bytesAvailable() const
+{
+    return MIXER_BUFFER_LENGTH_BYTES_STEREO + QIODevice::bytesAvailable();
+}
+
+qint64 AudioPullDevice::readData(char *data, qint64 maxSize)
+{
+    return m_player->pullAudio(data, maxSize);
+}
+
+qint64 AudioPullDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
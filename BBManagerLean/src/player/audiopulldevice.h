@@ -0,0 +1,86 @@
+#ifndef AUDIOPULLDEVICE_H
+#define AUDIOPULLDEVICE_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <QElapsedTimer>
+
+class Player;
+
+/**
+ * @brief Measures the interval between audio callbacks and the time spent rendering in them.
+ *
+ * In push mode a callback is a write of the player loop, in pull mode a read of the audio device.
+ * The offset between the moment pedal events happened and where they were applied in the audio
+ * is measured as well.
+ * Statistics are logged every AUDIO_TIMING_LOG_INTERVAL_MS and when playback stops. Logging allocates,
+ * so end() only tells the log is due and the player thread calls logIfDue() between the blocks.
+ */
+class AudioCallbackTiming
+{
+public:
+   AudioCallbackTiming();
+
+   void reset(const char *mode);
+   void begin();
+   void end();
+   void event(qint64 offset);
+   void log();
+   void logIfDue();
+
+   // Pedal events since the last log, offsets are in ns
+   inline qint64 eventCount() const {return m_eventCount;}
+   inline qint64 eventMin() const {return m_eventMin;}
+   inline qint64 eventMax() const {return m_eventMax;}
+
+private:
+   void clear();
+
+   const char *m_mode;
+   QElapsedTimer m_timer;
+   qint64 m_logTime;
+   bool m_logDue;
+   qint64 m_beginTime;
+   qint64 m_lastBeginTime;
+
+   qint64 m_count;
+   qint64 m_intervalCount;
+
+   // Units: ns
+   qint64 m_intervalMin;
+   qint64 m_intervalMax;
+   qint64 m_intervalTotal;
+   qint64 m_renderMax;
+   qint64 m_renderTotal;
+   qint64 m_eventCount;
+   qint64 m_eventMin;
+   qint64 m_eventMax;
+   qint64 m_eventTotal;
+};
+
+/**
+ * @brief Audio source read by QAudioOutput in pull mode.
+ *
+ * The device requests data when it needs it, the player renders it right away in readData().
+ * This replaces the polling of bytesFree() with a sleep in between, which adds up to 5 ms
+ * of scheduling jitter on top of the buffer.
+ */
+class AudioPullDevice : public QIODevice
+{
+   Q_OBJECT
+public:
+   explicit AudioPullDevice(Player *player, QObject *parent = nullptr);
+
+   bool isSequential() const;
+   qint64 bytesAvailable() const;
+
+protected:
+   qint64 readData(char *data, qint64 maxSize);
+   qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+   Player *m_player;
+};
+
+#endif // AUDIOPULLDEVICE_H
@@ -0,0 +1,281 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThreadPool>
+
+#include "batchrenderer.h"
+#include "offlinerenderer.h"
+#include "engineContext.h"
+#include "mixer.h"
+
+#define BATCH_DEFAULT_WALK_LOOPS    (2)
+
+/**
+ * @brief Renders one song of the batch, run by the thread pool.
+ */
+class BatchRenderJob : public QRunnable
+{
+public:
+    BatchRenderJob(BatchRenderer *batch, int index)
+        : mp_batch(batch)
+        , m_index(index)
+    {
+    }
+
+    void run() override
+    {
+        mp_batch->renderSong(m_index);
+    }
+
+private:
+    BatchRenderer *mp_batch;
+    int m_index;
+};
+
+BatchRenderer::BatchRenderer()
+    : m_walkLoops(BATCH_DEFAULT_WALK_LOOPS)
+    , m_tempo(0)
+    , m_polyphony(MIXER_DEFAULT_POLYPHONY)
+    , m_seed(ENGINE_DEFAULT_SEED)
+    , m_threadCount(QThread::idealThreadCount())
+    , m_completed(0)
+    , m_renderTime_ms(0)
+{
+}
+
+void BatchRenderer::setDrumset(const QString &path)
+{
+    m_drumsetPath = path;
+}
+
+void BatchRenderer::setEffectsPath(const QString &path)
+{
+    m_effectsPath = path;
+}
+
+/**
+ * @brief BatchRenderer::setTimeline
+ * @param path timeline applied to every song (see OfflineRenderer::loadTimeline), empty for none
+ */
+void BatchRenderer::setTimeline(const QString &path)
+{
+    m_timelinePath = path;
+}
+
+/**
+ * @brief BatchRenderer::setOutputDir
+ * @param path folder receiving the WAV files, created if needed
+ */
+void BatchRenderer::setOutputDir(const QString &path)
+{
+    m_outputDir = path;
+}
+
+/**
+ * @brief BatchRenderer::setWalkLoops
+ * @param loops number of main loops played for each part, 0 to only follow the timeline
+ */
+void BatchRenderer::setWalkLoops(int loops)
+{
+    m_walkLoops = qMax(0, loops);
+}
+
+/**
+ * @brief BatchRenderer::setTempo
+ * @param bpm 0 to use the tempo of each song
+ */
+void BatchRenderer::setTempo(int bpm)
+{
+    m_tempo = bpm;
+}
+
+/**
+ * @brief BatchRenderer::setPolyphony
+ * @param polyphony number of sounds playing at a time in each song (see OfflineRenderer::setPolyphony)
+ */
+void BatchRenderer::setPolyphony(int polyphony)
+{
+    m_polyphony = polyphony;
+}
+
+/**
+ * @brief BatchRenderer::setSeed
+ * @param seed of the random generator of each song (see OfflineRenderer::setSeed)
+ */
+void BatchRenderer::setSeed(quint32 seed)
+{
+    m_seed = seed;
+}
+
+/**
+ * @brief BatchRenderer::setThreadCount
+ * @param count number of songs rendered at a time, 0 for the number of cores
+ */
+void BatchRenderer::setThreadCount(int count)
+{
+    m_threadCount = count > 0 ? count : QThread::idealThreadCount();
+}
+
+void BatchRenderer::addSong(const QString &path)
+{
+    m_songs.append(path);
+}
+
+/**
+ * @brief BatchRenderer::addProject adds all the songs found in a project folder and its sub folders
+ * @param path
+ * @return number of songs added
+ */
+int BatchRenderer::addProject(const QString &path)
+{
+    QStringList songs;
+    QDirIterator it(path, QStringList() << "*.BBS" << "*.bbs", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        songs.append(it.next());
+    }
+    // Same order from a run to the other, whatever the file system returns
+    songs.sort();
+    m_songs.append(songs);
+    return songs.size();
+}
+
+/**
+ * @brief BatchRenderer::run renders all the songs, returns once they are all done
+ * @return false if any of them failed
+ */
+bool BatchRenderer::run()
+{
+    if (!m_outputDir.isEmpty() && !QDir().mkpath(m_outputDir)) {
+        qWarning() << "BatchRenderer - Failed to create folder: " << m_outputDir;
+        return false;
+    }
+
+    m_results.clear();
+    m_results.resize(m_songs.size());
+    for (int i = 0; i < m_songs.size(); i++) {
+        BatchRenderResult &result = m_results[i];
+        result.songPath = m_songs[i];
+        result.wavPath = wavPath(m_songs[i]);
+        result.ok = false;
+        result.duration_s = 0.0;
+        result.peakLevel_dB = 0.0;
+        result.renderTime_ms = 0;
+        result.realtimeRatio = 0.0;
+        result.steals = 0;
+    }
+    m_completed.store(0, std::memory_order_relaxed);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!OfflineRenderer::loadDrumset(m_drumsetPath, &m_drumset)) {
+        m_renderTime_ms = timer.elapsed();
+        return false;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_threadCount);
+    for (int i = 0; i < m_songs.size(); i++) {
+        // Deleted by the pool once run
+        pool.start(new BatchRenderJob(this, i));
+    }
+    pool.waitForDone();
+    m_drumset.clear();
+
+    m_renderTime_ms = timer.elapsed();
+
+    bool ok = true;
+    for (int i = 0; i < m_results.size(); i++) {
+        ok = ok && m_results[i].ok;
+    }
+    return ok;
+}
+
+/**
+ * @brief BatchRenderer::renderSong renders the song at index on the calling thread
+ *        NOTE: called by the pool threads, only writes m_results[index]
+ */
+void BatchRenderer::renderSong(int index)
+{
+    BatchRenderResult &result = m_results[index];
+
+    OfflineRenderer renderer;
+    renderer.setDrumset(m_drumsetPath);
+    renderer.setSharedDrumset(&m_drumset);
+    renderer.setSong(result.songPath);
+    renderer.setEffectsPath(m_effectsPath);
+    renderer.setTempo(m_tempo);
+    renderer.setWalkLoops(m_walkLoops);
+    renderer.setPolyphony(m_polyphony);
+    renderer.setSeed(m_seed);
+
+    if (m_timelinePath.isEmpty() || renderer.loadTimeline(m_timelinePath)) {
+        result.ok = renderer.render(result.wavPath);
+    }
+    result.duration_s = renderer.renderedSamples() / 44100.0;
+    result.peakLevel_dB = renderer.peakLevel_dB();
+    result.renderTime_ms = renderer.renderTime_ms();
+    result.realtimeRatio = renderer.realtimeRatio();
+    result.steals = renderer.stealCount();
+
+    int completed = m_completed.fetch_add(1, std::memory_order_relaxed) + 1;
+    qDebug() << "BatchRenderer - " << completed << "/" << m_results.size() << (result.ok ? " rendered " : " FAILED ") << result.songPath;
+}
+
+/**
+ * @brief BatchRenderer::wavPath
+ * @return output file of a song, named after the song and its folder as song files only have unique names within their folder
+ */
+QString BatchRenderer::wavPath(const QString &songPath) const
+{
+    QFileInfo info(songPath);
+    QString name = info.dir().dirName() + "_" + info.completeBaseName() + ".wav";
+    return m_outputDir.isEmpty() ? name : QDir(m_outputDir).filePath(name);
+}
+
+/**
+ * @brief BatchRenderer::writeCsv writes one line per song of the last run:
+ *        song, wav, status, duration (s), peak level (dBFS), render time (ms), realtime ratio
+ *        and number of sounds stolen
+ * @param path
+ */
+bool BatchRenderer::writeCsv(const QString &path) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning() << "BatchRenderer - Failed to write file at: " << path;
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "song,wav,status,duration_s,peak_dbfs,render_ms,realtime_ratio,steals\n";
+    for (int i = 0; i < m_results.size(); i++) {
+        const BatchRenderResult &result = m_results[i];
+        out << "\"" << result.songPath << "\",\"" << result.wavPath << "\","
+            << (result.ok ? "ok" : "failed") << ","
+            << QString::number(result.duration_s, 'f', 3) << ","
+            << QString::number(result.peakLevel_dB, 'f', 2) << ","
+            << result.renderTime_ms << ","
+            << QString::number(result.realtimeRatio, 'f', 1) << ","
+            << result.steals << "\n";
+    }
+    out.flush();
+    return file.error() == QFile::NoError;
+}
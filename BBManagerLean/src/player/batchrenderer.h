@@ -0,0 +1,83 @@
+#ifndef BATCHRENDERER_H
+#define BATCHRENDERER_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+
+#include "drumsetcache.h"
+
+/**
+ * @brief Outcome of the render of one song of a batch.
+ */
+struct BatchRenderResult
+{
+   QString songPath;
+   QString wavPath;
+   bool ok;
+   double duration_s;
+   double peakLevel_dB;
+   qint64 renderTime_ms;
+   double realtimeRatio;
+   int steals; // Sounds stolen by new ones once the polyphony was reached
+};
+
+/**
+ * @brief Renders many songs with one drumset to WAV files, on a thread pool sized to the number of cores.
+ *
+ * Each song is rendered by an OfflineRenderer walking through it (see OfflineRenderer::setWalkLoops),
+ * optionally along with a scripted timeline shared by all songs. The drumset is loaded and decoded
+ * once per run, all the renderers play from it.
+ */
+class BatchRenderer
+{
+public:
+   BatchRenderer();
+
+   void setDrumset(const QString &path);
+   void setEffectsPath(const QString &path);
+   void setTimeline(const QString &path);
+   void setOutputDir(const QString &path);
+   void setWalkLoops(int loops);
+   void setTempo(int bpm);
+   void setPolyphony(int polyphony);
+   void setSeed(quint32 seed);
+   void setThreadCount(int count);
+   void addSong(const QString &path);
+   int addProject(const QString &path);
+
+   bool run();
+   bool writeCsv(const QString &path) const;
+
+   inline int songCount() const {return m_songs.size();}
+   inline const QVector<BatchRenderResult> &results() const {return m_results;}
+   inline qint64 renderTime_ms() const {return m_renderTime_ms;}
+
+private:
+   Q_DISABLE_COPY(BatchRenderer)
+
+   friend class BatchRenderJob;
+   void renderSong(int index);
+   QString wavPath(const QString &songPath) const;
+
+   QString m_drumsetPath;
+   QString m_effectsPath;
+   QString m_timelinePath;
+   QString m_outputDir;
+   int m_walkLoops;
+   int m_tempo;
+   int m_polyphony;
+   quint32 m_seed;
+   int m_threadCount;
+   QStringList m_songs;
+
+   DrumsetCache m_drumset; // Loaded for the run, only read by the jobs
+   QVector<BatchRenderResult> m_results; // Sized before the jobs start, each job only writes its own entry
+   std::atomic<int> m_completed;
+   qint64 m_renderTime_ms;
+};
+
+#endif // BATCHRENDERER_H
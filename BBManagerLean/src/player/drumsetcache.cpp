@@ -0,0 +1,239 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <QFileInfo>
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "drumsetcache.h"
+#include "soundManager.h"
+
+// Drumset file header is: fileType[4], version, revision, build[2], fileCRC[4]
+#define DRUMSET_HEADER_CRC_OFFSET   (8)
+#define DRUMSET_HEADER_SIZE         (12)
+
+// Amount of each velocity layer paged in ahead of time when mapped (about 180 ms of 16 bits stereo)
+#define SAMPLE_ONSET_SIZE           (32 * 1024)
+
+DrumsetCache::DrumsetCache()
+    : m_mapped(nullptr)
+    , m_mappedSize(0)
+    , m_fileSize(-1)
+    , m_fileCRC(0)
+    , m_decoded(nullptr)
+    , m_decodeBudget(0)
+{
+}
+
+DrumsetCache::~DrumsetCache()
+{
+    clear();
+}
+
+/**
+ * @brief DrumsetCache::isCurrent
+ * @param filepath
+ * @return true if filepath is the resident drumset and the file was not modified since it was read
+ */
+bool DrumsetCache::isCurrent(const QString &filepath) const
+{
+    if (m_path.isEmpty() || isEmpty() || filepath != m_path) {
+        return false;
+    }
+
+    QFileInfo info(filepath);
+    if (!info.exists() || info.size() != m_fileSize || info.lastModified() != m_lastModified) {
+        return false;
+    }
+
+    // Size and date may not change when a drumset is rebuilt quickly, the header CRC will.
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    uint32_t crc;
+    bool ok = readHeaderCRC(file, &crc);
+    file.close();
+
+    return ok && crc == m_fileCRC;
+}
+
+/**
+ * @brief DrumsetCache::read replaces the resident drumset with the content of file
+ * @param filepath path used to identify the drumset later on
+ * @param file opened drumset file
+ */
+void DrumsetCache::read(const QString &filepath, QFile &file)
+{
+    clear();
+
+    m_data = file.readAll();
+    setIdentity(filepath, file);
+}
+
+/**
+ * @brief DrumsetCache::map replaces the resident drumset with a mapping of file
+ * @param filepath path used to identify the drumset later on
+ * @param file opened drumset file, may be closed once mapped
+ * @return false if the file could not be mapped, the cache is then empty
+ */
+bool DrumsetCache::map(const QString &filepath, QFile &file)
+{
+    clear();
+
+#ifdef Q_OS_UNIX
+    qint64 fileSize = file.size();
+    if (fileSize < DRUMSET_HEADER_SIZE) {
+        return false;
+    }
+
+    // SoundManager fixes up the instruments in a copy of their table, the mapping is only read
+    void *addr = mmap(nullptr, (size_t)fileSize, PROT_READ, MAP_PRIVATE, file.handle(), 0);
+    if (addr == MAP_FAILED) {
+        qWarning() << "DrumsetCache::map - mmap failed for " << filepath << ": " << strerror(errno);
+        return false;
+    }
+
+    m_mapped = (char *)addr;
+    m_mappedSize = fileSize;
+    setIdentity(filepath, file);
+
+    // Samples are read on demand, but page in the instrument table and the attack
+    // of every sound ahead of time to avoid page faults on the first notes.
+    adviseSampleOnsets();
+    return true;
+#else
+    Q_UNUSED(filepath);
+    Q_UNUSED(file);
+    return false;
+#endif
+}
+
+/**
+ * @brief DrumsetCache::decode decodes the 24 bits layers of the resident drumset (see SoundManager_decodeDrumset)
+ *        NOTE: must be called after read or map, before the drumset is loaded in a SoundManager
+ * @param budget memory given to the decoded layers, 0 to play them from the file
+ * @return false if out of memory, the drumset is then not decoded
+ */
+bool DrumsetCache::decode(uint32_t budget)
+{
+    SoundManager_freeDecodedDrumset(m_decoded);
+    m_decoded = SoundManager_decodeDrumset(data(), (uint32_t)size(), budget);
+    m_decodeBudget = budget;
+    return m_decoded != nullptr;
+}
+
+/**
+ * @brief DrumsetCache::capacity
+ * @return heap memory of the drumset, a mapping is not counted, the decoded layers are
+ */
+qint64 DrumsetCache::capacity() const
+{
+    SoundManager_DecodeStats stats;
+    SoundManager_getDecodeStats(m_decoded, &stats);
+    return m_data.capacity() + stats.decodedBytes;
+}
+
+void DrumsetCache::clear()
+{
+    SoundManager_freeDecodedDrumset(m_decoded);
+    m_decoded = nullptr;
+    m_decodeBudget = 0;
+    m_path.clear();
+    m_fileSize = -1;
+    m_fileCRC = 0;
+    m_data.clear();
+    m_data.squeeze();
+#ifdef Q_OS_UNIX
+    if (m_mapped) {
+        munmap(m_mapped, (size_t)m_mappedSize);
+    }
+#endif
+    m_mapped = nullptr;
+    m_mappedSize = 0;
+}
+
+void DrumsetCache::swap(DrumsetCache &other)
+{
+    m_data.swap(other.m_data);
+    std::swap(m_mapped, other.m_mapped);
+    std::swap(m_mappedSize, other.m_mappedSize);
+    m_path.swap(other.m_path);
+    std::swap(m_fileSize, other.m_fileSize);
+    std::swap(m_lastModified, other.m_lastModified);
+    std::swap(m_fileCRC, other.m_fileCRC);
+    std::swap(m_decoded, other.m_decoded);
+    std::swap(m_decodeBudget, other.m_decodeBudget);
+}
+
+void DrumsetCache::setIdentity(const QString &filepath, QFile &file)
+{
+    QFileInfo info(file);
+    m_fileSize = info.size();
+    m_lastModified = info.lastModified();
+    m_fileCRC = 0;
+    if (size() >= DRUMSET_HEADER_SIZE) {
+        memcpy(&m_fileCRC, data() + DRUMSET_HEADER_CRC_OFFSET, sizeof(m_fileCRC));
+    }
+    m_path = filepath;
+}
+
+/**
+ * @brief DrumsetCache::adviseSampleOnsets
+ */
+void DrumsetCache::adviseSampleOnsets()
+{
+#ifdef Q_OS_UNIX
+    const qint64 instSize = MIDIPARSER_NUMBER_OF_INSTRUMENTS * sizeof(Instrument_t);
+    if (!m_mapped || m_mappedSize < DRUMSET_HEADER_SIZE + instSize) {
+        return;
+    }
+
+    const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const Instrument_t *inst = (const Instrument_t *)(m_mapped + DRUMSET_HEADER_SIZE);
+    madvise(m_mapped, (size_t)(DRUMSET_HEADER_SIZE + instSize), MADV_WILLNEED);
+
+    for (unsigned int i = 0; i < MIDIPARSER_NUMBER_OF_INSTRUMENTS; i++) {
+        unsigned int nVel = qMin(inst[i].nVel, (unsigned int)MIDIPARSER_MAX_NUMBER_VELOCITY);
+        for (unsigned int j = 0; j < nVel; j++) {
+#if !(defined(__x86_64__) || defined(_M_X64))
+            qint64 offset = inst[i].vel[j].addr;
+#else
+            qint64 offset = inst[i].vel[j].offset;
+#endif
+            if (offset <= 0 || offset >= m_mappedSize) continue;
+
+            qint64 start = offset & ~(pageSize - 1);
+            qint64 length = qMin(offset + SAMPLE_ONSET_SIZE, m_mappedSize) - start;
+            madvise(m_mapped + start, (size_t)length, MADV_WILLNEED);
+        }
+    }
+#endif
+}
+
+bool DrumsetCache::readHeaderCRC(QFile &file, uint32_t *crc)
+{
+    char header[DRUMSET_HEADER_SIZE];
+    if (file.read(header, DRUMSET_HEADER_SIZE) != DRUMSET_HEADER_SIZE) {
+        return false;
+    }
+    memcpy(crc, header + DRUMSET_HEADER_CRC_OFFSET, sizeof(*crc));
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef DRUMSETCACHE_H
+#define DRUMSETCACHE_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <QDateTime>
+#include <stdint.h>
+
+#include "soundManager.h"
+
+/**
+ * @brief Keeps the drumset sample memory resident between playback sessions.
+ *
+ * SoundManager tables point directly into this memory, so it must stay alive
+ * as long as the drumset is registered in the SoundManager. A drumset is
+ * identified by its path, size, modification time and the CRC found in its
+ * header; as long as they match, the resident copy can be reused as is.
+ *
+ * The memory is either a heap copy of the file (read) or a read-only mapping of
+ * it (map). A mapping is paged in on demand and its pages are shared with the
+ * page cache, so it is not limited by the free memory. The SoundManager only
+ * reads the memory, a drumset can be played by several engines at a time.
+ *
+ * The 24 bits layers decoded for the SoundManager (decode) are kept along with
+ * the memory, and freed with it.
+ */
+class DrumsetCache
+{
+public:
+   DrumsetCache();
+   ~DrumsetCache();
+
+   bool isCurrent(const QString &filepath) const;
+   void read(const QString &filepath, QFile &file);
+   bool map(const QString &filepath, QFile &file);
+   bool decode(uint32_t budget);
+   void clear();
+   void swap(DrumsetCache &other);
+
+   inline const char *data() const {return m_mapped ? m_mapped : m_data.constData();}
+   inline bool isEmpty() const {return size() == 0;}
+   inline bool isMapped() const {return m_mapped != nullptr;}
+   inline qint64 size() const {return m_mapped ? m_mappedSize : m_data.size();}
+   qint64 capacity() const; // Heap memory only
+   inline const QString &path() const {return m_path;}
+   inline const SoundManager_DecodedDrumset *decoded() const {return m_decoded;}
+   inline bool isDecoded(uint32_t budget) const {return m_decoded && m_decodeBudget == budget;}
+
+private:
+   Q_DISABLE_COPY(DrumsetCache)
+
+   static bool readHeaderCRC(QFile &file, uint32_t *crc);
+   void setIdentity(const QString &filepath, QFile &file);
+   void adviseSampleOnsets();
+
+   QByteArray m_data;
+   char *m_mapped;
+   qint64 m_mappedSize;
+
+   QString m_path;
+   qint64 m_fileSize;
+   QDateTime m_lastModified;
+   uint32_t m_fileCRC;
+
+   SoundManager_DecodedDrumset *m_decoded; // Null until decoded
+   uint32_t m_decodeBudget;                // Budget m_decoded was decoded with
+};
+
+#endif // DRUMSETCACHE_H
@@ -0,0 +1,203 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <QElapsedTimer>
+#include <stdexcept>
+
+#include "drumsetloader.h"
+#include "player.h"
+
+DrumsetLoader::DrumsetLoader(QObject *parent)
+    : QThread(parent)
+    , m_requestMmap(false)
+    , m_requestDecodeBudget(0)
+    , m_ready(false)
+    , m_quit(false)
+{
+}
+
+DrumsetLoader::~DrumsetLoader()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_requested.wakeAll();
+    m_mutex.unlock();
+    wait();
+}
+
+/**
+ * @brief DrumsetLoader::load requests a drumset to be read in background, replacing any previous request
+ * @param filepath
+ * @param mmap true to map the drumset file, false to read it in a heap buffer
+ * @param decodeBudget memory given to its decoded 24 bits layers, see DrumsetCache::decode
+ */
+void DrumsetLoader::load(const QString &filepath, bool mmap, uint32_t decodeBudget)
+{
+    QMutexLocker locker(&m_mutex);
+    m_requestPath = filepath;
+    m_requestMmap = mmap;
+    m_requestDecodeBudget = decodeBudget;
+    m_ready = false;
+    m_requested.wakeOne();
+    locker.unlock();
+
+    if (!isRunning()) {
+        start(QThread::LowPriority);
+    }
+}
+
+/**
+ * @brief DrumsetLoader::cancel drops the pending request, a drumset already read is freed in background
+ */
+void DrumsetLoader::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_requestPath.clear();
+    m_ready = false;
+    m_requested.wakeOne();
+}
+
+/**
+ * @brief DrumsetLoader::take hands over the requested drumset, never waits
+ * @param drumset empty cache receiving the drumset
+ * @param mmap receives the mode the drumset was requested with
+ * @return false if the drumset is not read yet
+ */
+bool DrumsetLoader::take(DrumsetCache *drumset, bool *mmap)
+{
+    if (!m_mutex.tryLock()) {
+        return false;
+    }
+
+    bool ready = m_ready;
+    if (ready) {
+        drumset->swap(m_loaded);
+        *mmap = m_requestMmap;
+        m_requestPath.clear();
+        m_ready = false;
+    }
+    m_mutex.unlock();
+    return ready;
+}
+
+/**
+ * @brief DrumsetLoader::release frees a drumset in background, never waits
+ * @param drumset emptied on success
+ * @return false if the drumset could not be handed over yet, try again later
+ */
+bool DrumsetLoader::release(DrumsetCache *drumset)
+{
+    if (!m_mutex.tryLock()) {
+        return false;
+    }
+
+    bool released = m_released.isEmpty();
+    if (released) {
+        m_released.swap(*drumset);
+        m_requested.wakeOne();
+    }
+    m_mutex.unlock();
+
+    if (released && !isRunning()) {
+        start(QThread::LowPriority);
+    }
+    return released;
+}
+
+void DrumsetLoader::run(void)
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_quit) {
+        // Free drumsets outside of the lock, munmap or free of a large kit may take a while
+        if (!m_released.isEmpty() || (!m_ready && !m_loaded.isEmpty())) {
+            DrumsetCache drumset;
+            drumset.swap(m_released.isEmpty() ? m_loaded : m_released);
+            locker.unlock();
+            drumset.clear();
+            locker.relock();
+            continue;
+        }
+
+        if (m_requestPath.isEmpty() || m_ready) {
+            m_requested.wait(&m_mutex);
+            continue;
+        }
+
+        QString filepath = m_requestPath;
+        bool mmap = m_requestMmap;
+        uint32_t decodeBudget = m_requestDecodeBudget;
+        locker.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+
+        DrumsetCache drumset;
+        bool loaded = read(filepath, mmap, decodeBudget, &drumset);
+        if (loaded) {
+            SoundManager_DecodeStats decodeStats;
+            SoundManager_getDecodeStats(drumset.decoded(), &decodeStats);
+            qDebug() << "Drumset read in background " << filepath << (drumset.isMapped() ? " (mapped)" : " (heap)")
+                     << " in " << timer.elapsed() << "ms, 24 bits layers decoded: " << decodeStats.decodedLayers
+                     << " in " << decodeStats.decodedBytes / 1024 << "KB, " << decodeStats.rawLayers << " over the budget";
+        }
+
+        locker.relock();
+        if (filepath == m_requestPath && mmap == m_requestMmap && decodeBudget == m_requestDecodeBudget) {
+            if (loaded) {
+                m_loaded.swap(drumset);
+                m_ready = true;
+            } else {
+                m_requestPath.clear();
+            }
+        }
+        // Otherwise the request changed meanwhile, drumset is dropped
+        locker.unlock();
+        drumset.clear();
+        locker.relock();
+    }
+}
+
+bool DrumsetLoader::read(const QString &filepath, bool mmap, uint32_t decodeBudget, DrumsetCache *drumset)
+{
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "DrumsetLoader - Failed to open drumset file at: " << filepath;
+        return false;
+    }
+
+    try {
+        bool mapped = mmap && drumset->map(filepath, file);
+        if (!mapped) {
+            Player::checkDrumsetMemory(file.size());
+            drumset->read(filepath, file);
+        }
+    } catch (const std::exception& e) {
+        qWarning() << "DrumsetLoader - Unable to read drumset " << filepath << ": " << e.what();
+        drumset->clear();
+        return false;
+    }
+    file.close();
+
+    if (drumset->size() < 100) {
+        qWarning() << "DrumsetLoader - Invalid drumset data - file may be corrupted";
+        drumset->clear();
+        return false;
+    }
+    if (!drumset->decode(decodeBudget)) {
+        qWarning() << "DrumsetLoader - Not enough memory to decode drumset " << filepath;
+        drumset->clear();
+        return false;
+    }
+    return true;
+}
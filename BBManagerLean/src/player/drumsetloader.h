@@ -0,0 +1,47 @@
+#ifndef DRUMSETLOADER_H
+#define DRUMSETLOADER_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "drumsetcache.h"
+
+/**
+ * @brief Low priority thread reading a drumset while another one plays, so kits can be swapped during playback.
+ *
+ * The drumset is also decoded (see DrumsetCache::decode) so that it is ready to be prepared.
+ * The audio thread polls take() and never waits for the file I/O. Drumsets it does not
+ * use anymore are handed back with release() so they are also freed outside of it.
+ */
+class DrumsetLoader : public QThread
+{
+   Q_OBJECT
+public:
+   explicit DrumsetLoader(QObject *parent = nullptr);
+   ~DrumsetLoader();
+
+   void load(const QString &filepath, bool mmap, uint32_t decodeBudget);
+   void cancel();
+   bool take(DrumsetCache *drumset, bool *mmap);
+   bool release(DrumsetCache *drumset);
+
+private:
+   void run(void);
+   static bool read(const QString &filepath, bool mmap, uint32_t decodeBudget, DrumsetCache *drumset);
+
+   QMutex m_mutex;
+   QWaitCondition m_requested;
+
+   QString m_requestPath;
+   bool m_requestMmap;
+   uint32_t m_requestDecodeBudget;
+   bool m_ready;           // m_loaded holds the requested drumset
+   DrumsetCache m_loaded;
+   DrumsetCache m_released;
+   bool m_quit;
+};
+
+#endif // DRUMSETLOADER_H
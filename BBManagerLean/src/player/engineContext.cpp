@@ -0,0 +1,153 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "engineContext.h"
+#include "mixer.h"
+#include "soundManager.h"
+#include "songPlayer.h"
+
+#include <new>
+
+#define PCG32_MULTIPLIER            (6364136223846793005ull)
+#define PCG32_INCREMENT             (1442695040888963407ull)
+
+// Context bound to each thread, nullptr for the default one
+static ENGINE_THREAD_LOCAL EngineContext *BoundContext = nullptr;
+
+static void seedRandom(EngineRandom *random, uint32_t seed)
+{
+    random->seed = seed;
+    random->state = 0;
+    random->state = random->state * PCG32_MULTIPLIER + PCG32_INCREMENT;
+    random->state += seed;
+    random->state = random->state * PCG32_MULTIPLIER + PCG32_INCREMENT;
+}
+
+static EngineRandom defaultRandom(void)
+{
+    EngineRandom random;
+    seedRandom(&random, ENGINE_DEFAULT_SEED);
+    return random;
+}
+
+// Random generator of the default engine
+static EngineRandom DefaultRandom = defaultRandom();
+
+// Random generator of the engine bound to the calling thread
+static EngineRandom *boundRandom(void)
+{
+    return BoundContext ? &BoundContext->random : &DefaultRandom;
+}
+
+/**
+ * @brief EngineContext_create
+ *    Allocate a new engine. It is not bound to any thread, and still has to be initialized
+ *    like the default one (mixer_init, SoundManager_init, SongPlayer_init) once bound.
+ * @return nullptr if the allocation failed
+ */
+EngineContext *EngineContext_create(void)
+{
+    EngineContext *context = new (std::nothrow) EngineContext;
+    if (!context) {
+        return nullptr;
+    }
+    context->mixer = mixer_createState();
+    context->soundManager = SoundManager_createState();
+    context->songPlayer = SongPlayer_createState();
+    seedRandom(&context->random, ENGINE_DEFAULT_SEED);
+
+    if (!context->mixer || !context->soundManager || !context->songPlayer) {
+        EngineContext_destroy(context);
+        return nullptr;
+    }
+    return context;
+}
+
+/**
+ * @brief EngineContext_destroy
+ *    NOTE: the context must not be bound to any other thread than the calling one.
+ *    Memory referenced by the engine (drumset, effects, songs) belongs to the caller.
+ */
+void EngineContext_destroy(EngineContext *context)
+{
+    if (!context) {
+        return;
+    }
+    if (BoundContext == context) {
+        EngineContext_bind(nullptr);
+    }
+    SongPlayer_destroyState(context->songPlayer);
+    SoundManager_destroyState(context->soundManager);
+    mixer_destroyState(context->mixer);
+    delete context;
+}
+
+/**
+ * @brief EngineContext_bind
+ *    Make the calling thread work on the given engine
+ * @param context nullptr for the default engine
+ * @return the context previously bound to the thread, to restore it
+ */
+EngineContext *EngineContext_bind(EngineContext *context)
+{
+    EngineContext *previous = BoundContext;
+
+    mixer_bindState(context ? context->mixer : nullptr);
+    SoundManager_bindState(context ? context->soundManager : nullptr);
+    SongPlayer_bindState(context ? context->songPlayer : nullptr);
+
+    BoundContext = context;
+    return previous;
+}
+
+/**
+ * @brief EngineContext_setSeed
+ *    Restart the random generator of the engine bound to the calling thread,
+ *    a song rendered after the same seed picks the same layers and drum fills.
+ * @param seed
+ */
+void EngineContext_setSeed(uint32_t seed)
+{
+    seedRandom(boundRandom(), seed);
+}
+
+/**
+ * @brief EngineContext_getSeed
+ * @return the last seed of the random generator of the engine bound to the calling thread
+ */
+uint32_t EngineContext_getSeed(void)
+{
+    return boundRandom()->seed;
+}
+
+/**
+ * @brief EngineContext_random
+ *    Next number of the random generator of the engine bound to the calling thread.
+ *    NOTE: lock free, only to be called by the thread running the engine
+ * @param range
+ * @return a number from 0 to range - 1, 0 if range is 0
+ */
+uint32_t EngineContext_random(uint32_t range)
+{
+    EngineRandom *random = boundRandom();
+    uint64_t state = random->state;
+    uint32_t xorshifted = (uint32_t)(((state >> 18u) ^ state) >> 27u);
+    uint32_t rot = (uint32_t)(state >> 59u);
+    uint32_t value = (xorshifted >> rot) | (xorshifted << ((32u - rot) & 31u));
+
+    random->state = state * PCG32_MULTIPLIER + PCG32_INCREMENT;
+
+    // Scale to the range without a division
+    return (uint32_t)(((uint64_t)value * range) >> 32);
+}
@@ -0,0 +1,59 @@
+#ifndef ENGINECONTEXT_H
+#define ENGINECONTEXT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*****************************************************************************
+ **                     DEFINES
+ *****************************************************************************/
+// Storage of the per thread instance pointers of the engine modules
+#if defined(_MSC_VER)
+#    define ENGINE_THREAD_LOCAL     __declspec(thread)
+#else
+#    define ENGINE_THREAD_LOCAL     __thread
+#endif
+
+// Seed of the random generator of a new engine
+#define ENGINE_DEFAULT_SEED         (0x5B5B2014u)
+
+
+/*****************************************************************************
+ **                     TYPEDEF
+ *****************************************************************************/
+/* Random generator of an engine (PCG32), picking the round robin layers and the drum fills.
+ * Each engine has its own so that renders are reproducible and the audio thread never uses rand(). */
+typedef struct EngineRandom {
+    uint64_t state;
+    uint32_t seed;
+} EngineRandom;
+
+/* One complete engine: song player, sound manager and mixer.
+ * The SongPlayer_*, SoundManager_* and mixer_* functions work on the context bound to the calling
+ * thread, which is a process wide default one unless EngineContext_bind was called. */
+typedef struct EngineContext {
+    struct MIXER_State *mixer;
+    struct SoundManager_State *soundManager;
+    struct SongPlayer_State *songPlayer;
+    EngineRandom random;
+} EngineContext;
+
+
+/*****************************************************************************
+ **                     FUNCTION PROTOTYPES
+ *****************************************************************************/
+EngineContext *EngineContext_create(void);
+void EngineContext_destroy(EngineContext *context);
+EngineContext *EngineContext_bind(EngineContext *context);
+void EngineContext_setSeed(uint32_t seed);
+uint32_t EngineContext_getSeed(void);
+uint32_t EngineContext_random(uint32_t range);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ENGINECONTEXT_H
@@ -13,6 +13,8 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "mixer.h"
+#include "mixerKernels.h"
+#include "engineContext.h"
 #include "settings.h"
 #include "pragmapack.h"
 #include <string.h>
@@ -37,18 +39,29 @@ extern "C" {
 //#define RELEASE_TIME_MS             30
 #define RELEASE_GAIN_LENGTH         ((RELEASE_TIME_MAX * 44100) / 1000)
 //#define RELEASE_GAIN_LENGTH         (2)
+// Frames of the release ramp, the coefficients after it are zero
+#define RELEASE_RAMP_LENGTH         (100)
 
-#define MASTER_DIVIDER               (100000LL * 100LL * 100LL)
 
 
 
 
+#define MIXER_MAX_CHANNEL_ARRAY      (MIXER_MAX_POLYPHONY) // Number max of stereo channel, Polyphony of them play at a time
+// Channels fading out the sounds stolen by new ones (MIXER_STEAL_CHANNELS), after the regular channels
+#define MIXER_TOTAL_CHANNELS         (MIXER_MAX_CHANNEL_ARRAY + MIXER_STEAL_CHANNELS)
+#define IS_STEALING(i)               ((i) >= MIXER_MAX_CHANNEL_ARRAY)
 
-#define MIXER_MAX_CHANNEL_ARRAY      (64u) // Number max of stereo channel
+// Index ending the channel lists of the voice table
+#define MIXER_NO_CHANNEL             (0xFFFFu)
+// Lists heads of the notes and of the choke groups, keys sharing a bucket share its list
+#define MIXER_VOICE_BUCKETS          (32u)
+#define VOICE_BUCKET(key)            ((key) & (MIXER_VOICE_BUCKETS - 1u))
 
 // MIXER_BUFFER_LENGTH_SAMPLES DEFINED in .h so that it can be accessed by player.cpp
 #    define MIXER_BUFFER_LENGTH          (70560u)//(MIXER_BUFFER_LENGTH_SAMPLES)
-#define BUFFER_LENGTH               (MIXER_BUFFER_LENGTH)
+
+// Frames mixed at a time, small enough for the accumulators to stay in L1 cache
+#define MIXER_BLOCK_FRAMES          (128u)
 
 
 #define MIXER_TIME_SAMPLE_US_RATIO  (1.0f/(1000000.0f/44100.0f))
@@ -58,8 +71,6 @@ extern "C" {
 
 
 #define FIXED_POINT_OFF             (1000)
-#define MAX_VALUE                   (8388607)
-#define MIN_VALUE                   (-8388607)
 #ifndef true
 #define true 1
 #endif
@@ -82,6 +93,7 @@ extern "C" {
 
 typedef struct {
     unsigned char * add;         // Starting address of the audio samples
+    MIXER_format_t format;       // Sample layout, selects the mixing kernel
     unsigned int offsetSample;   // Number of byte to skip for a frame ( L + R )
     unsigned int offsetStereo;   // Number of offset bytes to apply betwwen left and right channel
     unsigned int offsetNext;     // Numver of offser bytes to apply afeter the right channel
@@ -103,26 +115,83 @@ typedef struct {
     unsigned int release_delay;
 } MIXER_channel_t;
 
+/* Structure of arrays indexing the channels, so that no operation scans all of them:
+ * a free channel is in the free list, an active one (byteIndex < nByte) in the active list,
+ * ordered from the oldest, and in the lists of its note and of its choke group, ordered the same way.
+ * Stealing channels, fading out stolen sounds, have their own free list and are only in the active list.
+ * The lists are doubly linked through the channel indexes, the free lists only use next.
+ */
+typedef struct {
+    unsigned short next[MIXER_TOTAL_CHANNELS];
+    unsigned short prev[MIXER_TOTAL_CHANNELS];
+    unsigned short noteNext[MIXER_TOTAL_CHANNELS];
+    unsigned short notePrev[MIXER_TOTAL_CHANNELS];
+    unsigned short chokeNext[MIXER_TOTAL_CHANNELS];
+    unsigned short chokePrev[MIXER_TOTAL_CHANNELS];
+
+    unsigned short freeHead;
+    unsigned short stealFreeHead;
+    unsigned short activeHead;
+    unsigned short activeTail;
+    unsigned short noteHead[MIXER_VOICE_BUCKETS];
+    unsigned short noteTail[MIXER_VOICE_BUCKETS];
+    unsigned short chokeHead[MIXER_VOICE_BUCKETS];
+    unsigned short chokeTail[MIXER_VOICE_BUCKETS];
+
+    unsigned int activeCount;    // Regular channels in the active list
+} MIXER_voiceTable_t;
+
 
 
 /******************************************************************************
  **                     INTERNAL GLOBAL VARIABLE 
  ********************************************** *******************************/
 
-static MIXER_channel_t Channel[MIXER_MAX_CHANNEL_ARRAY];
+// All the mixer state, one instance per engine (see EngineContext)
+struct MIXER_State {
+    MIXER_channel_t Channel[MIXER_TOTAL_CHANNELS];
+    MIXER_voiceTable_t Voices;
+
+    unsigned int UniqueId;
+
+    int64_t R_Buffer[MIXER_BLOCK_FRAMES];
+    int64_t L_Buffer[MIXER_BLOCK_FRAMES];
+    volatile unsigned int numEmptyValues;
+
+    int ReleaseCoeff[RELEASE_GAIN_LENGTH];
+    int ReleaseLength;
 
-static unsigned int UniqueId = 0;
+    float g_level;
 
-static signed long long R_Buffer[MIXER_BUFFER_LENGTH];
-static signed long long L_Buffer[MIXER_BUFFER_LENGTH];
-static volatile unsigned int numEmptyValues;
+    int gLeftFreq;
+    int gRightFreq;
+    unsigned int tt;
 
-static unsigned long counter = 180;
+    const MIXERKERNELS_set_t *Kernels;
 
-static int ReleaseCoeff[RELEASE_GAIN_LENGTH];
-static int ReleaseLength = RELEASE_GAIN_LENGTH;
+    unsigned int Polyphony;
+    unsigned int StealCount;
+};
 
-static float g_level;
+// Instance used by the threads which did not bind any other one
+static MIXER_State DefaultState;
+static ENGINE_THREAD_LOCAL MIXER_State *State = &DefaultState;
+
+#define Channel                     (State->Channel)
+#define Voices                      (State->Voices)
+#define UniqueId                    (State->UniqueId)
+#define R_Buffer                    (State->R_Buffer)
+#define L_Buffer                    (State->L_Buffer)
+#define numEmptyValues              (State->numEmptyValues)
+#define ReleaseCoeff                (State->ReleaseCoeff)
+#define ReleaseLength               (State->ReleaseLength)
+#define g_level                     (State->g_level)
+#define gLeftFreq                   (State->gLeftFreq)
+#define gRightFreq                  (State->gRightFreq)
+#define tt                          (State->tt)
+#define Kernels                     (State->Kernels)
+#define Polyphony                   (State->Polyphony)
+#define StealCount                  (State->StealCount)
 
 /******************************************************************************
  **                     INTERNAL FUNCTION PROTOTYPE
@@ -132,15 +201,47 @@ char IntDisable(void){ return 0; }
 void IntEnable(char status){(void) status;}
 
 static void calculateReleaseTimeCoeff(int *array, int length);
+static void resetVoices(void);
+static unsigned int allocateChannel(void);
+static void stealChannel(unsigned int i);
+static void startChannel(unsigned int i);
+static void freeChannel(unsigned int i);
 static void settingsCallback(SETTINGS_main_key_enum key, int value);
-static inline void quickRelease(MIXER_channel_t *channel);
+static void mixBlock(unsigned int frames);
 
 /******************************************************************************
  **              FUNCTION DEFINITIONS
  ******************************************************************************/
 
-int gLeftFreq = 0;
-int gRightFreq = 0;
+/*
+ * \brief Allocate a new mixer instance, it still has to be initialized with mixer_init once bound
+ */
+MIXER_State *mixer_createState(void)
+{
+    return (MIXER_State *) calloc(1, sizeof(MIXER_State));
+}
+
+void mixer_destroyState(MIXER_State *state)
+{
+    if (state == &DefaultState) {
+        return;
+    }
+    if (State == state) {
+        State = &DefaultState;
+    }
+    free(state);
+}
+
+/*
+ * \brief Make the calling thread use the given mixer instance, NULL for the default one
+ * \return the instance previously used by the thread
+ */
+MIXER_State *mixer_bindState(MIXER_State *state)
+{
+    MIXER_State *previous = State;
+    State = state ? state : &DefaultState;
+    return previous;
+}
 
 void mixer_setLeftFreq(unsigned int freq){
     gLeftFreq = freq;
@@ -157,11 +258,12 @@ void mixer_init(void)
 {
     unsigned int i;
     //Free all channel (active state is defined by byteIndex < nByte)
-    for( i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++ ) {
+    for( i = 0; i < MIXER_TOTAL_CHANNELS; i++ ) {
         Channel[i].nByte = 0u;
         Channel[i].timeiD = 0u;
         Channel[i].byteIndex = 0u;
     }
+    resetVoices();
 
 
 
@@ -169,7 +271,74 @@ void mixer_init(void)
     // Initialise the mixer circular buffer
     numEmptyValues = MIXER_BUFFER_LENGTH;
 
-    calculateReleaseTimeCoeff(ReleaseCoeff,100);
+    ReleaseLength = RELEASE_GAIN_LENGTH;
+
+    Polyphony = MIXER_DEFAULT_POLYPHONY;
+    StealCount = 0;
+
+    calculateReleaseTimeCoeff(ReleaseCoeff,RELEASE_RAMP_LENGTH);
+
+    Kernels = mixerKernels_select();
+}
+
+/*
+ * \brief Set the number of sounds playing at a time, from MIXER_MIN_POLYPHONY to MIXER_MAX_POLYPHONY.
+ *        Lowering it does not stop any sound, new sounds replace playing ones until fewer play.
+ */
+void mixer_setPolyphony(unsigned int voices)
+{
+    unsigned char status = IntDisable();
+
+    voices = voices < MIXER_MIN_POLYPHONY ? MIXER_MIN_POLYPHONY : voices;
+    voices = voices > MIXER_MAX_POLYPHONY ? MIXER_MAX_POLYPHONY : voices;
+    Polyphony = voices;
+
+    IntEnable(status);
+}
+
+unsigned int mixer_getPolyphony(void)
+{
+    return Polyphony;
+}
+
+/*
+ * \brief Number of sounds stolen to play new ones since mixer_init or the last reset
+ */
+unsigned int mixer_getStealCount(void)
+{
+    return StealCount;
+}
+
+/*
+ * \brief Number of sounds playing, not counting the ones fading out after being stolen
+ */
+unsigned int mixer_getVoiceCount(void)
+{
+    return Voices.activeCount;
+}
+
+void mixer_resetStealCount(void)
+{
+    StealCount = 0;
+}
+
+/*
+ * \brief Name of the voice mixing kernels picked for this CPU by mixer_init
+ */
+const char *mixer_getKernelsName(void)
+{
+    return Kernels ? Kernels->name : "";
+}
+
+/*
+ * \brief Mix with other kernels than the ones picked by mixer_init, until the next mixer_init.
+ *        For the tests, nullptr goes back to the kernels picked for this CPU.
+ */
+void mixer_setKernels(const MIXERKERNELS_set_t *kernels)
+{
+    unsigned char status = IntDisable();
+    Kernels = kernels ? kernels : mixerKernels_select();
+    IntEnable(status);
 }
 
 
@@ -180,6 +349,187 @@ static void calculateReleaseTimeCoeff(int *array, int length){
     }
 }
 
+static void listAppend(unsigned short *next, unsigned short *prev, unsigned short *head, unsigned short *tail, unsigned int i)
+{
+    next[i] = MIXER_NO_CHANNEL;
+    prev[i] = *tail;
+    if (*tail == MIXER_NO_CHANNEL) {
+        *head = i;
+    } else {
+        next[*tail] = i;
+    }
+    *tail = i;
+}
+
+static void listRemove(unsigned short *next, unsigned short *prev, unsigned short *head, unsigned short *tail, unsigned int i)
+{
+    if (prev[i] == MIXER_NO_CHANNEL) {
+        *head = next[i];
+    } else {
+        next[prev[i]] = next[i];
+    }
+    if (next[i] == MIXER_NO_CHANNEL) {
+        *tail = prev[i];
+    } else {
+        prev[next[i]] = prev[i];
+    }
+}
+
+/*
+ * \brief Empty the voice table, all the channels are free
+ */
+static void resetVoices(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < MIXER_TOTAL_CHANNELS; i++) {
+        Voices.next[i] = (i + 1 < MIXER_TOTAL_CHANNELS && i + 1 != MIXER_MAX_CHANNEL_ARRAY) ? i + 1 : MIXER_NO_CHANNEL;
+    }
+    Voices.freeHead = 0;
+    Voices.stealFreeHead = MIXER_MAX_CHANNEL_ARRAY;
+    Voices.activeHead = MIXER_NO_CHANNEL;
+    Voices.activeTail = MIXER_NO_CHANNEL;
+    for (i = 0; i < MIXER_VOICE_BUCKETS; i++) {
+        Voices.noteHead[i] = MIXER_NO_CHANNEL;
+        Voices.noteTail[i] = MIXER_NO_CHANNEL;
+        Voices.chokeHead[i] = MIXER_NO_CHANNEL;
+        Voices.chokeTail[i] = MIXER_NO_CHANNEL;
+    }
+    Voices.activeCount = 0;
+}
+
+static void unlinkChannel(unsigned int i)
+{
+    unsigned int note = VOICE_BUCKET(Channel[i].noteID);
+    unsigned int choke = VOICE_BUCKET(Channel[i].chokeGroup);
+
+    listRemove(Voices.next, Voices.prev, &Voices.activeHead, &Voices.activeTail, i);
+    if (IS_STEALING(i)) {
+        return;
+    }
+    Voices.activeCount--;
+    listRemove(Voices.noteNext, Voices.notePrev, &Voices.noteHead[note], &Voices.noteTail[note], i);
+    listRemove(Voices.chokeNext, Voices.chokePrev, &Voices.chokeHead[choke], &Voices.chokeTail[choke], i);
+}
+
+/*
+ * \brief Move the sound of a channel about to be reused to a stealing channel, which fades it out
+ *        over the release ramp while the next blocks are mixed
+ */
+static void stealChannel(unsigned int i)
+{
+    unsigned int position = Channel[i].release_position ? Channel[i].release_position : 1;
+    unsigned int s;
+    int remaining;
+
+    // Nothing to fade if the sound did not start or is already silent
+    if (Channel[i].byteIndex < 0 || position >= RELEASE_RAMP_LENGTH) {
+        return;
+    }
+
+    s = Voices.stealFreeHead;
+    if (s == MIXER_NO_CHANNEL) {
+        // All the stealing channels are busy, cut the oldest fade
+        for (s = Voices.activeHead; !IS_STEALING(s); s = Voices.next[s]);
+        freeChannel(s);
+    }
+    Voices.stealFreeHead = Voices.next[s];
+
+    Channel[s] = Channel[i];
+    Channel[s].release_position = position;
+    Channel[s].release_delay = 0;
+
+    // Ends with the ramp, or with the sound if sooner
+    remaining = (int)((RELEASE_RAMP_LENGTH - position) * Channel[s].offsetSample);
+    if (Channel[s].byteIndex + remaining < Channel[s].nByte) {
+        Channel[s].nByte = Channel[s].byteIndex + remaining;
+    }
+    listAppend(Voices.next, Voices.prev, &Voices.activeHead, &Voices.activeTail, s);
+}
+
+/*
+ * \brief Pick the sound to replace when the polyphony is reached: a released one first,
+ *        then the quietest (velocity x release coefficient), then the oldest
+ */
+static unsigned int victimChannel(void)
+{
+    unsigned int i;
+    unsigned int victim = MIXER_NO_CHANNEL;
+    unsigned int victimReleased = 0;
+    int64_t victimLevel = 0;
+
+    // From the oldest, so that the oldest wins ties
+    for (i = Voices.activeHead; i != MIXER_NO_CHANNEL; i = Voices.next[i]) {
+        unsigned int released = Channel[i].release_position != 0;
+        int64_t level = (int64_t)Channel[i].velocity * (int64_t)ReleaseCoeff[Channel[i].release_position];
+
+        if (IS_STEALING(i)) {
+            continue;
+        }
+        if (victim == MIXER_NO_CHANNEL || released > victimReleased
+                || (released == victimReleased && level < victimLevel)) {
+            victim = i;
+            victimReleased = released;
+            victimLevel = level;
+        }
+    }
+    return victim;
+}
+
+/*
+ * \brief Take a free channel, or steal one if the polyphony is reached
+ * \return the index of the channel, to be set up then started with startChannel
+ */
+static unsigned int allocateChannel(void)
+{
+    unsigned int i = Voices.freeHead;
+
+    if (Voices.activeCount < Polyphony && i != MIXER_NO_CHANNEL) {
+        Voices.freeHead = Voices.next[i];
+    } else {
+        /* Replace a playing sound with the new one, it fades out */
+        i = victimChannel();
+        stealChannel(i);
+        unlinkChannel(i);
+        StealCount++;
+    }
+    return i;
+}
+
+/*
+ * \brief Insert a channel set up by the add functions in the active lists, as the newest
+ */
+static void startChannel(unsigned int i)
+{
+    unsigned int note = VOICE_BUCKET(Channel[i].noteID);
+    unsigned int choke = VOICE_BUCKET(Channel[i].chokeGroup);
+
+    listAppend(Voices.next, Voices.prev, &Voices.activeHead, &Voices.activeTail, i);
+    Voices.activeCount++;
+    listAppend(Voices.noteNext, Voices.notePrev, &Voices.noteHead[note], &Voices.noteTail[note], i);
+    listAppend(Voices.chokeNext, Voices.chokePrev, &Voices.chokeHead[choke], &Voices.chokeTail[choke], i);
+
+    // Nothing to play
+    if (Channel[i].byteIndex >= Channel[i].nByte) {
+        freeChannel(i);
+    }
+}
+
+/*
+ * \brief Give back an active channel which ended or was removed
+ */
+static void freeChannel(unsigned int i)
+{
+    unlinkChannel(i);
+    if (IS_STEALING(i)) {
+        Voices.next[i] = Voices.stealFreeHead;
+        Voices.stealFreeHead = i;
+    } else {
+        Voices.next[i] = Voices.freeHead;
+        Voices.freeHead = i;
+    }
+}
+
 /**
  * \brief  This function tries to add activate a ADD/Activate a channel in the mixer,
  *          remove the oldest if no empty channel was found \n
@@ -205,65 +555,28 @@ unsigned int mixer_addPCM16Stereo(uint64_t  startAddress,
         unsigned int fillChokeId)
 {
     unsigned char status = IntDisable();
-    unsigned int i;
-    unsigned int oldestIndex = 0;
-
-    //Find the first empty channel and initialize it
-    //Search also for the oldest sample (e.g. smallest unique ID)
-    for( i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++ ) {
-
-
-        if( Channel[i].byteIndex >= Channel[i].nByte ) {
-
-            Channel[i].add = (unsigned char*) startAddress;
-            Channel[i].nByte = nSample * 2;
-            Channel[i].byteIndex = 0 - (4 * nDelay);
-            Channel[i].velocity = vol;
-            Channel[i].timeiD = ++UniqueId;
-            Channel[i].chokeGroup =  chokeGroup;
-            Channel[i].offsetSample = 4;
-            Channel[i].offsetStereo = 2;
-            Channel[i].offsetNext = 2;
-            Channel[i].leftShift = 16;
-            Channel[i].rightShift = 8;
-            Channel[i].dataMask = 0x0000FFFF;
-            Channel[i].noteID = noteID;
-            Channel[i].fillChokeGroup = fillChokeGroup;
-            Channel[i].fillChokeDelay = fillChokeDelay * 4; // Convert value delay in sample to number of byte
-            Channel[i].fillChokePartId = fillChokeId;
-            Channel[i].release_position = 0;
-            Channel[i].release_delay = 0;
-            IntEnable(status);
-            return UniqueId;
-        } else {
-
-            /* Look for the smaller */
-            if ( Channel[i].timeiD < Channel[oldestIndex].timeiD ){
-                oldestIndex = i;
-            }
-        }
-    }
-
-    /* Replace the oldest with the new if no channel were found */
-    quickRelease(&Channel[oldestIndex]);
-    Channel[oldestIndex].add = (unsigned char*)startAddress;
-    Channel[oldestIndex].nByte = nSample * 2;
-    Channel[oldestIndex].byteIndex = 0 - (4 * nDelay);
-    Channel[oldestIndex].velocity = vol;
-    Channel[oldestIndex].timeiD = ++UniqueId;
-    Channel[oldestIndex].chokeGroup = chokeGroup;
-    Channel[oldestIndex].offsetSample = 4;
-    Channel[oldestIndex].offsetStereo = 2;
-    Channel[oldestIndex].offsetNext = 2;
-    Channel[oldestIndex].leftShift = 16;
-    Channel[oldestIndex].rightShift = 8;
-    Channel[oldestIndex].dataMask = 0x0000FFFF;
-    Channel[oldestIndex].noteID = noteID;
-    Channel[oldestIndex].fillChokeGroup = fillChokeGroup;
-    Channel[oldestIndex].fillChokeDelay = fillChokeDelay * 4;
-    Channel[oldestIndex].fillChokePartId = fillChokeId;
-    Channel[oldestIndex].release_position = 0;
-    Channel[oldestIndex].release_delay = 0;
+    unsigned int i = allocateChannel();
+
+    Channel[i].add = (unsigned char*) startAddress;
+    Channel[i].nByte = nSample * 2;
+    Channel[i].byteIndex = 0 - (4 * nDelay);
+    Channel[i].velocity = vol;
+    Channel[i].timeiD = ++UniqueId;
+    Channel[i].chokeGroup =  chokeGroup;
+    Channel[i].offsetSample = 4;
+    Channel[i].format = MIXER_FORMAT_PCM16_STEREO;
+    Channel[i].offsetStereo = 2;
+    Channel[i].offsetNext = 2;
+    Channel[i].leftShift = 16;
+    Channel[i].rightShift = 8;
+    Channel[i].dataMask = 0x0000FFFF;
+    Channel[i].noteID = noteID;
+    Channel[i].fillChokeGroup = fillChokeGroup;
+    Channel[i].fillChokeDelay = fillChokeDelay * 4; // Convert value delay in sample to number of byte
+    Channel[i].fillChokePartId = fillChokeId;
+    Channel[i].release_position = 0;
+    Channel[i].release_delay = 0;
+    startChannel(i);
 
     IntEnable(status);
     return UniqueId;
@@ -296,68 +609,29 @@ unsigned int mixer_addPCM16Mono(uint64_t  startAddress,
         unsigned int fillChokeDelay,
         unsigned int fillChokeId)
 {
-    unsigned int i;
-    unsigned int oldestIndex;
     unsigned char status = IntDisable();
-    // Get the first sound to initialise the minimum seeker */
-    oldestIndex =  0;
-
-    //Find the first empty channel and initialize it
-    //Search also for the oldest sample (e.g. smallest unique ID)
-    for( i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++ ) {
-
-
-        if( Channel[i].byteIndex >= Channel[i].nByte ) {
-
-            Channel[i].add = (unsigned char*) startAddress;
-            Channel[i].nByte = nSample * 2;
-            Channel[i].byteIndex = 0 - (2 * nDelay);
-            Channel[i].velocity = vol;
-            Channel[i].timeiD = ++UniqueId;
-            Channel[i].chokeGroup =  chokeGroup;
-            Channel[i].offsetSample = 2;
-            Channel[i].offsetStereo = 0;
-            Channel[i].offsetNext = 2;
-            Channel[i].leftShift = 16;
-            Channel[i].rightShift = 8;
-            Channel[i].dataMask = 0x0000FFFF;
-            Channel[i].noteID = noteID;
-            Channel[i].fillChokeGroup = fillChokeGroup;
-            Channel[i].fillChokeDelay = fillChokeDelay * 2;
-            Channel[i].fillChokePartId = fillChokeId;
-            Channel[i].release_position = 0;
-            Channel[i].release_delay = 0;
-            IntEnable(status);
-            return UniqueId;
-        } else {
-
-            /* Look for the smaller */
-            if ( Channel[i].timeiD < Channel[oldestIndex].timeiD ){
-                oldestIndex = i;
-            }
-        }
-    }
-
-    /* Replace the oldest with the new if no channel were found */
-    quickRelease(&Channel[oldestIndex]);
-    Channel[oldestIndex].add = (unsigned char*)startAddress;
-    Channel[oldestIndex].nByte = nSample * 2;
-    Channel[oldestIndex].byteIndex = 0 - (2 * nDelay);
-    Channel[oldestIndex].velocity = vol;
-    Channel[oldestIndex].timeiD = ++UniqueId;
-    Channel[oldestIndex].chokeGroup = chokeGroup;
-    Channel[oldestIndex].offsetSample = 2;
-    Channel[oldestIndex].offsetStereo = 0;
-    Channel[oldestIndex].offsetNext = 2;
-    Channel[oldestIndex].leftShift = 16;
-    Channel[oldestIndex].rightShift = 8;
-    Channel[oldestIndex].dataMask = 0x0000FFFF;
-    Channel[oldestIndex].noteID = noteID;
-    Channel[oldestIndex].fillChokeGroup = fillChokeGroup;
-    Channel[oldestIndex].fillChokeDelay = fillChokeDelay * 2;
-    Channel[oldestIndex].fillChokePartId = fillChokeId;
-    Channel[oldestIndex].release_position = 0;
-    Channel[oldestIndex].release_delay = 0;
+    unsigned int i = allocateChannel();
+
+    Channel[i].add = (unsigned char*) startAddress;
+    Channel[i].nByte = nSample * 2;
+    Channel[i].byteIndex = 0 - (2 * nDelay);
+    Channel[i].velocity = vol;
+    Channel[i].timeiD = ++UniqueId;
+    Channel[i].chokeGroup =  chokeGroup;
+    Channel[i].offsetSample = 2;
+    Channel[i].format = MIXER_FORMAT_PCM16_MONO;
+    Channel[i].offsetStereo = 0;
+    Channel[i].offsetNext = 2;
+    Channel[i].leftShift = 16;
+    Channel[i].rightShift = 8;
+    Channel[i].dataMask = 0x0000FFFF;
+    Channel[i].noteID = noteID;
+    Channel[i].fillChokeGroup = fillChokeGroup;
+    Channel[i].fillChokeDelay = fillChokeDelay * 2;
+    Channel[i].fillChokePartId = fillChokeId;
+    Channel[i].release_position = 0;
+    Channel[i].release_delay = 0;
+    startChannel(i);
 
     IntEnable(status);
     return UniqueId;
@@ -387,72 +661,31 @@ unsigned int mixer_addPCM24Stereo(uint64_t  startAddress,
         unsigned int noteID,
         unsigned int fillChokeGroup,
         unsigned int fillChokeDelay,
-        unsigned int fillChokeId){
-
-
-    unsigned int i;
-    unsigned int oldestIndex;
+        unsigned int fillChokeId)
+{
     unsigned char status = IntDisable();
-
-
-    // Get the first sound to initialise the minimum seeker */
-    oldestIndex =  0;
-
-    //Find the first empty channel and initialize it
-    //Search also for the oldest sample (e.g. smallest unique ID)
-    for( i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++ ) {
-
-
-        if( Channel[i].byteIndex >= Channel[i].nByte ) {
-
-            Channel[i].add = (unsigned char*) startAddress;
-            Channel[i].nByte = nSample * 3;
-            Channel[i].byteIndex = 0 - (6 * nDelay);
-            Channel[i].velocity = vol;
-            Channel[i].timeiD = ++UniqueId;
-            Channel[i].chokeGroup =  chokeGroup;
-            Channel[i].offsetSample = 6;
-            Channel[i].offsetStereo = 3;
-            Channel[i].offsetNext = 3;
-            Channel[i].leftShift = 8;
-            Channel[i].rightShift = 8;
-            Channel[i].dataMask = 0x00FFFFFF;
-            Channel[i].noteID = noteID;
-            Channel[i].fillChokeGroup = fillChokeGroup;
-            Channel[i].fillChokeDelay = fillChokeDelay * 6;
-            Channel[i].fillChokePartId = fillChokeId;
-            Channel[i].release_position = 0;
-            Channel[i].release_delay = 0;
-            IntEnable(status);
-            return UniqueId;
-        } else {
-
-            /* Look for the smaller */
-            if ( Channel[i].timeiD < Channel[oldestIndex].timeiD ){
-                oldestIndex = i;
-            }
-        }
-    }
-    /* Replace the oldest with the new if no channel were found */
-    quickRelease(&Channel[oldestIndex]);
-    Channel[oldestIndex].add = (unsigned char*) startAddress;
-    Channel[oldestIndex].nByte = nSample * 3;
-    Channel[oldestIndex].byteIndex = 0 - (6 * nDelay);
-    Channel[oldestIndex].velocity = vol;
-    Channel[oldestIndex].timeiD = ++UniqueId;
-    Channel[oldestIndex].chokeGroup = chokeGroup;
-    Channel[oldestIndex].offsetSample = 6;
-    Channel[oldestIndex].offsetStereo = 3;
-    Channel[oldestIndex].offsetNext = 3;
-    Channel[oldestIndex].leftShift = 8;
-    Channel[oldestIndex].rightShift = 8;
-    Channel[oldestIndex].dataMask = 0x00FFFFFF;
-    Channel[oldestIndex].noteID = noteID;
-    Channel[oldestIndex].fillChokeGroup = fillChokeGroup;
-    Channel[oldestIndex].fillChokeDelay = fillChokeDelay * 6;
-    Channel[oldestIndex].fillChokePartId = fillChokeId;
-    Channel[oldestIndex].release_position = 0;
-    Channel[oldestIndex].release_delay = 0;
+    unsigned int i = allocateChannel();
+
+    Channel[i].add = (unsigned char*) startAddress;
+    Channel[i].nByte = nSample * 3;
+    Channel[i].byteIndex = 0 - (6 * nDelay);
+    Channel[i].velocity = vol;
+    Channel[i].timeiD = ++UniqueId;
+    Channel[i].chokeGroup =  chokeGroup;
+    Channel[i].offsetSample = 6;
+    Channel[i].format = MIXER_FORMAT_PCM24_STEREO;
+    Channel[i].offsetStereo = 3;
+    Channel[i].offsetNext = 3;
+    Channel[i].leftShift = 8;
+    Channel[i].rightShift = 8;
+    Channel[i].dataMask = 0x00FFFFFF;
+    Channel[i].noteID = noteID;
+    Channel[i].fillChokeGroup = fillChokeGroup;
+    Channel[i].fillChokeDelay = fillChokeDelay * 6;
+    Channel[i].fillChokePartId = fillChokeId;
+    Channel[i].release_position = 0;
+    Channel[i].release_delay = 0;
+    startChannel(i);
 
     IntEnable(status);
     return UniqueId;
@@ -484,70 +717,138 @@ unsigned int mixer_addPCM24Mono(uint64_t  startAddress,
         unsigned int fillChokeDelay,
         unsigned int fillChokeId)
 {
+    unsigned char status = IntDisable();
+    unsigned int i = allocateChannel();
+
+    Channel[i].add = (unsigned char*) startAddress;
+    Channel[i].nByte = nSample * 3;
+    Channel[i].byteIndex = 0 - (3 * nDelay);
+    Channel[i].velocity = vol;
+    Channel[i].timeiD = ++UniqueId;
+    Channel[i].chokeGroup =  chokeGroup;
+    Channel[i].offsetSample = 3;
+    Channel[i].format = MIXER_FORMAT_PCM24_MONO;
+    Channel[i].offsetStereo = 0;
+    Channel[i].offsetNext = 3;
+    Channel[i].leftShift = 8;
+    Channel[i].rightShift = 8;
+    Channel[i].dataMask = 0x00FFFFFF;
+    Channel[i].noteID = noteID;
+    Channel[i].fillChokeGroup = fillChokeGroup;
+    Channel[i].fillChokeDelay = fillChokeDelay * 3;
+    Channel[i].fillChokePartId = fillChokeId;
+    Channel[i].release_position = 0;
+    Channel[i].release_delay = 0;
+    startChannel(i);
 
-    unsigned int i;
-    unsigned int oldestIndex;
+    IntEnable(status);
+    return UniqueId;
+}
+
+
+/**
+ * \brief  This function tries to add activate a ADD/Activate a channel in the mixer,
+ *          remove the oldest if no empty channel was found \n
+ *          Samples are 24 bits values sign extended to 32 bits, as decoded by SoundManager
+ *
+ * \param  startAddress   Start address of the channel, aligned on 4 bytes .\n
+ * \param  nSample         Number of sample (sum of left and right samples) .\n
+ * \param  vol            Volume of the track : 0 @ 200;
+ *
+ * \return the unique ID of the sample
+ **/
+#if !(defined(__x86_64__) || defined(_M_X64))
+unsigned int mixer_addPCM24DecodedStereo(unsigned int startAddress,
+#else
+unsigned int mixer_addPCM24DecodedStereo(uint64_t  startAddress,
+#endif
+        unsigned int nSample,
+        unsigned int vol,
+        unsigned int nDelay,
+        unsigned int chokeGroup,
+        unsigned int noteID,
+        unsigned int fillChokeGroup,
+        unsigned int fillChokeDelay,
+        unsigned int fillChokeId)
+{
     unsigned char status = IntDisable();
+    unsigned int i = allocateChannel();
+
+    Channel[i].add = (unsigned char*) startAddress;
+    Channel[i].nByte = nSample * 4;
+    Channel[i].byteIndex = 0 - (8 * nDelay);
+    Channel[i].velocity = vol;
+    Channel[i].timeiD = ++UniqueId;
+    Channel[i].chokeGroup =  chokeGroup;
+    Channel[i].offsetSample = 8;
+    Channel[i].format = MIXER_FORMAT_PCM24_DECODED_STEREO;
+    Channel[i].offsetStereo = 4;
+    Channel[i].offsetNext = 4;
+    Channel[i].leftShift = 0;
+    Channel[i].rightShift = 0;
+    Channel[i].dataMask = -1;
+    Channel[i].noteID = noteID;
+    Channel[i].fillChokeGroup = fillChokeGroup;
+    Channel[i].fillChokeDelay = fillChokeDelay * 8;
+    Channel[i].fillChokePartId = fillChokeId;
+    Channel[i].release_position = 0;
+    Channel[i].release_delay = 0;
+    startChannel(i);
+
+    IntEnable(status);
+    return UniqueId;
+}
 
 
-    // Get the first sound to initialise the minimum seeker */
-    oldestIndex =  0;
-
-    //Find the first empty channel and initialize it
-    //Search also for the oldest sample (e.g. smallest unique ID)
-    for( i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++ ) {
-
-
-        if( Channel[i].byteIndex >= Channel[i].nByte ) {
-
-            Channel[i].add = (unsigned char*) startAddress;
-            Channel[i].nByte = nSample * 3;
-            Channel[i].byteIndex = 0 - (3 * nDelay);
-            Channel[i].velocity = vol;
-            Channel[i].timeiD = ++UniqueId;
-            Channel[i].chokeGroup =  chokeGroup;
-            Channel[i].offsetSample = 3;
-            Channel[i].offsetStereo = 0;
-            Channel[i].offsetNext = 3;
-            Channel[i].leftShift = 8;
-            Channel[i].rightShift = 8;
-            Channel[i].dataMask = 0x00FFFFFF;
-            Channel[i].noteID = noteID;
-            Channel[i].fillChokeGroup = fillChokeGroup;
-            Channel[i].fillChokeDelay = fillChokeDelay * 3;
-            Channel[i].fillChokePartId = fillChokeId;
-            Channel[i].release_position = 0;
-            Channel[i].release_delay = 0;
-            IntEnable(status);
-            return UniqueId;
-        } else {
-
-            /* Look for the smaller */
-            if ( Channel[i].timeiD < Channel[oldestIndex].timeiD ){
-                oldestIndex = i;
-            }
-        }
-    }
-    /* Replace the oldest with the new if no channel were found */
-    quickRelease(&Channel[oldestIndex]);
-    Channel[oldestIndex].add = (unsigned char*)startAddress;
-    Channel[oldestIndex].nByte = nSample * 3;
-    Channel[oldestIndex].byteIndex = 0 - (3 * nDelay);
-    Channel[oldestIndex].velocity = vol;
-    Channel[oldestIndex].timeiD = ++UniqueId;
-    Channel[oldestIndex].chokeGroup = chokeGroup;
-    Channel[oldestIndex].offsetSample = 3;
-    Channel[oldestIndex].offsetStereo = 0;
-    Channel[oldestIndex].offsetNext = 3;
-    Channel[oldestIndex].leftShift = 8;
-    Channel[oldestIndex].rightShift = 8;
-    Channel[oldestIndex].dataMask = 0x00FFFFFF;
-    Channel[oldestIndex].noteID = noteID;
-    Channel[oldestIndex].fillChokeGroup = fillChokeGroup;
-    Channel[oldestIndex].fillChokeDelay = fillChokeDelay * 3;
-    Channel[oldestIndex].fillChokePartId = fillChokeId;
-    Channel[oldestIndex].release_position = 0;
-    Channel[oldestIndex].release_delay = 0;
+
+/**
+ * \brief  This function tries to add activate a ADD/Activate a channel in the mixer,
+ *          remove the oldest if no empty channel was found \n
+ *          Samples are 24 bits values sign extended to 32 bits, as decoded by SoundManager
+ *
+ * \param  startAddress   Start address of the channel, aligned on 4 bytes .\n
+ * \param  nSample         Number of sample .\n
+ * \param  vol            Volume of the track : 0 @ 200;
+ *
+ * \return the unique ID of the sample
+ **/
+#if !(defined(__x86_64__) || defined(_M_X64))
+unsigned int mixer_addPCM24DecodedMono(unsigned int startAddress,
+#else
+unsigned int mixer_addPCM24DecodedMono(uint64_t  startAddress,
+#endif
+        unsigned int nSample,
+        unsigned int vol,
+        unsigned int nDelay,
+        unsigned int chokeGroup,
+        unsigned int noteID,
+        unsigned int fillChokeGroup,
+        unsigned int fillChokeDelay,
+        unsigned int fillChokeId)
+{
+    unsigned char status = IntDisable();
+    unsigned int i = allocateChannel();
+
+    Channel[i].add = (unsigned char*) startAddress;
+    Channel[i].nByte = nSample * 4;
+    Channel[i].byteIndex = 0 - (4 * nDelay);
+    Channel[i].velocity = vol;
+    Channel[i].timeiD = ++UniqueId;
+    Channel[i].chokeGroup =  chokeGroup;
+    Channel[i].offsetSample = 4;
+    Channel[i].format = MIXER_FORMAT_PCM24_DECODED_MONO;
+    Channel[i].offsetStereo = 0;
+    Channel[i].offsetNext = 4;
+    Channel[i].leftShift = 0;
+    Channel[i].rightShift = 0;
+    Channel[i].dataMask = -1;
+    Channel[i].noteID = noteID;
+    Channel[i].fillChokeGroup = fillChokeGroup;
+    Channel[i].fillChokeDelay = fillChokeDelay * 4;
+    Channel[i].fillChokePartId = fillChokeId;
+    Channel[i].release_position = 0;
+    Channel[i].release_delay = 0;
+    startChannel(i);
 
     IntEnable(status);
     return UniqueId;
@@ -567,7 +868,7 @@ void mixer_chokeChannel(unsigned int chokeGroup,unsigned int nDelay)
     unsigned int i, tmp;
     unsigned char status = IntDisable();
 
-    for (i=0; i<MIXER_MAX_CHANNEL_ARRAY; i++){
+    for (i = Voices.chokeHead[VOICE_BUCKET(chokeGroup)]; i != MIXER_NO_CHANNEL; i = Voices.chokeNext[i]){
 
         // Adjust the delay to stop the sound at the right time
         if (Channel[i].chokeGroup == chokeGroup){
@@ -588,7 +889,7 @@ void mixer_chokeNote(uint32_t note) {
     uint32_t i;
     uint8_t status = IntDisable();
 
-    for (i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++) {
+    for (i = Voices.noteHead[VOICE_BUCKET(note)]; i != MIXER_NO_CHANNEL; i = Voices.noteNext[i]) {
         if (Channel[i].noteID == note) {
 
             if (Channel[i].byteIndex <= Channel[i].nByte && Channel[i].release_position == 0){
@@ -606,8 +907,7 @@ void mixer_chokeNote(uint32_t note) {
 // Polyphony Manager
 void mixer_polyphonyRemove(unsigned int note, unsigned int nLimit, unsigned nDelay){
     unsigned int i;
-    unsigned int oldestId = 0xFFFFFFFFu;
-    unsigned int oldestIndex = 0;
+    unsigned int oldestIndex = MIXER_NO_CHANNEL;
     unsigned int activeCnt = 0;
     unsigned int tmp;
 
@@ -616,19 +916,13 @@ void mixer_polyphonyRemove(unsigned int note, unsigned int nLimit, unsigned nDel
 
     // A polyphoniy of zero if unlimited power!
     if (nLimit){
-        // For all the channel in the mixer
-        for (i=0; i<MIXER_MAX_CHANNEL_ARRAY; i++){
-
-            // Scan for any active channel with the corresponding note
+        // Active channels of the note, from the oldest
+        for (i = Voices.noteHead[VOICE_BUCKET(note)]; i != MIXER_NO_CHANNEL; i = Voices.noteNext[i]){
             if (Channel[i].noteID == note){
-                if (Channel[i].byteIndex < Channel[i].nByte){
-                    activeCnt++;
-                    if (Channel[i].timeiD < oldestId){
-                        oldestId = Channel[i].timeiD;
-                        oldestIndex = i;
-                    }
+                activeCnt++;
+                if (oldestIndex == MIXER_NO_CHANNEL){
+                    oldestIndex = i;
                 }
-
             }
         }
 
@@ -636,7 +930,7 @@ void mixer_polyphonyRemove(unsigned int note, unsigned int nLimit, unsigned nDel
 
             tmp = Channel[oldestIndex].byteIndex + (nDelay * (Channel[oldestIndex].offsetSample));
 
-            if (tmp <= Channel[oldestIndex].nByte && Channel[i].release_position == 0){
+            if (tmp <= Channel[oldestIndex].nByte && Channel[oldestIndex].release_position == 0){
 
                 Channel[oldestIndex].release_delay = nDelay;
                 Channel[oldestIndex].release_position = 1;
@@ -653,23 +947,19 @@ unsigned int mixer_shouldNoteBeExcluded(unsigned int fillChokeGroup, unsigned in
 
     unsigned int i;
     unsigned char status = IntDisable();
-    // Scan the mixer channel array
-    for (i = 0 ; i < MIXER_MAX_CHANNEL_ARRAY; i++){
+    // Scan the active channels, stolen sounds fading out do not count
+    for (i = Voices.activeHead; i != MIXER_NO_CHANNEL; i = Voices.next[i]){
 
-        // if channel is active
-        if (Channel[i].byteIndex < Channel[i].nByte){
+        // if same fill choke group note
+        if (!IS_STEALING(i) && Channel[i].fillChokeGroup == fillChokeGroup){
 
-            // if same fill choke group note
-            if (Channel[i].fillChokeGroup == fillChokeGroup){
+            // if not the same choke id
+            if (Channel[i].fillChokePartId != fillChokeId){
 
-                // if not the same choke id
-                if (Channel[i].fillChokePartId != fillChokeId){
-
-                    // if the fill choke delay is not finished
-                    if (Channel[i].byteIndex < Channel[i].fillChokeDelay){
-                        IntEnable(status);
-                        return 1;
-                    }
+                // if the fill choke delay is not finished
+                if (Channel[i].byteIndex < Channel[i].fillChokeDelay){
+                    IntEnable(status);
+                    return 1;
                 }
             }
         }
@@ -686,12 +976,13 @@ unsigned int mixer_shouldNoteBeExcluded(unsigned int fillChokeGroup, unsigned in
  **/
 void mixer_removeAll(void)
 {
-    unsigned char i;
+    unsigned int i;
     unsigned char status = IntDisable();
 
-    for( i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++ ) {
+    for( i = 0; i < MIXER_TOTAL_CHANNELS; i++ ) {
         Channel[i].nByte = 0;
     }
+    resetVoices();
 
     /* Restart the unique id */
     UniqueId = 0;
@@ -701,14 +992,15 @@ void mixer_removeAll(void)
 
 
 void mixer_removeSoundWithNote(unsigned int note){
-    int i;
+    unsigned int i, next;
     unsigned char status = IntDisable();
 
-    for(i = 0 ; i < MIXER_MAX_CHANNEL_ARRAY; i++){
+    for(i = Voices.noteHead[VOICE_BUCKET(note)]; i != MIXER_NO_CHANNEL; i = next){
+        next = Voices.noteNext[i];
         // Of note of the instrument is the requested note, remove the instrument
         if (Channel[i].noteID == note){
-            quickRelease(&Channel[i]);
             Channel[i].nByte = 0;
+            freeChannel(i);
         }
     }
 
@@ -723,16 +1015,17 @@ void mixer_removeSoundWithAddress(unsigned int addr, unsigned int range){
     unsigned int numOfRemovedChan = 0;
     unsigned int lowerAddress = (unsigned int) addr;
     unsigned int upperAddress = ((unsigned int) addr) + range;
-    unsigned int i;
+    unsigned int i, next;
 
     unsigned char status = IntDisable();
 
-    // For all the channel of the mixer
-    for (i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++){
+    // For all the active channels of the mixer
+    for (i = Voices.activeHead; i != MIXER_NO_CHANNEL; i = next){
+        next = Voices.next[i];
         if (((unsigned int)Channel[i].add >= lowerAddress) && ((unsigned int)Channel[i].add < upperAddress)) {
-            quickRelease(&Channel[i]);
             // This action wil remove the sound from the player.
             Channel[i].nByte = 0;
+            freeChannel(i);
             numOfRemovedChan++;
 
         }
@@ -744,16 +1037,17 @@ void mixer_removeSoundWithAddress(uint64_t addr, unsigned int range){
     unsigned int numOfRemovedChan = 0;
     uint64_t lowerAddress = (uint64_t) addr;
     uint64_t upperAddress = ((uint64_t) addr) + range;
-    unsigned int i;
+    unsigned int i, next;
 
     unsigned char status = IntDisable();
 
-    // For all the channel of the mixer
-    for (i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++){
+    // For all the active channels of the mixer
+    for (i = Voices.activeHead; i != MIXER_NO_CHANNEL; i = next){
+        next = Voices.next[i];
         if (((uint64_t)Channel[i].add >= lowerAddress) && ((uint64_t)Channel[i].add < upperAddress)) {
-            quickRelease(&Channel[i]);
             // This action wil remove the sound from the player.
             Channel[i].nByte = 0;
+            freeChannel(i);
             numOfRemovedChan++;
         }
     }
@@ -761,6 +1055,36 @@ void mixer_removeSoundWithAddress(uint64_t addr, unsigned int range){
 }
 #endif
 
+/**
+ *  \brief This function counts the channels still playing a sound located in the address range
+ */
+#if !(defined(__x86_64__) || defined(_M_X64))
+unsigned int mixer_countSoundWithAddress(unsigned int addr, unsigned int range){
+    unsigned int lowerAddress = (unsigned int) addr;
+    unsigned int upperAddress = ((unsigned int) addr) + range;
+#else
+unsigned int mixer_countSoundWithAddress(uint64_t addr, unsigned int range){
+    uint64_t lowerAddress = (uint64_t) addr;
+    uint64_t upperAddress = ((uint64_t) addr) + range;
+#endif
+    unsigned int count = 0;
+    unsigned int i;
+
+    unsigned char status = IntDisable();
+
+    for (i = Voices.activeHead; i != MIXER_NO_CHANNEL; i = Voices.next[i]){
+#if !(defined(__x86_64__) || defined(_M_X64))
+        if (((unsigned int)Channel[i].add >= lowerAddress) && ((unsigned int)Channel[i].add < upperAddress)) {
+#else
+        if (((uint64_t)Channel[i].add >= lowerAddress) && ((uint64_t)Channel[i].add < upperAddress)) {
+#endif
+            count++;
+        }
+    }
+    IntEnable(status);
+    return count;
+}
+
 /**
  * @brief mixer_setOutputLevel
  *       Set the output level of the data stream. The multiplication is made at the end of the audio processing
@@ -784,7 +1108,6 @@ float mixer_getOutputLevel(void){
 #define PI  (3.1415926535897932384626433832795)
 
 
-static unsigned int tt = 0;
 /* Function handler of the EMPTY DMA
  */
 void mixer_ReadOutputStream(signed short * buff, unsigned int length)
@@ -792,19 +1115,40 @@ void mixer_ReadOutputStream(signed short * buff, unsigned int length)
 
     // NOTE: length is in absolute sample count (regardless of stereo/mono)
 
+    unsigned int frames = length / 2;
+    unsigned int offset;
+    unsigned int n;
+
+    unsigned char status = IntDisable();
+
+    // Mixed block by block, only the accumulators of the current block are cleared,
+    // then converted to 16 bits by the kernels without any 64 bits division
+    for (offset = 0; offset < frames; offset += n) {
+        n = (frames - offset) < MIXER_BLOCK_FRAMES ? (frames - offset) : MIXER_BLOCK_FRAMES;
+        mixBlock(n);
+        Kernels->output(L_Buffer, R_Buffer, g_level, &buff[2 * offset], n);
+    }
+    IntEnable(status);
+
+}
+
+/* Mix the next frames of all the channels into the accumulators
+ */
+static void mixBlock(unsigned int frames)
+{
     unsigned int k;
     unsigned int i;
+    unsigned int next;
+    unsigned int n;
+    int64_t gain;
     MIXER_channel_t *chanPtr;
-    long tmp;
 
-    memset(R_Buffer,0,sizeof(R_Buffer));
-    memset(L_Buffer,0,sizeof(L_Buffer));
-
-    unsigned char status = IntDisable();
+    memset(R_Buffer,0,frames * sizeof(R_Buffer[0]));
+    memset(L_Buffer,0,frames * sizeof(L_Buffer[0]));
 
     /* For production only  ( the inversion is normal) */
     if (gLeftFreq | gRightFreq){
-        for ( i = 0; i < MIXER_BUFFER_LENGTH; i++ ) {
+        for ( i = 0; i < frames; i++ ) {
             if (gLeftFreq){
                 R_Buffer[i] =   (signed long long) (800000000.0 * cos( 2.0 * PI *  gLeftFreq *(double)tt/44100.0));
             } else {
@@ -818,14 +1162,24 @@ void mixer_ReadOutputStream(signed short * buff, unsigned int length)
             tt = (tt + 1) % 44100;
         }
     } else {
-        /* For each channel present in the mixer */
-        for ( i = 0; i < MIXER_MAX_CHANNEL_ARRAY; i++ ) {
+        /* For each active channel of the mixer */
+        for ( i = Voices.activeHead; i != MIXER_NO_CHANNEL; i = next ) {
+            next = Voices.next[i];
             chanPtr = &Channel[i];
             k = 0;
+            gain = (int64_t)ReleaseCoeff[0] * (int64_t)chanPtr->velocity;
 
-            while(k<(length/2)){
+            while(k<frames){
                 if (chanPtr->byteIndex < chanPtr->nByte){
-                    if (chanPtr->byteIndex >= 0){
+                    if (chanPtr->byteIndex >= 0 && !chanPtr->release_position && gain >= 0 && gain <= UINT32_MAX){
+                        // Constant gain until the end of the sound or of the block, mixed by the kernel of the format
+                        n = (chanPtr->nByte - chanPtr->byteIndex + chanPtr->offsetSample - 1) / chanPtr->offsetSample;
+                        n = n < (frames - k) ? n : (frames - k);
+                        Kernels->mix[chanPtr->format](&chanPtr->add[chanPtr->byteIndex], (uint32_t)gain, &L_Buffer[k], &R_Buffer[k], n);
+                        chanPtr->byteIndex += n * chanPtr->offsetSample;
+                        k += n;
+                        continue;
+                    } else if (chanPtr->byteIndex >= 0){
 
                         /* The calculation id based on 4 step:
                          * #1 - Read 4 byte ( they can be unaligned since the increment between sample is not  always 4)
@@ -862,78 +1216,15 @@ void mixer_ReadOutputStream(signed short * buff, unsigned int length)
                     break;
                 }
             }
-        }
-    }
-
-    k = 0;
-    i = 0;
 
-    while(k < length){
-        // LEFT HARD CLIP
-        tmp = (L_Buffer[i]/MASTER_DIVIDER);
-
-        tmp = tmp > MAX_VALUE ? MAX_VALUE : tmp;
-        tmp = tmp < MIN_VALUE ? MIN_VALUE : tmp;
-        buff[k++] = ((int)(g_level * (float)tmp)) >> 8;
-
-        // RIGHT HARD CLIP
-        tmp = (R_Buffer[i++]/MASTER_DIVIDER);
-
-        tmp = tmp > MAX_VALUE ? MAX_VALUE : tmp;
-        tmp = tmp < MIN_VALUE ? MIN_VALUE : tmp;
-        buff[k++] = ((int)(g_level * (float)tmp)) >> 8;
-    }
-    IntEnable(status);
-
-}
-
-static inline void quickRelease(MIXER_channel_t *chanPtr) {
-
-    int k = 0;
-
-    while(k<(BUFFER_LENGTH/2)){
-        if (chanPtr->byteIndex < chanPtr->nByte){
-            if (chanPtr->byteIndex >= 0){
-
-                /* The calculation id based on 4 step:
-                 * #1 - Read 4 byte ( they can be unaligned since the increment between sample is not  always 4)
-                 * #2 - Type cast those byte into an integer
-                 * #3 - Mask the integer to get the important values
-                 * #4 - Bit shift left and bit shift right for sign extension. Typecast the result into a 64 bits
-                 * #5 - Multiply the result with the gain
-                 * #6 - Multiply with the release gain value
-                 */
-                L_Buffer[k]  +=  ((int64_t)((BUFFER_LENGTH/2) - k)) * (int64_t)ReleaseCoeff[chanPtr->release_position] * (int64_t) GET_SAMPLE_VALUE(chanPtr) / (int64_t)(BUFFER_LENGTH/2);
-                NEXT_RIGHT_SAMPLE(chanPtr);
-
-                R_Buffer[k]  +=  ((int64_t)((BUFFER_LENGTH/2) - k)) * (int64_t)ReleaseCoeff[chanPtr->release_position] * (int64_t) GET_SAMPLE_VALUE(chanPtr) / (int64_t)(BUFFER_LENGTH/2);
-                NEXT_LEFT_SAMPLE(chanPtr);
-
-
-                // Decrement release delay if it is set
-                if (!chanPtr->release_delay){
-                    chanPtr->release_delay--;
-                } else {
-
-                    // when the release delay equal 0, if the release position exist, advance in the release array
-                    if (chanPtr->release_position){
-                        chanPtr->release_position++;
-                        if (chanPtr->release_position >= ReleaseLength){
-                            chanPtr->nByte = 0;
-                        }
-                    }
-                }
-            } else {
-                chanPtr->byteIndex += chanPtr->offsetSample;
+            // The sound ended or its release is over
+            if (chanPtr->byteIndex >= chanPtr->nByte) {
+                freeChannel(i);
             }
-            k++;
-        } else {
-            break;
         }
     }
 }
 
-
 #ifdef __cplusplus
 }
 #endif
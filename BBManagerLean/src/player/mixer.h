@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "mixerKernels.h"
 
 /*****************************************************************************
  **                     DEFINES
@@ -15,6 +16,8 @@ extern "C" {
 // 100 was defined arbitrarily to sound good and not to lag too much
 // On PC, buffers that are smaller than 80 ms cause distortion at the beginning of song or starving during the whole song.
 #    define MIXER_MIN_BUFFERRING_TIME_MS                    ( 50)
+// In pull mode the sound card requests data itself, there is no polling jitter to absorb
+#    define MIXER_MIN_PULL_BUFFERRING_TIME_MS               ( 20)
 #    define MIXER_DEFAULT_BUFFERRING_TIME_MS                (100)
 #    define MIXER_MAX_BUFFERRING_TIME_MS                    (500)
 #    define MIXER_BUFFERRING_TIME_MS_TO_SMAPLES(time)       (44100 * time / 1000)
@@ -26,10 +29,28 @@ extern "C" {
 #    define MIXER_BUFFER_LENGTH_BYTES_MONO                  (MIXER_BUFFER_LENGTH_SAMPLES * MIXER_BYTES_PER_SAMPLE_MONO)
 #    define MIXER_BUFFER_LENGTH_BYTES_STEREO                (MIXER_BUFFER_LENGTH_SAMPLES * MIXER_BYTES_PER_SAMPLE_STEREO)
 
+// Number of sounds playing at a time, a new sound beyond it replaces a playing one
+#    define MIXER_MIN_POLYPHONY                             ( 32u)
+#    define MIXER_DEFAULT_POLYPHONY                         ( 64u)
+#    define MIXER_MAX_POLYPHONY                             (256u)
+// Number of stolen sounds fading out at a time, on top of the polyphony
+#    define MIXER_STEAL_CHANNELS                            (  8u)
+
+
+/*****************************************************************************
+ **                     TYPEDEF
+ *****************************************************************************/
+/* Mixer instance, all the mixer_* functions work on the one bound to the calling thread */
+typedef struct MIXER_State MIXER_State;
+
 
 /*****************************************************************************
  **                     FUNCTION PROTOTYPES
  *****************************************************************************/
+MIXER_State *mixer_createState(void);
+void mixer_destroyState(MIXER_State *state);
+MIXER_State *mixer_bindState(MIXER_State *state);
+
 void mixer_init(void);
 
 void mixer_task(void);
@@ -90,12 +111,46 @@ unsigned int mixer_addPCM16Mono(uint64_t  startAddress,
         unsigned int fillChokeDelay,
         unsigned int fillChokeId);
 
+#if !(defined(__x86_64__) || defined(_M_X64))
+unsigned int mixer_addPCM24DecodedStereo(unsigned int startAddress,
+#else
+unsigned int mixer_addPCM24DecodedStereo(uint64_t  startAddress,
+#endif
+        unsigned int nSample,
+        unsigned int vol,
+        unsigned int nDelay,
+        unsigned int chokeID,
+        unsigned int noteID,
+        unsigned int fillChokeGroup,
+        unsigned int fillChokeDelay,
+        unsigned int fillChokeId);
+
+#if !(defined(__x86_64__) || defined(_M_X64))
+unsigned int mixer_addPCM24DecodedMono(unsigned int startAddress,
+#else
+unsigned int mixer_addPCM24DecodedMono(uint64_t  startAddress,
+#endif
+        unsigned int nSample,
+        unsigned int vol,
+        unsigned int nDelay,
+        unsigned int chokeID,
+        unsigned int noteID,
+        unsigned int fillChokeGroup,
+        unsigned int fillChokeDelay,
+        unsigned int fillChokeId);
+
 #if !(defined(__x86_64__) || defined(_M_X64))
 void mixer_removeSoundWithAddress(unsigned int addr, unsigned int range);
 #else
 void mixer_removeSoundWithAddress(uint64_t addr, unsigned int range);
 #endif
 
+#if !(defined(__x86_64__) || defined(_M_X64))
+unsigned int mixer_countSoundWithAddress(unsigned int addr, unsigned int range);
+#else
+unsigned int mixer_countSoundWithAddress(uint64_t addr, unsigned int range);
+#endif
+
 void mixer_removeSoundWithNote(unsigned int note);
 
 void mixer_polyphonyRemove(unsigned int note,
@@ -113,6 +168,14 @@ float mixer_getOutputLevel(void);
 void mixer_setOutputLevel(float level);
 void mixer_ReadOutputStream(signed short * buff, unsigned int length);
 void mixer_setDitheringBits(int ditheringBits);
+const char *mixer_getKernelsName(void);
+void mixer_setKernels(const MIXERKERNELS_set_t *kernels);
+
+void mixer_setPolyphony(unsigned int voices);
+unsigned int mixer_getPolyphony(void);
+unsigned int mixer_getStealCount(void);
+unsigned int mixer_getVoiceCount(void);
+void mixer_resetStealCount(void);
 
 void mixer_setLeftFreq(unsigned int freq);
 void mixer_setRightFreq(unsigned int freq);
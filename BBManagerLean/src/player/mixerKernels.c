@@ -0,0 +1,911 @@
+/*
+  	This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+ 	BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "mixerKernels.h"
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#    define MIXER_KERNELS_X86
+#    include <immintrin.h>
+#    if defined(_MSC_VER)
+#        include <intrin.h>
+#    endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#    define MIXER_KERNELS_NEON
+#    include <arm_neon.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/******************************************************************************
+ **                         INTERNAL MACROS
+ ******************************************************************************/
+
+// GCC and Clang only emit AVX2 instructions in the functions asking for it, MSVC always can
+#if defined(__GNUC__)
+#    define TARGET_AVX2             __attribute__((target("avx2")))
+#else
+#    define TARGET_AVX2
+#endif
+
+// The SIMD kernels multiply unsigned 32 bits values: samples are biased to be positive,
+// and the bias is removed from the 64 bits products, s * gain = (s + bias) * gain - bias * gain
+#define PCM16_BIAS                  (0x8000)
+#define PCM16_BIAS_SHIFT            (15)
+#define PCM24_BIAS                  (0x800000)
+#define PCM24_BIAS_SHIFT            (23)
+
+// 16 bits samples are mixed at the 24 bits scale
+#define PCM16_TO_PCM24_SHIFT        (8)
+
+// Output conversion without any 64 bits division: acc / MIXER_MASTER_DIVIDER ~= (acc >> OUTPUT_SHIFT) * OUTPUT_UNIT.
+// Any accumulator shifted fits 32 bits, a step is 1.7 units of 24 bits, 1/149 of an output LSB
+#define OUTPUT_SHIFT                (34)
+#define OUTPUT_UNIT                 ((float)((double)(1LL << OUTPUT_SHIFT) / (double)MIXER_MASTER_DIVIDER))
+
+#define SELF_TEST_BUFFER_SIZE       (1024)
+#define SELF_TEST_MAX_FRAMES        (130)
+
+
+/******************************************************************************
+ **                     SCALAR KERNELS
+ ******************************************************************************/
+
+static inline int32_t readPcm16(const unsigned char *p)
+{
+    return (int16_t)((uint16_t)p[0] | ((uint16_t)p[1] << 8));
+}
+
+static inline int32_t readPcm24(const unsigned char *p)
+{
+    // Bytes placed in the upper 24 bits, the arithmetic shift extends the sign
+    return ((int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24))) >> 8;
+}
+
+static void mixPcm16StereoScalar(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    unsigned int i;
+    for (i = 0; i < frames; i++) {
+        left[i]  += (int64_t)gain * (readPcm16(&src[4 * i]) * (1 << PCM16_TO_PCM24_SHIFT));
+        right[i] += (int64_t)gain * (readPcm16(&src[4 * i + 2]) * (1 << PCM16_TO_PCM24_SHIFT));
+    }
+}
+
+static void mixPcm16MonoScalar(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    unsigned int i;
+    for (i = 0; i < frames; i++) {
+        int64_t value = (int64_t)gain * (readPcm16(&src[2 * i]) * (1 << PCM16_TO_PCM24_SHIFT));
+        left[i]  += value;
+        right[i] += value;
+    }
+}
+
+static void mixPcm24StereoScalar(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    unsigned int i;
+    for (i = 0; i < frames; i++) {
+        left[i]  += (int64_t)gain * readPcm24(&src[6 * i]);
+        right[i] += (int64_t)gain * readPcm24(&src[6 * i + 3]);
+    }
+}
+
+static void mixPcm24MonoScalar(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    unsigned int i;
+    for (i = 0; i < frames; i++) {
+        int64_t value = (int64_t)gain * readPcm24(&src[3 * i]);
+        left[i]  += value;
+        right[i] += value;
+    }
+}
+
+static void mixDecodedStereoScalar(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const int32_t *samples = (const int32_t*)src;
+    unsigned int i;
+    for (i = 0; i < frames; i++) {
+        left[i]  += (int64_t)gain * samples[2 * i];
+        right[i] += (int64_t)gain * samples[2 * i + 1];
+    }
+}
+
+static void mixDecodedMonoScalar(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const int32_t *samples = (const int32_t*)src;
+    unsigned int i;
+    for (i = 0; i < frames; i++) {
+        int64_t value = (int64_t)gain * samples[i];
+        left[i]  += value;
+        right[i] += value;
+    }
+}
+
+static inline int16_t outputSample(int64_t acc, float level)
+{
+    float value = (float)(int32_t)(acc >> OUTPUT_SHIFT) * OUTPUT_UNIT;
+    int32_t out;
+
+    // Hard clip at 24 bits, then level and 16 bits
+    value = value > (float)MIXER_MAX_VALUE ? (float)MIXER_MAX_VALUE : value;
+    value = value < (float)MIXER_MIN_VALUE ? (float)MIXER_MIN_VALUE : value;
+    out = ((int32_t)(level * value)) >> 8;
+    return (int16_t)(out > INT16_MAX ? INT16_MAX : (out < INT16_MIN ? INT16_MIN : out));
+}
+
+static void outputScalar(const int64_t *left, const int64_t *right, float level, int16_t *dst, unsigned int frames)
+{
+    unsigned int i;
+    for (i = 0; i < frames; i++) {
+        dst[2 * i]     = outputSample(left[i], level);
+        dst[2 * i + 1] = outputSample(right[i], level);
+    }
+}
+
+static const MIXERKERNELS_set_t ScalarKernels = {
+    "scalar",
+    { mixPcm16StereoScalar, mixPcm16MonoScalar, mixPcm24StereoScalar, mixPcm24MonoScalar,
+      mixDecodedStereoScalar, mixDecodedMonoScalar },
+    outputScalar
+};
+
+
+/******************************************************************************
+ **                     SSE2 AND AVX2 KERNELS
+ ******************************************************************************/
+#ifdef MIXER_KERNELS_X86
+
+/* Products of the 32 bits lanes 0 and 2 by gain, as two 64 bits lanes */
+static inline __m128i mulEvenSse2(__m128i samples, __m128i gain, __m128i bias, __m128i biasProduct)
+{
+    return _mm_sub_epi64(_mm_mul_epu32(_mm_add_epi32(samples, bias), gain), biasProduct);
+}
+
+static inline void accumulateSse2(int64_t *dst, __m128i value)
+{
+    _mm_storeu_si128((__m128i*)dst, _mm_add_epi64(_mm_loadu_si128((const __m128i*)dst), value));
+}
+
+static void mixPcm16StereoSse2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m128i g = _mm_set1_epi32((int)gain);
+    const __m128i bias = _mm_set1_epi32(PCM16_BIAS);
+    const __m128i biasProduct = _mm_set1_epi64x((long long)((uint64_t)gain << PCM16_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 4 frames (16 bytes) at a time
+    for (; i + 4 <= frames; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[4 * i]);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); // L0 R0 L1 R1
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16); // L2 R2 L3 R3
+
+        accumulateSse2(&left[i],      _mm_slli_epi64(mulEvenSse2(lo, g, bias, biasProduct), PCM16_TO_PCM24_SHIFT));
+        accumulateSse2(&right[i],     _mm_slli_epi64(mulEvenSse2(_mm_srli_epi64(lo, 32), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT));
+        accumulateSse2(&left[i + 2],  _mm_slli_epi64(mulEvenSse2(hi, g, bias, biasProduct), PCM16_TO_PCM24_SHIFT));
+        accumulateSse2(&right[i + 2], _mm_slli_epi64(mulEvenSse2(_mm_srli_epi64(hi, 32), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT));
+    }
+    mixPcm16StereoScalar(&src[4 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixPcm16MonoSse2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m128i g = _mm_set1_epi32((int)gain);
+    const __m128i bias = _mm_set1_epi32(PCM16_BIAS);
+    const __m128i biasProduct = _mm_set1_epi64x((long long)((uint64_t)gain << PCM16_BIAS_SHIFT));
+    unsigned int i = 0;
+    int half;
+
+    // 8 frames (16 bytes) at a time
+    for (; i + 8 <= frames; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[2 * i]);
+        __m128i samples[2];
+        samples[0] = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16); // s0 s1 s2 s3
+        samples[1] = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16); // s4 s5 s6 s7
+
+        for (half = 0; half < 2; half++) {
+            __m128i even = _mm_slli_epi64(mulEvenSse2(samples[half], g, bias, biasProduct), PCM16_TO_PCM24_SHIFT);
+            __m128i odd = _mm_slli_epi64(mulEvenSse2(_mm_srli_epi64(samples[half], 32), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT);
+            __m128i first = _mm_unpacklo_epi64(even, odd);
+            __m128i second = _mm_unpackhi_epi64(even, odd);
+            accumulateSse2(&left[i + 4 * half],      first);
+            accumulateSse2(&right[i + 4 * half],     first);
+            accumulateSse2(&left[i + 4 * half + 2],  second);
+            accumulateSse2(&right[i + 4 * half + 2], second);
+        }
+    }
+    mixPcm16MonoScalar(&src[2 * i], gain, &left[i], &right[i], frames - i);
+}
+
+/* Four 24 bits samples sign extended to 32 bits, the load covers 16 bytes */
+static inline __m128i loadPcm24Sse2(const unsigned char *src)
+{
+    __m128i v = _mm_loadu_si128((const __m128i*)src);
+    // Without SSSE3 byte shuffles: the samples at bytes 0, 3, 6 and 9 are brought to the low 32 bits of copies
+    __m128i first = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));                   // s0 s1 . .
+    __m128i second = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9)); // s2 s3 . .
+    return _mm_srai_epi32(_mm_slli_epi32(_mm_unpacklo_epi64(first, second), 8), 8);
+}
+
+static void mixPcm24StereoSse2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m128i g = _mm_set1_epi32((int)gain);
+    const __m128i bias = _mm_set1_epi32(PCM24_BIAS);
+    const __m128i biasProduct = _mm_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 2 frames (12 bytes) at a time, the load covers 16 bytes which must all belong to the frames
+    for (; 6 * i + 16 <= 6 * frames; i += 2) {
+        __m128i v = loadPcm24Sse2(&src[6 * i]); // L0 R0 L1 R1
+        accumulateSse2(&left[i],  mulEvenSse2(v, g, bias, biasProduct));
+        accumulateSse2(&right[i], mulEvenSse2(_mm_srli_epi64(v, 32), g, bias, biasProduct));
+    }
+    mixPcm24StereoScalar(&src[6 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixPcm24MonoSse2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m128i g = _mm_set1_epi32((int)gain);
+    const __m128i bias = _mm_set1_epi32(PCM24_BIAS);
+    const __m128i biasProduct = _mm_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 4 frames (12 bytes) at a time, the load covers 16 bytes which must all belong to the frames
+    for (; 3 * i + 16 <= 3 * frames; i += 4) {
+        __m128i v = loadPcm24Sse2(&src[3 * i]);
+        __m128i even = mulEvenSse2(v, g, bias, biasProduct);
+        __m128i odd = mulEvenSse2(_mm_srli_epi64(v, 32), g, bias, biasProduct);
+        __m128i first = _mm_unpacklo_epi64(even, odd);
+        __m128i second = _mm_unpackhi_epi64(even, odd);
+        accumulateSse2(&left[i],      first);
+        accumulateSse2(&right[i],     first);
+        accumulateSse2(&left[i + 2],  second);
+        accumulateSse2(&right[i + 2], second);
+    }
+    mixPcm24MonoScalar(&src[3 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixDecodedStereoSse2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m128i g = _mm_set1_epi32((int)gain);
+    const __m128i bias = _mm_set1_epi32(PCM24_BIAS);
+    const __m128i biasProduct = _mm_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 2 frames (16 bytes) at a time
+    for (; i + 2 <= frames; i += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[8 * i]); // L0 R0 L1 R1
+        accumulateSse2(&left[i],  mulEvenSse2(v, g, bias, biasProduct));
+        accumulateSse2(&right[i], mulEvenSse2(_mm_srli_epi64(v, 32), g, bias, biasProduct));
+    }
+    mixDecodedStereoScalar(&src[8 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixDecodedMonoSse2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m128i g = _mm_set1_epi32((int)gain);
+    const __m128i bias = _mm_set1_epi32(PCM24_BIAS);
+    const __m128i biasProduct = _mm_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 4 frames (16 bytes) at a time
+    for (; i + 4 <= frames; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)&src[4 * i]);
+        __m128i even = mulEvenSse2(v, g, bias, biasProduct);
+        __m128i odd = mulEvenSse2(_mm_srli_epi64(v, 32), g, bias, biasProduct);
+        __m128i first = _mm_unpacklo_epi64(even, odd);
+        __m128i second = _mm_unpackhi_epi64(even, odd);
+        accumulateSse2(&left[i],      first);
+        accumulateSse2(&right[i],     first);
+        accumulateSse2(&left[i + 2],  second);
+        accumulateSse2(&right[i + 2], second);
+    }
+    mixDecodedMonoScalar(&src[4 * i], gain, &left[i], &right[i], frames - i);
+}
+
+/* Two frames as L0 R0 L1 R1, same computation as outputSample */
+static inline __m128i outputFramesSse2(__m128i left, __m128i right, __m128 level)
+{
+    // High halves of the accumulators, interleaved, then the rest of the shift
+    __m128i v = _mm_unpacklo_epi32(_mm_shuffle_epi32(left, _MM_SHUFFLE(3, 1, 3, 1)),
+                                   _mm_shuffle_epi32(right, _MM_SHUFFLE(3, 1, 3, 1)));
+    __m128 value = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(v, OUTPUT_SHIFT - 32)), _mm_set1_ps(OUTPUT_UNIT));
+
+    value = _mm_min_ps(value, _mm_set1_ps((float)MIXER_MAX_VALUE));
+    value = _mm_max_ps(value, _mm_set1_ps((float)MIXER_MIN_VALUE));
+    return _mm_srai_epi32(_mm_cvttps_epi32(_mm_mul_ps(level, value)), 8);
+}
+
+static void outputSse2(const int64_t *left, const int64_t *right, float level, int16_t *dst, unsigned int frames)
+{
+    const __m128 l = _mm_set1_ps(level);
+    unsigned int i = 0;
+
+    // 4 frames at a time, the saturated pack does the 16 bits clip
+    for (; i + 4 <= frames; i += 4) {
+        __m128i first = outputFramesSse2(_mm_loadu_si128((const __m128i*)&left[i]), _mm_loadu_si128((const __m128i*)&right[i]), l);
+        __m128i second = outputFramesSse2(_mm_loadu_si128((const __m128i*)&left[i + 2]), _mm_loadu_si128((const __m128i*)&right[i + 2]), l);
+        _mm_storeu_si128((__m128i*)&dst[2 * i], _mm_packs_epi32(first, second));
+    }
+    outputScalar(&left[i], &right[i], level, &dst[2 * i], frames - i);
+}
+
+static const MIXERKERNELS_set_t Sse2Kernels = {
+    "sse2",
+    { mixPcm16StereoSse2, mixPcm16MonoSse2, mixPcm24StereoSse2, mixPcm24MonoSse2,
+      mixDecodedStereoSse2, mixDecodedMonoSse2 },
+    outputSse2
+};
+
+/* Products of the 32 bits lanes 0, 2, 4 and 6 by gain, as four 64 bits lanes */
+static inline TARGET_AVX2 __m256i mulEvenAvx2(__m256i samples, __m256i gain, __m256i bias, __m256i biasProduct)
+{
+    return _mm256_sub_epi64(_mm256_mul_epu32(_mm256_add_epi32(samples, bias), gain), biasProduct);
+}
+
+static inline TARGET_AVX2 void accumulateAvx2(int64_t *dst, __m256i value)
+{
+    _mm256_storeu_si256((__m256i*)dst, _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)dst), value));
+}
+
+/* Four 24 bits samples at the start of each 128 bits lane, sign extended to 32 bits */
+static inline TARGET_AVX2 __m256i loadPcm24Avx2(const unsigned char *src)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+        -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)src)),
+                                        _mm_loadu_si128((const __m128i*)&src[12]), 1);
+    return _mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8);
+}
+
+static TARGET_AVX2 void mixPcm16StereoAvx2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m256i g = _mm256_set1_epi32((int)gain);
+    const __m256i bias = _mm256_set1_epi32(PCM16_BIAS);
+    const __m256i biasProduct = _mm256_set1_epi64x((long long)((uint64_t)gain << PCM16_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 4 frames (16 bytes) at a time
+    for (; i + 4 <= frames; i += 4) {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&src[4 * i])); // L0 R0 L1 R1 L2 R2 L3 R3
+        accumulateAvx2(&left[i],  _mm256_slli_epi64(mulEvenAvx2(v, g, bias, biasProduct), PCM16_TO_PCM24_SHIFT));
+        accumulateAvx2(&right[i], _mm256_slli_epi64(mulEvenAvx2(_mm256_srli_epi64(v, 32), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT));
+    }
+    mixPcm16StereoScalar(&src[4 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static TARGET_AVX2 void mixMonoProductsAvx2(__m256i even, __m256i odd, int64_t *left, int64_t *right)
+{
+    // even: s0 s2 | s4 s6, odd: s1 s3 | s5 s7
+    __m256i lo = _mm256_unpacklo_epi64(even, odd); // s0 s1 | s4 s5
+    __m256i hi = _mm256_unpackhi_epi64(even, odd); // s2 s3 | s6 s7
+    __m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+    __m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+    accumulateAvx2(&left[0],  first);
+    accumulateAvx2(&right[0], first);
+    accumulateAvx2(&left[4],  second);
+    accumulateAvx2(&right[4], second);
+}
+
+static TARGET_AVX2 void mixPcm16MonoAvx2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m256i g = _mm256_set1_epi32((int)gain);
+    const __m256i bias = _mm256_set1_epi32(PCM16_BIAS);
+    const __m256i biasProduct = _mm256_set1_epi64x((long long)((uint64_t)gain << PCM16_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 8 frames (16 bytes) at a time
+    for (; i + 8 <= frames; i += 8) {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&src[2 * i]));
+        mixMonoProductsAvx2(_mm256_slli_epi64(mulEvenAvx2(v, g, bias, biasProduct), PCM16_TO_PCM24_SHIFT),
+                            _mm256_slli_epi64(mulEvenAvx2(_mm256_srli_epi64(v, 32), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT),
+                            &left[i], &right[i]);
+    }
+    mixPcm16MonoScalar(&src[2 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static TARGET_AVX2 void mixPcm24StereoAvx2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m256i g = _mm256_set1_epi32((int)gain);
+    const __m256i bias = _mm256_set1_epi32(PCM24_BIAS);
+    const __m256i biasProduct = _mm256_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 4 frames (24 bytes) at a time, the loads cover 28 bytes which must all belong to the frames
+    for (; 6 * i + 28 <= 6 * frames; i += 4) {
+        __m256i v = loadPcm24Avx2(&src[6 * i]); // L0 R0 L1 R1 L2 R2 L3 R3
+        accumulateAvx2(&left[i],  mulEvenAvx2(v, g, bias, biasProduct));
+        accumulateAvx2(&right[i], mulEvenAvx2(_mm256_srli_epi64(v, 32), g, bias, biasProduct));
+    }
+    mixPcm24StereoScalar(&src[6 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static TARGET_AVX2 void mixPcm24MonoAvx2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m256i g = _mm256_set1_epi32((int)gain);
+    const __m256i bias = _mm256_set1_epi32(PCM24_BIAS);
+    const __m256i biasProduct = _mm256_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 8 frames (24 bytes) at a time, the loads cover 28 bytes which must all belong to the frames
+    for (; 3 * i + 28 <= 3 * frames; i += 8) {
+        __m256i v = loadPcm24Avx2(&src[3 * i]);
+        mixMonoProductsAvx2(mulEvenAvx2(v, g, bias, biasProduct),
+                            mulEvenAvx2(_mm256_srli_epi64(v, 32), g, bias, biasProduct),
+                            &left[i], &right[i]);
+    }
+    mixPcm24MonoScalar(&src[3 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static TARGET_AVX2 void mixDecodedStereoAvx2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m256i g = _mm256_set1_epi32((int)gain);
+    const __m256i bias = _mm256_set1_epi32(PCM24_BIAS);
+    const __m256i biasProduct = _mm256_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 4 frames (32 bytes) at a time
+    for (; i + 4 <= frames; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&src[8 * i]); // L0 R0 L1 R1 L2 R2 L3 R3
+        accumulateAvx2(&left[i],  mulEvenAvx2(v, g, bias, biasProduct));
+        accumulateAvx2(&right[i], mulEvenAvx2(_mm256_srli_epi64(v, 32), g, bias, biasProduct));
+    }
+    mixDecodedStereoScalar(&src[8 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static TARGET_AVX2 void mixDecodedMonoAvx2(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const __m256i g = _mm256_set1_epi32((int)gain);
+    const __m256i bias = _mm256_set1_epi32(PCM24_BIAS);
+    const __m256i biasProduct = _mm256_set1_epi64x((long long)((uint64_t)gain << PCM24_BIAS_SHIFT));
+    unsigned int i = 0;
+
+    // 8 frames (32 bytes) at a time
+    for (; i + 8 <= frames; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)&src[4 * i]);
+        mixMonoProductsAvx2(mulEvenAvx2(v, g, bias, biasProduct),
+                            mulEvenAvx2(_mm256_srli_epi64(v, 32), g, bias, biasProduct),
+                            &left[i], &right[i]);
+    }
+    mixDecodedMonoScalar(&src[4 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static const MIXERKERNELS_set_t Avx2Kernels = {
+    "avx2",
+    { mixPcm16StereoAvx2, mixPcm16MonoAvx2, mixPcm24StereoAvx2, mixPcm24MonoAvx2,
+      mixDecodedStereoAvx2, mixDecodedMonoAvx2 },
+    outputSse2
+};
+
+static int cpuHasAvx2(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    // The OS must save the AVX registers on context switches
+    if (!(info[2] & (1 << 27)) || (_xgetbv(0) & 6) != 6) {
+        return 0;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // MIXER_KERNELS_X86
+
+
+/******************************************************************************
+ **                     NEON KERNELS
+ ******************************************************************************/
+#ifdef MIXER_KERNELS_NEON
+
+/* Products of two samples by gain */
+static inline int64x2_t mulNeon(int32x2_t samples, uint32x2_t gain, int32x2_t bias, uint64x2_t biasProduct)
+{
+    return vreinterpretq_s64_u64(vsubq_u64(vmull_u32(vreinterpret_u32_s32(vadd_s32(samples, bias)), gain), biasProduct));
+}
+
+static inline void accumulateNeon(int64_t *dst, int64x2_t value)
+{
+    vst1q_s64(dst, vaddq_s64(vld1q_s64(dst), value));
+}
+
+/* Adds 8 samples of one side, scaled to 24 bits */
+static inline void mixPcm16Neon(int16x8_t samples, uint32x2_t g, int32x2_t bias, uint64x2_t biasProduct, int64_t *dst, int64_t *dst2)
+{
+    int32x4_t lo = vmovl_s16(vget_low_s16(samples));
+    int32x4_t hi = vmovl_s16(vget_high_s16(samples));
+    int64x2_t p[4];
+    int j;
+
+    p[0] = vshlq_n_s64(mulNeon(vget_low_s32(lo), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT);
+    p[1] = vshlq_n_s64(mulNeon(vget_high_s32(lo), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT);
+    p[2] = vshlq_n_s64(mulNeon(vget_low_s32(hi), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT);
+    p[3] = vshlq_n_s64(mulNeon(vget_high_s32(hi), g, bias, biasProduct), PCM16_TO_PCM24_SHIFT);
+    for (j = 0; j < 4; j++) {
+        accumulateNeon(&dst[2 * j], p[j]);
+        if (dst2) {
+            accumulateNeon(&dst2[2 * j], p[j]);
+        }
+    }
+}
+
+static void mixPcm16StereoNeon(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const uint32x2_t g = vdup_n_u32(gain);
+    const int32x2_t bias = vdup_n_s32(PCM16_BIAS);
+    const uint64x2_t biasProduct = vdupq_n_u64((uint64_t)gain << PCM16_BIAS_SHIFT);
+    unsigned int i = 0;
+
+    // 8 frames (32 bytes) at a time, deinterleaved by the load
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t v = vld2q_s16((const int16_t*)&src[4 * i]);
+        mixPcm16Neon(v.val[0], g, bias, biasProduct, &left[i], NULL);
+        mixPcm16Neon(v.val[1], g, bias, biasProduct, &right[i], NULL);
+    }
+    mixPcm16StereoScalar(&src[4 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixPcm16MonoNeon(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const uint32x2_t g = vdup_n_u32(gain);
+    const int32x2_t bias = vdup_n_s32(PCM16_BIAS);
+    const uint64x2_t biasProduct = vdupq_n_u64((uint64_t)gain << PCM16_BIAS_SHIFT);
+    unsigned int i = 0;
+
+    // 8 frames (16 bytes) at a time
+    for (; i + 8 <= frames; i += 8) {
+        mixPcm16Neon(vld1q_s16((const int16_t*)&src[2 * i]), g, bias, biasProduct, &left[i], &right[i]);
+    }
+    mixPcm16MonoScalar(&src[2 * i], gain, &left[i], &right[i], frames - i);
+}
+
+/* Adds 4 decoded samples of one side */
+static inline void mixDecodedNeon(int32x4_t samples, uint32x2_t g, int32x2_t bias, uint64x2_t biasProduct, int64_t *dst, int64_t *dst2)
+{
+    int64x2_t lo = mulNeon(vget_low_s32(samples), g, bias, biasProduct);
+    int64x2_t hi = mulNeon(vget_high_s32(samples), g, bias, biasProduct);
+
+    accumulateNeon(&dst[0], lo);
+    accumulateNeon(&dst[2], hi);
+    if (dst2) {
+        accumulateNeon(&dst2[0], lo);
+        accumulateNeon(&dst2[2], hi);
+    }
+}
+
+/* Eight 24 bits samples deinterleaved by byte, sign extended to 32 bits */
+static inline int32x4x2_t loadPcm24Neon(const unsigned char *src)
+{
+    uint8x8x3_t bytes = vld3_u8(src);
+    uint16x8_t low = vorrq_u16(vmovl_u8(bytes.val[0]), vshlq_n_u16(vmovl_u8(bytes.val[1]), 8));
+    int16x8_t high = vmovl_s8(vreinterpret_s8_u8(bytes.val[2]));
+    int32x4x2_t samples;
+
+    samples.val[0] = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_low_s16(high)), 16), vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(low))));
+    samples.val[1] = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_high_s16(high)), 16), vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(low))));
+    return samples;
+}
+
+static void mixPcm24StereoNeon(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const uint32x2_t g = vdup_n_u32(gain);
+    const int32x2_t bias = vdup_n_s32(PCM24_BIAS);
+    const uint64x2_t biasProduct = vdupq_n_u64((uint64_t)gain << PCM24_BIAS_SHIFT);
+    unsigned int i = 0;
+
+    // 4 frames (24 bytes) at a time
+    for (; i + 4 <= frames; i += 4) {
+        int32x4x2_t v = loadPcm24Neon(&src[6 * i]);          // L0 R0 L1 R1, L2 R2 L3 R3
+        int32x4x2_t sides = vuzpq_s32(v.val[0], v.val[1]);   // L0 L1 L2 L3, R0 R1 R2 R3
+        mixDecodedNeon(sides.val[0], g, bias, biasProduct, &left[i], NULL);
+        mixDecodedNeon(sides.val[1], g, bias, biasProduct, &right[i], NULL);
+    }
+    mixPcm24StereoScalar(&src[6 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixPcm24MonoNeon(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const uint32x2_t g = vdup_n_u32(gain);
+    const int32x2_t bias = vdup_n_s32(PCM24_BIAS);
+    const uint64x2_t biasProduct = vdupq_n_u64((uint64_t)gain << PCM24_BIAS_SHIFT);
+    unsigned int i = 0;
+
+    // 8 frames (24 bytes) at a time
+    for (; i + 8 <= frames; i += 8) {
+        int32x4x2_t v = loadPcm24Neon(&src[3 * i]);
+        mixDecodedNeon(v.val[0], g, bias, biasProduct, &left[i], &right[i]);
+        mixDecodedNeon(v.val[1], g, bias, biasProduct, &left[i + 4], &right[i + 4]);
+    }
+    mixPcm24MonoScalar(&src[3 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixDecodedStereoNeon(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const uint32x2_t g = vdup_n_u32(gain);
+    const int32x2_t bias = vdup_n_s32(PCM24_BIAS);
+    const uint64x2_t biasProduct = vdupq_n_u64((uint64_t)gain << PCM24_BIAS_SHIFT);
+    unsigned int i = 0;
+
+    // 4 frames (32 bytes) at a time, deinterleaved by the load
+    for (; i + 4 <= frames; i += 4) {
+        int32x4x2_t v = vld2q_s32((const int32_t*)&src[8 * i]);
+        mixDecodedNeon(v.val[0], g, bias, biasProduct, &left[i], NULL);
+        mixDecodedNeon(v.val[1], g, bias, biasProduct, &right[i], NULL);
+    }
+    mixDecodedStereoScalar(&src[8 * i], gain, &left[i], &right[i], frames - i);
+}
+
+static void mixDecodedMonoNeon(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    const uint32x2_t g = vdup_n_u32(gain);
+    const int32x2_t bias = vdup_n_s32(PCM24_BIAS);
+    const uint64x2_t biasProduct = vdupq_n_u64((uint64_t)gain << PCM24_BIAS_SHIFT);
+    unsigned int i = 0;
+
+    // 4 frames (16 bytes) at a time
+    for (; i + 4 <= frames; i += 4) {
+        mixDecodedNeon(vld1q_s32((const int32_t*)&src[4 * i]), g, bias, biasProduct, &left[i], &right[i]);
+    }
+    mixDecodedMonoScalar(&src[4 * i], gain, &left[i], &right[i], frames - i);
+}
+
+/* Two frames as L0 R0 L1 R1, same computation as outputSample */
+static inline int32x4_t outputFramesNeon(int64x2_t left, int64x2_t right, float level)
+{
+    // High halves of the accumulators, interleaved, then the rest of the shift
+    int32x2x2_t v = vzip_s32(vshrn_n_s64(left, 32), vshrn_n_s64(right, 32));
+    float32x4_t value = vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(vcombine_s32(v.val[0], v.val[1]), OUTPUT_SHIFT - 32)), OUTPUT_UNIT);
+
+    value = vminq_f32(value, vdupq_n_f32((float)MIXER_MAX_VALUE));
+    value = vmaxq_f32(value, vdupq_n_f32((float)MIXER_MIN_VALUE));
+    return vshrq_n_s32(vcvtq_s32_f32(vmulq_n_f32(value, level)), 8);
+}
+
+static void outputNeon(const int64_t *left, const int64_t *right, float level, int16_t *dst, unsigned int frames)
+{
+    unsigned int i = 0;
+
+    // 4 frames at a time, the saturated narrowing does the 16 bits clip
+    for (; i + 4 <= frames; i += 4) {
+        int32x4_t first = outputFramesNeon(vld1q_s64(&left[i]), vld1q_s64(&right[i]), level);
+        int32x4_t second = outputFramesNeon(vld1q_s64(&left[i + 2]), vld1q_s64(&right[i + 2]), level);
+        vst1q_s16(&dst[2 * i], vcombine_s16(vqmovn_s32(first), vqmovn_s32(second)));
+    }
+    outputScalar(&left[i], &right[i], level, &dst[2 * i], frames - i);
+}
+
+static const MIXERKERNELS_set_t NeonKernels = {
+    "neon",
+    { mixPcm16StereoNeon, mixPcm16MonoNeon, mixPcm24StereoNeon, mixPcm24MonoNeon,
+      mixDecodedStereoNeon, mixDecodedMonoNeon },
+    outputNeon
+};
+
+#endif // MIXER_KERNELS_NEON
+
+
+/******************************************************************************
+ **                     SELF TEST
+ ******************************************************************************/
+
+/* Same computation as the generic path of the mixer (GET_SAMPLE_VALUE): a 32 bits load, masked,
+ * shifted left then right to extend the sign */
+static void mixReference(MIXER_format_t format, const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames)
+{
+    static const unsigned int offsetSample[MIXER_NUMBER_OF_FORMAT] = { 4, 2, 6, 3, 8, 4 };
+    static const unsigned int offsetStereo[MIXER_NUMBER_OF_FORMAT] = { 2, 0, 3, 0, 4, 0 };
+    static const unsigned int leftShift[MIXER_NUMBER_OF_FORMAT]    = { 16, 16, 8, 8, 0, 0 };
+    static const unsigned int rightShift[MIXER_NUMBER_OF_FORMAT]   = { 8, 8, 8, 8, 0, 0 };
+    static const int dataMask[MIXER_NUMBER_OF_FORMAT]              = { 0x0000FFFF, 0x0000FFFF, 0x00FFFFFF, 0x00FFFFFF, -1, -1 };
+    unsigned int i;
+    int32_t raw;
+
+    for (i = 0; i < frames; i++) {
+        memcpy(&raw, &src[i * offsetSample[format]], sizeof(raw));
+        left[i] += (int64_t)gain * ((int32_t)((uint32_t)(raw & dataMask[format]) << leftShift[format]) >> rightShift[format]);
+        memcpy(&raw, &src[i * offsetSample[format] + offsetStereo[format]], sizeof(raw));
+        right[i] += (int64_t)gain * ((int32_t)((uint32_t)(raw & dataMask[format]) << leftShift[format]) >> rightShift[format]);
+    }
+}
+
+static uint32_t nextRandom(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed;
+}
+
+/* Mixing compared with the generic mixer computation, on random samples, gains, lengths and alignments */
+static int selfTestMix(const MIXERKERNELS_set_t *kernels)
+{
+    static const uint32_t gains[] = { 0u, 1u, 1000u, 1000u * 100u * 10000u, 0x7FFFFFFFu, 0x80000000u, 0xFFFFFFFFu };
+    static const unsigned int lengths[] = { 0, 1, 3, 4, 5, 7, 8, 9, 13, 16, 17, 31, 33, 64, 127, SELF_TEST_MAX_FRAMES };
+    // Room for the 32 bits loads of the reference past the last frame
+    unsigned char src[SELF_TEST_BUFFER_SIZE + 8];
+    // Decoded samples are 24 bits values, as SoundManager expands them
+    int32_t decoded[2 * SELF_TEST_MAX_FRAMES + 4];
+    int64_t expected[2][SELF_TEST_MAX_FRAMES];
+    int64_t result[2][SELF_TEST_MAX_FRAMES];
+    uint32_t seed = 0x5EED;
+    unsigned int i, format, g, l, offset;
+    int isDecoded;
+    const unsigned char *start;
+
+    for (i = 0; i < sizeof(src); i++) {
+        src[i] = (unsigned char)(nextRandom(&seed) >> 24);
+    }
+    // Full scale samples, as the random bytes rarely produce them
+    memcpy(src, "\x00\x80\xFF\x7F\x00\x00\x80\xFF\xFF\x7F", 10);
+    for (i = 0; i < sizeof(decoded) / sizeof(decoded[0]); i++) {
+        decoded[i] = readPcm24(&src[3 * i]);
+    }
+
+    for (format = 0; format < MIXER_NUMBER_OF_FORMAT; format++) {
+        // Decoded samples are only read at their alignment
+        isDecoded = format == MIXER_FORMAT_PCM24_DECODED_STEREO || format == MIXER_FORMAT_PCM24_DECODED_MONO;
+
+        for (g = 0; g <= sizeof(gains) / sizeof(gains[0]); g++) {
+            uint32_t gain = g < sizeof(gains) / sizeof(gains[0]) ? gains[g] : nextRandom(&seed);
+            for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                for (offset = 0; offset < 4; offset++) {
+                    for (i = 0; i < SELF_TEST_MAX_FRAMES; i++) {
+                        expected[0][i] = result[0][i] = (int64_t)(int32_t)nextRandom(&seed);
+                        expected[1][i] = result[1][i] = (int64_t)(int32_t)nextRandom(&seed);
+                    }
+                    start = isDecoded ? (const unsigned char*)&decoded[offset] : &src[offset];
+                    mixReference((MIXER_format_t)format, start, gain, expected[0], expected[1], lengths[l]);
+                    kernels->mix[format](start, gain, result[0], result[1], lengths[l]);
+                    if (memcmp(expected, result, sizeof(result)) != 0) {
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+/* Output compared with the scalar conversion, on accumulators of all magnitudes, clipped or not */
+static int selfTestOutput(const MIXERKERNELS_set_t *kernels)
+{
+    static const float levels[] = { 0.0f, 0.3f, 1.0f, 4.0f };
+    int64_t acc[2][SELF_TEST_MAX_FRAMES];
+    int16_t expected[2 * SELF_TEST_MAX_FRAMES];
+    int16_t result[2 * SELF_TEST_MAX_FRAMES];
+    uint32_t seed = 0x0D17;
+    unsigned int i, l, frames;
+
+    for (i = 0; i < SELF_TEST_MAX_FRAMES; i++) {
+        acc[i & 1][i] = (int64_t)(((uint64_t)nextRandom(&seed) << 32) | nextRandom(&seed)) >> (nextRandom(&seed) % 64);
+        acc[~i & 1][i] = (int64_t)(int32_t)nextRandom(&seed) * MIXER_MASTER_DIVIDER / 256;
+    }
+    acc[0][0] = INT64_MAX;
+    acc[1][0] = INT64_MIN;
+    acc[0][1] = MIXER_MAX_VALUE * MIXER_MASTER_DIVIDER;
+    acc[1][1] = MIXER_MIN_VALUE * MIXER_MASTER_DIVIDER;
+
+    for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++) {
+        for (frames = 0; frames <= SELF_TEST_MAX_FRAMES; frames += 1 + frames / 4) {
+            memset(expected, 0, sizeof(expected));
+            memset(result, 0, sizeof(result));
+            outputScalar(acc[0], acc[1], levels[l], expected, frames);
+            kernels->output(acc[0], acc[1], levels[l], result, frames);
+            if (memcmp(expected, result, sizeof(result)) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ *  \brief Checks that the kernels give bit exact results, mixing as the generic mixer computation
+ *         and converting as the scalar output
+ *  \return 1 if all the results are bit exact
+ */
+int mixerKernels_selfTest(const MIXERKERNELS_set_t *kernels)
+{
+    return selfTestMix(kernels) && selfTestOutput(kernels);
+}
+
+
+/******************************************************************************
+ **                     DISPATCH
+ ******************************************************************************/
+
+const MIXERKERNELS_set_t *mixerKernels_scalar(void)
+{
+    return &ScalarKernels;
+}
+
+/**
+ *  \brief Lists the kernel sets the CPU supports, the fastest first and the scalar ones last
+ *  \param sets filled with up to max sets, MIXER_KERNELS_MAX_SETS is always enough
+ *  \return number of sets
+ */
+unsigned int mixerKernels_supported(const MIXERKERNELS_set_t **sets, unsigned int max)
+{
+    const MIXERKERNELS_set_t *supported[MIXER_KERNELS_MAX_SETS];
+    unsigned int count = 0;
+    unsigned int i;
+
+#ifdef MIXER_KERNELS_X86
+    if (cpuHasAvx2()) {
+        supported[count++] = &Avx2Kernels;
+    }
+    supported[count++] = &Sse2Kernels;
+#endif
+#ifdef MIXER_KERNELS_NEON
+    supported[count++] = &NeonKernels;
+#endif
+    supported[count++] = &ScalarKernels;
+
+    for (i = 0; i < count && i < max; i++) {
+        sets[i] = supported[i];
+    }
+    return i;
+}
+
+// Kernels picked by mixerKernels_select, published once tested
+#if defined(_MSC_VER)
+// MSVC volatile accesses have acquire and release semantics
+static const MIXERKERNELS_set_t * volatile Selected = NULL;
+#    define LOAD_SELECTED()         (Selected)
+#    define STORE_SELECTED(set)     (Selected = (set))
+#else
+static const MIXERKERNELS_set_t *Selected = NULL;
+#    define LOAD_SELECTED()         __atomic_load_n(&Selected, __ATOMIC_ACQUIRE)
+#    define STORE_SELECTED(set)     __atomic_store_n(&Selected, (set), __ATOMIC_RELEASE)
+#endif
+
+/**
+ *  \brief Picks the fastest kernels supported by the CPU which pass the self test, once per process
+ *         NOTE: concurrent first calls are harmless, they all select the same kernels
+ */
+const MIXERKERNELS_set_t *mixerKernels_select(void)
+{
+    const MIXERKERNELS_set_t *sets[MIXER_KERNELS_MAX_SETS];
+    const MIXERKERNELS_set_t *selected = LOAD_SELECTED();
+    unsigned int count;
+    unsigned int i;
+
+    if (selected) {
+        return selected;
+    }
+
+    // The scalar kernels come last, they are the reference of the self test
+    count = mixerKernels_supported(sets, MIXER_KERNELS_MAX_SETS);
+    selected = &ScalarKernels;
+    for (i = 0; i + 1 < count; i++) {
+        if (mixerKernels_selfTest(sets[i])) {
+            selected = sets[i];
+            break;
+        }
+    }
+    STORE_SELECTED(selected);
+    return selected;
+}
+
+#ifdef __cplusplus
+}
+#endif
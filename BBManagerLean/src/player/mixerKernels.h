@@ -0,0 +1,66 @@
+#ifndef MIXER_KERNELS_H_
+#define MIXER_KERNELS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*****************************************************************************
+ **                     DEFINES
+ *****************************************************************************/
+// Accumulator units per 24 bits output unit, and the 24 bits hard clip
+#    define MIXER_MASTER_DIVIDER        (100000LL * 100LL * 100LL)
+#    define MIXER_MAX_VALUE             (8388607)
+#    define MIXER_MIN_VALUE             (-8388607)
+
+// Kernel sets a CPU can support at most, see mixerKernels_supported
+#    define MIXER_KERNELS_MAX_SETS      (4)
+
+
+/*****************************************************************************
+ **                     TYPEDEF
+ *****************************************************************************/
+/* Sample layouts created by mixer_addPCM16Stereo/16Mono/24Stereo/24Mono/24DecodedStereo/24DecodedMono,
+ * decoded samples are 24 bits values sign extended to 32 bits */
+typedef enum {
+    MIXER_FORMAT_PCM16_STEREO,
+    MIXER_FORMAT_PCM16_MONO,
+    MIXER_FORMAT_PCM24_STEREO,
+    MIXER_FORMAT_PCM24_MONO,
+    MIXER_FORMAT_PCM24_DECODED_STEREO,
+    MIXER_FORMAT_PCM24_DECODED_MONO,
+    MIXER_NUMBER_OF_FORMAT
+} MIXER_format_t;
+
+/* Adds frames of a voice played at a constant gain to the accumulators:
+ *     left[i] += gain * sample (24 bits scale), same for right, mono voices go to both sides.
+ * src points to the first frame, the kernel never reads past the bytes of the last frame. */
+typedef void (*MIXERKERNELS_mix_t)(const unsigned char *src, uint32_t gain, int64_t *left, int64_t *right, unsigned int frames);
+
+/* Converts accumulated frames to interleaved 16 bits stereo:
+ *     out = clip16((int)(level * clip24(acc / MIXER_MASTER_DIVIDER)) >> 8)
+ * The division is approximated by a shift and a float scale, within 1 LSB of the exact result. */
+typedef void (*MIXERKERNELS_output_t)(const int64_t *left, const int64_t *right, float level, int16_t *dst, unsigned int frames);
+
+typedef struct {
+    const char *name;
+    MIXERKERNELS_mix_t mix[MIXER_NUMBER_OF_FORMAT];
+    MIXERKERNELS_output_t output;
+} MIXERKERNELS_set_t;
+
+
+/*****************************************************************************
+ **                     FUNCTION PROTOTYPES
+ *****************************************************************************/
+const MIXERKERNELS_set_t *mixerKernels_select(void);
+const MIXERKERNELS_set_t *mixerKernels_scalar(void);
+unsigned int mixerKernels_supported(const MIXERKERNELS_set_t **sets, unsigned int max);
+int mixerKernels_selfTest(const MIXERKERNELS_set_t *kernels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MIXER_KERNELS_H_ */
@@ -0,0 +1,547 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <QElapsedTimer>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "offlinerenderer.h"
+#include "allocationtracker.h"
+#include "engineContext.h"
+#include "mixer.h"
+#include "player.h"
+#include "songPlayer.h"
+#include "soundManager.h"
+
+#define OFFLINE_OUTPUT_LEVEL        (1.0)
+#define OFFLINE_DEFAULT_TEMPO       (120)
+#define OFFLINE_SILENCE_THRESHOLD   (5)
+// Rendered after the last event of the timeline when no duration is set. Units: s
+#define OFFLINE_DEFAULT_TAIL        (30.0)
+// Time between the press and the release of a "tap". Units: s
+#define OFFLINE_TAP_LENGTH          (0.05)
+// Limit of a song walk when no duration is set, in case the song never ends. Units: s
+#define OFFLINE_MAX_WALK_DURATION   (30.0 * 60.0)
+
+#define WAV_HEADER_SIZE             (44)
+
+static void putLittleEndian(char *dst, quint32 value, int size)
+{
+    for (int i = 0; i < size; i++) {
+        dst[i] = (char)((value >> (8 * i)) & 0xFF);
+    }
+}
+
+OfflineRenderer::OfflineRenderer()
+    : m_tempo(0)
+    , m_duration(0.0)
+    , m_walkLoops(0)
+    , m_polyphony(MIXER_DEFAULT_POLYPHONY)
+    , m_seed(ENGINE_DEFAULT_SEED)
+    , m_sharedDrumset(nullptr)
+    , m_walkPart(-1)
+    , m_walkTicks(0)
+    , m_walkRelease(false)
+    , m_walkDone(false)
+    , m_renderedSamples(0)
+    , m_renderTime_ns(0)
+    , m_peak(0)
+    , m_stealCount(0)
+    , m_allocationCount(0)
+    , m_freeCount(0)
+{
+}
+
+void OfflineRenderer::setDrumset(const QString &path)
+{
+    m_drumsetPath = path;
+}
+
+/**
+ * @brief OfflineRenderer::setSharedDrumset renders with a drumset loaded by loadDrumset instead of the one at the
+ *        drumset path. It is only read, so it can be shared by renderers running at the same time.
+ * @param drumset must outlive the renders, nullptr to load the drumset at the path again
+ */
+void OfflineRenderer::setSharedDrumset(const DrumsetCache *drumset)
+{
+    m_sharedDrumset = drumset;
+}
+
+void OfflineRenderer::setSong(const QString &path)
+{
+    m_songPath = path;
+}
+
+void OfflineRenderer::setEffectsPath(const QString &path)
+{
+    m_effectsPath = path;
+}
+
+/**
+ * @brief OfflineRenderer::setTempo
+ * @param bpm 0 to use the song tempo
+ */
+void OfflineRenderer::setTempo(int bpm)
+{
+    m_tempo = bpm;
+}
+
+/**
+ * @brief OfflineRenderer::setDuration
+ * @param seconds 0 to render up to OFFLINE_DEFAULT_TAIL after the last event
+ */
+void OfflineRenderer::setDuration(double seconds)
+{
+    m_duration = seconds;
+}
+
+/**
+ * @brief OfflineRenderer::setWalkLoops makes the renderer walk through the song on its own:
+ *        each part is played for the given number of main loops then the transition to the next
+ *        part is triggered, and the outro after the last part. The timeline still applies.
+ * @param loops 0 to disable
+ */
+void OfflineRenderer::setWalkLoops(int loops)
+{
+    m_walkLoops = qMax(0, loops);
+}
+
+/**
+ * @brief OfflineRenderer::setPolyphony
+ * @param polyphony number of sounds playing at a time, from MIXER_MIN_POLYPHONY to MIXER_MAX_POLYPHONY
+ */
+void OfflineRenderer::setPolyphony(int polyphony)
+{
+    m_polyphony = qBound((int)MIXER_MIN_POLYPHONY, polyphony, (int)MIXER_MAX_POLYPHONY);
+}
+
+/**
+ * @brief OfflineRenderer::setSeed
+ * @param seed of the random generator picking the sound layers and drum fills,
+ *        renders with the same seed and settings are identical
+ */
+void OfflineRenderer::setSeed(quint32 seed)
+{
+    m_seed = seed;
+}
+
+void OfflineRenderer::addEvent(double time, BUTTON_EVENT event)
+{
+    OfflineEvent e;
+    e.time = time;
+    e.event = event;
+    m_timeline.append(e);
+}
+
+/**
+ * @brief OfflineRenderer::loadTimeline adds the events of a timeline file.
+ *
+ * Each line is "<time in seconds> <event>", where event is one of press, release, longpress,
+ * multitap, effect or tap (press then release). Empty lines and lines starting with # are ignored.
+ * @param path
+ * @return false if the file could not be read or a line is invalid
+ */
+bool OfflineRenderer::loadTimeline(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "OfflineRenderer - Failed to open timeline file at: " << path;
+        return false;
+    }
+    QStringList lines = QString::fromUtf8(file.readAll()).split('\n');
+    file.close();
+
+    for (int i = 0; i < lines.size(); i++) {
+        QString line = lines[i].simplified();
+        if (line.isEmpty() || line.startsWith("#")) {
+            continue;
+        }
+
+        QStringList fields = line.split(' ');
+        bool ok = fields.size() == 2;
+        double time = ok ? fields[0].toDouble(&ok) : 0.0;
+        BUTTON_EVENT event;
+        if (!ok || time < 0.0) {
+            qWarning() << "OfflineRenderer - Invalid timeline line " << (i + 1) << ": " << lines[i];
+            return false;
+        }
+
+        if (fields[1].toLower() == "tap") {
+            addEvent(time, BUTTON_EVENT_PEDAL_PRESS);
+            addEvent(time + OFFLINE_TAP_LENGTH, BUTTON_EVENT_PEDAL_RELEASE);
+        } else if (parseEvent(fields[1], &event)) {
+            addEvent(time, event);
+        } else {
+            qWarning() << "OfflineRenderer - Unknown event at timeline line " << (i + 1) << ": " << fields[1];
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief OfflineRenderer::parseEvent
+ * @param name one of press, release, longpress, multitap or effect
+ * @param event
+ * @return false if name is unknown
+ */
+bool OfflineRenderer::parseEvent(const QString &name, BUTTON_EVENT *event)
+{
+    QString lower = name.toLower();
+    if (lower == "press") {
+        *event = BUTTON_EVENT_PEDAL_PRESS;
+    } else if (lower == "release") {
+        *event = BUTTON_EVENT_PEDAL_RELEASE;
+    } else if (lower == "longpress") {
+        *event = BUTTON_EVENT_PEDAL_LONG_PRESS;
+    } else if (lower == "multitap") {
+        *event = BUTTON_EVENT_PEDAL_MULTI_TAP;
+    } else if (lower == "effect") {
+        *event = BUTTON_EVENT_FOOT_SECONDARY_PRESS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief OfflineRenderer::render renders the song to wavPath, on an engine of its own
+ *        so that it does not disturb a Player or other renderers running in the process
+ * @param wavPath
+ * @return false if the song could not be loaded or the file written
+ */
+bool OfflineRenderer::render(const QString &wavPath)
+{
+    EngineContext *context = EngineContext_create();
+    if (!context) {
+        qWarning() << "OfflineRenderer - Failed to allocate engine";
+        return false;
+    }
+    EngineContext *previous = EngineContext_bind(context);
+
+    bool ok = renderSong(wavPath);
+
+    EngineContext_bind(previous);
+    EngineContext_destroy(context);
+    return ok;
+}
+
+/**
+ * @brief OfflineRenderer::renderSong renders the song with the engine bound to the calling thread
+ */
+bool OfflineRenderer::renderSong(const QString &wavPath)
+{
+    m_renderedSamples = 0;
+    m_renderTime_ns = 0;
+    m_peak = 0;
+    m_stealCount = 0;
+    m_allocationCount = 0;
+    m_freeCount = 0;
+    m_walkPart = -1;
+    m_walkTicks = 0;
+    m_walkRelease = false;
+    m_walkDone = m_walkLoops <= 0;
+
+    if (!load()) {
+        release();
+        return false;
+    }
+
+    QFile file(wavPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || !writeWavHeader(file, 0)) {
+        qWarning() << "OfflineRenderer - Failed to write file at: " << wavPath;
+        release();
+        return false;
+    }
+
+    std::stable_sort(m_timeline.begin(), m_timeline.end(), [](const OfflineEvent &a, const OfflineEvent &b) {
+        return a.time < b.time;
+    });
+
+    double duration = m_duration;
+    if (duration <= 0.0 && m_walkLoops > 0) {
+        duration = OFFLINE_MAX_WALK_DURATION;
+    } else if (duration <= 0.0) {
+        duration = (m_timeline.isEmpty() ? 0.0 : m_timeline.last().time) + OFFLINE_DEFAULT_TAIL;
+    }
+    const qint64 maxSamples = (qint64)(duration * SAMPLE_PER_SECOND);
+
+    int tempo = m_tempo > 0 ? m_tempo : SongPlayer_getTempo();
+    if (tempo <= 0) {
+        tempo = OFFLINE_DEFAULT_TEMPO;
+    }
+
+    // Same as the player: the song starts right away, the timeline drives it from there
+    SongPlayer_externalStart();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    bool ok = true;
+    bool played = false;
+    int eventIndex = 0;
+    double processedSamples_real = 0.0;
+    SongPlayer_PlayerStatus lastStatus = STOPPED;
+    quint64 allocations = AllocationTracker::threadAllocations();
+    quint64 frees = AllocationTracker::threadFrees();
+
+    while (m_renderedSamples < maxSamples) {
+        // Same real-time path as the player, only the file is written outside of it
+        AllocationTracker::enterRealtime();
+
+        // Events are applied on the refresh they fall in, as the player does
+        double time = m_renderedSamples / SAMPLE_PER_SECOND;
+        while (eventIndex < m_timeline.size() && m_timeline[eventIndex].time <= time) {
+            SongPlayer_ButtonCallback(m_timeline[eventIndex].event, (unsigned long long)(m_timeline[eventIndex].time * 1000.0)); // Units: ms
+            eventIndex++;
+        }
+
+        SongPlayer_processSong(TICK_TO_TIME_RATIO(tempo), TICKS_PER_REFRESH);
+
+        SongPlayer_PlayerStatus status;
+        unsigned int partIndex;
+        unsigned int drumfillIndex;
+        SongPlayer_getPlayerStatus(&status, &partIndex, &drumfillIndex);
+        if (status == NO_SONG_LOADED) {
+            AllocationTracker::leaveRealtime();
+            break;
+        }
+        if (status != lastStatus) {
+            if (status == PLAYING_MAIN_TRACK && m_tempo <= 0 && SongPlayer_getTempo() > 0) {
+                tempo = SongPlayer_getTempo();
+            }
+            played = played || status != STOPPED;
+            lastStatus = status;
+        }
+        if (!m_walkDone) {
+            walk(status, partIndex, (unsigned long long)(time * 1000.0));
+        }
+
+        // Keep track of the actual amount of samples being processed (with fraction being summed until entire value reached)
+        processedSamples_real += SAMPLES_PER_REFRESH(tempo);
+        int samples = (int)qMin((qint64)qFloor(processedSamples_real), maxSamples - m_renderedSamples);
+        processedSamples_real -= (double)qFloor(processedSamples_real);
+        if (samples <= 0) {
+            AllocationTracker::leaveRealtime();
+            continue;
+        }
+
+        mixer_ReadOutputStream((short int*)m_buffer.data(), samples * 2); // length is in absolute sample count (stereo)
+        AllocationTracker::leaveRealtime();
+        qint64 bytes = (qint64)samples * SAMPLES_TO_BYTES_RATIO_I;
+        if (file.write(m_buffer.constData(), bytes) != bytes) {
+            qWarning() << "OfflineRenderer - Failed to write file at: " << wavPath;
+            ok = false;
+            break;
+        }
+        m_renderedSamples += samples;
+
+        const short int *data = (const short int*)m_buffer.constData();
+        int peak = 0;
+        for (int i = 0; i < samples * 2; i++) {
+            peak = qMax(peak, abs(data[i]));
+        }
+        m_peak = qMax(m_peak, peak);
+
+        // The song is over once it stopped and its sound died out
+        if (played && status == STOPPED && eventIndex >= m_timeline.size() && peak <= OFFLINE_SILENCE_THRESHOLD) {
+            break;
+        }
+    }
+
+    m_renderTime_ns = timer.nsecsElapsed();
+    m_stealCount = mixer_getStealCount();
+    m_allocationCount = (qint64)(AllocationTracker::threadAllocations() - allocations);
+    m_freeCount = (qint64)(AllocationTracker::threadFrees() - frees);
+
+    if (ok) {
+        ok = file.seek(0) && writeWavHeader(file, (quint32)(m_renderedSamples * SAMPLES_TO_BYTES_RATIO_I));
+    }
+    file.close();
+    release();
+
+    qDebug() << "OfflineRenderer - Rendered " << m_renderedSamples / SAMPLE_PER_SECOND << "s in "
+             << renderTime_ms() << "ms (" << realtimeRatio() << "x realtime) to " << wavPath;
+    return ok;
+}
+
+/**
+ * @brief OfflineRenderer::realtimeRatio
+ * @return duration of the rendered audio divided by the time it took to render it
+ */
+double OfflineRenderer::realtimeRatio() const
+{
+    if (m_renderTime_ns <= 0) {
+        return 0.0;
+    }
+    return (m_renderedSamples / SAMPLE_PER_SECOND) / (m_renderTime_ns / 1000000000.0);
+}
+
+/**
+ * @brief OfflineRenderer::peakLevel_dB
+ * @return highest absolute sample value of the last render relative to full scale, -inf dB for silence
+ */
+double OfflineRenderer::peakLevel_dB() const
+{
+    return 20.0 * log10(m_peak / 32768.0);
+}
+
+/**
+ * @brief OfflineRenderer::walk triggers the pedal events of the song walk, called after each refresh.
+ *
+ * Ticks spent playing the main loop of a part are counted, once they reach the number of loops
+ * the pedal is held (transition fill) and released as soon as the transition started, or it is
+ * double tapped on the last part (outro).
+ */
+void OfflineRenderer::walk(SongPlayer_PlayerStatus status, unsigned int partIndex, unsigned long long time)
+{
+    if (m_walkRelease) {
+        // Released once the transition is engaged, a release while still on the main loop would ask for a drum fill
+        if (status == TRANFILL_WAITING_TRIG || status == TRANFILL_ACTIVE || status == NO_FILL_TRAN) {
+            SongPlayer_ButtonCallback(BUTTON_EVENT_PEDAL_RELEASE, time);
+            m_walkRelease = false;
+        }
+        return;
+    }
+    if (status != PLAYING_MAIN_TRACK) {
+        return;
+    }
+    if ((int)partIndex != m_walkPart) {
+        m_walkPart = partIndex;
+        m_walkTicks = 0;
+    }
+
+    m_walkTicks += TICKS_PER_REFRESH;
+    if (m_walkTicks < m_walkLoops * SongPlayer_getMainLoopLength()) {
+        return;
+    }
+
+    if (m_walkPart + 1 < SongPlayer_getPartCount()) {
+        SongPlayer_ButtonCallback(BUTTON_EVENT_PEDAL_PRESS, time);
+        SongPlayer_ButtonCallback(BUTTON_EVENT_PEDAL_LONG_PRESS, time);
+        m_walkRelease = true;
+    } else {
+        // The press clears the long press of the last transition, which would turn the tap into a press
+        SongPlayer_ButtonCallback(BUTTON_EVENT_PEDAL_PRESS, time);
+        SongPlayer_ButtonCallback(BUTTON_EVENT_PEDAL_MULTI_TAP, time);
+        m_walkDone = true;
+    }
+}
+
+/**
+ * @brief OfflineRenderer::loadDrumset maps or reads the drumset at path and decodes its layers as for a render
+ */
+bool OfflineRenderer::loadDrumset(const QString &path, DrumsetCache *drumset)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "OfflineRenderer - Failed to open drumset file at: " << path;
+        return false;
+    }
+    if (!drumset->map(path, file)) {
+        drumset->read(path, file);
+    }
+    file.close();
+    if (drumset->isEmpty() || drumset->size() < 100) {
+        qWarning() << "OfflineRenderer - Invalid drumset data - file may be corrupted";
+        drumset->clear();
+        return false;
+    }
+    if (!drumset->decode(SOUNDMANAGER_DEFAULT_DECODE_BUDGET)) {
+        qWarning() << "OfflineRenderer - Failed to decode drumset layers";
+        drumset->clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief OfflineRenderer::load loads the drumset and the song, and initializes the mixer, SoundManager and SongPlayer
+ */
+bool OfflineRenderer::load()
+{
+    const DrumsetCache *drumset = m_sharedDrumset;
+    if (!drumset) {
+        if (!loadDrumset(m_drumsetPath, &m_drumset)) {
+            return false;
+        }
+        drumset = &m_drumset;
+    }
+
+    m_song.clear();
+    QString effectsPath = m_effectsPath.isEmpty() ? Player::defaultEffectsPath() : m_effectsPath;
+    if (!SongPrefetcher::load(m_songPath, effectsPath, &m_song)) {
+        return false;
+    }
+
+    m_buffer.resize(MIXER_BUFFER_LENGTH_BYTES_STEREO);
+
+    mixer_init();
+    mixer_setOutputLevel(OFFLINE_OUTPUT_LEVEL);
+    mixer_setPolyphony(m_polyphony);
+    EngineContext_setSeed(m_seed);
+
+    SoundManager_init();
+    SoundManager_LoadDrumset(drumset->data(), drumset->size(), drumset->decoded());
+
+    SongPlayer_init();
+    SongPlayer_loadPreparedSong(m_song.prepared);
+    for (int i = 0; i < MAX_SONG_PARTS; i++) {
+        SoundManager_LoadEffect(m_song.effects[i].isEmpty() ? nullptr : m_song.effects[i].data(), i);
+    }
+    return true;
+}
+
+/**
+ * @brief OfflineRenderer::release stops the song and frees it along with the drumset,
+ *        after removing them from the SongPlayer and SoundManager
+ */
+void OfflineRenderer::release()
+{
+    SongPlayer_externalStop();
+    SongPlayer_init();
+    for (int i = 0; i < MAX_SONG_PARTS; i++) {
+        SoundManager_LoadEffect(nullptr, i);
+    }
+    SoundManager_init();
+
+    m_song.clear();
+    m_drumset.clear();
+}
+
+/**
+ * @brief OfflineRenderer::writeWavHeader writes the header of a 44.1 kHz 16 bits stereo PCM WAV file
+ * @param file
+ * @param dataSize size of the samples following the header, in bytes
+ */
+bool OfflineRenderer::writeWavHeader(QFile &file, quint32 dataSize)
+{
+    char header[WAV_HEADER_SIZE];
+    memcpy(header, "RIFF", 4);
+    putLittleEndian(header + 4, dataSize + WAV_HEADER_SIZE - 8, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLittleEndian(header + 16, 16, 4);                                // fmt chunk size
+    putLittleEndian(header + 20, 1, 2);                                 // PCM
+    putLittleEndian(header + 22, 2, 2);                                 // Channels
+    putLittleEndian(header + 24, (quint32)SAMPLE_PER_SECOND, 4);        // Sample rate
+    putLittleEndian(header + 28, (quint32)SAMPLE_PER_SECOND * SAMPLES_TO_BYTES_RATIO_I, 4); // Byte rate
+    putLittleEndian(header + 32, SAMPLES_TO_BYTES_RATIO_I, 2);          // Block align
+    putLittleEndian(header + 34, 16, 2);                                // Bits per sample
+    memcpy(header + 36, "data", 4);
+    putLittleEndian(header + 40, dataSize, 4);
+
+    return file.write(header, WAV_HEADER_SIZE) == WAV_HEADER_SIZE;
+}
@@ -0,0 +1,102 @@
+#ifndef OFFLINERENDERER_H
+#define OFFLINERENDERER_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <QList>
+
+#include "button.h"
+#include "drumsetcache.h"
+#include "songprefetcher.h"
+#include "songPlayer.h"
+
+/**
+ * @brief Pedal event of a scripted timeline.
+ */
+struct OfflineEvent
+{
+   double time; // Units: s, from the start of the render
+   BUTTON_EVENT event;
+};
+
+/**
+ * @brief Renders a song with a drumset to a 16 bits stereo WAV file, as fast as possible and without any audio device.
+ *
+ * The song is started as the player does, pedal events come from a scripted timeline, or from
+ * a walk through the song: intro, a number of loops of each part with transitions in between, then outro.
+ * Rendering ends after the duration, or once the song stopped and its sound died out.
+ *
+ * Each render runs on an EngineContext of its own, renderers can be used from several threads
+ * at a time and alongside a Player. A renderer instance must only be used by one thread at a time,
+ * a drumset loaded once can be shared by all of them (see setSharedDrumset).
+ */
+class OfflineRenderer
+{
+public:
+   OfflineRenderer();
+
+   void setDrumset(const QString &path);
+   void setSharedDrumset(const DrumsetCache *drumset);
+   void setSong(const QString &path);
+   void setEffectsPath(const QString &path);
+   void setTempo(int bpm);
+   void setDuration(double seconds);
+   void setWalkLoops(int loops);
+   void setPolyphony(int polyphony);
+   void setSeed(quint32 seed);
+   void addEvent(double time, BUTTON_EVENT event);
+   bool loadTimeline(const QString &path);
+
+   bool render(const QString &wavPath);
+
+   inline qint64 renderedSamples() const {return m_renderedSamples;}
+   inline qint64 renderTime_ms() const {return m_renderTime_ns / 1000000;}
+   double realtimeRatio() const;
+   double peakLevel_dB() const;
+   inline int stealCount() const {return m_stealCount;}
+   inline qint64 allocationCount() const {return m_allocationCount;}
+   inline qint64 freeCount() const {return m_freeCount;}
+
+   static bool parseEvent(const QString &name, BUTTON_EVENT *event);
+   static bool loadDrumset(const QString &path, DrumsetCache *drumset);
+
+private:
+   Q_DISABLE_COPY(OfflineRenderer)
+
+   bool renderSong(const QString &wavPath);
+   void walk(SongPlayer_PlayerStatus status, unsigned int partIndex, unsigned long long time);
+   bool load();
+   void release();
+   static bool writeWavHeader(QFile &file, quint32 dataSize);
+
+   QString m_drumsetPath;
+   QString m_songPath;
+   QString m_effectsPath;
+   int m_tempo; // 0 to use the song tempo
+   double m_duration;
+   int m_walkLoops; // 0 to only follow the timeline
+   int m_polyphony;
+   quint32 m_seed; // Of the random generator of the engine
+   QList<OfflineEvent> m_timeline;
+
+   DrumsetCache m_drumset;
+   const DrumsetCache *m_sharedDrumset; // Loaded by the caller, used instead of m_drumset when set
+   PrefetchedSong m_song;
+   QByteArray m_buffer;
+
+   // Song walk progress
+   int m_walkPart;
+   int m_walkTicks;
+   bool m_walkRelease;
+   bool m_walkDone;
+
+   qint64 m_renderedSamples;
+   qint64 m_renderTime_ns;
+   int m_peak; // Highest absolute sample value
+   int m_stealCount; // Sounds stolen by new ones once the polyphony was reached
+   qint64 m_allocationCount; // Heap allocations while rendering, see AllocationTracker
+   qint64 m_freeCount; // Heap frees while rendering
+};
+
+#endif // OFFLINERENDERER_H
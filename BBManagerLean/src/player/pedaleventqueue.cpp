@@ -0,0 +1,93 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "pedaleventqueue.h"
+
+#define PEDAL_EVENT_QUEUE_MASK      (PEDAL_EVENT_QUEUE_SIZE - 1)
+
+PedalEventQueue::PedalEventQueue()
+    : m_head(0)
+    , m_tail(0)
+{
+}
+
+/**
+ * @brief PedalEventQueue::push
+ *        NOTE: producer side, must always be called from the same thread
+ * @param event
+ * @param timestamp
+ * @return false if the queue is full, the event is then dropped
+ */
+bool PedalEventQueue::push(BUTTON_EVENT event, qint64 timestamp)
+{
+    // Indexes only grow, they are compared as unsigned so that wrapping around is harmless
+    unsigned int tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) >= PEDAL_EVENT_QUEUE_SIZE) {
+        return false;
+    }
+
+    PedalEvent &slot = m_events[tail & PEDAL_EVENT_QUEUE_MASK];
+    slot.event = event;
+    slot.timestamp = timestamp;
+
+    // Publish the event once it is written
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief PedalEventQueue::peek
+ *        NOTE: consumer side, must always be called from the same thread
+ * @param event receives the oldest event, which stays in the queue
+ * @return false if the queue is empty
+ */
+bool PedalEventQueue::peek(PedalEvent *event) const
+{
+    unsigned int head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    *event = m_events[head & PEDAL_EVENT_QUEUE_MASK];
+    return true;
+}
+
+/**
+ * @brief PedalEventQueue::pop
+ *        NOTE: consumer side, must always be called from the same thread
+ * @param event receives the oldest event
+ * @return false if the queue is empty
+ */
+bool PedalEventQueue::pop(PedalEvent *event)
+{
+    unsigned int head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    *event = m_events[head & PEDAL_EVENT_QUEUE_MASK];
+
+    // Release the slot once it is read
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief PedalEventQueue::clear drops all pending events
+ *        NOTE: only valid while the consumer is not running
+ */
+void PedalEventQueue::clear()
+{
+    m_head.store(m_tail.load(std::memory_order_acquire), std::memory_order_release);
+}
@@ -0,0 +1,48 @@
+#ifndef PEDALEVENTQUEUE_H
+#define PEDALEVENTQUEUE_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <atomic>
+
+#include "button.h"
+
+// Must be a power of 2
+#define PEDAL_EVENT_QUEUE_SIZE      (64)
+
+/**
+ * @brief Pedal event along with the time it happened.
+ */
+struct PedalEvent
+{
+   BUTTON_EVENT event;
+   qint64 timestamp; // Units: ns, on the player event clock
+};
+
+/**
+ * @brief Wait-free single producer, single consumer ring of pedal events.
+ *
+ * Events are pushed by the thread calling the pedal slots (the GUI thread) and popped by
+ * the player thread. Neither side ever blocks or takes a lock: each one only writes its
+ * own index, and the other index is read with acquire semantics.
+ */
+class PedalEventQueue
+{
+public:
+   PedalEventQueue();
+
+   bool push(BUTTON_EVENT event, qint64 timestamp);
+   bool peek(PedalEvent *event) const;
+   bool pop(PedalEvent *event);
+   void clear();
+
+private:
+   Q_DISABLE_COPY(PedalEventQueue)
+
+   PedalEvent m_events[PEDAL_EVENT_QUEUE_SIZE];
+   std::atomic<unsigned int> m_head; // Next event to pop, only written by the consumer
+   std::atomic<unsigned int> m_tail; // Next event to push, only written by the producer
+};
+
+#endif // PEDALEVENTQUEUE_H
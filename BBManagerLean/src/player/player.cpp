@@ -18,6 +18,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QTimer>
 #include <stdexcept>
 
 #ifdef Q_OS_LINUX
@@ -26,26 +28,32 @@
 #endif
 
 #include "player.h"
+#include "allocationtracker.h"
 #include "mixer.h"
 #include "songPlayer.h"
 #include "../model/filegraph/song.h"
 #include "soundManager.h"
 #include "../../src/workspace/settings.h"
 
-#define TICK_TO_TIME_RATIO(bpm)     ((60.0f / (double)bpm) / 480.0f)
 #define PREPARE_STOP_THREASHOLD     (5)
 #define MIXER_DEFAULT_LEVEL         (1.0)
+#define PULL_MODE_CONTROL_INTERVAL_MS (10)
 
+// Adaptive buffering: grow quickly on underruns, shrink slowly, and wait longer before shrinking after each underrun
+#define ADAPTIVE_BUFFER_GROW_MS             (20)
+#define ADAPTIVE_BUFFER_SHRINK_MS           (5)
+#define ADAPTIVE_BUFFER_SHRINK_DELAY_MS     (30000)
+#define ADAPTIVE_BUFFER_MAX_SHRINK_DELAY_MS (600000)
+#define DEFAULT_EFFECTS_PATH        "/home/rory/Documents/BBWorkspace/user_lib/projects/BeatBuddy Default Content 2.0 - Project/EFFECTS"
+
+// Types of Player::Notification
+enum {
+    NOTIFY_STATUS,          // value: SongPlayer_PlayerStatus
+    NOTIFY_TEMPO,           // value: bpm set by the song
+    NOTIFY_SONG_CHANGE,     // value: sounds stolen during the previous song, the new one is m_changedSongPath
+    NOTIFY_DRUMSET_SWAP,
+};
 
-// NOTE: these defines can be used due to hardcoded initialization of m_format
-// Units: sample/s
-#define SAMPLE_PER_SECOND           44100.0f
-// Units: ticks/refresh
-#define TICKS_PER_REFRESH           5
-// Units: byte/sample
-#define SAMPLES_TO_BYTES_RATIO_I      (4)
-// Units: sample/refresh = ticks/refresh * s/tick * sample/s
-#define SAMPLES_PER_REFRESH(bpm)  (TICKS_PER_REFRESH * TICK_TO_TIME_RATIO(bpm) * SAMPLE_PER_SECOND)
 
 // The idea is to process a fixed amount of ticks per update
 // In order for player to behave properly (and transition to fit at proper time), the number of ticks needs to be fixed to a value that fits with bar length, etc..
@@ -72,12 +80,35 @@ Player::Player(QObject *parent)
     , m_device(QAudioDeviceInfo::defaultOutputDevice())
     , m_audioOutput(nullptr)
     , m_ioDevice(nullptr)
+    , m_pullDevice(this)
 {
     qDebug() << "Creating Player object";
     m_singleTrack = false;
     m_singleTrackOffset = 0;
 
     m_bufferTime_ms = Settings::getBufferingTime_ms();
+    m_drumsetMmap = Settings::getDrumsetMmap();
+    m_pullMode = Settings::getPullMode();
+    m_pullModeStarted = false;
+    m_pullOffset = 0;
+    m_pullLength = 0;
+    m_lastMemoryCheck = 0;
+    m_polyphony = Settings::getPolyphony();
+    m_decodeBudget_MB = Settings::getDecodeBudget_MB();
+    m_eventClock.start();
+
+    m_adaptiveBuffering = Settings::getAdaptiveBuffering();
+    if (m_adaptiveBuffering) {
+        slotSetBufferTime_ms(MIXER_MIN_BUFFERRING_TIME_MS);
+    }
+    m_outputStarted = false;
+    m_underrun = false;
+    m_pullStarved = false;
+    m_lastPullTime = -1;
+    m_underrunCount = 0;
+    m_lastBufferAdaptTime = 0;
+    m_bufferShrinkDelay_ms = ADAPTIVE_BUFFER_SHRINK_DELAY_MS;
+    m_drumsetLoadedMmap = m_drumsetMmap;
     m_bufferSize_bytes = MIXER_BUFFERRING_TIME_MS_TO_BYTES_STEREO(m_bufferTime_ms);
 
 
@@ -86,6 +117,30 @@ Player::Player(QObject *parent)
     m_prevBeatInBar = 0;
     m_prevTick = -1;
     m_prevPart = stopped;
+    m_prevPlayCount = 0;
+
+    memset(&m_published, 0, sizeof(m_published));
+    m_published.part = stopped;
+    m_published.sigNum = m_prevSigNum;
+    m_published.tick = m_prevTick;
+    m_status.store(m_published);
+    m_polledSequence = m_status.sequence();
+
+    qRegisterMetaType<PlayerSnapshot>("PlayerSnapshot");
+    connect(&m_statusTimer, &QTimer::timeout, this, &Player::slotPollStatus);
+    setStatusRate(PLAYER_DEFAULT_STATUS_RATE);
+
+    m_setlistIndex = 0;
+    m_nextSongChange = false;
+    m_songChangeCount = 0;
+    m_retiredSongCount = 0;
+
+    m_nextDrumsetMmap = false;
+    m_drumsetSwapTick = -1;
+    m_processedTicks = 0;
+
+    m_notificationCount = 0;
+    m_droppedNotifications = 0;
 }
 
 Player::~Player()
@@ -115,8 +170,42 @@ void Player::initAudio(void)
     m_audioOutput = new QAudioOutput(m_device, m_format, nullptr);
 
     // NOTE: m_bufferSize_bytes is only computed at start of thread.
-    m_bufferSize_bytes = MIXER_BUFFERRING_TIME_MS_TO_BYTES_STEREO(m_bufferTime_ms);
-    m_audioOutput->setBufferSize(m_bufferSize_bytes);
+    //       Buffers under MIXER_MIN_BUFFERRING_TIME_MS are only safe in pull mode.
+    int bufferTime_ms = m_pullModeStarted ? m_bufferTime_ms : qMax(m_bufferTime_ms, MIXER_MIN_BUFFERRING_TIME_MS);
+    m_bufferSize_bytes = MIXER_BUFFERRING_TIME_MS_TO_BYTES_STEREO(bufferTime_ms);
+    if (m_adaptiveBuffering) {
+        m_bufferTime_ms = bufferTime_ms; // Adapted from the actual buffer time
+    }
+
+    // In adaptive push mode, the sound card buffer is as big as it can get and only the part of it
+    // being filled (m_bufferSize_bytes) is adapted, through m_soundCardLimit
+    if (m_adaptiveBuffering && !m_pullModeStarted) {
+        m_audioOutput->setBufferSize(MIXER_BUFFERRING_TIME_MS_TO_BYTES_STEREO(MIXER_MAX_BUFFERRING_TIME_MS));
+    } else {
+        m_audioOutput->setBufferSize(m_bufferSize_bytes);
+    }
+
+    m_outputStarted = false;
+    m_underrun = false;
+    m_pullStarved = false;
+    m_lastPullTime = -1;
+    m_underrunCount = 0;
+    m_lastBufferAdaptTime = m_eventClock.elapsed();
+    m_bufferShrinkDelay_ms = ADAPTIVE_BUFFER_SHRINK_DELAY_MS;
+
+    if (m_pullModeStarted) {
+        // The audio device reads m_pullDevice whenever it needs data, from this thread's event loop
+        m_pullOffset = 0;
+        m_pullLength = 0;
+        m_pullError.clear();
+        m_pullDevice.close();
+        m_pullDevice.open(QIODevice::ReadOnly);
+        m_audioOutput->start(&m_pullDevice);
+        m_ioDevice = nullptr;
+        m_soundCardLimit = 0;
+        return;
+    }
+
     m_ioDevice = m_audioOutput->start();
 
     // Ajust the actual buffer size with real buffer size
@@ -133,6 +222,8 @@ void Player::initMixer(void)
 {
     mixer_init();
     mixer_setOutputLevel(MIXER_DEFAULT_LEVEL);
+    mixer_setPolyphony(m_polyphony);
+    qDebug() << "Mixing kernels:" << mixer_getKernelsName() << ", polyphony:" << mixer_getPolyphony();
 }
 
 bool Player::checkMemoryAvailability(qint64 requiredBytes)
@@ -160,17 +251,21 @@ bool Player::checkMemoryAvailability(qint64 requiredBytes)
 
 void Player::loadDrumset(const QString &filepath)
 {
+    QElapsedTimer loadTimer;
+    loadTimer.start();
+
+    // SoundManager tables still point into the resident drumset, nothing to do if it did not change.
+    // It may have been swapped in during playback: it is decoded as well, it still has to match the budget.
+    if (m_drumset.isCurrent(filepath) && m_drumsetLoadedMmap == m_drumsetMmap && m_drumset.isDecoded(decodeBudget())) {
+        qDebug() << "Drumset reused " << filepath << " in " << loadTimer.elapsed() << "ms";
+        return;
+    }
+
     qDebug() << "Loading drumset " << filepath;
 
     // Free any potential memory from previous operations
-    for (int i = 0; i < MAX_SONG_PARTS; i++) {
-        m_effects[i].clear();
-        m_effects[i].squeeze();
-    }
-    m_song.clear();
-    m_song.squeeze();
+    releaseSong();
     m_drumset.clear();
-    m_drumset.squeeze();
 
     QFile file(filepath);
     if (!file.open(QIODevice::ReadOnly)) {
@@ -182,49 +277,26 @@ void Player::loadDrumset(const QString &filepath)
         // Check file size before loading
         qint64 fileSize = file.size();
         qDebug() << "Drumset file size: " << fileSize << " bytes";
-        
-        // Impose a hard limit on file size (100MB)
-        const qint64 maxFileSize = 100 * 1024 * 1024; // 100MB
-        if (fileSize > maxFileSize) {
-            file.close();
-            qWarning() << "Drumset file too large: " << fileSize / (1024*1024) << "MB (max " << maxFileSize / (1024*1024) << "MB)";
-            throw std::runtime_error("Drumset file too large - maximum supported size is 100MB");
-        }
-        
-        // For large drumsets, reduce memory requirements to 1.1x file size
-        const qint64 largeFileCutoff = 50 * 1024 * 1024; // 50MB
-        
-        if (fileSize > largeFileCutoff) {
-            qDebug() << "Large drumset detected - adjusting memory requirements";
-            
-            // Check with reduced memory requirements (just 10% overhead)
-            struct sysinfo memInfo;
-            if (sysinfo(&memInfo) == 0) {
-                qint64 availableMemory = memInfo.freeram * memInfo.mem_unit;
-                qint64 requiredMemory = fileSize * 1.1; // Only 10% overhead for large files
-                
-                qDebug() << "Available memory: " << availableMemory / (1024*1024) << "MB";
-                qDebug() << "Required memory: " << requiredMemory / (1024*1024) << "MB";
-                
-                if (availableMemory < requiredMemory) {
-                    file.close();
-                    qWarning() << "Not enough memory for large drumset";
-                    throw std::runtime_error("Not enough memory to load large drumset - please free up system memory or use a smaller drumset");
-                }
-            }
-        } else {
-            // Standard approach for smaller files
-            if (!checkMemoryAvailability(fileSize)) {
-                file.close();
-                throw std::runtime_error("Not enough available memory to load drumset - try using a smaller drumset file");
+
+        // A mapped drumset is paged in from the file on demand, it is neither limited in size nor by free memory
+        bool mapped = false;
+        m_drumsetLoadedMmap = m_drumsetMmap;
+        if (m_drumsetMmap) {
+            mapped = m_drumset.map(filepath, file);
+            if (!mapped) {
+                qWarning() << "Unable to map drumset, falling back to heap copy";
             }
         }
-        
-        // Simply read the entire file in one go
-        qDebug() << "Reading drumset file...";
-        m_drumset = file.readAll();
+
+        if (!mapped) {
+            checkDrumsetMemory(fileSize);
+
+            // Simply read the entire file in one go
+            qDebug() << "Reading drumset file...";
+            m_drumset.read(filepath, file);
+        }
         file.close();
-        
+
         qDebug() << "Drumset loaded into memory, initializing sound manager...";
         try {
             SoundManager_init();
@@ -248,8 +320,18 @@ void Player::loadDrumset(const QString &filepath)
                 throw std::runtime_error("Invalid drumset data pointer");
             }
             
-            SoundManager_LoadDrumset(m_drumset.data(), m_drumset.size());
-            qDebug() << "Drumset successfully loaded";
+            if (!m_drumset.decode(decodeBudget())) {
+                qWarning() << "Failed to decode drumset layers";
+                throw std::runtime_error("Failed to decode drumset layers");
+            }
+            SoundManager_LoadDrumset(m_drumset.data(), m_drumset.size(), m_drumset.decoded());
+            qDebug() << "Drumset loaded " << filepath << (m_drumset.isMapped() ? " (mapped)" : " (heap)")
+                     << " in " << loadTimer.elapsed() << "ms";
+
+            SoundManager_DecodeStats decodeStats;
+            SoundManager_getDecodeStats(m_drumset.decoded(), &decodeStats);
+            qDebug() << "Drumset 24 bits layers decoded: " << decodeStats.decodedLayers << " in "
+                     << decodeStats.decodedBytes / 1024 << "KB, " << decodeStats.rawLayers << " over the budget";
         } catch (const std::exception& e) {
             qWarning() << "Failed to load drumset into sound manager:" << e.what();
             throw std::runtime_error(std::string("Failed to load drumset: ") + e.what());
@@ -260,11 +342,13 @@ void Player::loadDrumset(const QString &filepath)
     }
     catch (const std::bad_alloc&) {
         file.close();
+        m_drumset.clear();
         qWarning() << "Memory allocation failed while loading drumset";
         throw std::runtime_error("Not enough memory to load drumset - try using a smaller drumset file");
     }
     catch (const std::exception& e) {
         file.close();
+        m_drumset.clear();
         qWarning() << "Exception while loading drumset: " << e.what();
         throw;
     }
@@ -285,6 +369,9 @@ void Player::logMemoryUsage() const
     qDebug() << "Memory usage:";
     qDebug() << "  Song buffer: " << m_song.capacity() / (1024.0) << "KB";
     qDebug() << "  Drumset buffer: " << m_drumset.capacity() / (1024.0) << "KB";
+    if (m_drumset.isMapped()) {
+        qDebug() << "  Drumset mapped: " << m_drumset.size() / (1024.0) << "KB";
+    }
     qDebug() << "  Effect buffers: " << (totalMemoryUsed - m_song.capacity() - m_drumset.capacity()) / (1024.0) << "KB";
     qDebug() << "  TOTAL: " << totalMemoryUsed / (1024.0 * 1024.0) << "MB";
     
@@ -304,6 +391,49 @@ void Player::logMemoryUsage() const
 #endif
 }
 
+/**
+ * @brief Player::checkDrumsetMemory verifies a heap copy of the drumset can be made
+ * @param fileSize
+ */
+void Player::checkDrumsetMemory(qint64 fileSize)
+{
+    // Impose a hard limit on file size (100MB)
+    const qint64 maxFileSize = 100 * 1024 * 1024; // 100MB
+    if (fileSize > maxFileSize) {
+        qWarning() << "Drumset file too large: " << fileSize / (1024*1024) << "MB (max " << maxFileSize / (1024*1024) << "MB)";
+        throw std::runtime_error("Drumset file too large - maximum supported size is 100MB");
+    }
+
+    // For large drumsets, reduce memory requirements to 1.1x file size
+    const qint64 largeFileCutoff = 50 * 1024 * 1024; // 50MB
+
+    if (fileSize > largeFileCutoff) {
+        qDebug() << "Large drumset detected - adjusting memory requirements";
+
+#ifdef Q_OS_LINUX
+        // Check with reduced memory requirements (just 10% overhead)
+        struct sysinfo memInfo;
+        if (sysinfo(&memInfo) == 0) {
+            qint64 availableMemory = memInfo.freeram * memInfo.mem_unit;
+            qint64 requiredMemory = fileSize * 1.1; // Only 10% overhead for large files
+
+            qDebug() << "Available memory: " << availableMemory / (1024*1024) << "MB";
+            qDebug() << "Required memory: " << requiredMemory / (1024*1024) << "MB";
+
+            if (availableMemory < requiredMemory) {
+                qWarning() << "Not enough memory for large drumset";
+                throw std::runtime_error("Not enough memory to load large drumset - please free up system memory or use a smaller drumset");
+            }
+        }
+#endif
+    } else {
+        // Standard approach for smaller files
+        if (!checkMemoryAvailability(fileSize)) {
+            throw std::runtime_error("Not enough available memory to load drumset - try using a smaller drumset file");
+        }
+    }
+}
+
 bool Player::loadSong(const QString &filepath)
 {
     qDebug() << "Loading song " << filepath;
@@ -323,7 +453,16 @@ bool Player::loadSong(const QString &filepath)
     freeMemoryIfNeeded();
     
     logMemoryUsage();
-    
+
+    // Songs of the setlist are usually prefetched, they are already parsed along with their effects
+    PrefetchedSong prefetched;
+    if (m_prefetcher.take(filepath, &prefetched)) {
+        loadPrefetchedSong(prefetched);
+        qDebug() << "Song loaded from prefetch";
+        logMemoryUsage();
+        return true;
+    }
+
     // First, attempt to load the song without initializing the player
     QFile file(filepath);
     if (!file.open(QIODevice::ReadOnly)) {
@@ -372,14 +511,14 @@ bool Player::loadSong(const QString &filepath)
             throw std::runtime_error("Error loading song data into player");
         }
 
-        QString m_effectsPath = "/home/rory/Documents/BBWorkspace/user_lib/projects/BeatBuddy Default Content 2.0 - Project/EFFECTS";
+        QString effectsFolder = effectsPath();
 
-        qDebug() << "Loading effects from " << m_effectsPath;
+        qDebug() << "Loading effects from " << effectsFolder;
         for (uint i = 0; i < MAX_SONG_PARTS; i++) {
             char *name = SongPlayer_getSoundEffectName(i);
             if (name) {
                 if (*name != '\0') {
-                    if (!loadEffect(i, m_effectsPath + "/" + SongPlayer_getSoundEffectName(i))) {
+                    if (!loadEffect(i, effectsFolder + "/" + SongPlayer_getSoundEffectName(i))) {
                         return false;
                     }
                 } else {
@@ -405,6 +544,45 @@ bool Player::loadSong(const QString &filepath)
     }
 }
 
+/**
+ * @brief Player::loadPrefetchedSong hands a prefetched song and its effects over to the SongPlayer and SoundManager
+ * @param prefetched receives the released buffers
+ */
+void Player::loadPrefetchedSong(PrefetchedSong &prefetched)
+{
+    m_song.swap(prefetched.song);
+
+    SongPlayer_init();
+    SongPlayer_loadPreparedSong(prefetched.prepared);
+
+    for (int i = 0; i < MAX_SONG_PARTS; i++) {
+        if (prefetched.effects[i].isEmpty()) {
+            clearEffect(i);
+        } else {
+            m_effects[i].swap(prefetched.effects[i]);
+            SoundManager_LoadEffect(m_effects[i].data(), i);
+        }
+    }
+}
+
+/**
+ * @brief Player::effectsPath
+ * @return folder the song effects are loaded from
+ */
+QString Player::effectsPath() const
+{
+    return m_effectsPath.isEmpty() ? defaultEffectsPath() : m_effectsPath;
+}
+
+/**
+ * @brief Player::defaultEffectsPath
+ * @return folder the song effects are loaded from when none was set
+ */
+QString Player::defaultEffectsPath()
+{
+    return QString(DEFAULT_EFFECTS_PATH);
+}
+
 bool Player::loadEffect(int part, const QString &filepath)
 {
     QFile file(filepath);
@@ -452,6 +630,24 @@ void Player::clearEffect(int part)
     SoundManager_LoadEffect(nullptr, part);
 }
 
+/**
+ * @brief Player::releaseSong frees the song and its effects.
+ *        Effects are also removed from the SoundManager since it may outlive them with the resident drumset.
+ */
+void Player::releaseSong(void)
+{
+    SongPlayer_queueNextSong(nullptr);
+    m_nextSong.clear();
+    m_previousSong.clear();
+    releaseRetired();
+    m_song.clear();
+    m_song.squeeze();
+    for (int i = 0; i < MAX_SONG_PARTS; i++) {
+        clearEffect(i);
+        m_effects[i].squeeze();
+    }
+}
+
 int Player::processTime(int samplesToProcess)
 {
     SongPlayer_PlayerStatus currentPlayerStatus;
@@ -461,6 +657,21 @@ int Player::processTime(int samplesToProcess)
     // Process as many samples as possible, but always by multiples of TICKS_PER_REFRESH
     int updateCount = (int)(samplesToProcess / SAMPLES_PER_REFRESH(m_tempo));
 
+    // Swap the drumset on its bar boundary, before any note of the block is played
+    if (m_drumsetSwapTick >= 0) {
+        if (m_processedTicks >= m_drumsetSwapTick) {
+            commitDrumsetSwap();
+        } else {
+            updateCount = qMin(updateCount, (int)((m_drumsetSwapTick - m_processedTicks + TICKS_PER_REFRESH - 1) / TICKS_PER_REFRESH));
+        }
+    }
+
+    // End the block on the bar boundary where the song changes, so the next song starts right on it
+    int ticksToSongChange = m_singleTrack ? -1 : SongPlayer_getTicksToSongChange();
+    if (ticksToSongChange > 0) {
+        updateCount = qMin(updateCount, (ticksToSongChange + TICKS_PER_REFRESH - 1) / TICKS_PER_REFRESH);
+    }
+
     // Keep track of the actual amount of samples being processed (with fraction being summed until entire value reached)
     m_processedSamples_real += SAMPLES_PER_REFRESH(m_tempo) * updateCount;
 
@@ -468,6 +679,7 @@ int Player::processTime(int samplesToProcess)
     m_processedSamples_real -= (double)processedSamples;
 
     if(processedSamples > 0){
+        m_processedTicks += updateCount * TICKS_PER_REFRESH;
 
         if (m_singleTrack){
             SongPlayer_ProcessSingleTrack(TICK_TO_TIME_RATIO(m_tempo), updateCount * TICKS_PER_REFRESH, m_singleTrackOffset);
@@ -478,16 +690,20 @@ int Player::processTime(int samplesToProcess)
                 switch(currentPlayerStatus){
                 case SINGLE_TRACK_PLAYER:   m_prepareStop = 0;  break;
                 case STOPPED:               m_prepareStop = 1;  break;
-                default:
-                    qWarning() << "Player::processTime unhandled status " << currentPlayerStatus;
-                    break;
+                default:                                        break;
                 }
+                postNotification(NOTIFY_STATUS, currentPlayerStatus, PartIndex, DrumfillIndex);
                 m_lastPlayerStatus = currentPlayerStatus;
             }
 
         } else {
             SongPlayer_processSong(TICK_TO_TIME_RATIO(m_tempo), updateCount * TICKS_PER_REFRESH);
 
+            if (SongPlayer_getSongChangeCount() != m_songChangeCount) {
+                m_songChangeCount = SongPlayer_getSongChangeCount();
+                commitSongChange();
+            }
+
             SongPlayer_getPlayerStatus( &currentPlayerStatus,
                                         &PartIndex,
                                         &DrumfillIndex
@@ -496,20 +712,10 @@ int Player::processTime(int samplesToProcess)
                 switch (currentPlayerStatus) {
                 case NO_SONG_LOADED:            m_stop = 1;                                     break;
                 case STOPPED:                   m_prepareStop = 1;                              break;
-                case INTRO:                     emit sigPlayingIntro();                              break;
-                case PLAYING_MAIN_TRACK:
-                    qDebug() << "whats going on here1" << currentPlayerStatus << m_lastPlayerStatus
-                             << PartIndex << lastPartIndex;
-                    updateTempo();
-                    emit sigPlayingMainTrack(PartIndex);
-                    break;
-                case OUTRO:                     emit sigPlayingOutro();                              break;
-                case TRANFILL_ACTIVE:           emit sigPlayingTranfill(PartIndex);                  break;
-                case DRUMFILL_ACTIVE:           emit sigPlayingDrumfill(PartIndex, DrumfillIndex);   break;
-                default:
-                    qWarning() << "Player::processTime unhandled status " << currentPlayerStatus;
-                    break;
+                case PLAYING_MAIN_TRACK:        updateTempo();                                  break;
+                default:                                                                        break;
                 }
+                postNotification(NOTIFY_STATUS, currentPlayerStatus, PartIndex, DrumfillIndex);
                 if (currentPlayerStatus != STOPPED) {
                     m_prepareStop = 0;
                     // Make sure song is played at full strength if restarted during fadeout
@@ -527,18 +733,17 @@ int Player::processTime(int samplesToProcess)
 /**
  * NOTE: should only be called if samplesToProcess > 0
  * @brief Player::processAudio
+ * @param buffer receives the audio
  * @param samplesToProcess
  */
-void Player::processAudio(int samplesToProcess)
+void Player::processAudio(char *buffer, int samplesToProcess)
 {
 
 
-    mixer_ReadOutputStream((short int*)m_buffer,
+    mixer_ReadOutputStream((short int*)buffer,
                            samplesToProcess * m_format.channelCount()); // length is in absolute sample count (regardless of stereo/mono)
 
 
-    m_ioDevice->write(m_buffer, samplesToProcess * SAMPLES_TO_BYTES_RATIO_I);  // Number of bytes
-
     /* Stop audio thread if nothing is output after double tap */
     if (m_prepareStop) {
         int i;
@@ -547,7 +752,7 @@ void Player::processAudio(int samplesToProcess)
 
         // Scan the buffer untile one of the sample (16 bits) is bigger than the threashold,
         for (i=0; i<byteCount; i+=2 ) {
-            if (abs(*((short int*)(m_buffer + i))) > PREPARE_STOP_THREASHOLD) break;
+            if (abs(*((short int*)(buffer + i))) > PREPARE_STOP_THREASHOLD) break;
         }
         // if none found, stop
         if (i == byteCount) {
@@ -561,48 +766,531 @@ void Player::processAudio(int samplesToProcess)
 
 }
 
-void Player::processEvent(void)
+/**
+ * @brief Player::pullAudio renders audio on demand for the audio device (pull mode)
+ *        NOTE: called from the player thread event loop, through AudioPullDevice::readData
+ * @param data
+ * @param maxSize in bytes
+ * @return number of bytes written to data
+ */
+qint64 Player::pullAudio(char *data, qint64 maxSize)
+{
+    qint64 written = 0;
+    m_callbackTiming.begin();
+
+    // Nothing was read for longer than the buffer lasts: the sound card ran dry
+    qint64 now = m_eventClock.nsecsElapsed();
+    if (m_lastPullTime >= 0 && now - m_lastPullTime > m_bufferTime_ms * 1000000LL) {
+        m_pullStarved = true;
+    }
+    m_lastPullTime = now;
+
+    try {
+        // The unbreakable unit is the sample = 4 bytes
+        maxSize -= maxSize % SAMPLES_TO_BYTES_RATIO_I;
+        while (written < maxSize && !m_stop) {
+            if (m_pullOffset >= m_pullLength) {
+                // Time is processed by whole refreshes: render at least one, the remainder is kept for the next read
+                int sampleToProcess = (int)(qMin(maxSize - written, (qint64)m_bufferSize_bytes) / SAMPLES_TO_BYTES_RATIO_I);
+                sampleToProcess = qMax(sampleToProcess, qCeil(SAMPLES_PER_REFRESH(m_tempo)));
+                sampleToProcess = processBlock(sampleToProcess, m_eventClock.nsecsElapsed());
+                if (sampleToProcess <= 0) {
+                    break;
+                }
+                m_pullOffset = 0;
+                m_pullLength = sampleToProcess * SAMPLES_TO_BYTES_RATIO_I;
+            }
+
+            int length = (int)qMin((qint64)(m_pullLength - m_pullOffset), maxSize - written);
+            memcpy(data + written, m_buffer + m_pullOffset, length);
+            m_pullOffset += length;
+            written += length;
+        }
+    } catch (const std::exception& e) {
+        // Exceptions must not go through the audio device, they are thrown again once the event loop exited
+        m_pullError = e.what();
+        m_stop = 1;
+    }
+
+    m_callbackTiming.end();
+    if (written > 0) {
+        m_outputStarted = true;
+    }
+    return written;
+}
+
+/**
+ * @brief Player::runPullMode runs the thread event loop until playback stops, while the audio device pulls the audio
+ */
+void Player::runPullMode(void)
+{
+    QTimer timer;
+    connect(&timer, &QTimer::timeout, [this]() {
+        if (!checkMemoryUsage()) {
+            m_pullError = "Memory usage exceeded safe limits";
+            m_stop = 1;
+        }
+        if (m_stop) {
+            quit();
+            return;
+        }
+        checkUnderrun();
+        processChanges();
+    });
+    timer.start(PULL_MODE_CONTROL_INTERVAL_MS);
+
+    exec();
+
+    timer.stop();
+    m_audioOutput->stop();
+    m_pullDevice.close();
+
+    if (!m_pullError.isEmpty()) {
+        throw std::runtime_error(m_pullError.toStdString());
+    }
+}
+
+/**
+ * @brief Player::checkUnderrun detects the sound card running dry and adapts the buffer time if enabled.
+ *
+ * An underrun is detected when the output goes idle on an underrun error, when the whole buffer is
+ * free in push mode, or when nothing was read for longer than the buffer lasts in pull mode.
+ */
+void Player::checkUnderrun(void)
+{
+    if (!m_audioOutput || !m_outputStarted) {
+        return;
+    }
+
+    bool dry = m_audioOutput->state() == QAudio::IdleState && m_audioOutput->error() == QAudio::UnderrunError;
+    if (m_pullModeStarted) {
+        dry = dry || m_pullStarved;
+        m_pullStarved = false;
+    } else {
+        dry = dry || m_audioOutput->bytesFree() >= m_audioOutput->bufferSize();
+    }
+
+    qint64 now = m_eventClock.elapsed();
+    if (dry && !m_underrun) {
+        m_underrunCount++;
+        qWarning() << "Player::checkUnderrun - underrun " << m_underrunCount << " with a " << m_bufferTime_ms << "ms buffer";
+        emit sigBufferUnderrun(m_underrunCount);
+
+        if (m_adaptiveBuffering) {
+            adaptBufferTime(ADAPTIVE_BUFFER_GROW_MS);
+            m_bufferShrinkDelay_ms = qMin(2 * m_bufferShrinkDelay_ms, (qint64)ADAPTIVE_BUFFER_MAX_SHRINK_DELAY_MS);
+        }
+    } else if (m_adaptiveBuffering && now - m_lastBufferAdaptTime > m_bufferShrinkDelay_ms) {
+        adaptBufferTime(-ADAPTIVE_BUFFER_SHRINK_MS);
+    }
+    m_underrun = dry;
+}
+
+/**
+ * @brief Player::adaptBufferTime changes the buffer time while playing.
+ *        In push mode it applies right away, in pull mode the sound card buffer is only resized on next play.
+ * @param delta_ms
+ */
+void Player::adaptBufferTime(int delta_ms)
+{
+    m_lastBufferAdaptTime = m_eventClock.elapsed();
+
+    int previous_ms = m_bufferTime_ms;
+    slotSetBufferTime_ms(m_bufferTime_ms + delta_ms);
+    if (!m_pullModeStarted) {
+        m_bufferTime_ms = qMax(m_bufferTime_ms, MIXER_MIN_BUFFERRING_TIME_MS);
+    }
+    if (m_bufferTime_ms == previous_ms) {
+        return;
+    }
+    qDebug() << "Player::adaptBufferTime - buffer time " << previous_ms << "ms -> " << m_bufferTime_ms << "ms";
+
+    if (!m_pullModeStarted) {
+        // Fill more or less of the sound card buffer
+        int bufferSize_bytes = MIXER_BUFFERRING_TIME_MS_TO_BYTES_STEREO(m_bufferTime_ms);
+        m_soundCardLimit = (unsigned int)qMax(0, (int)m_soundCardLimit - (bufferSize_bytes - m_bufferSize_bytes));
+        m_bufferSize_bytes = bufferSize_bytes;
+    }
+}
+
+/**
+ * @brief Player::checkMemoryUsage periodically checks the memory used by the song and drumset
+ * @return false if memory usage is too high
+ */
+bool Player::checkMemoryUsage(void)
 {
-    if (m_lock.tryLockForRead()) {
-        if (!m_queue.isEmpty()) {
-            BUTTON_EVENT event = m_queue.dequeue();
+    const qint64 memoryCheckInterval = 5000; // Check memory every 5 seconds
+    const qint64 maxMemoryUsage = 500 * 1024 * 1024; // 500MB limit
 
-            SongPlayer_ButtonCallback(event, 0);
+    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+    if (currentTime - m_lastMemoryCheck <= memoryCheckInterval) {
+        return true;
+    }
+    m_lastMemoryCheck = currentTime;
+
+    // Get approximate memory usage of our key buffers
+    qint64 estimatedMemoryUsage = m_drumset.capacity() + m_song.size();
+    for (const auto& effect : m_effects) {
+        estimatedMemoryUsage += effect.size();
+    }
+
+    if (estimatedMemoryUsage > maxMemoryUsage) {
+        qWarning() << "Memory usage is too high: " << estimatedMemoryUsage << " bytes";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Player::processBlock renders a block of audio into m_buffer, applying each pending pedal event
+ *        at the start of the refresh it happened in, up to TICKS_PER_REFRESH ticks early.
+ *
+ * The block stands for the last samplesToProcess samples of time (the buffer latency is constant):
+ * an event that happened d seconds ago applies d * SAMPLE_PER_SECOND samples before the end of the block.
+ * The song is processed up to that position, then the event is handled and processing resumes, so
+ * transitions and accent hits land at the same moment whatever the buffer size. Since time is processed
+ * by whole refreshes, the event is applied at the start of the refresh it falls in: never late, and less
+ * than a refresh early (5 ticks, about 5 ms at 120 bpm).
+ * @param samplesToProcess
+ * @param now end of the block on m_eventClock (ns), the current time unless checked offline (see PlayerCheck)
+ * @return number of samples rendered
+ */
+int Player::processBlock(int samplesToProcess, qint64 now)
+{
+    AllocationTracker::RealtimeScope realtime;
+    int processed = 0;
+
+    PedalEvent event;
+    while (m_events.peek(&event)) {
+        qint64 offset = samplesToProcess - (qint64)((now - event.timestamp) * (SAMPLE_PER_SECOND / 1000000000.0));
+        if (offset >= samplesToProcess) {
+            break; // Happened after the block was started, left for the next block
         }
-        m_lock.unlock();
+
+        if (offset > processed) {
+            int samples = processTime((int)offset - processed);
+            if (samples > 0) {
+                processAudio(m_buffer + processed * SAMPLES_TO_BYTES_RATIO_I, samples);
+                processed += samples;
+            }
+        }
+
+        m_events.pop(&event);
+        m_callbackTiming.event((processed - qMax(offset, (qint64)0)) * (1000000000.0 / SAMPLE_PER_SECOND));
+        SongPlayer_ButtonCallback(event.event, event.timestamp / 1000000); // Units: ms
     }
+
+    if (samplesToProcess > processed) {
+        int samples = processTime(samplesToProcess - processed);
+        if (samples > 0) {
+            processAudio(m_buffer + processed * SAMPLES_TO_BYTES_RATIO_I, samples);
+            processed += samples;
+        }
+    }
+
+    publishStatus(false);
+    return processed;
+}
+
+/**
+ * @brief Player::queueEvent timestamps and queues a pedal event for the player thread
+ *        NOTE: the pedal slots must always be called from the same thread
+ * @param event
+ */
+void Player::queueEvent(BUTTON_EVENT event)
+{
+    if (!m_events.push(event, m_eventClock.nsecsElapsed())) {
+        qWarning() << "Player::queueEvent - queue is full, dropping event " << event;
+    }
+}
+
+/**
+ * @brief Player::processSongChange queues the song requested by requestNextSong once it is prefetched
+ */
+void Player::processSongChange(void)
+{
+    if (m_singleTrack || !m_lock.tryLockForWrite()) {
+        return;
+    }
+
+    // The song requested was swapped in by commitSongChange
+    if (!m_committedSongPath.isEmpty()) {
+        if (m_nextSongPath == m_committedSongPath) {
+            m_nextSongPath.clear();
+            m_nextSongChange = false;
+        }
+        m_committedSongPath.clear();
+    }
+
+    if (!m_nextSongPath.isEmpty() && m_nextSongPath != m_nextSong.path) {
+        bool pending;
+        PrefetchedSong song;
+        if (m_prefetcher.take(m_nextSongPath, &song, &pending)) {
+            // Queue the new song before the previously queued one is released
+            SongPlayer_queueNextSong(song.prepared);
+            m_nextSong.swap(song);
+        } else if (!pending) {
+            qWarning() << "Player: song " << m_nextSongPath << " was not prefetched, it cannot be chained";
+            m_nextSongPath.clear();
+            m_nextSongChange = false;
+        }
+    }
+
+    if (m_nextSongChange && !m_nextSong.path.isEmpty() && m_nextSong.path == m_nextSongPath) {
+        SongPlayer_externalNextSong();
+        m_nextSongChange = false;
+    }
+
+    m_lock.unlock();
 }
 
+/**
+ * @brief Player::commitSongChange takes over the buffers of the queued song once the SongPlayer started it
+ *        NOTE: called while rendering, it does not wait for m_lock, the request is updated by processSongChange
+ */
+void Player::commitSongChange(void)
+{
+    // Song and effects of two songs ago
+    retireSong(m_previousSong);
+    m_previousSong.song.swap(m_song);
+    m_song.swap(m_nextSong.song);
+    for (int i = 0; i < MAX_SONG_PARTS; i++) {
+        m_previousSong.effects[i].swap(m_effects[i]);
+        m_effects[i].swap(m_nextSong.effects[i]);
+        SoundManager_LoadEffect(m_effects[i].isEmpty() ? nullptr : m_effects[i].data(), i);
+    }
+    m_committedSongPath = m_nextSong.path;
+    m_changedSongPath = m_nextSong.path;
+    // The prepared song now holds the tracks of the previous song
+    retireSong(m_nextSong);
+
+    updateTempo();
+    postNotification(NOTIFY_SONG_CHANGE, (int)mixer_getStealCount());
+    mixer_resetStealCount();
+}
+
+/**
+ * @brief Player::retireSong takes over a song the audio rendering stopped using, releaseRetired frees it
+ *        NOTE: called while rendering. A song change retires two songs and only one can be committed
+ *        between two calls to processChanges (the next one must be queued first), so the slots cannot run out.
+ * @param song emptied
+ */
+void Player::retireSong(PrefetchedSong &song)
+{
+    if (m_retiredSongCount < PLAYER_RETIRED_SONGS) {
+        m_retiredSongs[m_retiredSongCount++].swap(song);
+    } else {
+        song.clear(); // Not expected, see above
+    }
+}
+
+/**
+ * @brief Player::releaseRetired frees the songs and the drumset the audio rendering stopped using
+ *        NOTE: called between the blocks, the drumset is freed by the loader thread if it is available
+ */
+void Player::releaseRetired(void)
+{
+    for (int i = 0; i < m_retiredSongCount; i++) {
+        m_retiredSongs[i].clear();
+    }
+    m_retiredSongCount = 0;
+
+    if (!m_retiredDrumset.isEmpty() && !m_drumsetLoader.release(&m_retiredDrumset)) {
+        m_retiredDrumset.clear();
+    }
+}
+
+/**
+ * @brief Player::processChanges does what the audio rendering left for after the block:
+ *        song and drumset changes, signals and logs, freeing what it stopped using
+ *        NOTE: in pull mode it runs on the control timer, never in the audio device reads
+ */
+void Player::processChanges(void)
+{
+    processSongChange();
+    processDrumsetSwap();
+    flushNotifications();
+    releaseRetired();
+    m_callbackTiming.logIfDue();
+}
+
+/**
+ * @brief drumsetSoundCount
+ * @return number of sounds of the mixer playing from the drumset file or from its decoded layers
+ */
+static unsigned int drumsetSoundCount(const DrumsetCache &drumset)
+{
+    uint32_t decodedBytes;
+    const int32_t *decoded = SoundManager_getDecodedData(drumset.decoded(), &decodedBytes);
+
+    unsigned int count = mixer_countSoundWithAddress((uintptr_t)drumset.data(), drumset.size());
+    if (decoded) {
+        count += mixer_countSoundWithAddress((uintptr_t)decoded, decodedBytes);
+    }
+    return count;
+}
+
+/**
+ * @brief removeDrumsetSounds removes the sounds of the mixer playing from the drumset file or from its decoded layers
+ */
+static void removeDrumsetSounds(const DrumsetCache &drumset)
+{
+    uint32_t decodedBytes;
+    const int32_t *decoded = SoundManager_getDecodedData(drumset.decoded(), &decodedBytes);
+
+    mixer_removeSoundWithAddress((uintptr_t)drumset.data(), drumset.size());
+    if (decoded) {
+        mixer_removeSoundWithAddress((uintptr_t)decoded, decodedBytes);
+    }
+}
+
+/**
+ * @brief Player::processDrumsetSwap prepares the drumset read and decoded by the loader,
+ *        and frees the previous one along with its decoded layers when it is silent
+ */
+void Player::processDrumsetSwap(void)
+{
+    // Swapped in on the next bar boundary by processTime
+    if (m_drumsetSwapTick < 0 && m_drumsetLoader.take(&m_nextDrumset, &m_nextDrumsetMmap)) {
+        SoundManager_PrepareDrumset(m_nextDrumset.data(), m_nextDrumset.size(), m_nextDrumset.decoded());
+        m_drumsetSwapTick = m_processedTicks + SongPlayer_getTicksToNextBar();
+    }
+
+    if (!m_previousDrumset.isEmpty() && drumsetSoundCount(m_previousDrumset) == 0) {
+        m_drumsetLoader.release(&m_previousDrumset);
+    }
+}
+
+/**
+ * @brief Player::commitDrumsetSwap makes the prepared drumset the playing one, voices of the previous one keep on ringing
+ */
+void Player::commitDrumsetSwap(void)
+{
+    // Only two drumsets can be kept, cut a previous one still ringing, releaseRetired frees it
+    if (!m_previousDrumset.isEmpty()) {
+        removeDrumsetSounds(m_previousDrumset);
+        m_retiredDrumset.swap(m_previousDrumset);
+    }
+
+    SoundManager_SwapDrumset();
+    m_previousDrumset.swap(m_drumset);
+    m_drumset.swap(m_nextDrumset);
+    m_drumsetLoadedMmap = m_nextDrumsetMmap;
+    m_drumsetSwapTick = -1;
+
+    postNotification(NOTIFY_DRUMSET_SWAP, 0);
+}
+
+/**
+ * @brief Player::cancelDrumsetSwap drops any drumset waiting to be swapped in or to be freed
+ */
+void Player::cancelDrumsetSwap(void)
+{
+    m_drumsetLoader.cancel();
+    m_nextDrumset.clear();
+    m_previousDrumset.clear();
+    m_retiredDrumset.clear();
+    m_drumsetSwapTick = -1;
+}
+
+/**
+ * @brief Player::updateTempo follows the tempo of the song, sigTempoChangedBySong is emitted by flushNotifications
+ */
 void Player::updateTempo()
 {
     int bpm = SongPlayer_getTempo();
-    qDebug() << "new tempo" << bpm << getTempo();
     if (bpm>0) {
       setTempo(bpm);
-      qDebug() << "emiting tempo change signal";
-      emit sigTempoChangedBySong(bpm);
+      postNotification(NOTIFY_TEMPO, bpm);
     }
 }
 
-void Player::updateStatus(bool forceEmit)
+/**
+ * @brief Player::postNotification keeps a signal of the audio rendering, to be emitted by flushNotifications
+ *        NOTE: called while rendering, it must not allocate. The notification is dropped if too many are pending.
+ */
+void Player::postNotification(int type, int value, unsigned int partIndex, unsigned int drumfillIndex)
 {
-   //update started
-   if( forceEmit || (!m_stop && !m_prevStarted) || (m_stop && m_prevStarted) ){
-      m_prevStarted = !m_stop;
-      emit sigStartedChanged(m_prevStarted);
-   }
+    if (m_notificationCount >= PLAYER_MAX_NOTIFICATIONS) {
+        m_droppedNotifications++;
+        return;
+    }
+    Notification &notification = m_notifications[m_notificationCount++];
+    notification.type = type;
+    notification.value = value;
+    notification.partIndex = partIndex;
+    notification.drumfillIndex = drumfillIndex;
+}
 
-   // update currentPart
-   partEnum currentPart = m_prevPart;
+/**
+ * @brief Player::flushNotifications emits the signals and logs kept while rendering, in order
+ */
+void Player::flushNotifications(void)
+{
+    for (int i = 0; i < m_notificationCount; i++) {
+        const Notification &notification = m_notifications[i];
+        switch (notification.type) {
+        case NOTIFY_STATUS:
+            switch (notification.value) {
+            case NO_SONG_LOADED:
+            case STOPPED:
+            case SINGLE_TRACK_PLAYER:                                                                   break;
+            case INTRO:                 emit sigPlayingIntro();                                         break;
+            case PLAYING_MAIN_TRACK:    emit sigPlayingMainTrack(notification.partIndex);               break;
+            case OUTRO:                 emit sigPlayingOutro();                                         break;
+            case TRANFILL_ACTIVE:       emit sigPlayingTranfill(notification.partIndex);                break;
+            case DRUMFILL_ACTIVE:       emit sigPlayingDrumfill(notification.partIndex, notification.drumfillIndex); break;
+            default:
+                qWarning() << "Player::processTime unhandled status " << notification.value;
+                break;
+            }
+            break;
+        case NOTIFY_TEMPO:
+            emit sigTempoChangedBySong(notification.value);
+            break;
+        case NOTIFY_SONG_CHANGE:
+            qDebug() << "Player:" << notification.value << "sounds stolen during the previous song";
+            qDebug() << "Player: song changed to " << m_changedSongPath;
+            emit sigSongChanged(m_changedSongPath);
+            break;
+        case NOTIFY_DRUMSET_SWAP:
+            qDebug() << "Drumset swapped to " << m_drumset.path();
+            break;
+        }
+    }
+    m_notificationCount = 0;
+    // Freed here rather than when the next song change replaces it
+    m_changedSongPath.clear();
+
+    if (m_droppedNotifications > 0) {
+        qWarning() << "Player:" << m_droppedNotifications << "notifications of the audio rendering were dropped";
+        m_droppedNotifications = 0;
+    }
+}
+
+/**
+ * @brief Player::publishStatus publishes the status of the player thread, for status() and the status signals
+ *        NOTE: called by the player thread after each block, it must not allocate nor emit
+ * @param restart true when playback starts, the status signals are then all emitted again
+ */
+void Player::publishStatus(bool restart)
+{
+   PlayerSnapshot snapshot;
+   SongPlayer_PlayerStatus status;
    unsigned int partIndex;
+   unsigned int drumfillIndex;
+   partEnum currentPart = (partEnum)m_published.part;
+   TimeSignature timeSignature;
+   int unusedStartBeat;
+   bool newPart = restart;
+
+   SongPlayer_getPlayerStatus(&status, &partIndex, &drumfillIndex);
 
+   // update currentPart
    if(m_stop){
       currentPart = stopped;
    } else {
 
-      SongPlayer_PlayerStatus status;
-      unsigned int drumfillIndex;
-      SongPlayer_getPlayerStatus(&status, &partIndex, &drumfillIndex);
       if(m_singleTrack){
 
          if(status == NO_SONG_LOADED || status == STOPPED){
@@ -669,45 +1357,115 @@ void Player::updateStatus(bool forceEmit)
       }
    }
 
-   if(forceEmit || (currentPart != m_prevPart)){
-      qDebug() << "Part changed!!" << currentPart << m_prevPart << forceEmit;
-      m_prevPart = currentPart;
-      emit sigPartChanged(m_prevPart);
+   snapshot = m_published;
+   if (restart) {
+      snapshot.playCount++;
+   }
+
+   // The tempo follows the part
+   if(restart || (currentPart != (partEnum)m_published.part)){
+      newPart = true;
       updateTempo();
    } else {
        if (lastPartIndex != partIndex && partIndex > 0) {
-           qDebug() << "whats going on here2" << lastPartIndex << partIndex << currentPart << m_prevPart;
            lastPartIndex = partIndex;
+           newPart = true;
            updateTempo();
-           emit sigPlayingMainTrack(partIndex);
+           postNotification(NOTIFY_STATUS, PLAYING_MAIN_TRACK, partIndex);
        }
    }
 
-   // update currentSigNum
-   int currentSigNum = m_prevSigNum;
-   TimeSignature timeSignature;
+   snapshot.started = !m_stop;
+   snapshot.playerStatus = status;
+   snapshot.part = currentPart;
+   snapshot.partIndex = partIndex;
+   snapshot.drumfillIndex = drumfillIndex;
+
+   // update currentSigNum, the previous one is kept without song
    if(SongPlayer_getTimeSignature(&timeSignature)){
-      currentSigNum = (int) timeSignature.num;
+      snapshot.sigNum = (int) timeSignature.num;
+   }
+
+   // update beatInBar, a new bar starts when it goes back
+   snapshot.beatInBar = SongPlayer_getBeatInbar(&unusedStartBeat);
+   if (newPart) {
+      snapshot.bar = 0;
+   } else if (snapshot.beatInBar >= 0 && snapshot.beatInBar < m_published.beatInBar) {
+      snapshot.bar++;
+   }
+
+   snapshot.tick = SongPlayer_getMasterTick();
+   snapshot.tempo = m_tempo;
+   snapshot.voices = (qint32)mixer_getVoiceCount();
+   snapshot.underrunCount = m_underrunCount;
+   snapshot.stealCount = (qint32)mixer_getStealCount();
+
+   m_published = snapshot;
+   m_status.store(snapshot);
+}
+
+/**
+ * @brief Player::slotPollStatus emits the status signals for what changed in the status published by the player thread
+ *        NOTE: runs in the thread which created the player, at the status rate
+ */
+void Player::slotPollStatus(void)
+{
+   PlayerSnapshot snapshot;
+   bool restart;
+
+   if (m_status.sequence() == m_polledSequence) {
+      return;
    }
+   m_polledSequence = m_status.sequence();
+   snapshot = m_status.load();
+   restart = snapshot.playCount != m_prevPlayCount;
+   m_prevPlayCount = snapshot.playCount;
 
-   if(forceEmit || (currentSigNum != m_prevSigNum)){
+   //update started
+   if (restart || (snapshot.started != 0) != m_prevStarted) {
+      m_prevStarted = snapshot.started != 0;
+      emit sigStartedChanged(m_prevStarted);
+   }
+
+   // update currentPart
+   if (restart || (partEnum)snapshot.part != m_prevPart) {
+      m_prevPart = (partEnum)snapshot.part;
+      emit sigPartChanged(m_prevPart);
+   }
 
-      m_prevSigNum = currentSigNum;
+   // update currentSigNum
+   if (restart || snapshot.sigNum != m_prevSigNum) {
+      m_prevSigNum = snapshot.sigNum;
       emit sigSigNumChanged(m_prevSigNum);
    }
 
    // update beatInBar
-   int unusedStartBeat;
-   int currentBeatInBar = SongPlayer_getBeatInbar(&unusedStartBeat);
-   if(forceEmit || (currentBeatInBar != m_prevBeatInBar)){
-      m_prevBeatInBar = currentBeatInBar;
+   if (restart || snapshot.beatInBar != m_prevBeatInBar) {
+      m_prevBeatInBar = snapshot.beatInBar;
       emit sigBeatInBarChanged(m_prevBeatInBar);
    }
 
    // emit MasterTick
-   auto currentTick = SongPlayer_getMasterTick();
-   if (forceEmit || (currentTick != m_prevTick))
-       emit sigPlayerPosition(m_prevTick = currentTick);
+   if (restart || snapshot.tick != m_prevTick) {
+      emit sigPlayerPosition(m_prevTick = snapshot.tick);
+   }
+
+   emit sigStatusChanged(snapshot);
+}
+
+/**
+ * @brief Player::setStatusRate sets how often the status signals can be emitted
+ *        NOTE: must be called from the thread which created the player
+ * @param rate_Hz 0 to only poll status()
+ */
+void Player::setStatusRate(int rate_Hz)
+{
+    m_statusRate = qMax(0, rate_Hz);
+    if (m_statusRate > 0) {
+        m_statusTimer.start(qMax(1, 1000 / m_statusRate));
+    } else {
+        m_statusTimer.stop();
+    }
 }
 
 // Add this method to runtime memory management
@@ -734,6 +1492,7 @@ void Player::freeMemoryIfNeeded()
 void Player::run(void)
 {
     try {
+        m_pullModeStarted = m_pullMode;
         initAudio();
         initMixer();
         emit sigPlayerStarted();
@@ -787,29 +1546,23 @@ void Player::run(void)
             }
         }
 
-        updateStatus(true);
+        m_notificationCount = 0;
+        m_droppedNotifications = 0;
+        publishStatus(true);
+        flushNotifications();
 
-        // Set memory usage monitoring variables
-        qint64 lastMemoryCheck = 0;
-        const qint64 memoryCheckInterval = 5000; // Check memory every 5 seconds
-        const qint64 maxMemoryUsage = 500 * 1024 * 1024; // 500MB limit
+        m_lastMemoryCheck = 0;
+        m_callbackTiming.reset(m_pullModeStarted ? "pull" : "push");
+
+        // In pull mode, the event loop only exits once stopped and the push loop below is skipped
+        if (m_pullModeStarted) {
+            runPullMode();
+        }
 
         while (!m_stop) {
             // Periodically check memory usage
-            qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
-            if (currentTime - lastMemoryCheck > memoryCheckInterval) {
-                lastMemoryCheck = currentTime;
-                
-                // Get approximate memory usage of our key buffers
-                qint64 estimatedMemoryUsage = m_drumset.size() + m_song.size();
-                for (const auto& effect : m_effects) {
-                    estimatedMemoryUsage += effect.size();
-                }
-                
-                if (estimatedMemoryUsage > maxMemoryUsage) {
-                    qWarning() << "Memory usage is too high: " << estimatedMemoryUsage << " bytes";
-                    throw std::runtime_error("Memory usage exceeded safe limits");
-                }
+            if (!checkMemoryUsage()) {
+                throw std::runtime_error("Memory usage exceeded safe limits");
             }
 
             // The time is regulated by the amount of free bytes in the buffer
@@ -828,20 +1581,25 @@ void Player::run(void)
             }
             // At this point, the sampleToProcess corresponds to the ammount of free space in audio buffer
             if (sampleToProcess > 0) {
-                // Require player to create data in mixer
-                sampleToProcess = processTime(sampleToProcess);
-            }
+                m_callbackTiming.begin();
 
-            // At this point, the sampleToProcess corresponds to the actual ammount of samples ready
-            if (sampleToProcess > 0) {
-                // Process data from mixer and send to audio card
-                processAudio(sampleToProcess);
+                // Require player to create data in mixer, along with the pedal events
+                sampleToProcess = processBlock(sampleToProcess, m_eventClock.nsecsElapsed());
+
+                // At this point, the sampleToProcess corresponds to the actual ammount of samples ready
+                if (sampleToProcess > 0) {
+                    // Send to audio card
+                    m_ioDevice->write(m_buffer, sampleToProcess * SAMPLES_TO_BYTES_RATIO_I);  // Number of bytes
+                    m_outputStarted = true;
+                }
+
+                m_callbackTiming.end();
             }
 
-            // Verify if any pedal were pressed
-            processEvent();
+            checkUnderrun();
 
-            updateStatus(false);
+            // Pedal events are applied within the blocks, verify if song or drumset changes are pending
+            processChanges();
 
             // NOTE: at 300 BPM, sound processing should be called every 2,083 msec.
             //       On mac mini, buffer was seen to display new free space when there is at least 2048
@@ -860,7 +1618,14 @@ void Player::run(void)
 
         // process status one last time to make sure VM is stopped by
         // playback panel stop button press
-        updateStatus(false);
+        publishStatus(false);
+        flushNotifications();
+        m_callbackTiming.log();
+        qDebug() << "Player:" << mixer_getStealCount() << "sounds stolen during the song";
+        if (AllocationTracker::allocations() > 0 || AllocationTracker::frees() > 0) {
+            qWarning() << "Player:" << AllocationTracker::allocations() << "heap allocations and" << AllocationTracker::frees()
+                       << "frees while rendering audio since start";
+        }
 
         if (!m_singleTrack) {
             SongPlayer_externalStop();
@@ -868,15 +1633,9 @@ void Player::run(void)
             m_singleTrack = false;
         }
 
-        // Free all memory before exiting thread
-        m_song.clear();
-        m_song.squeeze();
-        m_drumset.clear();
-        m_drumset.squeeze();
-        for (int i = 0; i < MAX_SONG_PARTS; i++) {
-            m_effects[i].clear();
-            m_effects[i].squeeze();
-        }
+        // Free song memory before exiting thread, drumset is kept resident for next run
+        releaseSong();
+        cancelDrumsetSwap();
 
         emit sigPlayerStopped();
     }
@@ -892,14 +1651,9 @@ void Player::run(void)
         }
         
         // Free all memory before exiting thread
-        m_song.clear();
-        m_song.squeeze();
+        releaseSong();
+        cancelDrumsetSwap();
         m_drumset.clear();
-        m_drumset.squeeze();
-        for (int i = 0; i < MAX_SONG_PARTS; i++) {
-            m_effects[i].clear();
-            m_effects[i].squeeze();
-        }
         
         emit sigPlayerStopped();
     }
@@ -915,14 +1669,9 @@ void Player::run(void)
         }
         
         // Free all memory before exiting thread
-        m_song.clear();
-        m_song.squeeze();
+        releaseSong();
+        cancelDrumsetSwap();
         m_drumset.clear();
-        m_drumset.squeeze();
-        for (int i = 0; i < MAX_SONG_PARTS; i++) {
-            m_effects[i].clear();
-            m_effects[i].squeeze();
-        }
         
         emit sigPlayerStopped();
     }
@@ -938,14 +1687,9 @@ void Player::run(void)
         }
         
         // Free all memory before exiting thread
-        m_song.clear();
-        m_song.squeeze();
+        releaseSong();
+        cancelDrumsetSwap();
         m_drumset.clear();
-        m_drumset.squeeze();
-        for (int i = 0; i < MAX_SONG_PARTS; i++) {
-            m_effects[i].clear();
-            m_effects[i].squeeze();
-        }
         
         emit sigPlayerStopped();
     }
@@ -965,11 +1709,15 @@ void Player::play(void)
         }
 
         m_ioDevice = nullptr;
-        m_drumset.clear();
         m_song.clear();
         m_processedSamples_real = 0;
-        m_queue.clear();
+        m_events.clear();
         m_lastPlayerStatus = STOPPED;
+        m_nextSongPath.clear();
+        m_nextSongChange = false;
+        m_songChangeCount = 0;
+        m_drumsetSwapTick = -1;
+        m_processedTicks = 0;
 
         start(QThread::TimeCriticalPriority);
     } else {
@@ -1011,6 +1759,11 @@ void Player::setDrumset(const QString &path)
 {
     qDebug() << "Player: drumset set to " << path;
     m_drumsetPath = path;
+
+    // While playing, the drumset is read in background and swapped in at the next bar
+    if (isRunning()) {
+        m_drumsetLoader.load(path, m_drumsetMmap, decodeBudget());
+    }
 }
 
 QString Player::song(void)
@@ -1018,6 +1771,63 @@ QString Player::song(void)
     return m_songPath;
 }
 
+/**
+ * @brief Player::setDrumsetMmap selects how the drumset is loaded on next play
+ * @param mmap true to map the drumset file, false to read it in a heap buffer
+ */
+void Player::setDrumsetMmap(bool mmap)
+{
+    qDebug() << "Player: drumset mmap set to " << mmap;
+    m_drumsetMmap = mmap;
+}
+
+/**
+ * @brief Player::setPullMode selects whether the audio device pulls the audio or the player pushes it,
+ *        applied on next play
+ * @param pullMode
+ */
+void Player::setPullMode(bool pullMode)
+{
+    qDebug() << "Player: pull mode set to " << pullMode;
+    m_pullMode = pullMode;
+}
+
+/**
+ * @brief Player::setAdaptiveBuffering lets the buffer time start at its minimum and adapt to the underruns
+ * @param adaptive
+ */
+void Player::setAdaptiveBuffering(bool adaptive)
+{
+    qDebug() << "Player: adaptive buffering set to " << adaptive;
+    m_adaptiveBuffering = adaptive;
+    if (adaptive) {
+        slotSetBufferTime_ms(MIXER_MIN_BUFFERRING_TIME_MS);
+    } else {
+        slotSetBufferTime_ms(Settings::getBufferingTime_ms());
+    }
+}
+
+/**
+ * @brief Player::setPolyphony sets the number of sounds playing at a time, applied on next play
+ * @param polyphony from MIXER_MIN_POLYPHONY to MIXER_MAX_POLYPHONY
+ */
+void Player::setPolyphony(int polyphony)
+{
+    qDebug() << "Player: polyphony set to " << polyphony;
+    m_polyphony = qBound((int)MIXER_MIN_POLYPHONY, polyphony, (int)MIXER_MAX_POLYPHONY);
+}
+
+/**
+ * @brief Player::setDecodeBudget_MB sets the memory given to the 24 bits layers decoded when a drumset is loaded,
+ *        applied on next drumset swap or play, the resident drumset is then loaded again
+ * @param budget_MB 0 to play them from the file
+ */
+void Player::setDecodeBudget_MB(int budget_MB)
+{
+    qDebug() << "Player: decode budget set to " << budget_MB << "MB";
+    m_decodeBudget_MB = qBound(0, budget_MB, 4095);
+}
+
 void Player::setSong(const QString &path)
 {
     qDebug() << "Player: song set to " << path;
@@ -1025,6 +1835,76 @@ void Player::setSong(const QString &path)
     m_songPath = path;
 }
 
+/**
+ * @brief Player::setSetlist selects the first song of songPaths and starts prefetching the setlist
+ * @param songPaths
+ */
+void Player::setSetlist(const QStringList &songPaths)
+{
+    qDebug() << "Player: setlist set to " << songPaths.size() << " songs";
+    m_setlist = songPaths;
+    setSetlistIndex(0);
+}
+
+/**
+ * @brief Player::setSetlistIndex selects a song of the setlist, it is played on next play or after the current one
+ * @param index
+ */
+void Player::setSetlistIndex(int index)
+{
+    if (index < 0 || index >= m_setlist.size()) {
+        qDebug() << "Player: no song " << index << " in setlist";
+        return;
+    }
+    m_setlistIndex = index;
+    setSong(m_setlist.at(m_setlistIndex));
+    prefetchSetlist();
+
+    // While playing, the selected song follows the current one
+    if (isRunning()) {
+        requestNextSong(m_setlist.at(m_setlistIndex), false);
+    }
+}
+
+/**
+ * @brief Player::nextSong selects the next song of the setlist.
+ *        While playing, the next song starts at the next bar boundary (or at the end of the outro).
+ */
+void Player::nextSong(void)
+{
+    if (m_setlistIndex + 1 >= m_setlist.size()) {
+        qDebug() << "Player: end of setlist";
+        return;
+    }
+    setSetlistIndex(m_setlistIndex + 1);
+    if (isRunning()) {
+        requestNextSong(m_setlist.at(m_setlistIndex), true);
+    }
+}
+
+/**
+ * @brief Player::requestNextSong chains a song after the current one without stopping the audio thread
+ * @param songPath song to play next, it must have been prefetched
+ * @param atNextBar true to change song at the next bar boundary, false to wait for the end of the current song
+ */
+void Player::requestNextSong(const QString &songPath, bool atNextBar)
+{
+    m_lock.lockForWrite();
+    m_nextSongPath = songPath;
+    m_nextSongChange = atNextBar;
+    m_lock.unlock();
+}
+
+/**
+ * @brief Player::prefetchSetlist requests the selected song and the one after it to be loaded in background
+ */
+void Player::prefetchSetlist(void)
+{
+    for (int i = m_setlistIndex; i < m_setlist.size() && i < m_setlistIndex + SONG_PREFETCH_SLOTS; i++) {
+        m_prefetcher.prefetch(m_setlist.at(i), effectsPath());
+    }
+}
+
 void Player::setSingleTrack(const QByteArray &trackData, int trackIndex, int typeId, int partIndex)
 {
     if (trackData.size()) mp_singleTrack = trackData;
@@ -1061,18 +1941,14 @@ int Player::getTempo(void){
 void Player::pedalPress(void)
 {
     if (!m_singleTrack){
-        m_lock.lockForWrite();
-        m_queue.enqueue(BUTTON_EVENT_PEDAL_PRESS);
-        m_lock.unlock();
+        queueEvent(BUTTON_EVENT_PEDAL_PRESS);
     }
 }
 
 void Player::pedalRelease(void)
 {
    if (!m_singleTrack){
-        m_lock.lockForWrite();
-        m_queue.enqueue(BUTTON_EVENT_PEDAL_RELEASE);
-        m_lock.unlock();
+        queueEvent(BUTTON_EVENT_PEDAL_RELEASE);
    }
 }
 
@@ -1080,27 +1956,21 @@ void Player::pedalRelease(void)
 void Player::pedalLongPress(void)
 {
     if (!m_singleTrack){
-        m_lock.lockForWrite();
-        m_queue.enqueue(BUTTON_EVENT_PEDAL_LONG_PRESS);
-        m_lock.unlock();
+        queueEvent(BUTTON_EVENT_PEDAL_LONG_PRESS);
     }
 }
 
 void Player::pedalDoubleTap(void)
 {
     if (!m_singleTrack){
-        m_lock.lockForWrite();
-        m_queue.enqueue(BUTTON_EVENT_PEDAL_MULTI_TAP);
-        m_lock.unlock();
+        queueEvent(BUTTON_EVENT_PEDAL_MULTI_TAP);
     }
 }
 
 void Player::effect(void)
 {
     if (!m_singleTrack){
-        m_lock.lockForWrite();
-        m_queue.enqueue(BUTTON_EVENT_FOOT_SECONDARY_PRESS);
-        m_lock.unlock();
+        queueEvent(BUTTON_EVENT_FOOT_SECONDARY_PRESS);
     }
 }
 
@@ -1108,8 +1978,8 @@ void Player::effect(void)
 void Player::slotSetBufferTime_ms(int time_ms){
    if(time_ms > MIXER_MAX_BUFFERRING_TIME_MS){
       m_bufferTime_ms = MIXER_MAX_BUFFERRING_TIME_MS;
-   } else if (time_ms < MIXER_MIN_BUFFERRING_TIME_MS){
-      m_bufferTime_ms = MIXER_MIN_BUFFERRING_TIME_MS;
+   } else if (time_ms < MIXER_MIN_PULL_BUFFERRING_TIME_MS){
+      m_bufferTime_ms = MIXER_MIN_PULL_BUFFERRING_TIME_MS;
    } else {
       m_bufferTime_ms = time_ms;
    }
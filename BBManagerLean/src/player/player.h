@@ -4,10 +4,58 @@
 // Use our wrapper for Qt includes
 #include "../QtIncludes.h"
 
+#include <QTimer>
+
 #include "button.h"
 #include "../model/filegraph/song.h"
 #include "songPlayer.h"
 #include "mixer.h"
+#include "audiopulldevice.h"
+#include "drumsetcache.h"
+#include "drumsetloader.h"
+#include "pedaleventqueue.h"
+#include "seqlock.h"
+#include "songprefetcher.h"
+
+#define TICK_TO_TIME_RATIO(bpm)     ((60.0f / (double)bpm) / 480.0f)
+
+// NOTE: these defines can be used due to hardcoded initialization of m_format
+// Units: sample/s
+#define SAMPLE_PER_SECOND           44100.0f
+// Units: ticks/refresh
+#define TICKS_PER_REFRESH           5
+// Units: byte/sample
+#define SAMPLES_TO_BYTES_RATIO_I      (4)
+// Units: sample/refresh = ticks/refresh * s/tick * sample/s
+#define SAMPLES_PER_REFRESH(bpm)  (TICKS_PER_REFRESH * TICK_TO_TIME_RATIO(bpm) * SAMPLE_PER_SECOND)
+// Notifications of the audio rendering waiting to be emitted
+#define PLAYER_MAX_NOTIFICATIONS    (16)
+// Songs the audio rendering stopped using, waiting to be freed by Player::releaseRetired
+#define PLAYER_RETIRED_SONGS        (2)
+// Units: Hz, rate of the status signals, see Player::setStatusRate
+#define PLAYER_DEFAULT_STATUS_RATE  (30)
+
+/**
+ * @brief Status of the player, published by the player thread after each block of audio (see Player::status).
+ */
+struct PlayerSnapshot
+{
+   quint32 playCount;       // Incremented each time playback starts
+   qint32 started;          // Nonzero while the player thread runs
+   qint32 playerStatus;     // SongPlayer_PlayerStatus
+   qint32 part;             // Player::partEnum
+   quint32 partIndex;
+   quint32 drumfillIndex;
+   qint32 bar;              // Bars played since the part started
+   qint32 beatInBar;        // Negative when stopped
+   qint32 sigNum;
+   qint32 tick;             // SongPlayer master tick
+   qint32 tempo;            // Units: bpm
+   qint32 voices;           // Sounds playing in the mixer
+   qint32 underrunCount;
+   qint32 stealCount;       // Sounds stolen since the song started
+};
+Q_DECLARE_METATYPE(PlayerSnapshot)
 
 class Player : public QThread
 {
@@ -32,39 +80,113 @@ public:
 
     inline int tempo(){return m_tempo;}
 
+    // Last status signalled, see status() for the one of the player thread
     inline bool started(){return m_prevStarted;}
     inline int sigNum(){return m_prevSigNum;}
     inline int beatInBar(){return m_prevBeatInBar;}
     inline partEnum part(){return m_prevPart;}
     inline int bufferTime_ms(){return m_bufferTime_ms;}
+    inline bool drumsetMmap(){return m_drumsetMmap;}
+    inline bool pullMode(){return m_pullMode;}
+    inline bool adaptiveBuffering(){return m_adaptiveBuffering;}
+    inline int polyphony(){return m_polyphony;}
+    inline int decodeBudget_MB(){return m_decodeBudget_MB;}
+    inline int underrunCount(){return m_underrunCount;}
+    inline const QStringList &setlist(){return m_setlist;}
+    inline PlayerSnapshot status() const {return m_status.load();}
+    inline int statusRate(){return m_statusRate;}
+    inline int setlistIndex(){return m_setlistIndex;}
 
     void updateTempo();
+
+    static QString defaultEffectsPath();
+    static bool checkMemoryAvailability(qint64 requiredBytes);
+    static void checkDrumsetMemory(qint64 fileSize);
     
 private:
     void initAudio(void);
     void initMixer(void);
     void loadDrumset(const QString &filepath);
+    inline uint32_t decodeBudget() const {return (uint32_t)m_decodeBudget_MB * 1024u * 1024u;}
     bool loadSong(const QString &filepath);
+    void loadPrefetchedSong(PrefetchedSong &prefetched);
+    void prefetchSetlist(void);
+    QString effectsPath() const;
     bool loadEffect(int part, const QString &filepath);
     void clearEffect(int part);
+    void releaseSong(void);
     int processTime(int samplesToProcess);
-    void processAudio(int samplesToProcess);
-    void processEvent(void);
-    void updateStatus(bool forceEmit);
+    void processAudio(char *buffer, int samplesToProcess);
+    int processBlock(int samplesToProcess, qint64 now);
+    qint64 pullAudio(char *data, qint64 maxSize);
+    void runPullMode(void);
+    void checkUnderrun(void);
+    void adaptBufferTime(int delta_ms);
+    bool checkMemoryUsage(void);
+    void queueEvent(BUTTON_EVENT event);
+    void processSongChange(void);
+    void commitSongChange(void);
+    void retireSong(PrefetchedSong &song);
+    void releaseRetired(void);
+    void processChanges(void);
+    void processDrumsetSwap(void);
+    void commitDrumsetSwap(void);
+    void cancelDrumsetSwap(void);
+    void requestNextSong(const QString &songPath, bool atNextBar);
+    void publishStatus(bool restart);
+    void postNotification(int type, int value, unsigned int partIndex = 0, unsigned int drumfillIndex = 0);
+    void flushNotifications(void);
     void run(void);
-    bool checkMemoryAvailability(qint64 requiredBytes);
     void logMemoryUsage() const;
     void freeMemoryIfNeeded();
 
+    // Drives the rendering without audio device to check it
+    friend class PlayerCheck;
+
     QAudioDeviceInfo m_device;
     QAudioOutput *m_audioOutput;
     QIODevice *m_ioDevice;
     QAudioFormat m_format;
 
-    QByteArray m_drumset;
+    // Pull mode: the audio device reads m_pullDevice, which renders into m_buffer on demand.
+    // Rendering is done by whole refreshes, what the device did not read yet is kept for the next read.
+    friend class AudioPullDevice;
+    AudioPullDevice m_pullDevice;
+    bool m_pullMode;
+    bool m_pullModeStarted;
+    int m_pullOffset;
+    int m_pullLength;
+    QString m_pullError;
+    AudioCallbackTiming m_callbackTiming;
+
+    DrumsetCache m_drumset; // NOTE: m_drumset outlives the thread, it is only reloaded when the drumset changes
+
+    // Drumset hot-swap: read by the loader, prepared in the SoundManager spare table and swapped in on
+    // m_drumsetSwapTick (a bar boundary). The previous drumset is freed once its last voice ended.
+    DrumsetLoader m_drumsetLoader;
+    DrumsetCache m_nextDrumset;
+    bool m_nextDrumsetMmap;
+    DrumsetCache m_previousDrumset;
+    qint64 m_drumsetSwapTick;
+    qint64 m_processedTicks;
     QByteArray m_song;
     QByteArray m_effects[MAX_SONG_PARTS];
 
+    qint64 m_lastMemoryCheck;
+
+    int m_polyphony; // Sounds playing at a time, a new one beyond it steals a playing one
+    int m_decodeBudget_MB; // Memory for the 24 bits layers decoded at drumset load, 0 to play them from the file
+
+    // Underrun detection: the sound card ran dry. In adaptive mode, m_bufferTime_ms grows on each
+    // underrun and slowly shrinks back after m_bufferShrinkDelay_ms without any.
+    bool m_adaptiveBuffering;
+    bool m_outputStarted;
+    bool m_underrun;
+    bool m_pullStarved;
+    qint64 m_lastPullTime;
+    int m_underrunCount;
+    qint64 m_lastBufferAdaptTime;
+    qint64 m_bufferShrinkDelay_ms;
     unsigned int m_soundCardLimit;
     char m_buffer[MIXER_BUFFER_LENGTH_BYTES_STEREO];
     int m_bufferTime_ms;
@@ -78,8 +200,27 @@ private:
 
 
     QString m_drumsetPath;
+    bool m_drumsetMmap;
+    bool m_drumsetLoadedMmap;
     QString m_songPath;
     QString m_effectsPath;
+    QStringList m_setlist;
+    int m_setlistIndex;
+    SongPrefetcher m_prefetcher;
+
+    // Song chained without stopping the thread: requested by the GUI thread (guarded by m_lock),
+    // queued and swapped in by the audio thread. The previous song is kept until the next change
+    // since its effects may still be ringing.
+    QString m_nextSongPath;
+    bool m_nextSongChange;
+    PrefetchedSong m_nextSong;
+    PrefetchedSong m_previousSong;
+    uint32_t m_songChangeCount;
+
+    // What the audio rendering stopped using: it must not free it, releaseRetired does between the blocks
+    PrefetchedSong m_retiredSongs[PLAYER_RETIRED_SONGS];
+    int m_retiredSongCount;
+    DrumsetCache m_retiredDrumset;
     int m_tempo;
     bool m_AutoPilot;
 
@@ -90,16 +231,42 @@ private:
     double m_processedSamples_real;
 
     QReadWriteLock m_lock;
-    QQueue<BUTTON_EVENT> m_queue;
+
+    // Pedal events, timestamped on m_eventClock when the slot is called
+    PedalEventQueue m_events;
+    QElapsedTimer m_eventClock;
 
     SongPlayer_PlayerStatus m_lastPlayerStatus;
 
-    // for status
+    // Signals and logs of the audio rendering: it must not allocate, so they are kept
+    // in m_notifications and emitted by flushNotifications, once the block is rendered.
+    struct Notification {
+        int type;
+        int value;
+        unsigned int partIndex;
+        unsigned int drumfillIndex;
+    };
+    Notification m_notifications[PLAYER_MAX_NOTIFICATIONS];
+    int m_notificationCount;
+    int m_droppedNotifications;
+    QString m_changedSongPath;
+    QString m_committedSongPath; // Song swapped in, m_nextSongPath is updated by processSongChange
+
+    // Status published by the player thread without locking: m_published is the player thread copy,
+    // the thread which created the player polls m_status at m_statusRate and emits the status signals.
+    SeqLock<PlayerSnapshot> m_status;
+    PlayerSnapshot m_published;
+    QTimer m_statusTimer;
+    int m_statusRate;
+    unsigned int m_polledSequence;
+
+    // for status, only used by the thread which created the player
     bool m_prevStarted;
     int m_prevSigNum;
     int m_prevBeatInBar;
     int m_prevTick;
     partEnum m_prevPart;
+    quint32 m_prevPlayCount;
 
 
 signals:
@@ -119,13 +286,24 @@ signals:
     void sigBeatInBarChanged(int);
     void sigPartChanged(int);
     void sigTempoChangedBySong(int);
+    void sigSongChanged(QString songPath);
+    void sigBufferUnderrun(int underrunCount);
+    void sigStatusChanged(const PlayerSnapshot &status);
 
 public slots:
     void play(void);
     void stop(void);
 
     void setDrumset(const QString &path);
+    void setDrumsetMmap(bool mmap);
+    void setPullMode(bool pullMode);
+    void setAdaptiveBuffering(bool adaptive);
+    void setPolyphony(int polyphony);
+    void setDecodeBudget_MB(int budget_MB);
     void setSong(const QString &path);
+    void setSetlist(const QStringList &songPaths);
+    void setSetlistIndex(int index);
+    void nextSong(void);
     void setSingleTrack(const QByteArray &trackData = QByteArray(), int trackIndex = -1, int typeId = -1, int partIndex = -1);
     void setEffectsPath(const QString &path);
     void setTempo(int bpm);
@@ -140,7 +318,11 @@ public slots:
 
     void effect(void);
     void slotSetBufferTime_ms(int time_ms);
+    void setStatusRate(int rate_Hz);
     void cleanupAudioOutput();
+
+private slots:
+    void slotPollStatus(void);
 };
 
 #endif // PLAYER_H
@@ -0,0 +1,405 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+
+#include "playercheck.h"
+#include "allocationtracker.h"
+#include "engineContext.h"
+#include "player.h"
+#include "songPlayer.h"
+
+// Units: samples, about 23 ms
+#define PLAYER_CHECK_DEFAULT_BLOCK  (1024)
+// Limit of the rendering, in case a change never happens. Units: s
+#define PLAYER_CHECK_MAX_DURATION   (600.0)
+// Rendered after the last change, so the previous song and drumset die out and are freed. Units: s
+#define PLAYER_CHECK_TAIL           (5.0)
+// Wait between two blocks while the prefetcher or the drumset loader reads a file. Units: ms
+#define PLAYER_CHECK_WAIT_MS        (1)
+// Tempo until the song sets its own, the user interface sets it before playing. Units: BPM
+#define PLAYER_CHECK_DEFAULT_TEMPO  (120)
+
+// Pedal taps of the event check: a press then a release, the interval does not match any block size. Units: s
+#define PLAYER_CHECK_TAPS           (12)
+#define PLAYER_CHECK_FIRST_TAP      (1.0)
+#define PLAYER_CHECK_TAP_INTERVAL   (1.37)
+#define PLAYER_CHECK_TAP_LENGTH     (0.05)
+#define PLAYER_CHECK_EVENT_DURATION (PLAYER_CHECK_FIRST_TAP + PLAYER_CHECK_TAPS * PLAYER_CHECK_TAP_INTERVAL)
+
+// Sound card buffers the event check is run with. Units: samples
+static const int EventCheckBlocks[PLAYER_CHECK_EVENT_BLOCKS] = {256, 1024, 4096};
+
+PlayerCheck::PlayerCheck()
+    : m_blockSamples(PLAYER_CHECK_DEFAULT_BLOCK)
+    , m_seed(ENGINE_DEFAULT_SEED)
+    , m_renderedSamples(0)
+    , m_songChanges(0)
+    , m_drumsetSwaps(0)
+    , m_allocationCount(0)
+    , m_freeCount(0)
+    , m_eventCount(0)
+    , m_eventMin_ns(0)
+    , m_eventMax_ns(0)
+{
+    for (int i = 0; i < PLAYER_CHECK_EVENT_BLOCKS; i++) {
+        m_blockEventMin_ns[i] = 0;
+        m_blockEventMax_ns[i] = 0;
+    }
+}
+
+/**
+ * @brief PlayerCheck::eventBlockSamples
+ * @param index from 0 to PLAYER_CHECK_EVENT_BLOCKS - 1
+ * @return the size of the blocks of this run of the event check, in samples
+ */
+int PlayerCheck::eventBlockSamples(int index)
+{
+    return EventCheckBlocks[index];
+}
+
+void PlayerCheck::setDrumset(const QString &path)
+{
+    m_drumsetPath = path;
+}
+
+/**
+ * @brief PlayerCheck::setNextDrumset
+ * @param path drumset swapped in once the songs are chained, empty to keep the drumset
+ */
+void PlayerCheck::setNextDrumset(const QString &path)
+{
+    m_nextDrumsetPath = path;
+}
+
+/**
+ * @brief PlayerCheck::setSongs
+ * @param paths the first song is started, each next one is chained at the next bar
+ *        once the previous one is playing. Three songs are needed for a song to be
+ *        released two song changes after it stopped being played.
+ */
+void PlayerCheck::setSongs(const QStringList &paths)
+{
+    m_songs = paths;
+}
+
+void PlayerCheck::setEffectsPath(const QString &path)
+{
+    m_effectsPath = path;
+}
+
+/**
+ * @brief PlayerCheck::setBlockSamples
+ * @param samples rendered by each Player::processBlock, as the sound card would ask for them
+ */
+void PlayerCheck::setBlockSamples(int samples)
+{
+    m_blockSamples = qBound(1, samples, (int)MIXER_BUFFER_LENGTH_SAMPLES);
+}
+
+void PlayerCheck::setSeed(quint32 seed)
+{
+    m_seed = seed;
+}
+
+/**
+ * @brief PlayerCheck::checkAllocations counts the heap allocations and frees of the audio rendering,
+ *        over the songs chained and the drumset swap
+ * @return false if the songs or the drumsets could not be loaded or a change did not happen,
+ *         allocationCount() and freeCount() must then be checked
+ */
+bool PlayerCheck::checkAllocations()
+{
+    m_renderedSamples = 0;
+    m_songChanges = 0;
+    m_drumsetSwaps = 0;
+    m_allocationCount = 0;
+    m_freeCount = 0;
+
+    if (m_songs.isEmpty()) {
+        qWarning() << "PlayerCheck - No song to play";
+        return false;
+    }
+
+    EngineContext *context = EngineContext_create();
+    if (!context) {
+        qWarning() << "PlayerCheck - Failed to allocate engine";
+        return false;
+    }
+    EngineContext *previous = EngineContext_bind(context);
+
+    bool ok;
+    {
+        Player player;
+        ok = start(player);
+        if (ok) {
+            quint64 allocations = AllocationTracker::threadAllocations();
+            quint64 frees = AllocationTracker::threadFrees();
+            ok = renderChanges(player);
+            m_allocationCount = (qint64)(AllocationTracker::threadAllocations() - allocations);
+            m_freeCount = (qint64)(AllocationTracker::threadFrees() - frees);
+        }
+        stop(player);
+    }
+
+    EngineContext_bind(previous);
+    EngineContext_destroy(context);
+
+    if (ok && m_songChanges < m_songs.size() - 1) {
+        qWarning() << "PlayerCheck - Only " << m_songChanges << " of " << (m_songs.size() - 1) << " song changes happened";
+        ok = false;
+    }
+    if (ok && !m_nextDrumsetPath.isEmpty() && m_drumsetSwaps == 0) {
+        qWarning() << "PlayerCheck - The drumset was not swapped";
+        ok = false;
+    }
+    return ok;
+}
+
+/**
+ * @brief PlayerCheck::checkEventTiming plays the first song with pedal taps, for each of the EventCheckBlocks,
+ *        and checks each event is applied at the start of the refresh it falls in
+ * @return false if the song could not be loaded, an event was not applied or was applied elsewhere
+ */
+bool PlayerCheck::checkEventTiming()
+{
+    m_eventCount = 0;
+    m_eventMin_ns = 0;
+    m_eventMax_ns = 0;
+    for (int i = 0; i < PLAYER_CHECK_EVENT_BLOCKS; i++) {
+        m_blockEventMin_ns[i] = 0;
+        m_blockEventMax_ns[i] = 0;
+    }
+
+    if (m_songs.isEmpty()) {
+        qWarning() << "PlayerCheck - No song to play";
+        return false;
+    }
+
+    EngineContext *context = EngineContext_create();
+    if (!context) {
+        qWarning() << "PlayerCheck - Failed to allocate engine";
+        return false;
+    }
+    EngineContext *previous = EngineContext_bind(context);
+
+    bool ok = true;
+    for (int i = 0; ok && i < PLAYER_CHECK_EVENT_BLOCKS; i++) {
+        Player player;
+        ok = start(player) && renderEvents(player, i);
+        stop(player);
+    }
+
+    EngineContext_bind(previous);
+    EngineContext_destroy(context);
+    return ok;
+}
+
+/**
+ * @brief PlayerCheck::start loads the drumset and the first song and starts it, as Player::play and Player::run do
+ */
+bool PlayerCheck::start(Player &player)
+{
+    player.setEffectsPath(m_effectsPath);
+    player.setDrumset(m_drumsetPath);
+    player.setSetlist(m_songs);
+
+    // Format of the rendered audio as set by initAudio, without opening the audio device
+    player.m_format.setSampleRate(44100);
+    player.m_format.setChannelCount(2);
+    player.m_format.setSampleSize(16);
+    player.m_format.setSampleType(QAudioFormat::SignedInt);
+
+    player.m_pullModeStarted = false;
+    player.m_stop = 0;
+    player.m_prepareStop = 0;
+    player.m_processedSamples_real = 0;
+    player.m_events.clear();
+    player.m_lastPlayerStatus = STOPPED;
+    player.m_nextSongPath.clear();
+    player.m_nextSongChange = false;
+    player.m_songChangeCount = 0;
+    player.m_drumsetSwapTick = -1;
+    player.m_processedTicks = 0;
+
+    player.initMixer();
+    EngineContext_setSeed(m_seed);
+
+    try {
+        player.loadDrumset(m_drumsetPath);
+        if (player.m_drumset.isEmpty()) {
+            qWarning() << "PlayerCheck - Failed to load drumset " << m_drumsetPath;
+            return false;
+        }
+        if (!player.loadSong(m_songs.first())) {
+            qWarning() << "PlayerCheck - Failed to load song " << m_songs.first();
+            return false;
+        }
+    } catch (const std::exception& e) {
+        qWarning() << "PlayerCheck - Failed to load: " << e.what();
+        return false;
+    }
+    player.setTempo(PLAYER_CHECK_DEFAULT_TEMPO);
+    player.updateTempo();
+    SongPlayer_externalStart();
+
+    player.m_notificationCount = 0;
+    player.m_droppedNotifications = 0;
+    player.publishStatus(true);
+    player.flushNotifications();
+    return true;
+}
+
+/**
+ * @brief PlayerCheck::stop stops the song and frees what the player loaded, as Player::run does when it exits
+ */
+void PlayerCheck::stop(Player &player)
+{
+    SongPlayer_externalStop();
+    player.releaseSong();
+    player.cancelDrumsetSwap();
+    player.m_drumset.clear();
+}
+
+/**
+ * @brief PlayerCheck::renderChanges renders block after block, chaining the songs then swapping the drumset
+ * @return false if nothing could be rendered
+ */
+bool PlayerCheck::renderChanges(Player &player)
+{
+    const qint64 maxSamples = (qint64)(PLAYER_CHECK_MAX_DURATION * SAMPLE_PER_SECOND);
+    const qint64 tailSamples = (qint64)(PLAYER_CHECK_TAIL * SAMPLE_PER_SECOND);
+    int nextSong = 1;
+    bool drumsetRequested = m_nextDrumsetPath.isEmpty();
+    const char *drumset = player.m_drumset.data();
+    uint32_t songChangeCount = player.m_songChangeCount;
+    qint64 doneSamples = -1; // When the last change happened
+
+    while (m_renderedSamples < maxSamples) {
+        // The player thread is not running, its requests can be read without locking
+        bool songPending = !player.m_nextSongPath.isEmpty();
+        if (!songPending && nextSong < m_songs.size()) {
+            player.m_prefetcher.prefetch(m_songs[nextSong], player.effectsPath());
+            player.requestNextSong(m_songs[nextSong], true);
+            nextSong++;
+            songPending = true;
+        } else if (!songPending && !drumsetRequested) {
+            player.m_drumsetLoader.load(m_nextDrumsetPath, player.m_drumsetMmap, player.decodeBudget());
+            drumsetRequested = true;
+        }
+
+        bool drumsetPending = drumsetRequested && !m_nextDrumsetPath.isEmpty() && m_drumsetSwaps == 0;
+        if (!songPending && nextSong >= m_songs.size() && drumsetRequested && !drumsetPending) {
+            if (doneSamples < 0) {
+                doneSamples = m_renderedSamples;
+            } else if (m_renderedSamples - doneSamples >= tailSamples) {
+                break;
+            }
+        }
+
+        // Rendering is much faster than real time, leave the files some time to be read
+        if ((songPending && player.m_nextSong.path.isEmpty()) || (drumsetPending && player.m_drumsetSwapTick < 0)) {
+            QThread::msleep(PLAYER_CHECK_WAIT_MS);
+        }
+
+        // As in pull mode, at least a refresh is rendered
+        int block = qMax(m_blockSamples, qCeil(SAMPLES_PER_REFRESH(player.m_tempo)));
+        int samples = player.processBlock(block, player.m_eventClock.nsecsElapsed());
+        if (samples <= 0) {
+            qWarning() << "PlayerCheck - Nothing rendered after " << m_renderedSamples << " samples";
+            return false;
+        }
+        m_renderedSamples += samples;
+
+        if (player.m_songChangeCount != songChangeCount) {
+            songChangeCount = player.m_songChangeCount;
+            m_songChanges++;
+        }
+        if (player.m_drumset.data() != drumset) {
+            drumset = player.m_drumset.data();
+            m_drumsetSwaps++;
+        }
+
+        player.processChanges();
+    }
+    return true;
+}
+
+/**
+ * @brief PlayerCheck::renderEvents renders the pedal taps with blocks of EventCheckBlocks[index] samples.
+ *
+ * The clock is the rendered audio: a block ends a block size after the audio rendered so far, the events
+ * that happened before it are queued, then the block is rendered. An event must then be applied less than
+ * a refresh before where it happened in the audio, never after (one sample is left for the rounding).
+ * @return false if an event was not applied or was applied elsewhere
+ */
+bool PlayerCheck::renderEvents(Player &player, int index)
+{
+    const int blockSamples = EventCheckBlocks[index];
+    const qint64 maxSamples = (qint64)(PLAYER_CHECK_EVENT_DURATION * SAMPLE_PER_SECOND);
+    const double sample_ns = 1000000000.0 / SAMPLE_PER_SECOND;
+    const int eventCount = 2 * PLAYER_CHECK_TAPS;
+    int nextEvent = 0;
+    int applied = 0;
+    qint64 rendered = 0;
+
+    player.m_callbackTiming.reset("check");
+    while (rendered < maxSamples) {
+        // As in pull mode, at least a refresh is rendered. The tempo only changes with the song.
+        int block = qMax(blockSamples, qCeil(SAMPLES_PER_REFRESH(player.m_tempo)));
+        double refresh_ns = SAMPLES_PER_REFRESH(player.m_tempo) * sample_ns;
+        qint64 now = (qint64)((rendered + block) * sample_ns);
+        while (nextEvent < eventCount) {
+            double time = PLAYER_CHECK_FIRST_TAP + (nextEvent / 2) * PLAYER_CHECK_TAP_INTERVAL + (nextEvent % 2) * PLAYER_CHECK_TAP_LENGTH;
+            qint64 timestamp = (qint64)(time * 1000000000.0);
+            if (timestamp >= now) {
+                break;
+            }
+            player.m_events.push(nextEvent % 2 ? BUTTON_EVENT_PEDAL_RELEASE : BUTTON_EVENT_PEDAL_PRESS, timestamp);
+            nextEvent++;
+        }
+
+        int samples = player.processBlock(block, now);
+        if (samples <= 0) {
+            qWarning() << "PlayerCheck - Nothing rendered after " << rendered << " samples";
+            return false;
+        }
+        rendered += samples;
+
+        const AudioCallbackTiming &timing = player.m_callbackTiming;
+        if (timing.eventCount() > 0) {
+            if (timing.eventMin() < -(qint64)(refresh_ns + sample_ns) || timing.eventMax() > (qint64)sample_ns) {
+                qWarning() << "PlayerCheck - Pedal event applied " << timing.eventMin() << " to " << timing.eventMax()
+                           << " ns from where it happened, with blocks of " << blockSamples << " samples";
+                return false;
+            }
+            m_eventMin_ns = m_eventCount > 0 ? qMin(m_eventMin_ns, timing.eventMin()) : timing.eventMin();
+            m_eventMax_ns = m_eventCount > 0 ? qMax(m_eventMax_ns, timing.eventMax()) : timing.eventMax();
+            m_blockEventMin_ns[index] = applied > 0 ? qMin(m_blockEventMin_ns[index], timing.eventMin()) : timing.eventMin();
+            m_blockEventMax_ns[index] = applied > 0 ? qMax(m_blockEventMax_ns[index], timing.eventMax()) : timing.eventMax();
+            m_eventCount += (int)timing.eventCount();
+            applied += (int)timing.eventCount();
+            player.m_callbackTiming.reset("check");
+        }
+
+        player.processChanges();
+    }
+
+    if (applied != eventCount) {
+        qWarning() << "PlayerCheck - Only " << applied << " of " << eventCount << " pedal events applied, with blocks of "
+                   << blockSamples << " samples";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+#ifndef PLAYERCHECK_H
+#define PLAYERCHECK_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+class Player;
+
+// Sound card buffers the event check is run with, see PlayerCheck::eventBlockSamples
+#define PLAYER_CHECK_EVENT_BLOCKS   (3)
+
+/**
+ * @brief Drives a Player without audio device to check its real-time path, as the player thread would:
+ *        Player::processBlock then Player::processChanges, block after block.
+ *
+ * The first song is started, then each next one is chained at the next bar and the next drumset
+ * is swapped in, so that song changes and drumset swaps are rendered along with the songs.
+ * Pedal events are checked on the first song: they come from a scripted timeline on a clock that
+ * follows the rendered audio, so where they land in the audio is known whatever the block size.
+ *
+ * The check runs on an EngineContext of its own, on the calling thread.
+ */
+class PlayerCheck
+{
+public:
+   PlayerCheck();
+
+   void setDrumset(const QString &path);
+   void setNextDrumset(const QString &path);
+   void setSongs(const QStringList &paths);
+   void setEffectsPath(const QString &path);
+   void setBlockSamples(int samples);
+   void setSeed(quint32 seed);
+
+   bool checkAllocations();
+   bool checkEventTiming();
+
+   inline qint64 renderedSamples() const {return m_renderedSamples;}
+   inline int songChanges() const {return m_songChanges;}
+   inline int drumsetSwaps() const {return m_drumsetSwaps;}
+   inline qint64 allocationCount() const {return m_allocationCount;}
+   inline qint64 freeCount() const {return m_freeCount;}
+   inline int eventCount() const {return m_eventCount;}
+   inline qint64 eventMin_ns() const {return m_eventMin_ns;}
+   inline qint64 eventMax_ns() const {return m_eventMax_ns;}
+   // Same with each sound card buffer, index from 0 to PLAYER_CHECK_EVENT_BLOCKS - 1
+   static int eventBlockSamples(int index);
+   inline qint64 eventMin_ns(int index) const {return m_blockEventMin_ns[index];}
+   inline qint64 eventMax_ns(int index) const {return m_blockEventMax_ns[index];}
+
+private:
+   Q_DISABLE_COPY(PlayerCheck)
+
+   bool start(Player &player);
+   void stop(Player &player);
+   bool renderChanges(Player &player);
+   bool renderEvents(Player &player, int index);
+
+   QString m_drumsetPath;
+   QString m_nextDrumsetPath; // Empty to keep the drumset
+   QStringList m_songs;       // Played in order, each one chained to the previous one
+   QString m_effectsPath;
+   int m_blockSamples;
+   quint32 m_seed;
+
+   qint64 m_renderedSamples;
+   int m_songChanges;
+   int m_drumsetSwaps;
+   qint64 m_allocationCount; // Heap allocations while rendering, see AllocationTracker
+   qint64 m_freeCount;       // Heap frees while rendering
+
+   // Pedal events applied, and their offset from where they should be in the audio (see AudioCallbackTiming::event)
+   int m_eventCount;
+   qint64 m_eventMin_ns;
+   qint64 m_eventMax_ns;
+   qint64 m_blockEventMin_ns[PLAYER_CHECK_EVENT_BLOCKS];
+   qint64 m_blockEventMax_ns[PLAYER_CHECK_EVENT_BLOCKS];
+};
+
+#endif // PLAYERCHECK_H
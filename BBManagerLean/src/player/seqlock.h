@@ -0,0 +1,86 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Publishes a plain struct from one thread to any number of readers without locks.
+ *
+ * The writer never waits: it makes the sequence odd, stores the value and makes the sequence even again.
+ * Readers copy the value and try again if the sequence was odd or changed meanwhile, so they always
+ * get a value stored as a whole. T must be trivially copyable.
+ */
+template <typename T>
+class SeqLock
+{
+public:
+   SeqLock() : m_sequence(0)
+   {
+      for (unsigned int i = 0; i < SEQLOCK_WORDS; i++) {
+         m_words[i].store(0, std::memory_order_relaxed);
+      }
+   }
+
+   /**
+    * @brief SeqLock::store
+    *        NOTE: writer side, must always be called from the same thread
+    */
+   void store(const T &value)
+   {
+      uint32_t words[SEQLOCK_WORDS] = {};
+      unsigned int sequence = m_sequence.load(std::memory_order_relaxed);
+
+      memcpy(words, &value, sizeof(T));
+      m_sequence.store(sequence + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      for (unsigned int i = 0; i < SEQLOCK_WORDS; i++) {
+         m_words[i].store(words[i], std::memory_order_relaxed);
+      }
+      m_sequence.store(sequence + 2, std::memory_order_release);
+   }
+
+   /**
+    * @brief SeqLock::load can be called from any thread
+    * @return the last value stored
+    */
+   T load() const
+   {
+      uint32_t words[SEQLOCK_WORDS];
+      unsigned int before;
+      unsigned int after;
+      T value;
+
+      do {
+         before = m_sequence.load(std::memory_order_acquire);
+         for (unsigned int i = 0; i < SEQLOCK_WORDS; i++) {
+            words[i] = m_words[i].load(std::memory_order_relaxed);
+         }
+         std::atomic_thread_fence(std::memory_order_acquire);
+         after = m_sequence.load(std::memory_order_relaxed);
+      } while ((before & 1) != 0 || before != after);
+
+      memcpy(&value, words, sizeof(T));
+      return value;
+   }
+
+   /**
+    * @brief SeqLock::sequence
+    * @return a number changing on each store, to check for a new value without loading it
+    */
+   inline unsigned int sequence() const {return m_sequence.load(std::memory_order_acquire) & ~1u;}
+
+private:
+   Q_DISABLE_COPY(SeqLock)
+
+   enum {SEQLOCK_WORDS = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t)};
+
+   std::atomic<unsigned int> m_sequence;
+   std::atomic<uint32_t> m_words[SEQLOCK_WORDS];
+};
+
+#endif // SEQLOCK_H
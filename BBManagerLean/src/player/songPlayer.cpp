@@ -22,7 +22,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
-#include <QDebug>
+#include <stddef.h>
+#include <new>
 #include <algorithm>
 
 
@@ -32,6 +33,7 @@
 #include "songPlayer.h"
 #include "soundManager.h"
 #include "settings.h"
+#include "engineContext.h"
 
 
 /*****************************************************************************
@@ -118,7 +120,7 @@ typedef SONG_SongPartStruct SongPart_t;
  **                     INTERNAL FUNCTION PROTOTYPE
  *****************************************************************************/
 
-static bool isEndOfTrack(int pos, SONG_SongPartStruct *CurrPartPtr/*, int loop, int loopCount*/);
+static bool isEndOfTrack(int pos, SONG_SongPartStruct *partPtr/*, int loop, int loopCount*/);
 
 static void TrackPlay(MIDIPARSER_MidiTrack *track, int startTick, int endTick, float ratio,
         int manualOffset, unsigned int partID);
@@ -142,6 +144,8 @@ static void SamePart(unsigned int nextDrumfill);
 static void OutroPart(void);
 static void SwapToOutro(void);
 static void StopSong(void);
+static void EndSong(void);
+static void StartNextSong(void);
 static void FirstPart(void);
 static void IntroPart(void);
 static void CheckAndCountBeat(void);
@@ -167,81 +171,197 @@ static void ResetBeatCounter(void);
  **                         INTERNAL GLOBAL VARIABLES
  *****************************************************************************/
 
-// Variable for the song and the track in the player
-static SONG_SongStruct *CurrSongPtr = nullptr;
-static SONG_SongPartStruct *CurrPartPtr;
-
-static volatile int MasterTick = 0;
-static int TmpMasterPartTick = 0;
-
-static volatile unsigned int PartIndex; // Current part index of the song
-static unsigned int DrumFillIndex;      // Current drumfill index of the current part
-
-AUTOPILOT_AutoPilotDataStruct * APPtr;
-uint32_t BeatCounter = 0;
-int32_t AutopilotAction = FALSE;
-int32_t AutopilotCueFill = FALSE;
-int32_t AutopilotTransitionCount;
-unsigned int currentLoopTick = -1; // Stores the current tick of the loop, start at infinity.
-int32_t newEnd = 0;
-int32_t addedTick = 0;//to fill the currentLoopon Pick up note cases
-bool playingPickUp = false;//to avoid counting a beat when is a pick up note
-
-QMap<int, int> idxs;//key playAt value real index
-
-static int PartStopSyncTick;
-static int PartStopPickUpSyncTickLength;
-
-static int DrumFillStartSyncTick;
-static int DrumFillPickUpSyncTickLength;
-
-static int TranFillStartSyncTick;
-static int TranFillStopSyncTick;
-static int TranFillPickUpSyncTickLength;
-
-static uint8_t PedalPressFlag; // Important to eliminate drumfill when quitting tap windows by the long pedal press
-static uint8_t PedalPresswDrumFillFlag = 0;
-static uint8_t TransPedalPressFlag = FALSE;
-static uint8_t WasPausedFlag;
-static uint8_t MultiTapCounter;
-static uint8_t WasLongPressed;
-
-static uint8_t DelayStartCmd = 0;
-static volatile SongPlayer_PlayerStatus PlayerStatus;
-static volatile SongPlayer_PlayerStatus LastPlayerStatus;
-static volatile SongPlayer_PlayerStatus UnPausedPlayerStatus;
-static volatile SongPlayer_PlayerStatus PausedPlayerStatus;
-static volatile SongFlags_t RequestFlag;
-
-static Player_FootswitchActions PrimaryFootSwitchPlayingAction;
-static Player_FootswitchActions PrimaryFootSwitchStoppedAction;
-static Player_FootswitchActions SecondaryFootSwitchPlayingAction;
-static Player_FootswitchActions SecondaryFootSwitchStoppedAction;
-static PLAYER_actions MainUnpauseModeTapToFill = START_FILL;
-static PLAYER_actions MainUnpauseModeHoldToTransition = START_TRANSITION;
-static int8_t ActivePauseEnable = DEFAULT_ACTIVE_PAUSE;
-static int8_t TrippleTapEnable  = DEFAULT_TRIPLE_TAP_STOP;
-static int8_t StartBeatOnPress;
-
-static uint32_t NextPartNumber;
-static int8_t SendStopOnPause = 0;
-static int8_t SendStopOnEnd = 0;
-
-static SONGFILE_FileStruct *CurrSongFilePtr = nullptr;
-static std::vector<MIDIPARSER_MidiTrack> Tracks;
-static MIDIPARSER_MidiTrack *SingleMidiTrackPtr = nullptr;
-
+struct SongPlayer_PreparedSong {
+    char *file;
+    std::vector<MIDIPARSER_MidiTrack> tracks;
+};
 
-static uint32_t SobrietyDrumTranFill;
-static uint32_t SobriertySpecialEffectTickDelay;
+// All the song player state, one instance per engine (see EngineContext)
+struct SongPlayer_State {
+    // Variable for the song and the track in the player
+    SONG_SongStruct *CurrSongPtr = nullptr;
+    SONG_SongPartStruct *CurrPartPtr = nullptr;
+
+    volatile int MasterTick = 0;
+    int TmpMasterPartTick = 0;
+
+    volatile unsigned int PartIndex = 0; // Current part index of the song
+    unsigned int DrumFillIndex = 0;      // Current drumfill index of the current part
+
+    AUTOPILOT_AutoPilotDataStruct * APPtr = nullptr;
+    uint32_t BeatCounter = 0;
+    int32_t AutopilotAction = FALSE;
+    int32_t AutopilotCueFill = FALSE;
+    int32_t AutopilotTransitionCount = 0;
+    unsigned int currentLoopTick = -1; // Stores the current tick of the loop, start at infinity.
+    int32_t newEnd = 0;
+    int32_t addedTick = 0;//to fill the currentLoopon Pick up note cases
+    bool playingPickUp = false;//to avoid counting a beat when is a pick up note
+
+    // Autopilot drum fills left to play in the part, sorted by playAt (see fillAPIndex)
+    uint32_t APFillPlayAt[MAX_AUTOPILOT_FILLS] = {};
+    unsigned int APFillIndex[MAX_AUTOPILOT_FILLS] = {};
+    unsigned int APFillCount = 0;
+
+    int PartStopSyncTick = 0;
+    int PartStopPickUpSyncTickLength = 0;
+
+    int DrumFillStartSyncTick = 0;
+    int DrumFillPickUpSyncTickLength = 0;
+
+    int TranFillStartSyncTick = 0;
+    int TranFillStopSyncTick = 0;
+    int TranFillPickUpSyncTickLength = 0;
+
+    uint8_t PedalPressFlag = 0; // Important to eliminate drumfill when quitting tap windows by the long pedal press
+    uint8_t PedalPresswDrumFillFlag = 0;
+    uint8_t TransPedalPressFlag = FALSE;
+    uint8_t WasPausedFlag = 0;
+    uint8_t MultiTapCounter = 0;
+    uint8_t WasLongPressed = 0;
+    unsigned long long LastMultiTapTime = 0;
+
+    uint8_t DelayStartCmd = 0;
+    volatile SongPlayer_PlayerStatus PlayerStatus = NO_SONG_LOADED;
+    volatile SongPlayer_PlayerStatus LastPlayerStatus = NO_SONG_LOADED;
+    volatile SongPlayer_PlayerStatus UnPausedPlayerStatus = NO_SONG_LOADED;
+    volatile SongPlayer_PlayerStatus PausedPlayerStatus = NO_SONG_LOADED;
+    volatile SongFlags_t RequestFlag = REQUEST_DONE;
+
+    Player_FootswitchActions PrimaryFootSwitchPlayingAction = ACTION_NONE;
+    Player_FootswitchActions PrimaryFootSwitchStoppedAction = ACTION_NONE;
+    Player_FootswitchActions SecondaryFootSwitchPlayingAction = ACTION_NONE;
+    Player_FootswitchActions SecondaryFootSwitchStoppedAction = ACTION_NONE;
+    PLAYER_actions MainUnpauseModeTapToFill = START_FILL;
+    PLAYER_actions MainUnpauseModeHoldToTransition = START_TRANSITION;
+    int8_t ActivePauseEnable = DEFAULT_ACTIVE_PAUSE;
+    int8_t TrippleTapEnable  = DEFAULT_TRIPLE_TAP_STOP;
+    int8_t StartBeatOnPress = 0;
+
+    uint32_t NextPartNumber = 0;
+    int8_t SendStopOnPause = 0;
+    int8_t SendStopOnEnd = 0;
+
+    SONGFILE_FileStruct *CurrSongFilePtr = nullptr;
+    std::vector<MIDIPARSER_MidiTrack> Tracks;
+    MIDIPARSER_MidiTrack *SingleMidiTrackPtr = nullptr;
+
+    // Song chained after the current one (see SongPlayer_queueNextSong)
+    SongPlayer_PreparedSong *NextSongPtr = nullptr;
+    int32_t NextSongSyncTick = -1;     // ProcessedTick of the bar boundary where to change song, -1 if none
+    int32_t ProcessedTick = 0;         // Ticks processed since init, unlike MasterTick it never goes back
+    volatile uint32_t SongChangeCount = 0;
+
+
+    uint32_t SobrietyDrumTranFill = 0;
+    uint32_t SobriertySpecialEffectTickDelay = 0;
+
+    uint32_t Test = 0;
+};
 
-static uint32_t Test;
+// Instance used by the threads which did not bind any other one
+static SongPlayer_State DefaultState;
+static ENGINE_THREAD_LOCAL SongPlayer_State *State = &DefaultState;
+
+#define CurrSongPtr                         (State->CurrSongPtr)
+#define CurrPartPtr                         (State->CurrPartPtr)
+#define MasterTick                          (State->MasterTick)
+#define TmpMasterPartTick                   (State->TmpMasterPartTick)
+#define PartIndex                           (State->PartIndex)
+#define DrumFillIndex                       (State->DrumFillIndex)
+#define APPtr                               (State->APPtr)
+#define BeatCounter                         (State->BeatCounter)
+#define AutopilotAction                     (State->AutopilotAction)
+#define AutopilotCueFill                    (State->AutopilotCueFill)
+#define AutopilotTransitionCount            (State->AutopilotTransitionCount)
+#define currentLoopTick                     (State->currentLoopTick)
+#define newEnd                              (State->newEnd)
+#define addedTick                           (State->addedTick)
+#define playingPickUp                       (State->playingPickUp)
+#define APFillPlayAt                        (State->APFillPlayAt)
+#define APFillIndex                         (State->APFillIndex)
+#define APFillCount                         (State->APFillCount)
+#define PartStopSyncTick                    (State->PartStopSyncTick)
+#define PartStopPickUpSyncTickLength        (State->PartStopPickUpSyncTickLength)
+#define DrumFillStartSyncTick               (State->DrumFillStartSyncTick)
+#define DrumFillPickUpSyncTickLength        (State->DrumFillPickUpSyncTickLength)
+#define TranFillStartSyncTick               (State->TranFillStartSyncTick)
+#define TranFillStopSyncTick                (State->TranFillStopSyncTick)
+#define TranFillPickUpSyncTickLength        (State->TranFillPickUpSyncTickLength)
+#define PedalPressFlag                      (State->PedalPressFlag)
+#define PedalPresswDrumFillFlag             (State->PedalPresswDrumFillFlag)
+#define TransPedalPressFlag                 (State->TransPedalPressFlag)
+#define WasPausedFlag                       (State->WasPausedFlag)
+#define MultiTapCounter                     (State->MultiTapCounter)
+#define WasLongPressed                      (State->WasLongPressed)
+#define LastMultiTapTime                    (State->LastMultiTapTime)
+#define DelayStartCmd                       (State->DelayStartCmd)
+#define PlayerStatus                        (State->PlayerStatus)
+#define LastPlayerStatus                    (State->LastPlayerStatus)
+#define UnPausedPlayerStatus                (State->UnPausedPlayerStatus)
+#define PausedPlayerStatus                  (State->PausedPlayerStatus)
+#define RequestFlag                         (State->RequestFlag)
+#define PrimaryFootSwitchPlayingAction      (State->PrimaryFootSwitchPlayingAction)
+#define PrimaryFootSwitchStoppedAction      (State->PrimaryFootSwitchStoppedAction)
+#define SecondaryFootSwitchPlayingAction    (State->SecondaryFootSwitchPlayingAction)
+#define SecondaryFootSwitchStoppedAction    (State->SecondaryFootSwitchStoppedAction)
+#define MainUnpauseModeTapToFill            (State->MainUnpauseModeTapToFill)
+#define MainUnpauseModeHoldToTransition     (State->MainUnpauseModeHoldToTransition)
+#define ActivePauseEnable                   (State->ActivePauseEnable)
+#define TrippleTapEnable                    (State->TrippleTapEnable)
+#define StartBeatOnPress                    (State->StartBeatOnPress)
+#define NextPartNumber                      (State->NextPartNumber)
+#define SendStopOnPause                     (State->SendStopOnPause)
+#define SendStopOnEnd                       (State->SendStopOnEnd)
+#define CurrSongFilePtr                     (State->CurrSongFilePtr)
+#define Tracks                              (State->Tracks)
+#define SingleMidiTrackPtr                  (State->SingleMidiTrackPtr)
+#define NextSongPtr                         (State->NextSongPtr)
+#define NextSongSyncTick                    (State->NextSongSyncTick)
+#define ProcessedTick                       (State->ProcessedTick)
+#define SongChangeCount                     (State->SongChangeCount)
+#define SobrietyDrumTranFill                (State->SobrietyDrumTranFill)
+#define SobriertySpecialEffectTickDelay     (State->SobriertySpecialEffectTickDelay)
+#define Test                                (State->Test)
 
 
 /*****************************************************************************
  **                      	FUNCTION DEFINITION
  *****************************************************************************/
 
+/**
+ * @brief SongPlayer_createState
+ *    Allocate a new song player instance, it still has to be initialized with SongPlayer_init once bound
+ * @return nullptr if the allocation failed
+ */
+SongPlayer_State *SongPlayer_createState(void)
+{
+    return new (std::nothrow) SongPlayer_State;
+}
+
+void SongPlayer_destroyState(SongPlayer_State *state)
+{
+    if (state == &DefaultState) {
+        return;
+    }
+    if (State == state) {
+        State = &DefaultState;
+    }
+    delete state;
+}
+
+/**
+ * @brief SongPlayer_bindState
+ *    Make the calling thread use the given song player instance, nullptr for the default one
+ * @return the instance previously used by the thread
+ */
+SongPlayer_State *SongPlayer_bindState(SongPlayer_State *state)
+{
+    SongPlayer_State *previous = State;
+    State = state ? state : &DefaultState;
+    return previous;
+}
+
 /**
  * @brief SongPlayer_init
  *    Make the initialisation of the songPlayer
@@ -271,6 +391,11 @@ void SongPlayer_init(void) {
     APPtr = nullptr;
 
     NextPartNumber = 0;
+
+    NextSongPtr = nullptr;
+    NextSongSyncTick = -1;
+    ProcessedTick = 0;
+    SongChangeCount = 0;
 }
 
 
@@ -408,6 +533,31 @@ int SongPlayer_getbarLength(){
     IntEnable(status);
     return result;
 }
+
+/**
+ * @brief SongPlayer_getPartCount
+ * @return number of parts of the current song, 0 if none is loaded
+ */
+int SongPlayer_getPartCount(void)
+{
+    return CurrSongPtr ? (int)CurrSongPtr->nPart : 0;
+}
+
+/**
+ * @brief SongPlayer_getMainLoopLength
+ * @return length of the main loop of the current part in ticks, 0 if there is none
+ */
+int SongPlayer_getMainLoopLength(void)
+{
+    unsigned char status = IntDisable();
+    int result = 0;
+    if (CurrSongPtr != nullptr && CurrPartPtr != nullptr && MAIN_LOOP_PTR(CurrPartPtr)) {
+        result = MAIN_LOOP_PTR(CurrPartPtr)->nTick;
+    }
+    IntEnable(status);
+    return result;
+}
+
 /**
  *
  */
@@ -586,9 +736,9 @@ void SongPlayer_getPlayerStatus(SongPlayer_PlayerStatus *playerStatus,
     *drumfillIndex = DrumFillIndex;
 }
 
-static void adjust_length(int ix){
+static void adjust_length(std::vector<MIDIPARSER_MidiTrack> &tracks, int ix){
     if (ix == -1) return;
-    auto& t = Tracks[ix];
+    auto& t = tracks[ix];
     if ((t.nTick  / (4 * 480 / t.timeSigDen)) % t.timeSigNum){
         int nBeatMissing = t.timeSigNum - ((t.nTick  / (4 * 480 / t.timeSigDen)) % t.timeSigNum);
         t.nTick += nBeatMissing * (4 * 480 / t.timeSigDen);
@@ -596,44 +746,68 @@ static void adjust_length(int ix){
 }
 
 // Preparse the pick up note legth to be a multiple of the player tick to simplify shits.
-static void adjust_trig_length(int ix) {
+static void adjust_trig_length(std::vector<MIDIPARSER_MidiTrack> &tracks, int ix) {
     if (ix == -1) return;
-    auto& t = Tracks[ix];
+    auto& t = tracks[ix];
     t.trigPos = (int)(0.70f * (float)t.barLength);
 }
 
-
-
 /**
- * @brief SongPlayer_loadSong
- * @param file
+ * @brief ValidateSong verifies that a song file can be played
+ * @param songFile
  * @param length
- * @return
+ * @return -1 if the file is not a valid song file, 0 if a part is missing a track, 1 otherwise
  */
-int SongPlayer_loadSong(char* file, uint32_t length)
-{
+static int ValidateSong(SONGFILE_FileStruct *songFile, uint32_t length) {
     unsigned int i;
     unsigned int j;
     SONG_SongStruct *SongPtr;
 
-    (void)length;
-
-    CurrSongFilePtr = (SONGFILE_FileStruct*) file;
+    if (length < offsetof(SONGFILE_FileStruct, trackIndexes)) {
+        return -1;
+    }
 
     // Verify the file type
-    if (strncmp(CurrSongFilePtr->header.fileType,"BBSF",4)) {
+    if (strncmp(songFile->header.fileType,"BBSF",4)) {
         return -1;
     }
 
     // Verify the version, revision & build number
 
     // if invalid flag is set (e.g. No main part, etc...)
-    if (CurrSongFilePtr->header.flags & SONGFILE_INVALID_FILE_FLAG_MASK) return -1;
+    if (songFile->header.flags & SONGFILE_INVALID_FILE_FLAG_MASK) return -1;
+
+    SongPtr = &songFile->song;
+    if (SongPtr->nPart > MAX_SONG_PARTS) return -1;
 
+    for (i = 0; i < SongPtr->nPart; i++) {
+        /* Main Loop */
+        if (SongPtr->part[i].mainLoopIndex < 0) {
+            return 0;
+        }
+        /* Drumfills */
+        for (j = 0; j < SongPtr->part[i].nDrumFill; j++) {
+            if (SongPtr->part[i].drumFillIndex[j] < 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
 
-    SongPtr = &CurrSongFilePtr->song;
+/**
+ * @brief CacheTracks parses all the tracks of a song file and adjusts them for the player
+ * @param file
+ * @param length
+ * @param tracks
+ * @return false if a track lies outside of the file
+ */
+static bool CacheTracks(char* file, uint32_t length, std::vector<MIDIPARSER_MidiTrack> &tracks) {
+    SONGFILE_FileStruct *songFile = (SONGFILE_FileStruct*) file;
+    SONG_SongStruct *SongPtr = &songFile->song;
+    unsigned int i;
+    unsigned int j;
 
-    if (CurrSongPtr != SongPtr)
     { // cache all tracks
         auto sz = 0; // find track count
         if (auto s = SongPtr->outro.mainLoopIndex+1) if (sz < s) sz = s;
@@ -645,39 +819,45 @@ int SongPlayer_loadSong(char* file, uint32_t length)
                 if (auto s = p.drumFillIndex[j]+1) if (sz < s) sz = s;
             if (auto s = p.mainLoopIndex+1) if (sz < s) sz = s;
         }
-        Tracks.resize(sz--);
-        for (auto p = file + CurrSongFilePtr->offsets.tracksDataOffset; sz >= 0; --sz)
-            Tracks[sz].read(p + CurrSongFilePtr->trackIndexes[sz].dataOffset);
+        if (sz > (int)SONGFILE_MAX_TRACKS_PER_SONG) return false;
+        tracks.resize(sz--);
+        for (auto p = file + songFile->offsets.tracksDataOffset; sz >= 0; --sz) {
+            if (songFile->offsets.tracksDataOffset + songFile->trackIndexes[sz].dataOffset >= length) return false;
+            tracks[sz].read(p + songFile->trackIndexes[sz].dataOffset);
+        }
     }
 
     /* Intro */
-    adjust_trig_length(SongPtr->intro.mainLoopIndex);
-
+    adjust_trig_length(tracks, SongPtr->intro.mainLoopIndex);
 
     for (i = 0; i < SongPtr->nPart; i++) {
         /* Main Loop */
-        if (SongPtr->part[i].mainLoopIndex < 0)
-            return 0;
         auto ix = SongPtr->part[i].mainLoopIndex;
-        adjust_trig_length(ix);
-        adjust_length(ix);
+        adjust_trig_length(tracks, ix);
+        adjust_length(tracks, ix);
 
         /* Drumfills */
         for (j = 0; j < SongPtr->part[i].nDrumFill; j++) {
-            if (SongPtr->part[i].drumFillIndex[j] < 0) {
-                return 0;
-            }
-            adjust_trig_length(SongPtr->part[i].drumFillIndex[j]);
+            adjust_trig_length(tracks, SongPtr->part[i].drumFillIndex[j]);
         }
         /* Transition Fill */
-        adjust_trig_length(SongPtr->part[i].transFillIndex);
+        adjust_trig_length(tracks, SongPtr->part[i].transFillIndex);
     }
 
     /* Outro */
-    adjust_trig_length(SongPtr->outro.mainLoopIndex);
+    adjust_trig_length(tracks, SongPtr->outro.mainLoopIndex);
+    return true;
+}
 
+/**
+ * @brief SetCurrentSong makes the song file (with its tracks already cached) the current song
+ * @param file
+ */
+static void SetCurrentSong(char* file) {
+    CurrSongFilePtr = (SONGFILE_FileStruct*) file;
 
     /* Retreive the autopilot strucutre */
+    APPtr = nullptr;
     if (CurrSongFilePtr->offsets.autoPilotDataOffset != 0) {
         APPtr = (AUTOPILOT_AutoPilotDataStruct *)(file + CurrSongFilePtr->offsets.autoPilotDataOffset);
 
@@ -687,12 +867,166 @@ int SongPlayer_loadSong(char* file, uint32_t length)
         }
     }
 
-    CurrSongPtr = SongPtr;
+    CurrSongPtr = &CurrSongFilePtr->song;
 
     ResetSongPosition();
+}
+
+/**
+ * @brief SongPlayer_loadSong
+ * @param file
+ * @param length
+ * @return
+ */
+int SongPlayer_loadSong(char* file, uint32_t length)
+{
+    int result = ValidateSong((SONGFILE_FileStruct*) file, length);
+    if (result <= 0) {
+        return result;
+    }
+
+    if (!CacheTracks(file, length, Tracks)) {
+        return -1;
+    }
+
+    SetCurrentSong(file);
     return 1;
 }
 
+/**
+ * @brief SongPlayer_prepareSong validates a song and parses its tracks without affecting the player.
+ *        It can be called from any thread. The file must remain valid as long as the prepared song
+ *        or the song loaded from it is used.
+ * @param file
+ * @param length
+ * @return nullptr if the song cannot be played
+ */
+SongPlayer_PreparedSong *SongPlayer_prepareSong(char* file, uint32_t length)
+{
+    if (ValidateSong((SONGFILE_FileStruct*) file, length) <= 0) {
+        return nullptr;
+    }
+
+    SongPlayer_PreparedSong *song = new SongPlayer_PreparedSong;
+    song->file = file;
+    if (!CacheTracks(file, length, song->tracks)) {
+        delete song;
+        return nullptr;
+    }
+    return song;
+}
+
+void SongPlayer_releasePreparedSong(SongPlayer_PreparedSong *song)
+{
+    delete song;
+}
+
+char* SongPlayer_getPreparedSoundEffectName(SongPlayer_PreparedSong *song, uint32_t part)
+{
+    SONG_SongStruct *SongPtr = &((SONGFILE_FileStruct*) song->file)->song;
+
+    if (part >= SongPtr->nPart) return nullptr;
+
+    return (char*)SongPtr->part[part].effectName;
+}
+
+/**
+ * @brief SongPlayer_loadPreparedSong loads a prepared song, its tracks are swapped in without any parsing.
+ *        The prepared song is left with the previous tracks and still has to be released.
+ * @param song
+ * @return 1 on success
+ */
+int SongPlayer_loadPreparedSong(SongPlayer_PreparedSong *song)
+{
+    Tracks.swap(song->tracks);
+    SetCurrentSong(song->file);
+    return 1;
+}
+
+/**
+ * @brief SongPlayer_queueNextSong chains a prepared song after the current one.
+ *        When the current song ends (end of outro), the next song starts right away instead of stopping.
+ *        The prepared song receives the tracks of the current song once it is started,
+ *        see SongPlayer_getSongChangeCount.
+ * @param song nullptr to cancel
+ */
+void SongPlayer_queueNextSong(SongPlayer_PreparedSong *song)
+{
+    uint8_t status = IntDisable();
+    NextSongPtr = song;
+    if (song == nullptr) {
+        NextSongSyncTick = -1;
+    }
+    IntEnable(status);
+}
+
+/**
+ * @brief SongPlayer_externalNextSong starts the queued song at the next bar boundary.
+ *        During the outro, the song is changed at the end of the outro.
+ */
+void SongPlayer_externalNextSong(void)
+{
+    uint8_t status = IntDisable();
+    if (NextSongPtr != nullptr && NextSongSyncTick < 0 && CurrPartPtr != nullptr) {
+        switch (PlayerStatus) {
+        case NO_SONG_LOADED:
+        case STOPPED:
+        case PAUSED:
+        case OUTRO:
+        case OUTRO_WAITING_TRIG:
+        case SINGLE_TRACK_PLAYER:
+            break;
+        default:
+            NextSongSyncTick = ProcessedTick + SongPlayer_getTicksToNextBar();
+            break;
+        }
+    }
+    IntEnable(status);
+}
+
+/**
+ * @brief SongPlayer_getTicksToNextBar
+ * @return number of ticks before the next bar boundary, 0 when on a boundary or not playing
+ */
+int SongPlayer_getTicksToNextBar(void)
+{
+    if (PlayerStatus == NO_SONG_LOADED || PlayerStatus == STOPPED || PlayerStatus == PAUSED) {
+        return 0;
+    }
+    if (CurrPartPtr == nullptr && !(PlayerStatus == SINGLE_TRACK_PLAYER && SingleMidiTrackPtr != nullptr)) {
+        return 0;
+    }
+
+    int32_t barLength = SongPlayer_getbarLength();
+    if (barLength <= 0) {
+        return 0;
+    }
+    int32_t barTick = SongPlayer_getMasterTick() % barLength;
+    if (barTick < 0) barTick += barLength;
+    return barTick ? barLength - barTick : 0;
+}
+
+/**
+ * @brief SongPlayer_getTicksToSongChange
+ * @return number of ticks before the song changes at a bar boundary, -1 if no change is pending
+ */
+int SongPlayer_getTicksToSongChange(void)
+{
+    if (NextSongPtr == nullptr || NextSongSyncTick < 0) {
+        return -1;
+    }
+    return std::max(NextSongSyncTick - ProcessedTick, 0);
+}
+
+/**
+ * @brief SongPlayer_getSongChangeCount
+ * @return number of times the queued song was started, the previous song file can be released when it changes
+ */
+uint32_t SongPlayer_getSongChangeCount(void)
+{
+    return SongChangeCount;
+}
+
 void SongPlayer_SetSingleTrack(MIDIPARSER_MidiTrack *track) {
 
     SingleMidiTrackPtr = track;
@@ -746,6 +1080,12 @@ void SongPlayer_processSong(float ratio, int32_t nTick) {
         return;
     }
 
+    // Change song on the requested bar boundary
+    if (NextSongPtr != nullptr && NextSongSyncTick >= 0 && ProcessedTick >= NextSongSyncTick) {
+        StartNextSong();
+    }
+    ProcessedTick += nTick;
+
     // Clear previous flag
     AutopilotCueFill = FALSE;
 
@@ -977,7 +1317,7 @@ void SongPlayer_processSong(float ratio, int32_t nTick) {
                     //the beat will be restarted at the end of the drumfill
                     if (CurrPartPtr->shuffleFlag) {
                         if (CurrPartPtr->nDrumFill != 0) {
-                            DrumFillIndex = rand() % CurrPartPtr->nDrumFill;
+                            DrumFillIndex = EngineContext_random(CurrPartPtr->nDrumFill);
                         }
                     } else {
                         fillAPIndex();
@@ -1388,7 +1728,7 @@ void SongPlayer_processSong(float ratio, int32_t nTick) {
             SamePart(2); // do a drumfill, if it exists, and loop again
             SpecialEffectManager();
         }
-        if(idxs.size() == 0 && APPtr)
+        if(APFillCount == 0 && APPtr)
         {
             fillAPIndex();
         }
@@ -1434,7 +1774,7 @@ void SongPlayer_processSong(float ratio, int32_t nTick) {
                 NextPart();
                 TransPedalPressFlag = FALSE;
             }else{
-                StopSong();
+                EndSong();
             }
             SpecialEffectManager();
         }
@@ -1457,9 +1797,9 @@ void SongPlayer_processSong(float ratio, int32_t nTick) {
                     MAIN_LOOP_PTR(CurrPartPtr)->nTick + POST_EVENT_MAX_TICK, ratio,
                     nTick, OUTR_FILL_ID);
 
-            // Stop the song after the last sounds have been launched
+            // Stop the song (or chain the next one) after the last sounds have been launched
             PedalPresswDrumFillFlag = 0;
-            StopSong();
+            EndSong();
         }
 
         break;
@@ -1551,7 +1891,7 @@ static void NextPart(void) {
     // Suffle drumsets if enabled in song
     if (CurrPartPtr->shuffleFlag) {
         if (CurrPartPtr->nDrumFill != 0) {
-            DrumFillIndex = rand() % CurrPartPtr->nDrumFill;
+            DrumFillIndex = EngineContext_random(CurrPartPtr->nDrumFill);
         }
     } else {
         fillAPIndex();
@@ -1609,7 +1949,7 @@ static void FirstPart(void) {
     if (CurrPartPtr != NULL ) {
         if (CurrPartPtr->nDrumFill != 0) {
             if (CurrPartPtr->shuffleFlag) {
-                DrumFillIndex = rand() % CurrPartPtr->nDrumFill;
+                DrumFillIndex = EngineContext_random(CurrPartPtr->nDrumFill);
             } else {
                 DrumFillIndex = (APPtr)?getNextAPIndex():0; // First Drumfill always
             }
@@ -1660,7 +2000,7 @@ static void IntroPart(void) {
 
         if (CurrPartPtr->shuffleFlag) {
             if (CurrPartPtr->nDrumFill != 0) {
-                DrumFillIndex = rand() % CurrPartPtr->nDrumFill;
+                DrumFillIndex = EngineContext_random(CurrPartPtr->nDrumFill);
             }
         } else {
             fillAPIndex();
@@ -1689,7 +2029,6 @@ static void CheckAndCountBeat(void) {
 
         if (shouldcount) {
             BeatCounter++;
-              qDebug() << MasterTick << "CBeat" << BeatCounter << timeSignature.num;
         }
         currentLoopTick = (newEnd != 0)? newTickPosition + addedTick: newTickPosition;
         addedTick = 0;
@@ -1739,7 +2078,7 @@ static void SamePart(unsigned int nextDrumfill) {
             if (CurrPartPtr != NULL ) {
                 if (CurrPartPtr->nDrumFill != 0) {
                     if (CurrPartPtr->shuffleFlag) {
-                        DrumFillIndex = rand() % CurrPartPtr->nDrumFill;
+                        DrumFillIndex = EngineContext_random(CurrPartPtr->nDrumFill);
                     } else {
                         DrumFillIndex = (APPtr)?getNextAPIndex():(DrumFillIndex + 1) % CurrPartPtr->nDrumFill;
                     }
@@ -1756,41 +2095,67 @@ static void SamePart(unsigned int nextDrumfill) {
 static unsigned int getNextAPIndex()
 {
     unsigned int index;
-    if(idxs.size() <= 0)
+    unsigned int i;
+    if(APFillCount == 0)
     {
       return 0; //if that was the last drumfill
     }else{
-        index = idxs.first();
-        idxs.remove(idxs.firstKey());
+        index = APFillIndex[0];
+        APFillCount--;
+        for (i = 0; i < APFillCount; i++) {
+            APFillPlayAt[i] = APFillPlayAt[i + 1];
+            APFillIndex[i] = APFillIndex[i + 1];
+        }
        return index;
     }
 }
 
+/**
+ * @brief fillAPIndex lists the autopilot drum fills of the part by playAt, a later fill replaces
+ *        an earlier one with the same playAt. Fixed size arrays since it runs while rendering.
+ */
 static void fillAPIndex()
 {
+    uint32_t playAt;
+    unsigned int position;
+    unsigned int i;
+
     if(APPtr)
     {
         if(CurrPartPtr){
-            idxs.clear();//avoid pedal press in the middle of sequence
-            int counter = CurrSongPtr->part[PartIndex].nDrumFill;
-            for(int i = 0;i < counter; i++)
+            APFillCount = 0;//avoid pedal press in the middle of sequence
+            unsigned int counter = std::min(CurrSongPtr->part[PartIndex].nDrumFill, (uint32_t)MAX_AUTOPILOT_FILLS);
+            for(unsigned int fill = 0;fill < counter; fill++)
             {
-                if(APPtr->part[PartIndex].drumFill[i].playAt > 0){
-                  idxs.insert(APPtr->part[PartIndex].drumFill[i].playAt,i);
+                playAt = APPtr->part[PartIndex].drumFill[fill].playAt;
+                if(playAt == 0){
+                    continue;
                 }
+                for (position = 0; position < APFillCount && APFillPlayAt[position] < playAt; position++);
+                if (position < APFillCount && APFillPlayAt[position] == playAt) {
+                    APFillIndex[position] = fill;
+                    continue;
+                }
+                for (i = APFillCount; i > position; i--) {
+                    APFillPlayAt[i] = APFillPlayAt[i - 1];
+                    APFillIndex[i] = APFillIndex[i - 1];
+                }
+                APFillPlayAt[position] = playAt;
+                APFillIndex[position] = fill;
+                APFillCount++;
             }
         }
     }
 }
 
-static bool isEndOfTrack(int pos, SONG_SongPartStruct *CurrPartPtr/*, int loop, int loopCount*/) {
+static bool isEndOfTrack(int pos, SONG_SongPartStruct *partPtr/*, int loop, int loopCount*/) {
     // the issue here is to decide when to make decision.  Last measure, or end of loop
     // 1) if no fills or transitions, then end of loop
     // 2) no fills, but a trans, then end of loop unless it's last, then use last measure.
     // 3) if fills, but no trans, then last measure, unless it's last, then end of loop.
     // 4) if fills and transtions, then always last measure.
 
-    int endOfTrack = MAIN_LOOP_PTR(CurrPartPtr)->nTick;
+    int endOfTrack = MAIN_LOOP_PTR(partPtr)->nTick;
 
     return pos>endOfTrack;
 }
@@ -1855,7 +2220,6 @@ static void TrackPlay(MIDIPARSER_MidiTrack *track, int32_t startTick, int32_t en
         TmpMasterPartTick -=DrumFillPickUpSyncTickLength;//This avoids displacing the beat
         DrumFillPickUpSyncTickLength = 0;
         if(playingPickUp){//if it played pick up notes, on pedal press pick up notes might not play
-             qDebug() <<"The pick up notes were played and next tick is " << track->event[track->index].tick <<"The current beta is "<<BeatCounter;
              currentLoopTick= 0;
         }
     }
@@ -1892,6 +2256,7 @@ static void StopSong(void) {
 
         // Cancel any pending action
         RequestFlag = REQUEST_DONE;
+        NextSongSyncTick = -1;
         if (CurrSongPtr != NULL ) {
             PlayerStatus = STOPPED;
         } else {
@@ -1907,6 +2272,45 @@ static void StopSong(void) {
 
 }
 
+/**
+ * @brief EndSong stops the song at its end, unless a song is queued after it
+ */
+static void EndSong(void) {
+    if (NextSongPtr != nullptr) {
+        StartNextSong();
+        TmpMasterPartTick = MasterTick;
+    } else {
+        StopSong();
+    }
+}
+
+/**
+ * @brief StartNextSong swaps the queued song in and starts it without stopping the player.
+ *        Voices of the previous song keep on ringing in the mixer.
+ */
+static void StartNextSong(void) {
+    uint8_t status = IntDisable();
+    SongPlayer_PreparedSong *song = NextSongPtr;
+    NextSongPtr = nullptr;
+    NextSongSyncTick = -1;
+
+    // The prepared song gets the previous tracks, they are freed along with it
+    Tracks.swap(song->tracks);
+    SetCurrentSong(song->file);
+
+    BeatCounter = 0;
+    NextPartNumber = 0;
+    SobrietyDrumTranFill = 0;
+    PedalPresswDrumFillFlag = 0;
+    TransPedalPressFlag = FALSE;
+    AutopilotAction = FALSE;
+    RequestFlag = REQUEST_DONE;
+
+    IntroPart();
+    SongChangeCount++;
+    IntEnable(status);
+}
+
 static uint8_t IntDisable(void) {return 0;}
 static void IntEnable(uint8_t intStatus) {(void)intStatus;}
 static void TEMPO_startWithInt(void) {}
@@ -2219,7 +2623,6 @@ static void  OUTRO_CANCELED_ButtonHandler(BUTTON_EVENT event){
     (void)event;
 }
 
-static unsigned long long LastMultiTapTime = 0;
 
 void SongPlayer_ButtonCallback(BUTTON_EVENT event, unsigned long long time)
 {
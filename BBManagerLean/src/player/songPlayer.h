@@ -15,6 +15,12 @@
 #define INTR_FILL_ID            (4)
 #define OUTR_FILL_ID            (5)
 
+/* Song player instance, all the SongPlayer_* functions work on the one bound to the calling thread */
+typedef struct SongPlayer_State SongPlayer_State;
+
+/* Song validated and parsed ahead of time (see SongPlayer_prepareSong) */
+typedef struct SongPlayer_PreparedSong SongPlayer_PreparedSong;
+
 PACK typedef struct {
   unsigned char num;
   unsigned char den;
@@ -57,10 +63,22 @@ typedef enum{
 /*****************************************************************************
 **                     FUNCTION PROTOYPE
 *****************************************************************************/
+SongPlayer_State *SongPlayer_createState(void);
+void SongPlayer_destroyState(SongPlayer_State *state);
+SongPlayer_State *SongPlayer_bindState(SongPlayer_State *state);
 void SongPlayer_init(void); // <--
 void SongPlayer_deInit(void);
 void SongPlayer_reInit(void);
 int SongPlayer_loadSong(char* file, uint32_t length);
+SongPlayer_PreparedSong *SongPlayer_prepareSong(char* file, uint32_t length);
+void SongPlayer_releasePreparedSong(SongPlayer_PreparedSong *song);
+char* SongPlayer_getPreparedSoundEffectName(SongPlayer_PreparedSong *song, uint32_t part);
+int SongPlayer_loadPreparedSong(SongPlayer_PreparedSong *song);
+void SongPlayer_queueNextSong(SongPlayer_PreparedSong *song);
+void SongPlayer_externalNextSong(void);
+int SongPlayer_getTicksToNextBar(void);
+int SongPlayer_getTicksToSongChange(void);
+uint32_t SongPlayer_getSongChangeCount(void);
 void SongPlayer_forceStop(void);   // <--
 void SongPlayer_processSong(float ratio, int nEvent); // <--
 void SongPlayer_ProcessSingleTrack(float ratio, int nTick, int offset);
@@ -74,6 +92,8 @@ int SongPlayer_getMasterTick(void);
 
 int SongPlayer_getTimeSignature(TimeSignature * timeSignature);
 int SongPlayer_getbarLength();
+int SongPlayer_getPartCount(void);
+int SongPlayer_getMainLoopLength(void);
 int SongPlayer_getTempo();
 
 unsigned int SongPlayer_getNextNoteValue(unsigned char * nextNote, unsigned int length);
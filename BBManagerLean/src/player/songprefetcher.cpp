@@ -0,0 +1,224 @@
+/*
+  This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+  BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <QElapsedTimer>
+#include <algorithm>
+#include <new>
+
+#include "songprefetcher.h"
+
+PrefetchedSong::PrefetchedSong()
+    : prepared(nullptr)
+{
+}
+
+PrefetchedSong::~PrefetchedSong()
+{
+    clear();
+}
+
+void PrefetchedSong::swap(PrefetchedSong &other)
+{
+    path.swap(other.path);
+    song.swap(other.song);
+    for (int i = 0; i < MAX_SONG_PARTS; i++) {
+        effects[i].swap(other.effects[i]);
+    }
+    std::swap(prepared, other.prepared);
+}
+
+void PrefetchedSong::clear()
+{
+    path.clear();
+    if (prepared) {
+        SongPlayer_releasePreparedSong(prepared);
+        prepared = nullptr;
+    }
+    song.clear();
+    for (int i = 0; i < MAX_SONG_PARTS; i++) {
+        effects[i].clear();
+    }
+}
+
+SongPrefetcher::SongPrefetcher(QObject *parent)
+    : QThread(parent)
+    , m_nextSlot(0)
+    , m_quit(false)
+{
+}
+
+SongPrefetcher::~SongPrefetcher()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_requested.wakeAll();
+    m_mutex.unlock();
+    wait();
+}
+
+/**
+ * @brief SongPrefetcher::prefetch requests a song to be loaded in background
+ * @param songPath
+ * @param effectsPath folder of the song effects
+ */
+void SongPrefetcher::prefetch(const QString &songPath, const QString &effectsPath)
+{
+    QMutexLocker locker(&m_mutex);
+    m_effectsPath = effectsPath;
+    if (songPath.isEmpty() || findSlot(songPath) >= 0 || songPath == m_loadingPath || m_requests.contains(songPath)) {
+        return;
+    }
+    m_requests.append(songPath);
+    while (m_requests.size() > SONG_PREFETCH_SLOTS) {
+        m_requests.removeFirst();
+    }
+    m_requested.wakeOne();
+    locker.unlock();
+
+    if (!isRunning()) {
+        start(QThread::LowPriority);
+    }
+}
+
+/**
+ * @brief SongPrefetcher::take hands over a prefetched song, waiting for it if it is still loading
+ * @param songPath
+ * @param song receives the prefetched song
+ * @param pending if given, does not wait: set to true when the song is not loaded yet
+ * @return false if songPath was not prefetched (or could not be)
+ */
+bool SongPrefetcher::take(const QString &songPath, PrefetchedSong *song, bool *pending)
+{
+    QMutexLocker locker(&m_mutex);
+    while (!songPath.isEmpty() && (songPath == m_loadingPath || m_requests.contains(songPath))) {
+        if (pending) {
+            *pending = true;
+            return false;
+        }
+        m_loaded.wait(&m_mutex);
+    }
+    if (pending) {
+        *pending = false;
+    }
+
+    int slot = findSlot(songPath);
+    if (slot < 0) {
+        return false;
+    }
+    song->swap(m_songs[slot]);
+    m_songs[slot].clear();
+    return true;
+}
+
+int SongPrefetcher::findSlot(const QString &songPath) const
+{
+    if (songPath.isEmpty()) {
+        return -1;
+    }
+    for (int i = 0; i < SONG_PREFETCH_SLOTS; i++) {
+        if (m_songs[i].path == songPath) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void SongPrefetcher::run(void)
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_quit) {
+        if (m_requests.isEmpty()) {
+            m_requested.wait(&m_mutex);
+            continue;
+        }
+
+        QString songPath = m_requests.takeFirst();
+        QString effectsPath = m_effectsPath;
+        m_loadingPath = songPath;
+        locker.unlock();
+
+        QElapsedTimer timer;
+        timer.start();
+
+        PrefetchedSong song;
+        bool loaded;
+        try {
+            loaded = load(songPath, effectsPath, &song);
+        } catch (const std::bad_alloc&) {
+            qWarning() << "SongPrefetcher - Memory allocation failed while prefetching " << songPath;
+            loaded = false;
+        }
+        if (loaded) {
+            qDebug() << "Song prefetched " << songPath << " in " << timer.elapsed() << "ms";
+        }
+
+        locker.relock();
+        if (loaded) {
+            // Use a free slot if any, otherwise drop the oldest prefetched song
+            int slot = -1;
+            for (int i = 0; i < SONG_PREFETCH_SLOTS && slot < 0; i++) {
+                if (m_songs[i].path.isEmpty()) slot = i;
+            }
+            if (slot < 0) {
+                slot = m_nextSlot;
+                m_nextSlot = (m_nextSlot + 1) % SONG_PREFETCH_SLOTS;
+            }
+            m_songs[slot].swap(song);
+        }
+        m_loadingPath.clear();
+        m_loaded.wakeAll();
+    }
+}
+
+/**
+ * @brief SongPrefetcher::load reads, validates and parses a song along with its effects
+ * @param songPath
+ * @param effectsPath folder of the song effects
+ * @param song receives the song
+ * @return false if the song or one of its effects could not be loaded
+ */
+bool SongPrefetcher::load(const QString &songPath, const QString &effectsPath, PrefetchedSong *song)
+{
+    QFile file(songPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "SongPrefetcher - Failed to open song file at: " << songPath;
+        return false;
+    }
+    song->song = file.readAll();
+    file.close();
+
+    song->prepared = SongPlayer_prepareSong(song->song.data(), song->song.size());
+    if (!song->prepared) {
+        qWarning() << "SongPrefetcher - Invalid song file " << songPath;
+        return false;
+    }
+
+    for (uint i = 0; i < MAX_SONG_PARTS; i++) {
+        char *name = SongPlayer_getPreparedSoundEffectName(song->prepared, i);
+        if (!name || *name == '\0') {
+            continue;
+        }
+
+        QFile effect(effectsPath + "/" + name);
+        if (!effect.open(QIODevice::ReadOnly)) {
+            qWarning() << "SongPrefetcher - Failed to open effect file at: " << effectsPath + "/" + name;
+            return false;
+        }
+        song->effects[i] = effect.readAll();
+        effect.close();
+    }
+
+    song->path = songPath;
+    return true;
+}
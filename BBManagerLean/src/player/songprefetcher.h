@@ -0,0 +1,71 @@
+#ifndef SONGPREFETCHER_H
+#define SONGPREFETCHER_H
+
+// Use our wrapper for Qt includes
+#include "../QtIncludes.h"
+
+#include <QMutex>
+#include <QStringList>
+#include <QWaitCondition>
+
+#include "../model/filegraph/song.h"
+#include "songPlayer.h"
+
+/**
+ * @brief Song read, validated and parsed ahead of time along with its effects.
+ */
+struct PrefetchedSong
+{
+   PrefetchedSong();
+   ~PrefetchedSong();
+
+   void swap(PrefetchedSong &other);
+   void clear();
+
+   QString path;
+   QByteArray song;
+   QByteArray effects[MAX_SONG_PARTS];
+   SongPlayer_PreparedSong *prepared;
+
+private:
+   Q_DISABLE_COPY(PrefetchedSong)
+};
+
+// Number of songs kept prefetched (the one about to be played and the next one)
+#define SONG_PREFETCH_SLOTS     (2)
+
+/**
+ * @brief Low priority thread loading the next songs of a setlist while the current one plays.
+ *
+ * Up to SONG_PREFETCH_SLOTS songs are kept prefetched, the oldest one is dropped first.
+ */
+class SongPrefetcher : public QThread
+{
+   Q_OBJECT
+public:
+   explicit SongPrefetcher(QObject *parent = nullptr);
+   ~SongPrefetcher();
+
+   void prefetch(const QString &songPath, const QString &effectsPath);
+   bool take(const QString &songPath, PrefetchedSong *song, bool *pending = nullptr);
+
+   static bool load(const QString &songPath, const QString &effectsPath, PrefetchedSong *song);
+
+private:
+   void run(void);
+
+   QMutex m_mutex;
+   QWaitCondition m_requested;
+   QWaitCondition m_loaded;
+
+   int findSlot(const QString &songPath) const;
+
+   QStringList m_requests;
+   QString m_effectsPath;
+   QString m_loadingPath;
+   PrefetchedSong m_songs[SONG_PREFETCH_SLOTS];
+   int m_nextSlot;
+   bool m_quit;
+};
+
+#endif // SONGPREFETCHER_H
@@ -14,6 +14,7 @@
 */
 #include "soundManager.h"
 #include "mixer.h"
+#include "engineContext.h"
 #include "math.h"
 #include "pragmapack.h"
 #include <stdint.h>
@@ -53,10 +54,15 @@ extern "C" {
 #define MEMORY_ALIGMENT_SIZE        (512)
 
 #define SAMPLING_RATE				(44100)
+#define NUMBER_OF_VELOCITY          (128u)
 #define NEXT_NOTE_SEEK_NUMBER       (128)
 
 
 
+// 24 bits layers decoded at load time are expanded to 32 bits, each one starting on a SIMD load boundary
+#define DECODE_ALIGNMENT            (16u)
+#define DECODE_ALIGN(size)          (((size) + DECODE_ALIGNMENT - 1u) & ~(uint64_t)(DECODE_ALIGNMENT - 1u))
+
 #define MEMORY_SIZE                 (101 * 1024 * 1024)
 #define BIG_FILE_THRESHOLD          (50 * 1024 * 1024)
 #define LOWER_HALF_OFFSET           (0)
@@ -67,7 +73,6 @@ extern "C" {
  *****************************************************************************/
 static const unsigned int Divider[3] = { 4, 8, 16 };
 static const unsigned long gLinearGainFactor = 10000;
-static unsigned int gGain[128][128];
 
 unsigned long long gStartTime;
 unsigned long long gStopTime;
@@ -92,10 +97,19 @@ PACK typedef struct {
     unsigned char* addr;
 } PACKED Effect_t;
 
+/* Velocity layers played for a note velocity: one of count layers from first, picked at random */
+typedef struct {
+    unsigned char first;
+    unsigned char count;
+    unsigned int volume;        // Velocity gain of the group times the instrument volume
+} VelocityLayers_t;
+
 typedef struct {
-    Instrument_t *inst;
+    Instrument_t inst[MIDIPARSER_NUMBER_OF_INSTRUMENTS]; // Copy of the file table, the file itself is only read
     MALLOC_RESULT_t status[MIDIPARSER_NUMBER_OF_INSTRUMENTS];
+    VelocityLayers_t layers[MIDIPARSER_NUMBER_OF_INSTRUMENTS][NUMBER_OF_VELOCITY]; // Set by fillDrumset for the active instruments
     unsigned char ChokeChan[MIDIPARSER_NUMBER_OF_CHOKE];
+    int32_t *decoded[MIDIPARSER_NUMBER_OF_INSTRUMENTS][MIDIPARSER_MAX_NUMBER_VELOCITY]; // NULL to play from the file
 } DrumsetStruct_t;
 
 
@@ -113,7 +127,15 @@ PACK typedef struct HeaderStruct {
     uint16_t build;
     uint32_t fileCRC;
 } PACKED DRUMSETFILE_HeaderStruct;
-Effect_t EffectTable[32];
+
+/* 24 bits layers of a drumset file, decoded outside of any engine so that it can be done
+   in background and shared: the engines only point into it (see SoundManager_LoadDrumset) */
+struct SoundManager_DecodedDrumset {
+    void *block;                // As allocated, data is aligned within it
+    int32_t *data;
+    int32_t *layers[MIDIPARSER_NUMBER_OF_INSTRUMENTS][MIDIPARSER_MAX_NUMBER_VELOCITY]; // NULL to play from the file
+    SoundManager_DecodeStats stats;
+};
 
 
 PACK typedef struct chunk {
@@ -137,10 +159,33 @@ PACK typedef struct header {
 /*****************************************************************************
  **                     INTERNAL GLOBAL VARIABLE
  *****************************************************************************/
-/* Drumset Variable */
-static DrumsetStruct_t Drumset;
+// All the sound manager state, one instance per engine (see EngineContext)
+struct SoundManager_State {
+    unsigned int gGain[128][128];
+
+    Effect_t EffectTable[32];
+
+    /* Drumset Variable */
+    // Two tables so a drumset can be prepared while the other one plays (see SoundManager_PrepareDrumset)
+    DrumsetStruct_t DrumsetTable[2];
+    DrumsetStruct_t *Drumset;
+#    if (defined(__x86_64__) || defined(_M_X64))
+    DrumsetStruct64_t Drumset64Table[2];
+    DrumsetStruct64_t *Drumset64;
+#    endif
+};
+
+// Instance used by the threads which did not bind any other one
+static SoundManager_State DefaultState;
+static ENGINE_THREAD_LOCAL SoundManager_State *State = &DefaultState;
+
+#define gGain                       (State->gGain)
+#define EffectTable                 (State->EffectTable)
+#define DrumsetTable                (State->DrumsetTable)
+#define Drumset                     (State->Drumset)
 #    if (defined(__x86_64__) || defined(_M_X64))
-static DrumsetStruct64_t Drumset64;
+#define Drumset64Table              (State->Drumset64Table)
+#define Drumset64                   (State->Drumset64)
 #    endif
 
 /*****************************************************************************
@@ -152,6 +197,38 @@ static DrumsetStruct64_t Drumset64;
  *****************************************************************************/
 
 
+/**
+ *  \brief Allocates a new sound manager instance, it still has to be initialized with SoundManager_init once bound
+ */
+SoundManager_State *SoundManager_createState(void)
+{
+    return (SoundManager_State *) calloc(1, sizeof(SoundManager_State));
+}
+
+void SoundManager_destroyState(SoundManager_State *state)
+{
+    SoundManager_State *previous;
+
+    if (state == &DefaultState) {
+        return;
+    }
+    // Sounds and decoded layers belong to the caller, only the instance itself is freed
+    previous = SoundManager_bindState(state);
+    State = (previous == state) ? &DefaultState : previous;
+    free(state);
+}
+
+/**
+ *  \brief Makes the calling thread use the given sound manager instance, NULL for the default one
+ *  \return the instance previously used by the thread
+ */
+SoundManager_State *SoundManager_bindState(SoundManager_State *state)
+{
+    SoundManager_State *previous = State;
+    State = state ? state : &DefaultState;
+    return previous;
+}
+
 static void fillGainTable(){
     float top_db;
     float req_db;
@@ -173,17 +250,29 @@ static void fillGainTable(){
     }
 }
 
-void SoundManager_init(void){
+static void resetDrumset(DrumsetStruct_t *drum){
     unsigned int i;
 
     // Invalidate all the drumset channels
     for (i = 0; i < MIDIPARSER_NUMBER_OF_INSTRUMENTS; i++){
-        Drumset.status[i] = FREE;
+        drum->status[i] = FREE;
     }
+    memset(drum->decoded, 0, sizeof(drum->decoded));
     // Reset all the choke channel
     for (i = 0; i < MIDIPARSER_NUMBER_OF_CHOKE; i++){
-        Drumset.ChokeChan[i] = 0u;
+        drum->ChokeChan[i] = 0u;
     }
+}
+
+void SoundManager_init(void){
+    unsigned int i;
+
+    Drumset = &DrumsetTable[0];
+#if (defined(__x86_64__) || defined(_M_X64))
+    Drumset64 = &Drumset64Table[0];
+#endif
+    resetDrumset(&DrumsetTable[0]);
+    resetDrumset(&DrumsetTable[1]);
 
     for (i = 0; i < 32 ; i++){
         EffectTable[i].status = FREE;
@@ -266,39 +355,259 @@ void SoundManager_LoadEffect(char* file, uint32_t part){
 }
 
 
-void SoundManager_LoadDrumset(char* file, uint32_t size)
+/**
+ *  \brief Velocity layers of each note velocity of an instrument, so that a note on does not search them.
+ *         A velocity plays the highest group of layers sharing the same lower bound velocity below it,
+ *         with the gain from the group velocity to the lower bound of the next group.
+ *         The layers are sorted by lower bound velocity, a velocity below all of them plays the lowest group.
+ */
+static void fillVelocityLayers(DrumsetStruct_t *drum, unsigned int i)
 {
-    unsigned int i, j;
+    Instrument_t *inst = &drum->inst[i];
+    int nVel = inst->nVel > MIDIPARSER_MAX_NUMBER_VELOCITY ? MIDIPARSER_MAX_NUMBER_VELOCITY : (int)inst->nVel;
+    unsigned char groupFirst[MIDIPARSER_MAX_NUMBER_VELOCITY];
+    int high_index = 0;
+    int j;
+    unsigned int top;
+    unsigned int velocity;
 
-    (void)size; // remove warning
+    // First layer of the group of each layer
+    for (j = 0; j < nVel; j++){
+        groupFirst[j] = (j > 0 && inst->vel[j].vel == inst->vel[j - 1].vel) ? groupFirst[j - 1] : (unsigned char)j;
+    }
+    // Top of the lowest group
+    while (high_index < nVel - 1 && inst->vel[high_index + 1].vel == inst->vel[0].vel) {
+        high_index++;
+    }
 
-    // TODO make sure old sound stop playing
-    for (i = 0; i < MIDIPARSER_NUMBER_OF_INSTRUMENTS; i++){
-        Drumset.status[i] = FREE;
+    for (velocity = 0; velocity < NUMBER_OF_VELOCITY; velocity++){
+        while (high_index < nVel - 1 && inst->vel[high_index + 1].vel <= velocity) {
+            high_index++;
+        }
+
+        if (high_index < nVel - 1){
+            top = inst->vel[high_index + 1].vel - 1;
+            top = top > NUMBER_OF_VELOCITY - 1 ? NUMBER_OF_VELOCITY - 1 : top;
+        } else {
+            top = NUMBER_OF_VELOCITY - 1;
+        }
+
+        drum->layers[i][velocity].first = groupFirst[high_index];
+        drum->layers[i][velocity].count = (unsigned char)(high_index + 1 - groupFirst[high_index]);
+        drum->layers[i][velocity].volume = gGain[top][velocity] * inst->volume;
     }
+}
 
-    // Set the address of the instruments array
-    Drumset.inst = (Instrument_t*)(file + sizeof(DRUMSETFILE_HeaderStruct));
+#if !(defined(__x86_64__) || defined(_M_X64))
+static void fillDrumset(DrumsetStruct_t *drum, const char* file, uint32_t size, const SoundManager_DecodedDrumset *decoded)
+#else
+static void fillDrumset(DrumsetStruct_t *drum, DrumsetStruct64_t *drum64, const char* file, uint32_t size, const SoundManager_DecodedDrumset *decoded)
+#endif
+{
+    unsigned int i, j;
 
+    resetDrumset(drum);
 
+    // A file without a complete instruments array plays nothing
+    if (size < sizeof(DRUMSETFILE_HeaderStruct) + sizeof(drum->inst)) {
+        return;
+    }
+    // The instruments array is fixed up in a copy, so the file can be shared by several engines
+    memcpy(drum->inst, file + sizeof(DRUMSETFILE_HeaderStruct), sizeof(drum->inst));
 
     // Complete for all the instruments
     for (i = 0; i < MIDIPARSER_NUMBER_OF_INSTRUMENTS; i++){
-        if (Drumset.inst[i].nVel){
-            if (Drumset.inst[i].volume == 0)Drumset.inst[i].volume = 100;
-            if (Drumset.inst[i].volume > 100) Drumset.inst[i].volume = 100;
+        if (drum->inst[i].nVel){
+            if (drum->inst[i].volume == 0)drum->inst[i].volume = 100;
+            if (drum->inst[i].volume > 100) drum->inst[i].volume = 100;
 
-            for (j=0; j < Drumset.inst[i].nVel; j++){
+            for (j=0; j < drum->inst[i].nVel && j < MIDIPARSER_MAX_NUMBER_VELOCITY; j++){
 #if !(defined(__x86_64__) || defined(_M_X64))
-                Drumset.inst[i].vel[j].addr += (unsigned int)file;
+                drum->inst[i].vel[j].addr += (unsigned int)file;
 #else
                 // Need to keep address in a separate structure since it takes 8 bytes
-                Drumset64.inst[i].vel[j].addr = (uint64_t)file + Drumset.inst[i].vel[j].offset;
+                drum64->inst[i].vel[j].addr = (uint64_t)file + drum->inst[i].vel[j].offset;
+#endif
+            }
+            fillVelocityLayers(drum, i);
+            drum->status[i] = ACTIVE;
+        }
+    }
+
+    if (decoded) {
+        memcpy(drum->decoded, decoded->layers, sizeof(drum->decoded));
+    }
+}
+
+/**
+ *  \brief Memory taken by a velocity layer once decoded
+ *  \return 0 if the layer is not a 24 bits one lying within the file
+ */
+static uint64_t decodedLayerSize(const Vel_t *vel, uint32_t size)
+{
+#if !(defined(__x86_64__) || defined(_M_X64))
+    uint64_t offset = vel->addr;
+#else
+    uint64_t offset = vel->offset;
+#endif
+
+    if (vel->bps != 24 || offset + (uint64_t)vel->nSample * 3u > size) {
+        return 0;
+    }
+    return DECODE_ALIGN((uint64_t)vel->nSample * sizeof(int32_t));
+}
+
+/**
+ *  \brief Expands the 24 bits layers of a drumset file to 32 bits, so the mixer reads whole aligned samples.
+ *         Layers are decoded in the instrument order as long as they fit in budget,
+ *         the others keep on playing from the file. Does not use any engine, so that it can run on
+ *         a loader thread, and the result can be shared by the engines playing the same file.
+ *  \param budget 0 to play all the layers from the file
+ *  \return NULL if out of memory, free it with SoundManager_freeDecodedDrumset once no engine uses it
+ */
+SoundManager_DecodedDrumset *SoundManager_decodeDrumset(const char* file, uint32_t size, uint32_t budget)
+{
+    const Instrument_t *inst = (const Instrument_t *)(file + sizeof(DRUMSETFILE_HeaderStruct));
+    SoundManager_DecodedDrumset *decoded;
+    uint64_t total = 0;
+    uint64_t bytes;
+    unsigned int i, j, k;
+    int32_t *dst;
+    const unsigned char *src;
+
+    decoded = (SoundManager_DecodedDrumset *) calloc(1, sizeof(SoundManager_DecodedDrumset));
+    if (decoded == NULL || size < sizeof(DRUMSETFILE_HeaderStruct) + MIDIPARSER_NUMBER_OF_INSTRUMENTS * sizeof(Instrument_t)) {
+        return decoded;
+    }
+
+    // Size of the layers fitting the budget
+    for (i = 0; i < MIDIPARSER_NUMBER_OF_INSTRUMENTS; i++){
+        for (j = 0; j < inst[i].nVel && j < MIDIPARSER_MAX_NUMBER_VELOCITY; j++){
+            bytes = decodedLayerSize(&inst[i].vel[j], size);
+            if (bytes == 0) continue;
+
+            if (total + bytes > budget) {
+                decoded->stats.rawLayers++;
+            } else {
+                total += bytes;
+                decoded->stats.decodedLayers++;
+            }
+        }
+    }
+    if (total == 0) {
+        return decoded;
+    }
+
+    decoded->block = malloc((size_t)total + DECODE_ALIGNMENT);
+    if (decoded->block == NULL) {
+        // Not enough memory, everything plays from the file
+        decoded->stats.rawLayers += decoded->stats.decodedLayers;
+        decoded->stats.decodedLayers = 0;
+        return decoded;
+    }
+    decoded->data = (int32_t *)(uintptr_t)DECODE_ALIGN((uintptr_t)decoded->block);
+    decoded->stats.decodedBytes = (uint32_t)total;
+
+    // Same layers as above, laid out one after the other
+    dst = decoded->data;
+    total = 0;
+    for (i = 0; i < MIDIPARSER_NUMBER_OF_INSTRUMENTS; i++){
+        for (j = 0; j < inst[i].nVel && j < MIDIPARSER_MAX_NUMBER_VELOCITY; j++){
+            bytes = decodedLayerSize(&inst[i].vel[j], size);
+            if (bytes == 0 || total + bytes > budget) continue;
+
+#if !(defined(__x86_64__) || defined(_M_X64))
+            src = (const unsigned char *)file + inst[i].vel[j].addr;
+#else
+            src = (const unsigned char *)file + inst[i].vel[j].offset;
 #endif
+            for (k = 0; k < inst[i].vel[j].nSample; k++){
+                // Bytes placed in the upper 24 bits, the arithmetic shift extends the sign
+                dst[k] = ((int32_t)(((uint32_t)src[3 * k] << 8) | ((uint32_t)src[3 * k + 1] << 16) | ((uint32_t)src[3 * k + 2] << 24))) >> 8;
             }
-            Drumset.status[i] = ACTIVE;
+            decoded->layers[i][j] = dst;
+            dst += bytes / sizeof(int32_t);
+            total += bytes;
         }
     }
+    return decoded;
+}
+
+/**
+ *  \brief Frees the layers decoded by SoundManager_decodeDrumset
+ *         NOTE: no engine may play from them anymore, see SoundManager_getDecodedData
+ */
+void SoundManager_freeDecodedDrumset(SoundManager_DecodedDrumset *decoded)
+{
+    if (decoded) {
+        free(decoded->block);
+        free(decoded);
+    }
+}
+
+void SoundManager_getDecodeStats(const SoundManager_DecodedDrumset *decoded, SoundManager_DecodeStats *stats)
+{
+    if (decoded) {
+        *stats = decoded->stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+/**
+ *  \brief Memory the decoded layers are played from, to find the mixer sounds using it
+ *  \return NULL if no layer was decoded
+ */
+const int32_t *SoundManager_getDecodedData(const SoundManager_DecodedDrumset *decoded, uint32_t *bytes)
+{
+    *bytes = decoded ? decoded->stats.decodedBytes : 0;
+    return decoded ? decoded->data : NULL;
+}
+
+/**
+ *  \brief Loads a drumset in the playing table
+ *  \param decoded its 24 bits layers as decoded by SoundManager_decodeDrumset, NULL to play them from the file.
+ *         Both the file and the decoded layers belong to the caller and must outlive the sounds playing from them.
+ *         They are only read, several engines can play from the same ones.
+ */
+void SoundManager_LoadDrumset(const char* file, uint32_t size, const SoundManager_DecodedDrumset *decoded)
+{
+    // TODO make sure old sound stop playing
+#if !(defined(__x86_64__) || defined(_M_X64))
+    fillDrumset(Drumset, file, size, decoded);
+#else
+    fillDrumset(Drumset, Drumset64, file, size, decoded);
+#endif
+}
+
+/**
+ *  \brief Loads a drumset in the table which is not playing, SoundManager_SwapDrumset makes it the playing one.
+ *         Sounds of the playing drumset are not affected.
+ *  \param decoded as for SoundManager_LoadDrumset, decoded ahead of time since this is called during playback
+ */
+void SoundManager_PrepareDrumset(const char* file, uint32_t size, const SoundManager_DecodedDrumset *decoded)
+{
+    int next = (Drumset == &DrumsetTable[0]) ? 1 : 0;
+
+#if !(defined(__x86_64__) || defined(_M_X64))
+    fillDrumset(&DrumsetTable[next], file, size, decoded);
+#else
+    fillDrumset(&DrumsetTable[next], &Drumset64Table[next], file, size, decoded);
+#endif
+}
+
+/**
+ *  \brief Plays the drumset loaded by SoundManager_PrepareDrumset from now on.
+ *         Sounds already in the mixer keep on playing from the previous drumset memory.
+ */
+void SoundManager_SwapDrumset(void)
+{
+    int next = (Drumset == &DrumsetTable[0]) ? 1 : 0;
+
+    Drumset = &DrumsetTable[next];
+#if (defined(__x86_64__) || defined(_M_X64))
+    Drumset64 = &Drumset64Table[next];
+#endif
 }
 
 
@@ -397,56 +706,29 @@ void SoundManager_playDrumsetNote(unsigned char note, unsigned char velocity,
     unsigned int fillChokeGroup;
     unsigned int fillChokeDelay_nsample;
     unsigned int volume;
-    unsigned int groupVelocity = 0;
     int high_index = 0;
-    int low_index = 0;
-    int delta;
+    VelocityLayers_t *layers;
     DrumsetStruct_t *drum = NULL;
     unsigned int nDelay = (pickUp == 0)?((unsigned int) (delay_seconde * SAMPLING_RATE)):0;
 
     // If there is no sound for the note
 
 #if (defined(__x86_64__) || defined(_M_X64))
-    DrumsetStruct64_t *drum64 = &Drumset64;
+    DrumsetStruct64_t *drum64 = Drumset64;
 #endif
-    if (Drumset.status[note] == FREE) return;
-    drum = &Drumset;
+    drum = Drumset;
+    if (drum->status[note] == FREE) return;
 
     if (velocity < 1 && drum->inst[note].nonPercussion>0) {
         // Choke note when velocity is zero, and non percussion
         mixer_chokeNote(note);
     } else {
-        // Start the iteration with the end of the velocity array
-        high_index = drum->inst[note].nVel - 1;
-
-
-        // Loop until the velocity is lower or equal to the requested velocity
-        while (drum->inst[note].vel[high_index].vel > velocity) {
-            high_index--;
-        }
-
-        if (high_index < drum->inst[note].nVel - 1){
-            volume = gGain[drum->inst[note].vel[high_index + 1].vel - 1][velocity] * drum->inst[note].volume;
-        } else {
-            volume = gGain[127][velocity] * drum->inst[note].volume;
-        }
-
-        // Save the index and the top velocity of the group
-        low_index = high_index;
-        groupVelocity = drum->inst[note].vel[high_index].vel;
-
-        // Look up every that have the same velocity of the group
-        while (groupVelocity == drum->inst[note].vel[low_index].vel) {
-            low_index--;
-            if (low_index < 0)
-                break;
-        }
-
-        // Number of possible velocity
-        delta = high_index - low_index;
+        // Group of layers of the velocity, precomputed by fillDrumset
+        layers = &drum->layers[note][velocity < NUMBER_OF_VELOCITY ? velocity : NUMBER_OF_VELOCITY - 1];
+        volume = layers->volume;
 
         // Get a random index to add some variations in the sounds of the player
-        high_index = 1 + low_index + (rand() % delta);
+        high_index = layers->first + EngineContext_random(layers->count);
 
         // If a choke group is activated for the instrument
         if (drum->inst[note].chokeGroup) {
@@ -511,8 +793,38 @@ void SoundManager_playDrumsetNote(unsigned char note, unsigned char velocity,
             break;
 
         case 24:
-            // if channel is stereo
-            if (drum->inst[note].vel[high_index].nChannel == 2) {
+            // Decoded at load time
+            if (drum->decoded[note][high_index] != NULL) {
+                if (drum->inst[note].vel[high_index].nChannel == 2) {
+#if !(defined(__x86_64__) || defined(_M_X64))
+                    mixer_addPCM24DecodedStereo((unsigned int)drum->decoded[note][high_index],
+#else
+                    mixer_addPCM24DecodedStereo((uint64_t)drum->decoded[note][high_index],
+#endif
+                            drum->inst[note].vel[high_index].nSample,
+                            volume,
+                            nDelay,
+                            drum->inst[note].chokeGroup,
+                            note,
+                            fillChokeGroup,
+                            fillChokeDelay_nsample,
+                            partID);
+                } else {
+#if !(defined(__x86_64__) || defined(_M_X64))
+                    mixer_addPCM24DecodedMono((unsigned int)drum->decoded[note][high_index],
+#else
+                    mixer_addPCM24DecodedMono((uint64_t)drum->decoded[note][high_index],
+#endif
+                            drum->inst[note].vel[high_index].nSample,
+                            volume,
+                            nDelay,
+                            drum->inst[note].chokeGroup,
+                            note,
+                            fillChokeGroup,
+                            fillChokeDelay_nsample,
+                            partID);
+                }
+            } else if (drum->inst[note].vel[high_index].nChannel == 2) {
 #if !(defined(__x86_64__) || defined(_M_X64))
                 mixer_addPCM24Stereo(drum->inst[note].vel[high_index].addr,
 #else
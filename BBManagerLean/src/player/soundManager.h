@@ -63,8 +63,33 @@ typedef struct {
 #endif
 
 
+// Memory given by default to the 24 bits layers decoded at load time
+#define SOUNDMANAGER_DEFAULT_DECODE_BUDGET      (64u * 1024u * 1024u)
+
+/* 24 bits layers of a drumset file decoded to 32 bits, see SoundManager_decodeDrumset */
+typedef struct SoundManager_DecodedDrumset SoundManager_DecodedDrumset;
+
+typedef struct {
+    uint32_t decodedBytes;      // Memory used by the decoded layers
+    unsigned int decodedLayers; // 24 bits velocity layers played from the decoded memory
+    unsigned int rawLayers;     // 24 bits velocity layers over the budget, played from the file
+} SoundManager_DecodeStats;
+
+/* Sound manager instance, all the SoundManager_* functions work on the one bound to the calling thread */
+typedef struct SoundManager_State SoundManager_State;
+
+extern SoundManager_State *SoundManager_createState(void);
+extern void SoundManager_destroyState(SoundManager_State *state);
+extern SoundManager_State *SoundManager_bindState(SoundManager_State *state);
+
 extern void SoundManager_init(void);
-extern void SoundManager_LoadDrumset(char* file, uint32_t size);
+extern SoundManager_DecodedDrumset *SoundManager_decodeDrumset(const char* file, uint32_t size, uint32_t budget);
+extern void SoundManager_freeDecodedDrumset(SoundManager_DecodedDrumset *decoded);
+extern void SoundManager_getDecodeStats(const SoundManager_DecodedDrumset *decoded, SoundManager_DecodeStats *stats);
+extern const int32_t *SoundManager_getDecodedData(const SoundManager_DecodedDrumset *decoded, uint32_t *bytes);
+extern void SoundManager_LoadDrumset(const char* file, uint32_t size, const SoundManager_DecodedDrumset *decoded);
+extern void SoundManager_PrepareDrumset(const char* file, uint32_t size, const SoundManager_DecodedDrumset *decoded);
+extern void SoundManager_SwapDrumset(void);
 extern void SoundManager_playDrumsetNote(unsigned char note, unsigned char velocity, float delay_seconde,float ratio, unsigned int isExclusive, int pickUp);
 extern void SoundManager_playSpecialEffect(unsigned char vel, uint32_t part);
 extern void SoundManager_LoadEffect(char* file, uint32_t part);
@@ -15,7 +15,9 @@
 #include "settings.h"
 
 #include "version.h"
+#include "../asynclogger.h"
 #include "../player/mixer.h"
+#include "../player/soundManager.h"
 
 bool Settings::softwareUuidExists()
 {
@@ -157,6 +159,123 @@ void Settings::setBufferingTime_ms(int bufferingTime_ms)
    QSettings().setValue(KEY_BUFFERING_TIME, QVariant(bufferingTime_ms)); // Keep released key...
 }
 
+bool Settings::getDrumsetMmap()
+{
+   QSettings settings;
+   if(!settings.contains(KEY_DRUMSET_MMAP)){
+#ifdef Q_OS_UNIX
+      return true;
+#else
+      return false; // Drumset mapping is only implemented with mmap
+#endif
+   }
+   return settings.value(KEY_DRUMSET_MMAP).toBool();
+}
+
+void Settings::setDrumsetMmap(bool value)
+{
+   QSettings().setValue(KEY_DRUMSET_MMAP, QVariant(value));
+}
+
+bool Settings::getPullMode()
+{
+   QSettings settings;
+   if(!settings.contains(KEY_PULL_MODE)){
+      return false;
+   }
+   return settings.value(KEY_PULL_MODE).toBool();
+}
+
+void Settings::setPullMode(bool value)
+{
+   QSettings().setValue(KEY_PULL_MODE, QVariant(value));
+}
+
+bool Settings::getAdaptiveBuffering()
+{
+   QSettings settings;
+   if(!settings.contains(KEY_ADAPTIVE_BUFFERING)){
+      return false;
+   }
+   return settings.value(KEY_ADAPTIVE_BUFFERING).toBool();
+}
+
+void Settings::setAdaptiveBuffering(bool value)
+{
+   QSettings().setValue(KEY_ADAPTIVE_BUFFERING, QVariant(value));
+}
+
+int Settings::getPolyphony()
+{
+   QSettings settings;
+   if(!settings.contains(KEY_POLYPHONY)){
+      return MIXER_DEFAULT_POLYPHONY;
+   }
+   bool ok = false;
+   int polyphony = settings.value(KEY_POLYPHONY).toInt(&ok);
+   if(!ok){
+      return MIXER_DEFAULT_POLYPHONY;
+   }
+   return polyphony;
+}
+
+void Settings::setPolyphony(int polyphony)
+{
+   QSettings().setValue(KEY_POLYPHONY, QVariant(polyphony));
+}
+
+int Settings::getDecodeBudget_MB()
+{
+   QSettings settings;
+   if(!settings.contains(KEY_DECODE_BUDGET)){
+      return SOUNDMANAGER_DEFAULT_DECODE_BUDGET / (1024 * 1024);
+   }
+   bool ok = false;
+   int budget_MB = settings.value(KEY_DECODE_BUDGET).toInt(&ok);
+   if(!ok){
+      return SOUNDMANAGER_DEFAULT_DECODE_BUDGET / (1024 * 1024);
+   }
+   return budget_MB;
+}
+
+void Settings::setDecodeBudget_MB(int budget_MB)
+{
+   QSettings().setValue(KEY_DECODE_BUDGET, QVariant(budget_MB));
+}
+
+int Settings::getLogLevel()
+{
+   QSettings settings;
+   if(!settings.contains(KEY_LOG_LEVEL)){
+      return LOG_LEVEL_DEBUG;
+   }
+   bool ok = false;
+   int level = settings.value(KEY_LOG_LEVEL).toInt(&ok);
+   if(!ok){
+      return LOG_LEVEL_DEBUG;
+   }
+   return level;
+}
+
+void Settings::setLogLevel(int level)
+{
+   QSettings().setValue(KEY_LOG_LEVEL, QVariant(level));
+}
+
+bool Settings::getLogToFile()
+{
+   QSettings settings;
+   if(!settings.contains(KEY_LOG_TO_FILE)){
+      return true;
+   }
+   return settings.value(KEY_LOG_TO_FILE).toBool();
+}
+
+void Settings::setLogToFile(bool value)
+{
+   QSettings().setValue(KEY_LOG_TO_FILE, QVariant(value));
+}
+
 
 bool Settings::helpIndexExists()
 {
@@ -15,6 +15,14 @@
 #define KEY_H "window/h"
 
 #define KEY_BUFFERING_TIME "player_buffering_time"
+#define KEY_DRUMSET_MMAP "player_drumset_mmap"
+#define KEY_PULL_MODE "player_pull_mode"
+#define KEY_ADAPTIVE_BUFFERING "player_adaptive_buffering"
+#define KEY_POLYPHONY "player_polyphony"
+#define KEY_DECODE_BUDGET "player_decode_budget_mb"
+
+#define KEY_LOG_LEVEL "general/log_level"
+#define KEY_LOG_TO_FILE "general/log_to_file"
 
 #define KEY_DND_W "color_dnd_withdraw"
 #define KEY_DND_C "color_dnd_copy"
@@ -92,6 +100,27 @@ public:
    static int getBufferingTime_ms();
    static void setBufferingTime_ms(int bufferingTime_ms);
 
+   static bool getDrumsetMmap();
+   static void setDrumsetMmap(bool value);
+
+   static bool getPullMode();
+   static void setPullMode(bool value);
+
+   static bool getAdaptiveBuffering();
+   static void setAdaptiveBuffering(bool value);
+
+   static int getPolyphony();
+   static void setPolyphony(int polyphony);
+
+   static int getDecodeBudget_MB();
+   static void setDecodeBudget_MB(int budget_MB);
+
+   static int getLogLevel();
+   static void setLogLevel(int level);
+
+   static bool getLogToFile();
+   static void setLogToFile(bool value);
+
    static bool helpIndexExists();
    static QString getHelpIndexDir();
 
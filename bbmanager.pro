@@ -1,3 +1,7 @@
 TEMPLATE = subdirs
-SUBDIRS = BBManagerLean \
-    bbmtest
+SUBDIRS = BBManagerLean
+
+# The benchmarks are only built on request: qmake CONFIG+=bbmtest
+bbmtest {
+    SUBDIRS += bbmtest
+}
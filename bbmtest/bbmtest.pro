@@ -0,0 +1,60 @@
+# Benchmarks of the engine and file hot paths on synthetic data, results are written as JSON
+# (see README.md). Built from the sources of BBManagerLean, always optimized.
+
+QT += core gui multimedia network widgets
+
+CONFIG += c++11 console release
+CONFIG -= debug app_bundle
+
+# Add position independent code flag
+QMAKE_CXXFLAGS += -fPIC
+
+TARGET = bbmtest
+TEMPLATE = app
+
+BBM_DIR = $$PWD/../BBManagerLean
+BBM_PRO = $$BBM_DIR/BBManagerLean.pro
+
+# Paths of BBManagerLean.pro are relative to it
+defineReplace(bbmPaths) {
+    paths = $$1
+    result =
+    for(path, paths) {
+        contains(path, ^\\./.*) {
+            result += $$BBM_DIR/$$path
+        } else {
+            result += $$path
+        }
+    }
+    return($$result)
+}
+
+BBM_SOURCES = $$fromfile($$BBM_PRO, SOURCES)
+BBM_SOURCES -= ./src/main.cpp
+
+SOURCES += $$bbmPaths($$BBM_SOURCES)
+HEADERS += $$bbmPaths($$fromfile($$BBM_PRO, HEADERS))
+OBJECTIVE_SOURCES += $$bbmPaths($$fromfile($$BBM_PRO, OBJECTIVE_SOURCES))
+RESOURCES += $$bbmPaths($$fromfile($$BBM_PRO, RESOURCES))
+INCLUDEPATH += $$bbmPaths($$fromfile($$BBM_PRO, INCLUDEPATH))
+DEPENDPATH += $$fromfile($$BBM_PRO, DEPENDPATH)
+LIBS += $$fromfile($$BBM_PRO, LIBS)
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    main.cpp \
+    benchmark.cpp \
+    syntheticdata.cpp \
+    enginebenchmarks.cpp \
+    filebenchmarks.cpp
+
+HEADERS += \
+    benchmark.h \
+    syntheticdata.h
+
+DEFINES+= MININI_ANSI
+DEFINES+= QT_MESSAGELOGCONTEXT
+
+# Same as the release builds of BBManagerLean, the allocation tracker is left out as it hooks malloc
+DEFINES+= BBM_LOG_LEVEL=LOG_LEVEL_INFO QT_NO_DEBUG_OUTPUT
@@ -0,0 +1,226 @@
+/*
+    This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+    BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "benchmark.h"
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QTextStream>
+
+#include <algorithm>
+#include <vector>
+
+// Iterations of a sample are never raised beyond it
+#define BENCHMARK_MAX_ITERATIONS    (1 << 28)
+
+BenchmarkRunner::BenchmarkRunner()
+    : m_minSampleTime_ms(BENCHMARK_DEFAULT_MIN_SAMPLE_MS)
+    , m_samples(BENCHMARK_DEFAULT_SAMPLES)
+    , m_listOnly(false)
+    , m_checkCount(0)
+{
+}
+
+/**
+ * @brief BenchmarkRunner::setFilter
+ * @param filter only the cases whose name contains it are run, empty to run all of them
+ */
+void BenchmarkRunner::setFilter(const QString &filter)
+{
+    m_filter = filter;
+}
+
+void BenchmarkRunner::setMinSampleTime_ms(int time_ms)
+{
+    m_minSampleTime_ms = qMax(1, time_ms);
+}
+
+void BenchmarkRunner::setSamples(int samples)
+{
+    m_samples = qMax(1, samples);
+}
+
+/**
+ * @brief BenchmarkRunner::setListOnly
+ * @param listOnly true to print the names of the selected cases without running them
+ */
+void BenchmarkRunner::setListOnly(bool listOnly)
+{
+    m_listOnly = listOnly;
+}
+
+/**
+ * @brief BenchmarkRunner::isSelected
+ * @return true if the case is to be run, cases check it before generating their data
+ */
+bool BenchmarkRunner::isSelected(const QString &name) const
+{
+    return m_filter.isEmpty() || name.contains(m_filter, Qt::CaseInsensitive);
+}
+
+/**
+ * @brief BenchmarkRunner::run times a case and appends its result
+ * @param name of the case, "group/case/variant"
+ * @param body work timed, once per iteration
+ * @param bytes processed by one iteration, to report a throughput
+ * @param items processed by one iteration, to report a rate
+ * @param itemUnit name of the items
+ * @param setup called before each sample, not timed
+ */
+void BenchmarkRunner::run(const QString &name, const std::function<void()> &body, qint64 bytes, qint64 items,
+                          const QString &itemUnit, const std::function<void()> &setup)
+{
+    QTextStream out(stdout);
+
+    if (!isSelected(name)) {
+        return;
+    }
+    if (m_listOnly) {
+        out << name << endl;
+        return;
+    }
+
+    QElapsedTimer timer;
+    qint64 minSampleTime_ns = (qint64)m_minSampleTime_ms * 1000000;
+    qint64 iterations = 1;
+    qint64 elapsed_ns;
+
+    // Calibration, also warms up the caches
+    forever {
+        if (setup) {
+            setup();
+        }
+        timer.start();
+        for (qint64 i = 0; i < iterations; i++) {
+            body();
+        }
+        elapsed_ns = timer.nsecsElapsed();
+        if (elapsed_ns >= minSampleTime_ns || iterations >= BENCHMARK_MAX_ITERATIONS) {
+            break;
+        }
+        // Aim a bit over the minimum time, at most 10 times more iterations at once
+        qint64 next = elapsed_ns > 0 ? (qint64)(iterations * 1.2 * minSampleTime_ns / elapsed_ns) : iterations * 10;
+        iterations = qBound(iterations + 1, next, qMin(iterations * 10, (qint64)BENCHMARK_MAX_ITERATIONS));
+    }
+
+    std::vector<double> times_ns;
+    for (int s = 0; s < m_samples; s++) {
+        if (setup) {
+            setup();
+        }
+        timer.start();
+        for (qint64 i = 0; i < iterations; i++) {
+            body();
+        }
+        times_ns.push_back((double)timer.nsecsElapsed() / iterations);
+    }
+    std::sort(times_ns.begin(), times_ns.end());
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.samples = m_samples;
+    result.median_ns = times_ns[times_ns.size() / 2];
+    result.min_ns = times_ns.front();
+    result.max_ns = times_ns.back();
+    result.bytes = bytes;
+    result.items = items;
+    result.itemUnit = itemUnit;
+    m_results.append(result);
+
+    out << qSetFieldWidth(48) << left << name << qSetFieldWidth(0)
+        << QString("%1 ns (min %2)").arg(result.median_ns, 12, 'f', 1).arg(result.min_ns, 0, 'f', 1);
+    if (bytes > 0) {
+        out << QString(", %1 MB/s").arg(bytes * 1e3 / result.median_ns, 0, 'f', 1);
+    }
+    if (items > 0) {
+        out << QString(", %1 ns/%2").arg(result.median_ns / items, 0, 'f', 2).arg(itemUnit);
+    }
+    out << endl;
+}
+
+/**
+ * @brief BenchmarkRunner::check runs a check case
+ * @param name of the case, "group/case/variant"
+ * @param body returns what went wrong, empty if the check passed
+ */
+void BenchmarkRunner::check(const QString &name, const std::function<QString()> &body)
+{
+    QTextStream out(stdout);
+
+    if (!isSelected(name)) {
+        return;
+    }
+    if (m_listOnly) {
+        out << name << endl;
+        return;
+    }
+
+    QString error = body();
+    m_checkCount++;
+    out << qSetFieldWidth(48) << left << name << qSetFieldWidth(0) << (error.isEmpty() ? "ok" : "FAILED: " + error) << endl;
+    if (!error.isEmpty()) {
+        m_failures.append(name + ": " + error);
+    }
+}
+
+/**
+ * @brief BenchmarkRunner::result
+ * @return the result of a case, null if it was not run
+ */
+const BenchmarkRunner::Result *BenchmarkRunner::result(const QString &name) const
+{
+    for (int i = 0; i < m_results.size(); i++) {
+        if (m_results[i].name == name) {
+            return &m_results[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief BenchmarkRunner::toJson
+ * @return the results, one object per case, and the failed checks
+ */
+QJsonObject BenchmarkRunner::toJson() const
+{
+    QJsonArray cases;
+
+    foreach (const Result &result, m_results) {
+        QJsonObject item;
+        item["name"] = result.name;
+        item["iterations"] = result.iterations;
+        item["samples"] = result.samples;
+        item["median_ns"] = result.median_ns;
+        item["min_ns"] = result.min_ns;
+        item["max_ns"] = result.max_ns;
+        if (result.bytes > 0) {
+            item["bytes"] = result.bytes;
+            item["bytes_per_s"] = result.bytes * 1e9 / result.median_ns;
+        }
+        if (result.items > 0) {
+            item["items"] = result.items;
+            item["item_unit"] = result.itemUnit;
+            item["ns_per_item"] = result.median_ns / result.items;
+        }
+        cases.append(item);
+    }
+
+    QJsonObject json;
+    json["min_sample_ms"] = m_minSampleTime_ms;
+    json["samples"] = m_samples;
+    json["cases"] = cases;
+    json["failures"] = QJsonArray::fromStringList(m_failures);
+    return json;
+}
@@ -0,0 +1,73 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+// Units: ms, minimum duration of a sample, iterations are doubled until a sample lasts as long
+#define BENCHMARK_DEFAULT_MIN_SAMPLE_MS     (50)
+// Samples of each case, the median and the minimum are reported
+#define BENCHMARK_DEFAULT_SAMPLES           (7)
+
+/**
+ * @brief Runs the benchmark cases and collects their timings.
+ *
+ * A case is a function timed over a number of iterations: each sample runs it until it lasts at least
+ * minSampleTime_ms, the median and the minimum of the samples are reported per iteration. Work which
+ * must not be timed (restoring a state consumed by the case) goes in the optional setup function,
+ * called before each sample.
+ *
+ * A check is a case which is not timed: it verifies a behavior or a result of a timed case, and
+ * bbmtest fails if any check does.
+ */
+class BenchmarkRunner
+{
+public:
+   struct Result {
+      QString name;
+      qint64 iterations;        // Per sample
+      int samples;
+      double median_ns;         // Per iteration
+      double min_ns;
+      double max_ns;
+      qint64 bytes;             // Processed per iteration, 0 if not relevant
+      qint64 items;             // Processed per iteration (samples, events...), 0 if not relevant
+      QString itemUnit;
+   };
+
+   BenchmarkRunner();
+
+   void setFilter(const QString &filter);
+   void setMinSampleTime_ms(int time_ms);
+   void setSamples(int samples);
+   void setListOnly(bool listOnly);
+
+   bool isSelected(const QString &name) const;
+   void run(const QString &name, const std::function<void()> &body, qint64 bytes = 0, qint64 items = 0,
+            const QString &itemUnit = QString(), const std::function<void()> &setup = std::function<void()>());
+   void check(const QString &name, const std::function<QString()> &body);
+
+   const Result *result(const QString &name) const;
+   inline const QList<Result> &results() const {return m_results;}
+   inline int checkCount() const {return m_checkCount;}
+   inline const QStringList &failures() const {return m_failures;}
+   QJsonObject toJson() const;
+
+private:
+   QString m_filter;
+   int m_minSampleTime_ms;
+   int m_samples;
+   bool m_listOnly;
+   QList<Result> m_results;
+   int m_checkCount;
+   QStringList m_failures; // "name: what went wrong" of the failed checks
+};
+
+void runEngineBenchmarks(BenchmarkRunner &runner);
+void runFileBenchmarks(BenchmarkRunner &runner);
+
+#endif // BENCHMARK_H
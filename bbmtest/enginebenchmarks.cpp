@@ -0,0 +1,647 @@
+/*
+    This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+    BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "benchmark.h"
+#include "syntheticdata.h"
+
+#include <QDebug>
+#include <QTemporaryDir>
+#include <QVector>
+
+#include "player/engineContext.h"
+#include "player/mixer.h"
+#include "player/mixerKernels.h"
+#include "player/player.h"
+#include "player/soundManager.h"
+#include "player/songPlayer.h"
+
+#if !(defined(__x86_64__) || defined(_M_X64))
+#define MIXER_ADDRESS(p)            ((unsigned int)(p))
+#else
+#define MIXER_ADDRESS(p)            ((uint64_t)(p))
+#endif
+
+// Units: frames, rendered per mixer call, about a refresh of the player
+#define BENCH_BLOCK_FRAMES          (256)
+// Units: frames, length of the mixer sounds, long enough not to end during most samples
+#define BENCH_SOUND_FRAMES          (10 * 44100)
+// Units: frames, between the starts of the mixer sounds so that each voice reads its own memory
+#define BENCH_VOICE_OFFSET          (4096)
+// Volume of the mixer sounds, 100 is full scale for the sound manager
+#define BENCH_VOICE_VOLUME          (25 * 10000)
+// Full scale as in the player, the mixer is muted once initialized
+#define BENCH_OUTPUT_LEVEL          (1.0f)
+// Units: frames, length of the drumset layers
+#define BENCH_LAYER_FRAMES          (44100 / 2)
+// Tempo the songs are played at
+#define BENCH_SONG_BPM              (120)
+// Seed of all the synthetic data of the engine cases
+#define BENCH_ENGINE_SEED           (2014u)
+// Hi-hat of the choke case: closed and open notes, in a choke group of their own, 2 sounds per note
+#define BENCH_HIHAT_CLOSED          (42)
+#define BENCH_HIHAT_OPEN            (46)
+#define BENCH_HIHAT_CHOKE_GROUP     (1)
+#define BENCH_HIHAT_POLYPHONY       (2)
+// Note of the first steal order sound, each one plays its own note above the hi-hat ones
+#define BENCH_STEAL_FIRST_NOTE      (48)
+// Units: ns, bound of a note on when all the voices and stealing channels are busy
+#define BENCH_NOTE_ON_MAX_NS        (20000)
+// Units: frames, rendered before checking which sounds were stolen, longer than the mixer release ramp
+#define BENCH_STEAL_SETTLE_FRAMES   (256)
+// Random inputs of each sample layout and output level compared between kernel sets
+#define BENCH_KERNEL_ROUNDS         (64)
+// Units: refreshes of the player, rendered at each level to compare the output with the exact conversion
+#define BENCH_REFERENCE_REFRESHES   (2000)
+// Units: LSB of the 16 bits output, allowed between the kernels and the exact conversion
+#define BENCH_REFERENCE_MAX_DIFF    (1)
+
+enum SoundFormat {
+   SOUND_16_BITS,
+   SOUND_24_BITS,
+   SOUND_24_BITS_DECODED // As the sound manager plays the 24 bits layers it cached
+};
+
+/**
+ * @brief startVoices restarts the mixer with voices stereo sounds, each one from its own offset of data
+ */
+static void startVoices(const QByteArray &data, SoundFormat format, int voices)
+{
+    int bytesPerSample = format == SOUND_16_BITS ? 2 : format == SOUND_24_BITS ? 3 : 4;
+    const char *sound = data.constData();
+
+    mixer_removeAll();
+    for (int i = 0; i < voices; i++) {
+        const char *start = sound + (qint64)i * BENCH_VOICE_OFFSET * 2 * bytesPerSample;
+        unsigned int note = SYNTHETIC_FIRST_NOTE + i % 64;
+        switch (format) {
+        case SOUND_16_BITS:
+            mixer_addPCM16Stereo(MIXER_ADDRESS(start), BENCH_SOUND_FRAMES * 2, BENCH_VOICE_VOLUME, 0, 0, note, 0, 0, 0);
+            break;
+        case SOUND_24_BITS:
+            mixer_addPCM24Stereo(MIXER_ADDRESS(start), BENCH_SOUND_FRAMES * 2, BENCH_VOICE_VOLUME, 0, 0, note, 0, 0, 0);
+            break;
+        case SOUND_24_BITS_DECODED:
+            mixer_addPCM24DecodedStereo(MIXER_ADDRESS(start), BENCH_SOUND_FRAMES * 2, BENCH_VOICE_VOLUME, 0, 0, note, 0, 0, 0);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief runMixerBenchmarks times mixer_ReadOutputStream with a number of voices playing.
+ *        The voices are restarted as soon as one ended, so that the count is constant.
+ */
+static void runMixerBenchmarks(BenchmarkRunner &runner)
+{
+    const int voiceCounts[] = {1, 16, 64};
+    const int frames = BENCH_SOUND_FRAMES + 64 * BENCH_VOICE_OFFSET;
+    QVector<short int> buffer(BENCH_BLOCK_FRAMES * 2);
+
+    for (int f = SOUND_16_BITS; f <= SOUND_24_BITS_DECODED; f++) {
+        SoundFormat format = (SoundFormat)f;
+        const char *formatName = format == SOUND_16_BITS ? "16bit" : format == SOUND_24_BITS ? "24bit" : "24bit_decoded";
+
+        bool selected = false;
+        for (int voices : voiceCounts) {
+            selected = selected || runner.isSelected(QString("mixer/read_output/%1/%2_voices").arg(formatName).arg(voices));
+        }
+        if (!selected) {
+            continue;
+        }
+
+        QByteArray data = SyntheticData::pcm(format == SOUND_16_BITS ? 16 : 24, 2, frames, BENCH_ENGINE_SEED);
+        if (format == SOUND_24_BITS_DECODED) {
+            // Same layout as the sound manager cache: the 24 bits sign extended to 32 bits
+            QByteArray decoded(frames * 2 * (int)sizeof(int32_t), '\0');
+            const uchar *in = (const uchar *)data.constData();
+            int32_t *out = (int32_t *)decoded.data();
+            for (int i = 0; i < frames * 2; i++, in += 3) {
+                out[i] = ((int32_t)(((uint32_t)in[0] << 8) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 24))) >> 8;
+            }
+            data = decoded;
+        }
+
+        for (int voices : voiceCounts) {
+            mixer_init();
+            mixer_setOutputLevel(BENCH_OUTPUT_LEVEL);
+            mixer_setPolyphony(MIXER_DEFAULT_POLYPHONY);
+            runner.run(QString("mixer/read_output/%1/%2_voices").arg(formatName).arg(voices), [&]() {
+                if ((int)mixer_getVoiceCount() < voices) {
+                    startVoices(data, format, voices);
+                }
+                mixer_ReadOutputStream(buffer.data(), BENCH_BLOCK_FRAMES * 2); // length is in absolute sample count (stereo)
+            }, BENCH_BLOCK_FRAMES * MIXER_BYTES_PER_SAMPLE_STEREO, BENCH_BLOCK_FRAMES, "frame", [&]() {
+                startVoices(data, format, voices);
+            });
+        }
+        mixer_removeAll();
+    }
+}
+
+/**
+ * @brief runChokeBenchmarks times a dense hi-hat pattern over a full mixer: each hit alternates
+ *        closed and open, chokes the other one and limits the note polyphony as the sound manager
+ *        does, then a block is rendered. Long sounds keep the voice count at the polyphony.
+ */
+static void runChokeBenchmarks(BenchmarkRunner &runner)
+{
+    const QString name("mixer/choke/64_voices");
+    if (!runner.isSelected(name)) {
+        return;
+    }
+
+    const int voices = 64;
+    const int frames = BENCH_SOUND_FRAMES + voices * BENCH_VOICE_OFFSET;
+    QByteArray data = SyntheticData::pcm(16, 2, frames, BENCH_ENGINE_SEED);
+    const char *hihat = data.constData() + (qint64)voices * BENCH_VOICE_OFFSET * 4;
+    QVector<short int> buffer(BENCH_BLOCK_FRAMES * 2);
+
+    mixer_init();
+    mixer_setOutputLevel(BENCH_OUTPUT_LEVEL);
+    mixer_setPolyphony(voices);
+
+    unsigned int count = 0;
+    runner.run(name, [&]() {
+        unsigned int note = count % 2 ? BENCH_HIHAT_OPEN : BENCH_HIHAT_CLOSED;
+        if ((int)mixer_getVoiceCount() < voices) {
+            startVoices(data, SOUND_16_BITS, voices);
+        }
+        mixer_chokeChannel(BENCH_HIHAT_CHOKE_GROUP, 0);
+        mixer_addPCM16Stereo(MIXER_ADDRESS(hihat), BENCH_LAYER_FRAMES * 2, BENCH_VOICE_VOLUME, 0,
+                             BENCH_HIHAT_CHOKE_GROUP, note, 0, 0, 0);
+        mixer_polyphonyRemove(note, BENCH_HIHAT_POLYPHONY, 0);
+        mixer_ReadOutputStream(buffer.data(), BENCH_BLOCK_FRAMES * 2); // length is in absolute sample count (stereo)
+        count++;
+    }, 0, 1, "hit", [&]() {
+        startVoices(data, SOUND_16_BITS, voices);
+    });
+
+    mixer_removeAll();
+}
+
+/**
+ * @brief checkStealOrder checks which sounds the mixer replaces once the polyphony is reached:
+ *        a released one first, then the quietest, then the oldest. The polyphony is filled with
+ *        sounds from the oldest, each one with its own address and note, then new sounds are added.
+ *        Once the stolen sounds faded out, only the expected ones must be gone.
+ */
+static void checkStealOrder(BenchmarkRunner &runner)
+{
+    const int voices = MIXER_MIN_POLYPHONY;
+    const int sounds = voices + 4;
+    QByteArray data = SyntheticData::pcm(16, 2, BENCH_SOUND_FRAMES + sounds * BENCH_VOICE_OFFSET, BENCH_ENGINE_SEED);
+    QVector<short int> buffer(BENCH_STEAL_SETTLE_FRAMES * 2);
+    unsigned int volume[sounds];
+    unsigned int chokeGroup[sounds];
+    unsigned int note[sounds];
+    int added = 0;
+
+    auto address = [&](int i) {
+        return MIXER_ADDRESS(data.constData() + (qint64)i * BENCH_VOICE_OFFSET * 4);
+    };
+    auto add = [&](int count) {
+        for (int i = 0; i < count; i++, added++) {
+            mixer_addPCM16Stereo(address(added), BENCH_SOUND_FRAMES * 2, volume[added], 0, chokeGroup[added], note[added], 0, 0, 0);
+        }
+    };
+    // Restarts the mixer, the sounds are then set up and the polyphony filled by add(voices)
+    auto reset = [&]() {
+        mixer_init();
+        mixer_setOutputLevel(BENCH_OUTPUT_LEVEL);
+        mixer_setPolyphony(voices);
+        for (int i = 0; i < sounds; i++) {
+            volume[i] = BENCH_VOICE_VOLUME;
+            chokeGroup[i] = 0;
+            note[i] = BENCH_STEAL_FIRST_NOTE + i;
+        }
+        added = 0;
+    };
+    // Renders until the stolen sounds faded out, then compares the sounds gone with the expected ones
+    auto gone = [&](const QList<int> &expected) {
+        mixer_ReadOutputStream(buffer.data(), BENCH_STEAL_SETTLE_FRAMES * 2); // length is in absolute sample count (stereo)
+
+        QList<int> stolen;
+        for (int i = 0; i < added; i++) {
+            if (mixer_countSoundWithAddress(address(i), 1) == 0) {
+                stolen.append(i);
+            }
+        }
+        if (stolen == expected && mixer_getStealCount() == (unsigned int)expected.size()) {
+            return QString();
+        }
+
+        QStringList expectedText, stolenText;
+        foreach (int i, expected) {
+            expectedText << QString::number(i);
+        }
+        foreach (int i, stolen) {
+            stolenText << QString::number(i);
+        }
+        return QString("sounds %1 stolen instead of %2 (%3 steals)").arg(stolenText.join(",")).arg(expectedText.join(","))
+                .arg(mixer_getStealCount());
+    };
+
+    runner.check("mixer/steal_order/oldest", [&]() {
+        reset();
+        add(voices + 2);
+        return gone({0, 1});
+    });
+
+    runner.check("mixer/steal_order/quietest", [&]() {
+        reset();
+        volume[5] = BENCH_VOICE_VOLUME / 4;
+        add(voices + 1);
+        return gone({5});
+    });
+
+    runner.check("mixer/steal_order/released", [&]() {
+        reset();
+        volume[0] = BENCH_VOICE_VOLUME / 4;
+        add(voices);
+        mixer_chokeNote(note[20]);
+        add(2);
+        return gone({0, 20});
+    });
+
+    runner.check("mixer/steal_order/choke_group", [&]() {
+        reset();
+        chokeGroup[10] = chokeGroup[20] = BENCH_HIHAT_CHOKE_GROUP;
+        add(voices);
+        mixer_chokeChannel(BENCH_HIHAT_CHOKE_GROUP, 0);
+        add(3);
+        return gone({0, 10, 20});
+    });
+
+    runner.check("mixer/steal_order/note_polyphony", [&]() {
+        reset();
+        note[3] = note[7] = note[9] = BENCH_HIHAT_CLOSED;
+        add(voices);
+        mixer_polyphonyRemove(BENCH_HIHAT_CLOSED, BENCH_HIHAT_POLYPHONY, 0);
+        add(1);
+        return gone({3});
+    });
+
+    mixer_removeAll();
+}
+
+/**
+ * @brief checkMixerKernels checks that each kernel set the CPU supports mixes all the sample layouts
+ *        and converts the output exactly as the scalar kernels, on random samples, gains, lengths up to
+ *        a block and alignments. The mixer would only fall back to the scalar kernels when a set fails
+ *        its own self test (see mixerKernels_select), the check fails instead.
+ */
+static void checkMixerKernels(BenchmarkRunner &runner)
+{
+    static const char *formatNames[MIXER_NUMBER_OF_FORMAT] = {
+        "pcm16_stereo", "pcm16_mono", "pcm24_stereo", "pcm24_mono", "pcm24_decoded_stereo", "pcm24_decoded_mono"
+    };
+    static const float levels[] = {0.0f, 0.3f, 1.0f, 4.0f};
+    const MIXERKERNELS_set_t *scalar = mixerKernels_scalar();
+    const MIXERKERNELS_set_t *sets[MIXER_KERNELS_MAX_SETS];
+    unsigned int count = mixerKernels_supported(sets, MIXER_KERNELS_MAX_SETS);
+
+    for (unsigned int s = 0; s < count; s++) {
+        const MIXERKERNELS_set_t *kernels = sets[s];
+        runner.check(QString("mixer/kernels/%1/bit_exact").arg(kernels->name), [&]() {
+            if (!mixerKernels_selfTest(kernels)) {
+                return QString("self test failed");
+            }
+
+            quint32 seed = BENCH_ENGINE_SEED;
+            auto random = [&seed]() {
+                seed = seed * 1664525u + 1013904223u;
+                return seed;
+            };
+            // Any byte is a valid sample of the file layouts, decoded ones are 24 bits values
+            QVector<unsigned char> bytes(BENCH_BLOCK_FRAMES * 8 + 4);
+            QVector<int32_t> decoded(BENCH_BLOCK_FRAMES * 2 + 4);
+            for (int i = 0; i < bytes.size(); i++) {
+                bytes[i] = (unsigned char)(random() >> 24);
+            }
+            for (int i = 0; i < decoded.size(); i++) {
+                decoded[i] = (int32_t)(random() << 8) >> 8;
+            }
+            QVector<int64_t> expected(BENCH_BLOCK_FRAMES * 2);
+            QVector<int64_t> actual(BENCH_BLOCK_FRAMES * 2);
+            int64_t *expectedLeft = expected.data();
+            int64_t *expectedRight = expected.data() + BENCH_BLOCK_FRAMES;
+            int64_t *actualLeft = actual.data();
+            int64_t *actualRight = actual.data() + BENCH_BLOCK_FRAMES;
+
+            for (int format = 0; format < MIXER_NUMBER_OF_FORMAT; format++) {
+                bool isDecoded = format == MIXER_FORMAT_PCM24_DECODED_STEREO || format == MIXER_FORMAT_PCM24_DECODED_MONO;
+                for (int round = 0; round < BENCH_KERNEL_ROUNDS; round++) {
+                    unsigned int frames = round < 2 ? round * BENCH_BLOCK_FRAMES : random() % (BENCH_BLOCK_FRAMES + 1);
+                    unsigned int offset = random() % 4;
+                    uint32_t gain = round == 0 ? 0xFFFFFFFFu : random();
+                    const unsigned char *src = isDecoded ? (const unsigned char *)&decoded[offset] : &bytes[offset];
+
+                    for (int i = 0; i < expected.size(); i++) {
+                        expected[i] = actual[i] = (int64_t)(int32_t)random();
+                    }
+                    scalar->mix[format](src, gain, expectedLeft, expectedRight, frames);
+                    kernels->mix[format](src, gain, actualLeft, actualRight, frames);
+                    if (expected != actual) {
+                        return QString("%1 differs on %2 frames at offset %3, gain %4").arg(formatNames[format])
+                                .arg(frames).arg(offset).arg(gain);
+                    }
+                }
+            }
+
+            QVector<int16_t> expectedOutput(BENCH_BLOCK_FRAMES * 2);
+            QVector<int16_t> actualOutput(BENCH_BLOCK_FRAMES * 2);
+            for (float level : levels) {
+                for (int round = 0; round < BENCH_KERNEL_ROUNDS; round++) {
+                    unsigned int frames = round == 0 ? BENCH_BLOCK_FRAMES : random() % (BENCH_BLOCK_FRAMES + 1);
+                    // Accumulators of all magnitudes, from silence to far over the clip
+                    for (int i = 0; i < expected.size(); i++) {
+                        expected[i] = (int64_t)(((quint64)random() << 32) | random()) >> (random() % 64);
+                    }
+                    expectedOutput.fill(0);
+                    actualOutput.fill(0);
+                    scalar->output(expectedLeft, expectedRight, level, expectedOutput.data(), frames);
+                    kernels->output(expectedLeft, expectedRight, level, actualOutput.data(), frames);
+                    if (expectedOutput != actualOutput) {
+                        return QString("output differs on %1 frames at level %2").arg(frames).arg(level);
+                    }
+                }
+            }
+            return QString();
+        });
+    }
+}
+
+/**
+ * @brief runNoteOnBenchmarks times the worst case of a note on in the mixer: all the voices play
+ *        and all the stealing channels fade out, so that each new sound scans the whole voice table
+ *        for its victim then cuts the oldest fade. The mixer is not rendered, which keeps it so.
+ *        The cost must stay within BENCH_NOTE_ON_MAX_NS.
+ */
+static void runNoteOnBenchmarks(BenchmarkRunner &runner)
+{
+    const QString name("mixer/note_on/saturated");
+    if (!runner.isSelected(name)) {
+        return;
+    }
+
+    const int voices = MIXER_MAX_POLYPHONY;
+    QByteArray data = SyntheticData::pcm(16, 2, BENCH_SOUND_FRAMES, BENCH_ENGINE_SEED);
+    const char *sound = data.constData();
+    unsigned int count = 0;
+    auto noteOn = [&]() {
+        unsigned int note = SYNTHETIC_FIRST_NOTE + count % 64;
+        mixer_addPCM16Stereo(MIXER_ADDRESS(sound), BENCH_SOUND_FRAMES * 2, BENCH_VOICE_VOLUME, 0, 0, note, 0, 0, 0);
+        count++;
+    };
+
+    mixer_init();
+    mixer_setOutputLevel(BENCH_OUTPUT_LEVEL);
+    mixer_setPolyphony(voices);
+    for (int i = 0; i < voices + (int)MIXER_STEAL_CHANNELS; i++) {
+        noteOn();
+    }
+    mixer_resetStealCount();
+    count = 0;
+
+    runner.run(name, noteOn, 0, 1, "note");
+
+    runner.check(name + "/bound", [&]() {
+        const BenchmarkRunner::Result *result = runner.result(name);
+        if (!result) {
+            return QString("not timed");
+        }
+        if (mixer_getVoiceCount() != (unsigned int)voices || mixer_getStealCount() != count) {
+            return QString("%1 voices and %2 steals for %3 notes, the mixer was not saturated")
+                    .arg(mixer_getVoiceCount()).arg(mixer_getStealCount()).arg(count);
+        }
+        if (result->median_ns > BENCH_NOTE_ON_MAX_NS) {
+            return QString("%1 ns per note, over %2 ns").arg(result->median_ns, 0, 'f', 1).arg(BENCH_NOTE_ON_MAX_NS);
+        }
+        return QString();
+    });
+
+    mixer_removeAll();
+}
+
+/**
+ * @brief runSoundManagerBenchmarks times the note on of a drumset, cycling through its instruments
+ *        and velocities. The mixer is not rendered: once the polyphony is reached, which is the case
+ *        of most of the notes, each one replaces the oldest sound as in a dense song.
+ */
+static void runSoundManagerBenchmarks(BenchmarkRunner &runner)
+{
+    const int instruments = 16;
+    const int layers = 4;
+
+    for (int bps = 16; bps <= 24; bps += 8) {
+        QString name = QString("soundmanager/note_on/%1bit").arg(bps);
+        if (!runner.isSelected(name)) {
+            continue;
+        }
+
+        QByteArray drumset = SyntheticData::drumset(instruments, layers, bps, BENCH_LAYER_FRAMES, BENCH_ENGINE_SEED);
+        SoundManager_DecodedDrumset *decoded = SoundManager_decodeDrumset(drumset.data(), drumset.size(), SOUNDMANAGER_DEFAULT_DECODE_BUDGET);
+        mixer_init();
+        SoundManager_init();
+        SoundManager_LoadDrumset(drumset.data(), drumset.size(), decoded);
+
+        unsigned int count = 0;
+        runner.run(name, [&]() {
+            unsigned char note = SYNTHETIC_FIRST_NOTE + count % instruments;
+            unsigned char velocity = 1 + (count * 37) % 127;
+            SoundManager_playDrumsetNote(note, velocity, 0.0f, 1.0f, 0, 0);
+            count++;
+        }, 0, 1, "note", []() {
+            mixer_removeAll();
+        });
+
+        mixer_removeAll();
+        SoundManager_init();
+        SoundManager_freeDecodedDrumset(decoded);
+    }
+}
+
+/**
+ * @brief runSongPlayerBenchmarks times a refresh of the player on a generated song:
+ *        SongPlayer_processSong alone, the sounds it started being removed, then along with the rendering
+ */
+static void runSongPlayerBenchmarks(BenchmarkRunner &runner)
+{
+    const QString processName("songplayer/process_song");
+    const QString refreshName("songplayer/refresh");
+    if (!runner.isSelected(processName) && !runner.isSelected(refreshName)) {
+        return;
+    }
+
+    QTemporaryDir dir;
+    QByteArray song = dir.isValid() ? SyntheticData::songFile(dir.path(), 3, 8, BENCH_ENGINE_SEED) : QByteArray();
+    if (song.isEmpty()) {
+        qWarning() << "runSongPlayerBenchmarks - Failed to generate song";
+        return;
+    }
+    QByteArray drumset = SyntheticData::drumset(8, 4, 16, BENCH_LAYER_FRAMES, BENCH_ENGINE_SEED);
+
+    mixer_init();
+    mixer_setOutputLevel(BENCH_OUTPUT_LEVEL);
+    SoundManager_init();
+    SoundManager_LoadDrumset(drumset.data(), drumset.size(), nullptr);
+    SongPlayer_init();
+    if (SongPlayer_loadSong(song.data(), song.size()) <= 0) {
+        qWarning() << "runSongPlayerBenchmarks - Failed to load song";
+        SongPlayer_init();
+        return;
+    }
+    SongPlayer_externalStart();
+
+    const float ratio = TICK_TO_TIME_RATIO(BENCH_SONG_BPM);
+    runner.run(processName, [&]() {
+        SongPlayer_processSong(ratio, TICKS_PER_REFRESH);
+        mixer_removeAll();
+    }, 0, TICKS_PER_REFRESH, "tick");
+
+    const int frames = qRound(SAMPLES_PER_REFRESH(BENCH_SONG_BPM));
+    QVector<short int> buffer(frames * 2);
+    runner.run(refreshName, [&]() {
+        SongPlayer_processSong(ratio, TICKS_PER_REFRESH);
+        mixer_ReadOutputStream(buffer.data(), frames * 2); // length is in absolute sample count (stereo)
+    }, frames * MIXER_BYTES_PER_SAMPLE_STEREO, frames, "frame");
+
+    SongPlayer_externalStop();
+    SongPlayer_init();
+    mixer_removeAll();
+    SoundManager_init();
+}
+
+// Kernels whose output is compared with the exact conversion by referenceOutput
+static const MIXERKERNELS_set_t *ReferenceKernels;
+static int ReferenceMaxDiff;
+static qint64 ReferenceSamples;
+static qint64 ReferenceNonZero;
+
+static int16_t referenceSample(int64_t acc, float level)
+{
+    int64_t value = acc / MIXER_MASTER_DIVIDER;
+    value = qBound((int64_t)MIXER_MIN_VALUE, value, (int64_t)MIXER_MAX_VALUE);
+    int out = ((int)(level * (float)value)) >> 8;
+    return (int16_t)qBound((int)INT16_MIN, out, (int)INT16_MAX);
+}
+
+static void referenceOutput(const int64_t *left, const int64_t *right, float level, int16_t *dst, unsigned int frames)
+{
+    ReferenceKernels->output(left, right, level, dst, frames);
+    for (unsigned int i = 0; i < frames; i++) {
+        for (int side = 0; side < 2; side++) {
+            int diff = qAbs((int)dst[2 * i + side] - (int)referenceSample(side ? right[i] : left[i], level));
+            ReferenceMaxDiff = qMax(ReferenceMaxDiff, diff);
+            ReferenceNonZero += dst[2 * i + side] != 0;
+        }
+    }
+    ReferenceSamples += 2 * frames;
+}
+
+/**
+ * @brief checkOutputReference renders a generated song at several output levels with each kernel set
+ *        the CPU supports, and compares each sample with the exact conversion of the accumulators:
+ *        clip16((int)(level * clip24(acc / MIXER_MASTER_DIVIDER)) >> 8), within BENCH_REFERENCE_MAX_DIFF
+ */
+static void checkOutputReference(BenchmarkRunner &runner)
+{
+    const QString name("mixer/output/reference");
+    if (!runner.isSelected(name)) {
+        return;
+    }
+
+    runner.check(name, [&]() {
+        static const float levels[] = {0.3f, BENCH_OUTPUT_LEVEL};
+        QTemporaryDir dir;
+        QByteArray song = dir.isValid() ? SyntheticData::songFile(dir.path(), 3, 8, BENCH_ENGINE_SEED) : QByteArray();
+        if (song.isEmpty()) {
+            return QString("failed to generate song");
+        }
+        QByteArray drumset = SyntheticData::drumset(8, 4, 24, BENCH_LAYER_FRAMES, BENCH_ENGINE_SEED);
+        const float ratio = TICK_TO_TIME_RATIO(BENCH_SONG_BPM);
+        const int frames = qRound(SAMPLES_PER_REFRESH(BENCH_SONG_BPM));
+        QVector<short int> buffer(frames * 2);
+        const MIXERKERNELS_set_t *sets[MIXER_KERNELS_MAX_SETS];
+        unsigned int count = mixerKernels_supported(sets, MIXER_KERNELS_MAX_SETS);
+
+        for (unsigned int s = 0; s < count; s++) {
+            ReferenceKernels = sets[s];
+            ReferenceMaxDiff = 0;
+            ReferenceSamples = 0;
+            ReferenceNonZero = 0;
+            for (float level : levels) {
+                MIXERKERNELS_set_t kernels = *ReferenceKernels;
+                kernels.output = referenceOutput;
+                mixer_init();
+                mixer_setOutputLevel(level);
+                mixer_setKernels(&kernels);
+                SoundManager_init();
+                SoundManager_LoadDrumset(drumset.data(), drumset.size(), nullptr);
+                SongPlayer_init();
+                bool loaded = SongPlayer_loadSong(song.data(), song.size()) > 0;
+                if (loaded) {
+                    SongPlayer_externalStart();
+                    for (int i = 0; i < BENCH_REFERENCE_REFRESHES; i++) {
+                        SongPlayer_processSong(ratio, TICKS_PER_REFRESH);
+                        mixer_ReadOutputStream(buffer.data(), frames * 2); // length is in absolute sample count (stereo)
+                    }
+                    SongPlayer_externalStop();
+                }
+                SongPlayer_init();
+                mixer_removeAll();
+                SoundManager_init();
+                mixer_setKernels(nullptr);
+                if (!loaded) {
+                    return QString("failed to load song");
+                }
+            }
+
+            if (ReferenceNonZero == 0) {
+                return QString("the song rendered silence");
+            }
+            if (ReferenceMaxDiff > BENCH_REFERENCE_MAX_DIFF) {
+                return QString("%1 kernels differ by %2 LSB from the exact conversion on %3 samples")
+                        .arg(ReferenceKernels->name).arg(ReferenceMaxDiff).arg(ReferenceSamples);
+            }
+        }
+        return QString();
+    });
+}
+
+/**
+ * @brief runEngineBenchmarks runs the cases of the real-time path on an engine of their own
+ */
+void runEngineBenchmarks(BenchmarkRunner &runner)
+{
+    EngineContext *context = EngineContext_create();
+    if (!context) {
+        qWarning() << "runEngineBenchmarks - Failed to allocate engine";
+        return;
+    }
+    EngineContext *previous = EngineContext_bind(context);
+    EngineContext_setSeed(BENCH_ENGINE_SEED);
+
+    runMixerBenchmarks(runner);
+    runChokeBenchmarks(runner);
+    checkStealOrder(runner);
+    checkMixerKernels(runner);
+    runNoteOnBenchmarks(runner);
+    runSoundManagerBenchmarks(runner);
+    runSongPlayerBenchmarks(runner);
+    checkOutputReference(runner);
+
+    EngineContext_bind(previous);
+    EngineContext_destroy(context);
+}
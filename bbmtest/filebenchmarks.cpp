@@ -0,0 +1,187 @@
+/*
+    This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+    BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "benchmark.h"
+#include "syntheticdata.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QVector>
+
+#include <random>
+
+#include "crc32.h"
+#include "drmmaker/DrumSetMaker.h"
+#include "model/filegraph/midiParser.h"
+#include "model/filegraph/songfilemodel.h"
+
+// Units: bytes, of the buffer the CRC is computed on
+#define BENCH_CRC_BUFFER_SIZE       (16 * 1024 * 1024)
+// Units: bytes, of the WAV data of the generated kit
+#define BENCH_KIT_SIZE              (50 * 1024 * 1024)
+#define BENCH_KIT_INSTRUMENTS       (32)
+#define BENCH_KIT_LAYERS            (4)
+// Seed of all the synthetic data of the file cases
+#define BENCH_FILE_SEED             (2020u)
+
+// Results the compiler must not optimize away
+static volatile uint32_t Sink;
+
+/**
+ * @brief runMidiBenchmarks times midi_ParseFile on grooves of a few bars and on very long files
+ */
+static void runMidiBenchmarks(BenchmarkRunner &runner)
+{
+    const int barCounts[] = {8, 256, 4096};
+
+    for (int bars : barCounts) {
+        QString name = QString("midi/parse/%1_bars").arg(bars);
+        if (!runner.isSelected(name)) {
+            continue;
+        }
+
+        QByteArray data = SyntheticData::midiFile(bars, 8, BENCH_FILE_SEED);
+        uint8_t *file = (uint8_t *)data.data();
+        MIDIPARSER_MidiTrack track;
+        int errors;
+        uint32_t events = midi_ParseFile(file, data.size(), &track, MAIN_DRUM_LOOP, &errors);
+        if (!events) {
+            qWarning() << "runMidiBenchmarks - Failed to parse file, errors:" << QString::number(errors, 16);
+            continue;
+        }
+
+        runner.run(name, [&]() {
+            Sink = midi_ParseFile(file, data.size(), &track, MAIN_DRUM_LOOP, &errors);
+        }, data.size(), events, "event");
+    }
+}
+
+/**
+ * @brief runSongFileBenchmarks times SongFileModel::readFromBuffer on a generated song.
+ *        A model is created for each read, as the project does when it loads a song:
+ *        the model skips the parsing when the file CRC is the one it holds.
+ */
+static void runSongFileBenchmarks(BenchmarkRunner &runner)
+{
+    const QString name("songfile/read_from_buffer");
+    if (!runner.isSelected(name)) {
+        return;
+    }
+
+    QTemporaryDir dir;
+    QByteArray song = dir.isValid() ? SyntheticData::songFile(dir.path(), 8, 32, BENCH_FILE_SEED) : QByteArray();
+    if (song.isEmpty()) {
+        qWarning() << "runSongFileBenchmarks - Failed to generate song";
+        return;
+    }
+
+    uint8_t *buffer = (uint8_t *)song.data();
+    runner.run(name, [&]() {
+        SongFileModel model;
+        QStringList parseErrors;
+        Sink = model.readFromBuffer(buffer, song.size(), &parseErrors);
+    }, song.size());
+}
+
+/**
+ * @brief runCrcBenchmarks times the CRC of the song and drumset files
+ */
+static void runCrcBenchmarks(BenchmarkRunner &runner)
+{
+    const QString name("crc32/update");
+    if (!runner.isSelected(name)) {
+        return;
+    }
+
+    std::mt19937 random(BENCH_FILE_SEED);
+    QVector<uint32_t> data(BENCH_CRC_BUFFER_SIZE / sizeof(uint32_t));
+    for (int i = 0; i < data.size(); i++) {
+        data[i] = random();
+    }
+
+    runner.run(name, [&]() {
+        Crc32 crc;
+        crc.update((const uint8_t *)data.constData(), BENCH_CRC_BUFFER_SIZE);
+        Sink = crc.getCRC(true);
+    }, BENCH_CRC_BUFFER_SIZE);
+}
+
+/**
+ * @brief runDrumSetMakerBenchmarks times DrumSetMaker::buildDRM on a kit of BENCH_KIT_SIZE of
+ *        24 bits stereo WAV files, read from a temporary directory as the drumset maker does
+ */
+static void runDrumSetMakerBenchmarks(BenchmarkRunner &runner)
+{
+    const QString name("drmmaker/build_drm/50MB");
+    if (!runner.isSelected(name)) {
+        return;
+    }
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        qWarning() << "runDrumSetMakerBenchmarks - Failed to create temporary directory";
+        return;
+    }
+    QDir wavDir(dir.path());
+    const int frames = BENCH_KIT_SIZE / (BENCH_KIT_INSTRUMENTS * BENCH_KIT_LAYERS * 6);
+    qint64 bytes = 0;
+
+    DrmMakerModel model(dir.path());
+    for (int i = 0; i < BENCH_KIT_INSTRUMENTS; i++) {
+        Instrument *instrument = new Instrument(&model, QString("Instrument %1").arg(i + 1), nullptr, SYNTHETIC_FIRST_NOTE + i);
+        QList<Velocity *> velocityList;
+        for (int j = 0; j < BENCH_KIT_LAYERS; j++) {
+            QString path = wavDir.absoluteFilePath(QString("instrument%1_%2.wav").arg(i).arg(j));
+            QByteArray wav = SyntheticData::wavFile(24, 2, frames, BENCH_FILE_SEED + i * BENCH_KIT_LAYERS + j);
+            if (!SyntheticData::writeFile(path, wav)) {
+                qDeleteAll(velocityList);
+                delete instrument;
+                model.clearInstrumentList();
+                return;
+            }
+            bytes += wav.size();
+            velocityList.append(new Velocity(&model, j * 128 / BENCH_KIT_LAYERS, (j + 1) * 128 / BENCH_KIT_LAYERS - 1, path));
+        }
+        instrument->setVelocityList(velocityList);
+        model.addInstrument(instrument);
+    }
+
+    DrumSetMaker maker(&model);
+    if (maker.checkErrorsAndSort()) {
+        qWarning() << "runDrumSetMakerBenchmarks - Invalid kit";
+        model.clearInstrumentList();
+        return;
+    }
+
+    runner.run(name, [&]() {
+        maker.clearBuild();
+        Sink = maker.buildDRM();
+    }, bytes);
+
+    maker.clearBuild();
+    model.clearInstrumentList();
+}
+
+/**
+ * @brief runFileBenchmarks runs the cases of the file loading and saving
+ */
+void runFileBenchmarks(BenchmarkRunner &runner)
+{
+    runMidiBenchmarks(runner);
+    runSongFileBenchmarks(runner);
+    runCrcBenchmarks(runner);
+    runDrumSetMakerBenchmarks(runner);
+}
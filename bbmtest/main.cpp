@@ -0,0 +1,107 @@
+/*
+    This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+    BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <iostream>
+#include <QApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QThread>
+#include "benchmark.h"
+#include "version.h"
+#include "player/mixer.h"
+
+// Value following option in args, or defaultValue if absent
+QString optionValue(const QStringList &args, const QString &option, const QString &defaultValue = QString()) {
+    int index = args.indexOf(option);
+    return (index >= 0 && index + 1 < args.size()) ? args[index + 1] : defaultValue;
+}
+
+// Build and machine the results were measured on, results are only comparable on the same machine
+QJsonObject environment() {
+    QJsonObject json;
+    json["version"] = QString(VER_FILEVERSION_STR);
+    json["qt"] = QString(qVersion());
+#ifdef QT_NO_DEBUG
+    json["build"] = QString("release");
+#else
+    json["build"] = QString("debug");
+#endif
+    json["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    json["os"] = QSysInfo::prettyProductName();
+    json["cpu_arch"] = QSysInfo::currentCpuArchitecture();
+    json["cpu_cores"] = QThread::idealThreadCount();
+
+    // Kernels are picked for the CPU by mixer_init
+    mixer_init();
+    json["mixer_kernels"] = QString(mixer_getKernelsName());
+    return json;
+}
+
+// Run the benchmarks on synthetic data and write the results as JSON:
+//   [--output file] [--filter text] [--min-time ms] [--samples n] [--list]
+int main(int argc, char *argv[])
+{
+    // The drumset maker cases create widgets, no display is needed
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication a(argc, argv);
+    // Settings written by the models must not end up in the ones of the application
+    a.setOrganizationName("Singular Sound");
+    a.setApplicationName("BBManager Benchmarks");
+
+    QStringList args = a.arguments();
+    if (args.contains("--help") || args.contains("-h")) {
+        std::cout << "Usage: bbmtest [--output file] [--filter text] [--min-time ms] [--samples n] [--list]" << std::endl;
+        return 0;
+    }
+
+    BenchmarkRunner runner;
+    runner.setFilter(optionValue(args, "--filter"));
+    runner.setMinSampleTime_ms(optionValue(args, "--min-time", QString::number(BENCHMARK_DEFAULT_MIN_SAMPLE_MS)).toInt());
+    runner.setSamples(optionValue(args, "--samples", QString::number(BENCHMARK_DEFAULT_SAMPLES)).toInt());
+    runner.setListOnly(args.contains("--list"));
+
+    runEngineBenchmarks(runner);
+    runFileBenchmarks(runner);
+
+    if (args.contains("--list")) {
+        return 0;
+    }
+    if (runner.results().isEmpty() && runner.checkCount() == 0) {
+        std::cerr << "No benchmark run" << std::endl;
+        return 1;
+    }
+
+    QJsonObject json = runner.toJson();
+    json["environment"] = environment();
+
+    QString output = optionValue(args, "--output", "bbmtest.json");
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(QJsonDocument(json).toJson()) < 0) {
+        std::cerr << "Failed to write " << output.toStdString() << std::endl;
+        return 1;
+    }
+    std::cout << runner.results().size() << " benchmark(s), " << runner.checkCount() << " check(s), results in "
+              << output.toStdString() << std::endl;
+
+    // Checks failing make the run fail, once the results are written
+    foreach (const QString &failure, runner.failures()) {
+        std::cerr << "Check failed: " << failure.toStdString() << std::endl;
+    }
+    return runner.failures().isEmpty() ? 0 : 1;
+}
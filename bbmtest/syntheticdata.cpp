@@ -0,0 +1,314 @@
+/*
+    This software and the content provided for use with it is Copyright © 2014-2020 Singular Sound
+    BeatBuddy Manager is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License version 2 as published by
+    the Free Software Foundation.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "syntheticdata.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+#include <math.h>
+#include <random>
+#include <string.h>
+
+#include "drmmaker/Utils/Common.h"
+#include "model/beatsmodelfiles.h"
+#include "model/filegraph/midiParser.h"
+#include "model/filegraph/songfilemodel.h"
+#include "model/filegraph/songmodel.h"
+#include "model/filegraph/songpartmodel.h"
+#include "model/filegraph/songtracksmodel.h"
+
+// Units: ticks, a 16th note, the grooves are made of 16 steps per bar
+#define SYNTHETIC_STEP_TICKS        (SYNTHETIC_TPQN / 4)
+// Units: ticks, from a note on to its note off
+#define SYNTHETIC_NOTE_LENGTH       (SYNTHETIC_STEP_TICKS / 2)
+// Tempo of the generated songs
+#define SYNTHETIC_SONG_BPM          (120)
+
+static void appendLE(QByteArray &data, quint32 value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        data.append((char)((value >> (8 * i)) & 0xFF));
+    }
+}
+
+static void appendBE(QByteArray &data, quint32 value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--) {
+        data.append((char)((value >> (8 * i)) & 0xFF));
+    }
+}
+
+static void appendVariableLength(QByteArray &data, quint32 value)
+{
+    char bytes[4];
+    int count = 0;
+    do {
+        bytes[count++] = (char)(value & 0x7F);
+        value >>= 7;
+    } while (value && count < 4);
+    while (count > 1) {
+        data.append((char)(bytes[--count] | 0x80));
+    }
+    data.append(bytes[0]);
+}
+
+/**
+ * @brief SyntheticData::pcm generates a drum like sound: noise with an exponential decay
+ * @param bps bits per sample, 16 or 24, little endian and packed as in the WAV files
+ * @param channels interleaved
+ * @param frames samples per channel
+ */
+QByteArray SyntheticData::pcm(int bps, int channels, int frames, quint32 seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    int bytes = bps / 8;
+    int peak = (1 << (bps - 1)) - 1;
+    float decay = frames > 0 ? expf(logf(0.001f) / frames) : 1.0f; // -60 dB at the end
+
+    QByteArray data;
+    data.reserve(frames * channels * bytes);
+    float gain = 0.9f;
+    for (int i = 0; i < frames; i++) {
+        for (int c = 0; c < channels; c++) {
+            appendLE(data, (quint32)(int)(noise(random) * gain * peak), bytes);
+        }
+        gain *= decay;
+    }
+    return data;
+}
+
+/**
+ * @brief SyntheticData::wavFile wraps pcm() in a RIFF/WAVE file as the drumset maker reads them
+ */
+QByteArray SyntheticData::wavFile(int bps, int channels, int frames, quint32 seed)
+{
+    QByteArray samples = pcm(bps, channels, frames, seed);
+    int blockAlign = channels * bps / 8;
+
+    QByteArray data;
+    data.reserve(44 + samples.size());
+    data.append("RIFF");
+    appendLE(data, 36 + samples.size(), 4);
+    data.append("WAVE");
+    data.append("fmt ");
+    appendLE(data, 16, 4);                  // Chunk size
+    appendLE(data, 1, 2);                   // PCM
+    appendLE(data, channels, 2);
+    appendLE(data, 44100, 4);               // Sampling frequency
+    appendLE(data, 44100 * blockAlign, 4);  // Byte rate
+    appendLE(data, blockAlign, 2);
+    appendLE(data, bps, 2);
+    data.append("data");
+    appendLE(data, samples.size(), 4);
+    data.append(samples);
+    return data;
+}
+
+/**
+ * @brief SyntheticData::midiFile generates a 4/4 groove as a format 0 file, 16 steps per bar:
+ *        kick on the beats, snare on 2 and 4, hi-hat on every step, and the other instruments at random
+ * @param bars
+ * @param instruments notes used from SYNTHETIC_FIRST_NOTE, at least 3
+ *
+ * There is neither a tempo nor an end of track meta event, the parser traces them to stderr.
+ */
+QByteArray SyntheticData::midiFile(int bars, int instruments, quint32 seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> velocity(40, 127);
+    std::uniform_int_distribution<int> instrument(3, qMax(3, instruments - 1));
+    std::bernoulli_distribution extra(0.3);
+
+    QByteArray track;
+    // Time signature 4/4, 24 MIDI clocks per click, 8 32nd notes per quarter
+    const char timeSignature[] = {0x00, (char)0xFF, 0x58, 0x04, 0x04, 0x02, 0x18, 0x08};
+    track.append(timeSignature, sizeof(timeSignature));
+
+    QList<int> notes;
+    quint32 delta = 0;
+    for (int step = 0; step < bars * 16; step++) {
+        notes.clear();
+        if (step % 4 == 0) {
+            notes.append(SYNTHETIC_FIRST_NOTE);
+        }
+        if (step % 8 == 4) {
+            notes.append(SYNTHETIC_FIRST_NOTE + 1);
+        }
+        notes.append(SYNTHETIC_FIRST_NOTE + 2);
+        if (instruments > 3 && extra(random)) {
+            notes.append(SYNTHETIC_FIRST_NOTE + instrument(random));
+        }
+
+        foreach (int note, notes) {
+            appendVariableLength(track, delta);
+            track.append((char)0x99);       // Note on, channel 10
+            track.append((char)note);
+            track.append((char)velocity(random));
+            delta = 0;
+        }
+        delta = SYNTHETIC_NOTE_LENGTH;
+        foreach (int note, notes) {
+            appendVariableLength(track, delta);
+            track.append((char)0x89);       // Note off, channel 10
+            track.append((char)note);
+            track.append((char)0x40);
+            delta = 0;
+        }
+        delta = SYNTHETIC_STEP_TICKS - SYNTHETIC_NOTE_LENGTH;
+    }
+
+    QByteArray data;
+    data.append("MThd");
+    appendBE(data, 6, 4);                   // Header length
+    appendBE(data, 0, 2);                   // Format
+    appendBE(data, 1, 2);                   // Track count
+    appendBE(data, SYNTHETIC_TPQN, 2);
+    data.append("MTrk");
+    appendBE(data, track.size(), 4);
+    data.append(track);
+    return data;
+}
+
+/**
+ * @brief SyntheticData::drumset generates a drumset file as SoundManager_LoadDrumset reads it:
+ *        header, instrument table, then the stereo layers from DRM_WAV_START_OFFSET
+ * @param instruments from note SYNTHETIC_FIRST_NOTE
+ * @param layers per instrument, velocity ranges of the same width
+ * @param bps 16 or 24
+ * @param frames of each layer
+ *
+ * The metadata and extension sections are left out, the player does not read them.
+ */
+QByteArray SyntheticData::drumset(int instruments, int layers, int bps, int frames, quint32 seed)
+{
+    instruments = qBound(1, instruments, DRM_MAX_INSTRUMENT_COUNT - SYNTHETIC_FIRST_NOTE);
+    layers = qBound(1, layers, MIDIPARSER_MAX_NUMBER_VELOCITY);
+
+    QByteArray data(DRM_WAV_START_OFFSET, '\0');
+    DrmHeader_t *header = (DrmHeader_t *)data.data();
+    memcpy(header->header, "BBds", 4);
+    header->version = DRM_VERSION;
+    header->revision = DRM_REVISION;
+
+    quint32 offset = DRM_WAV_START_OFFSET;
+    for (int i = 0; i < instruments; i++) {
+        for (int j = 0; j < layers; j++) {
+            QByteArray layer = pcm(bps, 2, frames, seed + i * MIDIPARSER_MAX_NUMBER_VELOCITY + j);
+            // Pointers into data are taken again, append may move it
+            Instrument_t *inst = (Instrument_t *)(data.data() + DRM_INSTRUMENT_OFFSET) + SYNTHETIC_FIRST_NOTE + i;
+            inst->poly = 1;
+            inst->nVel = layers;
+            inst->volume = 100;
+            inst->dataSize += layer.size();
+            inst->vel[j].bps = bps;
+            inst->vel[j].nChannel = 2;
+            inst->vel[j].fs = 44100;
+            inst->vel[j].vel = j * 128 / layers;
+            inst->vel[j].nSample = layer.size() / (bps / 8);
+#if !(defined(__x86_64__) || defined(_M_X64))
+            inst->vel[j].addr = offset; // Made an address by the sound manager
+#else
+            inst->vel[j].offset = offset;
+#endif
+            data.append(layer);
+            offset += layer.size();
+        }
+    }
+    return data;
+}
+
+/**
+ * @brief SyntheticData::songFile generates a song as the editor saves it: intro, parts with
+ *        a main loop, two drum fills and a transition fill each, and outro
+ * @param dirPath where the MIDI files of the tracks and the song file are written
+ * @param parts
+ * @param bars of the main loops, the fills are 1 bar long
+ * @return the song file, empty on error
+ */
+QByteArray SyntheticData::songFile(const QString &dirPath, int parts, int bars, quint32 seed)
+{
+    QDir dir(dirPath);
+    SongFileModel song;
+    SongModel *songModel = song.getSongModel();
+    SongTracksModel *tracks = song.getSongTracksModel();
+    QStringList parseErrors;
+    int trackCount = 0;
+
+    // Each track is a MIDI file of its own, as imported in the editor
+    auto createTrack = [&](int trackBars, int trackType) -> SongTrack * {
+        QString path = dir.absoluteFilePath(QString("track%1.mid").arg(trackCount));
+        if (!writeFile(path, midiFile(trackBars, 8, seed + trackCount++))) {
+            return nullptr;
+        }
+        return tracks->createTrack(path, trackType, &parseErrors);
+    };
+
+    songModel->setBpm(SYNTHETIC_SONG_BPM);
+    for (int i = 0; i < qBound(1, parts, MAX_SONG_PARTS); i++) {
+        songModel->appendNewPart();
+    }
+
+    SongTrack *track = createTrack(1, INTRO_FILL);
+    if (track) {
+        songModel->intro()->setMainLoop(track, 0);
+    }
+    track = createTrack(1, OUTRO_FILL);
+    if (track) {
+        songModel->outro()->setMainLoop(track, 0);
+    }
+    for (int i = 0; i < songModel->partCount(); i++) {
+        SongPartModel *part = songModel->part(i);
+        if ((track = createTrack(bars, MAIN_DRUM_LOOP))) {
+            part->setMainLoop(track, 0);
+        }
+        for (int j = 0; j < 2; j++) {
+            if ((track = createTrack(1, DRUM_FILL))) {
+                part->appendDrumFill(track, j);
+            }
+        }
+        if ((track = createTrack(1, TRANS_FILL))) {
+            part->setTransFill(track, 0);
+        }
+    }
+
+    if (!parseErrors.isEmpty()) {
+        qWarning() << "SyntheticData::songFile - Failed to create tracks:" << parseErrors;
+        return QByteArray();
+    }
+
+    QFile file(dir.absoluteFilePath("song." BMFILES_MIDI_BASED_SONG_EXTENSION));
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+        qWarning() << "SyntheticData::songFile - Failed to write file at:" << file.fileName();
+        return QByteArray();
+    }
+    song.writeToFile(file);
+    file.seek(0);
+    QByteArray data = file.readAll();
+    file.close();
+    return data;
+}
+
+bool SyntheticData::writeFile(const QString &path, const QByteArray &data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(data) != data.size()) {
+        qWarning() << "SyntheticData::writeFile - Failed to write file at:" << path;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef SYNTHETICDATA_H
+#define SYNTHETICDATA_H
+
+#include <QByteArray>
+#include <QString>
+
+// First MIDI note of the generated drumsets and grooves (kick)
+#define SYNTHETIC_FIRST_NOTE        (36)
+// Units: ticks, resolution of the generated MIDI files, same as the parser
+#define SYNTHETIC_TPQN              (480)
+
+/**
+ * @brief Generates the data the benchmarks run on, so that they do not depend on user content.
+ *
+ * All the data is pseudo random from a seed: a given seed always gives the same bytes,
+ * results of two runs are comparable.
+ */
+class SyntheticData
+{
+public:
+   static QByteArray pcm(int bps, int channels, int frames, quint32 seed);
+   static QByteArray wavFile(int bps, int channels, int frames, quint32 seed);
+   static QByteArray midiFile(int bars, int instruments, quint32 seed);
+   static QByteArray drumset(int instruments, int layers, int bps, int frames, quint32 seed);
+   static QByteArray songFile(const QString &dirPath, int parts, int bars, quint32 seed);
+
+   static bool writeFile(const QString &path, const QByteArray &data);
+};
+
+#endif // SYNTHETICDATA_H